@@ -13,9 +13,13 @@
 #include "ofc_hdrs.h"
 
 tOfcCpGlobals gOfcCpGlobals;
-extern unsigned int gCntrlIpAddr;
+extern unsigned int gaCntrlIpAddr[OFC_MAX_CNTRL];
+extern int  gNumCntrl;
+extern unsigned int gNumAuxConn;
+extern unsigned int gPktInQLen;
 extern char *gpOpenFlowIf[OFC_MAX_OF_IF_NUM];
 extern int  gNumOpenFlowIf;
+extern tOfcDpGlobals gOfcDpGlobals;
 
 /******************************************************************                                                                          
 * Function: OfcCpMainInit
@@ -32,20 +36,30 @@ extern int  gNumOpenFlowIf;
 *******************************************************************/
 int OfcCpMainInit (void)
 {
-    memset (&gOfcCpGlobals, 0, sizeof (gOfcCpGlobals));
+    tOfcCntrlConn *pConn = NULL;
+    int           cntrlIndex = 0;
+    int           auxId = 0;
 
-    /* Initialize semaphore */
-    sema_init (&gOfcCpGlobals.semId, 1);
-    sema_init (&gOfcCpGlobals.dpMsgQSemId, 1);
+    memset (&gOfcCpGlobals, 0, sizeof (gOfcCpGlobals));
 
     /* Initialize queues */
-    INIT_LIST_HEAD (&gOfcCpGlobals.dpMsgListHead);
+    OfcQueueInit (&gOfcCpGlobals.dpMsgQ, gPktInQLen);
+    INIT_LIST_HEAD (&gOfcCpGlobals.barrierList);
 
-    /* Create TCP socket to interact with controller */ 
-    if (OfcCpCreateCntrlSocket() != OFC_SUCCESS)
+    /* Connections to controllers are established by control path
+     * task loop, first attempt is made immediately */
+    for (cntrlIndex = 0; cntrlIndex < gNumCntrl; cntrlIndex++)
     {
-        printk (KERN_CRIT "Control socket creation failed!!\r\n");
-        return OFC_FAILURE;
+        gOfcCpGlobals.aCntrl[cntrlIndex].role = OFPCR_ROLE_EQUAL;
+        for (auxId = 0; auxId <= gNumAuxConn; auxId++)
+        {
+            pConn = &gOfcCpGlobals.aCntrl[cntrlIndex].aConn[auxId];
+            pConn->cntrlIndex = cntrlIndex;
+            pConn->auxId = auxId;
+            pConn->state = OFC_CNTRL_DISCONNECTED;
+            pConn->connectTime = jiffies;
+            pConn->backoffMs = OFC_CNTRL_BACKOFF_MIN_MS;
+        }
     }
 
     gOfcCpGlobals.isModInit = OFC_TRUE;
@@ -67,7 +81,8 @@ int OfcCpMainInit (void)
 *******************************************************************/
 int OfcCpMainTask (void *args)
 {
-    int event = 0;
+    long timeout = 0;
+    int  event = 0;
 
     /* Initialize memory and structures */
     if (OfcCpMainInit() != OFC_SUCCESS)
@@ -78,21 +93,32 @@ int OfcCpMainTask (void *args)
         return OFC_FAILURE;
     }
 
-    while (1)
+    while (!kthread_should_stop())
     {
-        if (OfcCpReceiveEvent (OFC_CTRL_PKT_EVENT | OFC_DP_TO_CP_EVENT,
-            &event) == OFC_SUCCESS)
+        /* Reconnect and echo timers, returns time to next expiry */
+        timeout = OfcCpCntrlConnTimer();
+
+        if (OfcCpReceiveEvent (OFC_CTRL_PKT_EVENT | OFC_DP_TO_CP_EVENT |
+                               OFC_CNTRL_STATE_EVENT | OFC_DP_COMMIT_EVENT,
+                               timeout, &event) == OFC_SUCCESS)
         {
-            if (event & OFC_CTRL_PKT_EVENT)
+            if (event & OFC_DP_COMMIT_EVENT)
             {
-                /* Receive packet from controller */
-                OfcCpRxControlPacket();
+                /* Reply to barriers acknowledged by data path */
+                OfcCpRxDataPathCommit();
+            }
+
+            if (event & (OFC_CNTRL_STATE_EVENT | OFC_CTRL_PKT_EVENT))
+            {
+                /* Controller connections established or lost and
+                 * packets received from controllers */
+                OfcCpRxCntrlConns();
             }
 
             if (event & OFC_DP_TO_CP_EVENT)
             {
                 /* Process information sent by data path task */
-                OfcCpRxDataPathMsg();
+                OfcCpRxDataPathMsg (OFC_FALSE);
             }
         }
     }
@@ -100,47 +126,452 @@ int OfcCpMainTask (void *args)
     return OFC_SUCCESS;
 }
 
+/******************************************************************                                                                          
+* Function: OfcCpCntrlConnTimer
+*
+* Description: This function runs timers of all controller
+*              connections. Auxiliary connections are started only
+*              once main connection of controller is up.
+*
+* Input: None
+*
+* Output: None
+*
+* Returns: Jiffies until next timer expiry
+*
+*******************************************************************/
+long OfcCpCntrlConnTimer (void)
+{
+    tOfcCntrl     *pCntrl = NULL;
+    unsigned long expiry = 0;
+    unsigned long nextExpiry = 0;
+    int           isExpirySet = OFC_FALSE;
+    int           cntrlIndex = 0;
+    int           auxId = 0;
+
+    for (cntrlIndex = 0; cntrlIndex < gNumCntrl; cntrlIndex++)
+    {
+        pCntrl = &gOfcCpGlobals.aCntrl[cntrlIndex];
+        for (auxId = 0; auxId <= gNumAuxConn; auxId++)
+        {
+            if ((auxId != OFC_CTRL_MAIN_CONNECTION) &&
+                (pCntrl->aConn[OFC_CTRL_MAIN_CONNECTION].state !=
+                 OFC_CNTRL_CONNECTED))
+            {
+                break;
+            }
+
+            expiry = OfcCpConnTimer (&pCntrl->aConn[auxId]);
+            if ((isExpirySet == OFC_FALSE) || 
+                (time_before (expiry, nextExpiry)))
+            {
+                nextExpiry = expiry;
+                isExpirySet = OFC_TRUE;
+            }
+        }
+    }
+
+    if (isExpirySet == OFC_FALSE)
+    {
+        return MAX_SCHEDULE_TIMEOUT;
+    }
+
+    return time_after (nextExpiry, jiffies) ? 
+           (long) (nextExpiry - jiffies) : 1;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpConnTimer
+*
+* Description: This function runs timers of a controller
+*              connection. It starts reconnect once backoff delay
+*              expires, aborts TCP handshake that takes too long,
+*              and sends echo request when connection is idle.
+*
+* Input: pConn - Controller connection
+*
+* Output: None
+*
+* Returns: Jiffies of next timer expiry
+*
+*******************************************************************/
+unsigned long OfcCpConnTimer (tOfcCntrlConn *pConn)
+{
+    unsigned long expiry = 0;
+    unsigned long echoInterval = msecs_to_jiffies (OFC_ECHO_INTERVAL_MS);
+
+    switch (pConn->state)
+    {
+        case OFC_CNTRL_DISCONNECTED:
+            if (time_before (jiffies, pConn->connectTime))
+            {
+                expiry = pConn->connectTime;
+                break;
+            }
+
+            pConn->connectTime = jiffies;
+            if (OfcCpCreateCntrlSocket (pConn) != OFC_SUCCESS)
+            {
+                OfcCpCntrlDisconnect (pConn);
+                expiry = pConn->connectTime;
+                break;
+            }
+
+            /* Socket state change event completes connection */
+            pConn->state = OFC_CNTRL_CONNECTING;
+            expiry = pConn->connectTime + 
+                     msecs_to_jiffies (OFC_CNTRL_CONNECT_TMO_MS);
+            break;
+
+        case OFC_CNTRL_CONNECTING:
+            expiry = pConn->connectTime + 
+                     msecs_to_jiffies (OFC_CNTRL_CONNECT_TMO_MS);
+            if (time_after_eq (jiffies, expiry))
+            {
+                printk (KERN_CRIT "Connection to controller %d timed "
+                                  "out\r\n", pConn->cntrlIndex);
+                OfcCpCntrlDisconnect (pConn);
+                expiry = pConn->connectTime;
+            }
+            break;
+
+        case OFC_CNTRL_CONNECTED:
+            if (pConn->echoMissCount >= OFC_ECHO_MAX_MISS)
+            {
+                printk (KERN_CRIT "Controller %d not responding to echo "
+                                  "requests\r\n", pConn->cntrlIndex);
+                OfcCpCntrlDisconnect (pConn);
+                expiry = pConn->connectTime;
+                break;
+            }
+
+            /* Echo request is sent only after connection is idle
+             * for echo interval */
+            expiry = time_after (pConn->lastRxTime, pConn->lastEchoTime) ?
+                     pConn->lastRxTime : pConn->lastEchoTime;
+            expiry += echoInterval;
+            if (time_after_eq (jiffies, expiry))
+            {
+                OfcCpSendEchoRequest (pConn);
+                pConn->lastEchoTime = jiffies;
+                pConn->echoMissCount++;
+                expiry = pConn->lastEchoTime + echoInterval;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return expiry;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpRxCntrlConns
+*
+* Description: This function processes work posted by socket
+*              callbacks of controller connections
+*
+* Input: None
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcCpRxCntrlConns (void)
+{
+    tOfcCntrlConn *pConn = NULL;
+    int           cntrlIndex = 0;
+    int           auxId = 0;
+
+    for (cntrlIndex = 0; cntrlIndex < gNumCntrl; cntrlIndex++)
+    {
+        for (auxId = 0; auxId <= gNumAuxConn; auxId++)
+        {
+            pConn = &gOfcCpGlobals.aCntrl[cntrlIndex].aConn[auxId];
+
+            if (test_and_clear_bit (OFC_CONN_STATE_PENDING, 
+                                    &pConn->flags))
+            {
+                /* Connection established or lost */
+                OfcCpCntrlStateChange (pConn);
+            }
+
+            if (OfcQueueIsThrottled (&gOfcDpGlobals.cpMsgQ) == OFC_TRUE)
+            {
+                /* Data path is behind, leave packets in socket so
+                 * that TCP flow control pushes back on controller.
+                 * Data path posts OFC_CTRL_PKT_EVENT once queue
+                 * drains */
+                continue;
+            }
+
+            if ((test_and_clear_bit (OFC_CONN_RX_PENDING, 
+                                     &pConn->flags)) &&
+                (pConn->state == OFC_CNTRL_CONNECTED))
+            {
+                /* Receive packet from controller */
+                OfcCpRxControlPacket (pConn);
+            }
+        }
+    }
+
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpCntrlStateChange
+*
+* Description: This function processes state change of controller
+*              socket. It completes connection once TCP handshake
+*              is done, and schedules reconnect if connection is
+*              refused, reset or closed by controller.
+*
+* Input: pConn - Controller connection
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcCpCntrlStateChange (tOfcCntrlConn *pConn)
+{
+    int sockState = 0;
+
+    if (pConn->pSocket == NULL)
+    {
+        /* Event from socket that is already closed */
+        return;
+    }
+
+    sockState = ACCESS_ONCE (pConn->pSocket->sk->sk_state);
+    if (sockState == TCP_ESTABLISHED)
+    {
+        if (pConn->state == OFC_CNTRL_CONNECTING)
+        {
+            printk (KERN_INFO "Connected to controller %d (auxId:%d, "
+                              "reconnects:%u)\r\n", pConn->cntrlIndex,
+                              pConn->auxId, pConn->reconnectCount);
+            pConn->lastRxTime = jiffies;
+            pConn->lastEchoTime = jiffies;
+            pConn->echoMissCount = 0;
+            pConn->backoffMs = OFC_CNTRL_BACKOFF_MIN_MS;
+            pConn->state = OFC_CNTRL_CONNECTED;
+            OfcCpSetDefaultAsync (pConn);
+
+            if (pConn->auxId == OFC_CTRL_MAIN_CONNECTION)
+            {
+                /* Controller starts in equal role */
+                gOfcCpGlobals.aCntrl[pConn->cntrlIndex].role = 
+                    OFPCR_ROLE_EQUAL;
+                ACCESS_ONCE (gOfcCpGlobals.numCntrlUp) = 
+                    gOfcCpGlobals.numCntrlUp + 1;
+            }
+            OfcCpUpdatePktInReasons();
+        }
+        return;
+    }
+
+    if (sockState == TCP_SYN_SENT)
+    {
+        /* Handshake in progress */
+        return;
+    }
+
+    if (pConn->state == OFC_CNTRL_CONNECTED)
+    {
+        printk (KERN_CRIT "Connection to controller %d lost (auxId:%d)"
+                          "\r\n", pConn->cntrlIndex, pConn->auxId);
+    }
+    else
+    {
+        printk (KERN_CRIT "Failed to connect to controller %d "
+                          "(auxId:%d)\r\n", pConn->cntrlIndex, 
+                          pConn->auxId);
+    }
+    OfcCpCntrlDisconnect (pConn);
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpCntrlDisconnect
+*
+* Description: This function closes controller connection and
+*              schedules reconnect. Reconnect delay doubles on each
+*              failed attempt. Installed flows are retained, so
+*              data path keeps forwarding while controller is
+*              unreachable and no resync is needed on reconnect.
+*              Auxiliary connections are closed along with main
+*              connection.
+*
+* Input: pConn - Controller connection
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcCpCntrlDisconnect (tOfcCntrlConn *pConn)
+{
+    tOfcCntrlConn *pAuxConn = NULL;
+    int           auxId = 0;
+
+    if ((pConn->auxId == OFC_CTRL_MAIN_CONNECTION) &&
+        (pConn->state == OFC_CNTRL_CONNECTED))
+    {
+        ACCESS_ONCE (gOfcCpGlobals.numCntrlUp) = 
+            gOfcCpGlobals.numCntrlUp - 1;
+    }
+
+    OfcCpDeleteCntrlSocket (pConn);
+    OfcCpDeleteBarriers (pConn);
+    pConn->state = OFC_CNTRL_DISCONNECTED;
+
+    pConn->connectTime = jiffies + msecs_to_jiffies (pConn->backoffMs);
+    printk (KERN_INFO "Reconnecting to controller %d in %u ms "
+                      "(auxId:%d)\r\n", pConn->cntrlIndex, 
+                      pConn->backoffMs, pConn->auxId);
+
+    pConn->backoffMs *= 2;
+    if (pConn->backoffMs > OFC_CNTRL_BACKOFF_MAX_MS)
+    {
+        pConn->backoffMs = OFC_CNTRL_BACKOFF_MAX_MS;
+    }
+    pConn->reconnectCount++;
+
+    if (pConn->auxId != OFC_CTRL_MAIN_CONNECTION)
+    {
+        OfcCpUpdatePktInReasons();
+        return;
+    }
+
+    /* Auxiliary connections reconnect as soon as main connection
+     * is up again */
+    for (auxId = 1; auxId <= gNumAuxConn; auxId++)
+    {
+        pAuxConn = &gOfcCpGlobals.aCntrl[pConn->cntrlIndex].aConn[auxId];
+        OfcCpDeleteCntrlSocket (pAuxConn);
+        OfcCpDeleteBarriers (pAuxConn);
+        pAuxConn->state = OFC_CNTRL_DISCONNECTED;
+        pAuxConn->connectTime = jiffies;
+        pAuxConn->backoffMs = OFC_CNTRL_BACKOFF_MIN_MS;
+    }
+    OfcCpUpdatePktInReasons();
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpGetPktInConn
+*
+* Description: This function selects connection to controller on
+*              which packet-in is sent. Packet-ins are spread over
+*              main and auxiliary connections by flow, so packets
+*              of a flow stay in order. No connection is selected
+*              if controller is down. Slave role is applied by
+*              asynchronous message masks of connection.
+*
+* Input: cntrlIndex - Controller index
+*        flowHash - Hash of packet header fields
+*
+* Output: None
+*
+* Returns: Pointer to connection, NULL if none
+*
+*******************************************************************/
+tOfcCntrlConn *OfcCpGetPktInConn (int cntrlIndex, __u32 flowHash)
+{
+    tOfcCntrl     *pCntrl = &gOfcCpGlobals.aCntrl[cntrlIndex];
+    tOfcCntrlConn *pConn = NULL;
+
+    if (pCntrl->aConn[OFC_CTRL_MAIN_CONNECTION].state != 
+        OFC_CNTRL_CONNECTED)
+    {
+        return NULL;
+    }
+
+    pConn = &pCntrl->aConn[flowHash % (gNumAuxConn + 1)];
+    if (pConn->state != OFC_CNTRL_CONNECTED)
+    {
+        pConn = &pCntrl->aConn[OFC_CTRL_MAIN_CONNECTION];
+    }
+
+    return pConn;
+}
+
 /******************************************************************                                                                          
 * Function: OfcCpRxControlPacket
 *
 * Description: This function receives OpenFlow control packets
-*              from SDN controller and processes these packets
+*              from SDN controller and processes these packets.
+*              Only complete messages are processed, a message
+*              split across reads stays in receive buffer of
+*              connection until rest of it arrives
 *
-* Input: None
+* Input: pConn - Controller connection
 *
 * Output: None
 *
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcCpRxControlPacket (void)
+int OfcCpRxControlPacket (tOfcCntrlConn *pConn)
 {
     tOfcOfHdr  *pOfHdr = NULL;
     __u8       *pCntrlPkt = NULL;
-    __u8       *pPkt = NULL;
-    __u16      pktLen = 0;
+    __u32      pktLen = 0;
     __u16      cntrlPktLen = 0;
-    __u16      bytesProcessed = 0;
+    __u32      bytesProcessed = 0;
     int        retVal = OFC_SUCCESS;
 
-    if (OfcCpRecvCntrlPktOnSock (&pPkt, &pktLen) 
-        != OFC_SUCCESS)
+    if (OfcCpRecvCntrlPktOnSock (pConn) != OFC_SUCCESS)
     {
-        printk (KERN_CRIT "Failed to read control packet from"
-                          " socket\r\n");
         return OFC_FAILURE;
     }
+    pktLen = pConn->rxLen;
+
+    /* Control packets received on socket may not be read at once */
+    if (!skb_queue_empty (&pConn->pSocket->sk->sk_receive_queue))
+    {
+        set_bit (OFC_CONN_RX_PENDING, &pConn->flags);
+        OfcCpSendEvent (OFC_CTRL_PKT_EVENT);
+    }
 
     printk (KERN_INFO "Control packet received (pktLen:%d)\r\n", pktLen);
 
-    /* On each read call, socket returns all the control messages
-     * present in the socket queue. Therefore, the packets need
-     * need to be separated and processed sequentially */
-    pCntrlPkt = pPkt;
-    while (bytesProcessed < pktLen)
+    /* Any message from controller proves connection is alive */
+    pConn->lastRxTime = jiffies;
+    pConn->echoMissCount = 0;
+
+    /* Replies are sent on connection request was received on */
+    gOfcCpGlobals.pRxConn = pConn;
+
+    /* On each read call, socket returns the control messages
+     * present in the socket queue, the last of which may be
+     * incomplete. Therefore, the packets need to be separated
+     * and processed sequentially */
+    pCntrlPkt = pConn->pRxBuf;
+    while ((pktLen - bytesProcessed) >= OFC_OPENFLOW_HDR_LEN)
     {
         pOfHdr = (tOfcOfHdr *) ((void *) pCntrlPkt);
         cntrlPktLen = ntohs (pOfHdr->length);
+        if (cntrlPktLen < OFC_OPENFLOW_HDR_LEN)
+        {
+            /* Message boundaries are lost, stream cannot be
+             * parsed any further */
+            printk (KERN_CRIT "Invalid control packet length %d from "
+                              "controller %d (auxId:%d)\r\n", 
+                              cntrlPktLen, pConn->cntrlIndex,
+                              pConn->auxId);
+            gOfcCpGlobals.pRxConn = NULL;
+            OfcCpCntrlDisconnect (pConn);
+            return OFC_FAILURE;
+        }
+        if (cntrlPktLen > (pktLen - bytesProcessed))
+        {
+            /* Rest of message not yet received */
+            break;
+        }
         printk (KERN_INFO "Processing control packet (bytesProcessed:%d,"
                 " cntrlPktLen:%d)\r\n", bytesProcessed, cntrlPktLen);
 
@@ -171,6 +602,23 @@ int OfcCpRxControlPacket (void)
             continue;
         }
 
+        /* Controller in slave role cannot modify switch state */
+        if ((gOfcCpGlobals.aCntrl[pConn->cntrlIndex].role == 
+             OFPCR_ROLE_SLAVE) &&
+            ((pOfHdr->type == OFPT_PACKET_OUT) ||
+             (pOfHdr->type == OFPT_FLOW_MOD) ||
+             (pOfHdr->type == OFPT_GROUP_MOD) ||
+             (pOfHdr->type == OFPT_METER_MOD) ||
+             (pOfHdr->type == OFPT_PORT_MOD) ||
+             (pOfHdr->type == OFPT_TABLE_MOD)))
+        {
+            OfcCpSendErrorMsg (pCntrlPkt, OFPET_BAD_REQUEST, 
+                               OFPBRC_IS_SLAVE);
+            bytesProcessed += cntrlPktLen;
+            pCntrlPkt += cntrlPktLen;
+            continue;
+        }
+
         switch (pOfHdr->type)
         {
             case OFPT_HELLO:
@@ -202,7 +650,16 @@ int OfcCpRxControlPacket (void)
                 OfcCpProcessFlowMod (pCntrlPkt, cntrlPktLen);
                 break;
 
+            case OFPT_GROUP_MOD:
+                OfcCpProcessGroupMod (pCntrlPkt, cntrlPktLen);
+                break;
+
+            case OFPT_METER_MOD:
+                OfcCpProcessMeterMod (pCntrlPkt, cntrlPktLen);
+                break;
+
             case OFPT_PORT_MOD:
+                OfcCpProcessPortMod (pCntrlPkt, cntrlPktLen);
                 break;
 
             case OFPT_TABLE_MOD:
@@ -213,7 +670,19 @@ int OfcCpRxControlPacket (void)
                 break;
 
             case OFPT_BARRIER_REQUEST:
-                OfcCpSendBarrierReply (pOfHdr->xid);
+                OfcCpProcessBarrierReq (pOfHdr->xid);
+                break;
+
+            case OFPT_ROLE_REQUEST:
+                OfcCpProcessRoleRequest (pCntrlPkt, cntrlPktLen);
+                break;
+
+            case OFPT_SET_ASYNC:
+                OfcCpProcessSetAsync (pCntrlPkt, cntrlPktLen);
+                break;
+
+            case OFPT_GET_ASYNC_CONFIG_REQUEST:
+                OfcCpProcessGetAsyncReq (pCntrlPkt, cntrlPktLen);
                 break;
 
             default:
@@ -225,9 +694,14 @@ int OfcCpRxControlPacket (void)
         pCntrlPkt += cntrlPktLen;
     }
 
-    /* Release processed control packet */
-    kfree (pPkt);
-    pPkt = NULL;
+    gOfcCpGlobals.pRxConn = NULL;
+
+    /* Keep incomplete message at start of buffer for next read */
+    pConn->rxLen = pktLen - bytesProcessed;
+    if ((pConn->rxLen != 0) && (bytesProcessed != 0))
+    {
+        memmove (pConn->pRxBuf, pCntrlPkt, pConn->rxLen);
+    }
 
     return retVal;
 }
@@ -236,30 +710,62 @@ int OfcCpRxControlPacket (void)
 * Function: OfcCpRxDataPathMsg
 *
 * Description: This function dequeues messages sent by data path
-*              task and forwards them to the controller.
+*              task and forwards them to the controller. Unless
+*              queue is drained, at most OFC_PKT_IN_TX_BUDGET
+*              messages are sent at a time so that controller
+*              packets and echo timers are served in between.
 *
-* Input: None
+* Input: isDrain - OFC_TRUE to send all queued messages
 *
 * Output: None
 *
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-void OfcCpRxDataPathMsg (void)
+void OfcCpRxDataPathMsg (int isDrain)
 {
-    tDpCpMsgQ *pMsgQ = NULL;
-    __u8      *pOpenFlowPkt = NULL;
-    __u16     pktLen = 0;
+    tDpCpMsgQ     *pMsgQ = NULL;
+    tOfcCntrlConn *pConn = NULL;
+    __u8          *pOpenFlowPkt = NULL;
+    __u16         pktLen = 0;
+    int           cntrlIndex = 0;
+    int           budget = OFC_PKT_IN_TX_BUDGET;
+
+    while ((isDrain == OFC_TRUE) || (budget > 0))
+    {
+        if ((pMsgQ = OfcCpRecvFromDpMsgQ()) == NULL)
+        {
+            return;
+        }
+        budget--;
 
-    down_interruptible (&gOfcCpGlobals.dpMsgQSemId);
+        if (pMsgQ->pStatsReq != NULL)
+        {
+            /* Reply segment of flow or aggregate stats */
+            OfcCpSendStatsReply (pMsgQ);
+            kfree (pMsgQ);
+            pMsgQ = NULL;
+            continue;
+        }
+
+        if (gOfcCpGlobals.numCntrlUp == 0)
+        {
+            /* Packets queued before connection was lost */
+            if (pMsgQ->pPkt != NULL)
+            {
+                kfree (pMsgQ->pPkt);
+                pMsgQ->pPkt = NULL;
+            }
+            kfree (pMsgQ);
+            pMsgQ = NULL;
+            continue;
+        }
 
-    while ((pMsgQ = OfcCpRecvFromDpMsgQ()) != NULL)
-    {
         /* Send packet as packet-in to controller */
         OfcCpConstructPacketIn (pMsgQ->pPkt, pMsgQ->pktLen, 
                                 pMsgQ->inPort, pMsgQ->msgType,
                                 pMsgQ->tableId, pMsgQ->cookie,
-                                pMsgQ->pFlowEntry->matchFields,
+                                pMsgQ->matchFields,
                                 &pOpenFlowPkt);
         if (pOpenFlowPkt == NULL)
         {
@@ -275,10 +781,30 @@ void OfcCpRxDataPathMsg (void)
             continue;
         }
 
+        /* Packet-in is sent to every controller in master or
+         * equal role */
         pktLen = ntohs (((tOfcOfHdr *) pOpenFlowPkt)->length);
-        OfcCpSendCntrlPktFromSock (pOpenFlowPkt, pktLen);
+        for (cntrlIndex = 0; cntrlIndex < gNumCntrl; cntrlIndex++)
+        {
+            pConn = OfcCpGetPktInConn (cntrlIndex, pMsgQ->flowHash);
+            if ((pConn == NULL) ||
+                (OfcCpIsAsyncEnabled (pConn, OFPT_PACKET_IN, 
+                                      pMsgQ->msgType) != OFC_TRUE))
+            {
+                continue;
+            }
+
+            /* Packet-in is not sent if it would leave no room in
+             * send buffer for replies and echo messages */
+            if (sk_stream_wspace (pConn->pSocket->sk) < 
+                (int) (pktLen + OFC_CNTRL_TX_RESERVE))
+            {
+                pConn->pktInDropCount++;
+                continue;
+            }
 
-        printk (KERN_INFO "Sent Packet-In to controller\r\n");
+            OfcCpSendCntrlPktOnConn (pConn, pOpenFlowPkt, pktLen);
+        }
 
         /* Release message */
         kfree (pOpenFlowPkt);
@@ -292,7 +818,8 @@ void OfcCpRxDataPathMsg (void)
         pMsgQ = NULL;
     }
 
-    up (&gOfcCpGlobals.dpMsgQSemId);
+    /* Messages left in queue are sent after controllers are served */
+    OfcCpSendEvent (OFC_DP_TO_CP_EVENT);
 
     return;
 }
@@ -444,29 +971,72 @@ int OfcCpSendEchoReply (__u8 *pCntrlPkt, __u16 cntrlPktLen)
 }
 
 /******************************************************************                                                                          
-* Function: OfcCpSendFeatureReply
+* Function: OfcCpSendEchoRequest
 *
-* Description: This function is invoked to reply to FEATURE_REQUEST
-*              message from the controller.
+* Description: This function sends echo request message to the
+*              controller to check liveness of idle connection
 *
-* Input: pCntrlPkt - The packet received from the controller.
+* Input: pConn - Controller connection
 *
 * Output: None
 *
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcCpSendFeatureReply (__u8 *pCntrlPkt)
+int OfcCpSendEchoRequest (tOfcCntrlConn *pConn)
 {
-    tOfcFeatReply     *pResponseMsg = NULL;
-    struct net_device *dev = NULL;
-    __u8              *pOpenFlowPkt = NULL;
-    __u16             featReplyLen = 0;
-
-    printk (KERN_INFO "Feature Request Rx\r\n");
+    __u8   *pEchoReq = NULL;
+    __u32  xid = 0;
 
-    pResponseMsg = (tOfcFeatReply *) kmalloc (sizeof(tOfcFeatReply),
-                                              GFP_KERNEL);
+    xid = htonl (++gOfcCpGlobals.echoXid);
+    if (OfcCpAddOpenFlowHdr (NULL, 0, OFPT_ECHO_REQUEST, xid, 
+                             &pEchoReq)
+        != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Failed to construct Echo Request\r\n");
+        return OFC_FAILURE;
+    }
+
+    if (OfcCpSendCntrlPktOnConn (pConn, pEchoReq, OFC_OPENFLOW_HDR_LEN)
+        != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Failed to send Echo Request\r\n");
+        kfree (pEchoReq);
+        pEchoReq = NULL;
+        return OFC_FAILURE;
+    }
+
+    printk (KERN_INFO "Echo Request Tx\r\n");
+
+    kfree (pEchoReq);
+    pEchoReq = NULL;
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpSendFeatureReply
+*
+* Description: This function is invoked to reply to FEATURE_REQUEST
+*              message from the controller.
+*
+* Input: pCntrlPkt - The packet received from the controller.
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpSendFeatureReply (__u8 *pCntrlPkt)
+{
+    tOfcFeatReply     *pResponseMsg = NULL;
+    struct net_device *dev = NULL;
+    __u8              *pOpenFlowPkt = NULL;
+    __u16             featReplyLen = 0;
+
+    printk (KERN_INFO "Feature Request Rx\r\n");
+
+    pResponseMsg = (tOfcFeatReply *) kmalloc (sizeof(tOfcFeatReply),
+                                              GFP_KERNEL);
     if (!pResponseMsg)
     {
         printk (KERN_CRIT "Failed to allocate memory to Feature "
@@ -474,7 +1044,8 @@ int OfcCpSendFeatureReply (__u8 *pCntrlPkt)
         return OFC_FAILURE;
     }
 
-    dev = OfcGetNetDevByIp (gCntrlIpAddr);
+    /* Datapath id is same on all controller connections */
+    dev = OfcGetNetDevByIp (gaCntrlIpAddr[0]);
     if (!dev)
     {
         printk (KERN_CRIT "Failed to retrieve interface for "
@@ -489,7 +1060,7 @@ int OfcCpSendFeatureReply (__u8 *pCntrlPkt)
             OFC_MAC_ADDR_LEN);
     pResponseMsg->maxBuffers = htonl (OFC_MAX_PKT_BUFFER);
     pResponseMsg->maxTables  = OFC_MAX_FLOW_TABLES;
-    pResponseMsg->auxilaryId = OFC_CTRL_MAIN_CONNECTION;
+    pResponseMsg->auxilaryId = gOfcCpGlobals.pRxConn->auxId;
     pResponseMsg->capabilities = 
         htonl (OFPC_FLOW_STATS | OFPC_TABLE_STATS);
 
@@ -570,8 +1141,6 @@ int OfcCpConstructPacketIn (__u8 *pPkt, __u32 pktLen, __u8 inPort,
         return OFC_FAILURE;
     }
 
-    printk (KERN_INFO "Constructing Packet-In\r\n");
-
     /* Construct match field TLV  */
     pMatchTlv = (tOfcMatchTlv *) kmalloc (OFC_MTU_SIZE, GFP_KERNEL);
     if (pMatchTlv == NULL)
@@ -727,6 +1296,41 @@ int OfcCpConstructPacketIn (__u8 *pPkt, __u32 pktLen, __u8 inPort,
                   (((__u8 *) pOxmTlv) + oxmTlvLen + pOxmTlv->length);
     }
 
+    if (matchFields.mplsMatchFlags & OFC_MPLS_LABEL_MATCH)
+    {
+        pOxmTlv->Class = htons (OFPXMC_OPENFLOW_BASIC);
+        pOxmTlv->field = OFCXMT_OFB_MPLS_LABEL << 1;
+        pOxmTlv->length = sizeof (matchFields.mplsLabel);
+        fourByteField = htonl (matchFields.mplsLabel);
+        memcpy (pOxmTlv->aValue, &fourByteField,
+                sizeof (matchFields.mplsLabel));
+        matchTlvLen += oxmTlvLen + pOxmTlv->length;
+        pOxmTlv = (tOfcMatchOxmTlv *) (void *) 
+                  (((__u8 *) pOxmTlv) + oxmTlvLen + pOxmTlv->length);
+    }
+
+    if (matchFields.mplsMatchFlags & OFC_MPLS_TC_MATCH)
+    {
+        pOxmTlv->Class = htons (OFPXMC_OPENFLOW_BASIC);
+        pOxmTlv->field = OFCXMT_OFB_MPLS_TC << 1;
+        pOxmTlv->length = sizeof (matchFields.mplsTc);
+        pOxmTlv->aValue[0] = matchFields.mplsTc;
+        matchTlvLen += oxmTlvLen + pOxmTlv->length;
+        pOxmTlv = (tOfcMatchOxmTlv *) (void *) 
+                  (((__u8 *) pOxmTlv) + oxmTlvLen + pOxmTlv->length);
+    }
+
+    if (matchFields.mplsMatchFlags & OFC_MPLS_BOS_MATCH)
+    {
+        pOxmTlv->Class = htons (OFPXMC_OPENFLOW_BASIC);
+        pOxmTlv->field = OFCXMT_OFB_MPLS_BOS << 1;
+        pOxmTlv->length = sizeof (matchFields.mplsBos);
+        pOxmTlv->aValue[0] = matchFields.mplsBos;
+        matchTlvLen += oxmTlvLen + pOxmTlv->length;
+        pOxmTlv = (tOfcMatchOxmTlv *) (void *) 
+                  (((__u8 *) pOxmTlv) + oxmTlvLen + pOxmTlv->length);
+    }
+
     /* Add input port in match field TLV OXM fields */
     pOxmTlv->Class = htons (OFPXMC_OPENFLOW_BASIC);
     pOxmTlv->field = OFCXMT_OFB_IN_PORT << 1;
@@ -818,10 +1422,10 @@ int OfcCpConstructPacketIn (__u8 *pPkt, __u32 pktLen, __u8 inPort,
 int OfcCpProcessPktOut (__u8 *pPkt, __u16 pktLen)
 {
     struct list_head *pActionListHead;
-    tOfcActionList   *pActionList = NULL;
     tOfcActionTlv    *pActionTlv = NULL;
     tOfcPktOutHdr    *pPktOut = NULL;
     tDpCpMsgQ        msgQ;
+    __u32            inPort = 0;
     __u16            actionListLen = 0;
     __u16            dataPktLen = 0;
     __u8             *pPktParser = NULL;
@@ -842,62 +1446,42 @@ int OfcCpProcessPktOut (__u8 *pPkt, __u16 pktLen)
     pPktOut = 
         (tOfcPktOutHdr *) (void *) (pPkt + OFC_OPENFLOW_HDR_LEN);
     actionListLen = ntohs (pPktOut->actionsLen);
+    if ((OFC_OPENFLOW_HDR_LEN + sizeof (tOfcPktOutHdr) + actionListLen)
+        > pktLen)
+    {
+        printk (KERN_CRIT "Invalid packet-out actions length\r\n");
+        kfree (pActionListHead);
+        pActionListHead = NULL;
+        return OFC_FAILURE;
+    }
 
     pActionTlv = (tOfcActionTlv *) (void *) (((__u8 *) pPktOut) +
                                            sizeof (tOfcPktOutHdr));
 
     /* Extract action list to be sent to data path task 
      * from packet-out message, since actions shall be taken by
-     * data path task */
-    while (actionListLen > 0)
+     * data path task. Actions are same as those of flows. */
+    if (OfcCpAddActionList (pActionTlv, actionListLen, pActionListHead)
+        != OFC_SUCCESS)
     {
-        pActionList = (tOfcActionList *) kmalloc 
-                       (sizeof (tOfcActionList), GFP_KERNEL);
-        if (pActionList == NULL)
-        {
-            printk (KERN_CRIT "Failed to allocate memory to "
-                              "action list\r\n");
-            /* TODO: Delete action list */
-            OfcDeleteList (pActionListHead);
-            kfree (pActionListHead);
-            pActionListHead = NULL;
-            return OFC_FAILURE;
-        }
-
-        memset (pActionList, 0, sizeof (tOfcActionList));
-        pActionList->actionType = ntohs (pActionTlv->type); 
-        INIT_LIST_HEAD (&pActionList->list);
-
-        switch (pActionList->actionType)
-        {
-            case OFCAT_OUTPUT:
-                pPktParser = (__u8 *) (void *)
-                              (((__u8 *) pActionTlv) + 
-                               sizeof (pActionTlv->type) +
-                               sizeof (pActionTlv->length));
-                memcpy (&pActionList->u.outPort, pPktParser,
-                        sizeof (pActionList->u.outPort));
-                pActionList->u.outPort = ntohl (pActionList->u.outPort);
-
-                list_add_tail (&pActionList->list, pActionListHead);
-                break;
-
-            default:
-                break;
-        }
-
-        actionListLen -= ntohs (pActionTlv->length);
-        pActionTlv = (tOfcActionTlv *) (void *) 
-                      (((__u8 *) pActionTlv) + ntohs (pActionTlv->length));
+        printk (KERN_CRIT "Failed to extract packet-out "
+                          "actions\r\n");
+        kfree (pActionListHead);
+        pActionListHead = NULL;
+        return OFC_FAILURE;
     }
 
     /* Extract data packet */
-    pPktParser = (__u8 *) (void *) pActionTlv;
+    pPktParser = (__u8 *) (void *) (((__u8 *) pActionTlv) + 
+                                    actionListLen);
     dataPktLen = ntohs (((tOfcOfHdr *) pPkt)->length) - 
                  OFC_OPENFLOW_HDR_LEN - sizeof (tOfcPktOutHdr) - 
                  (ntohs (pPktOut->actionsLen));
 
-    pDataPkt = (__u8 *) kmalloc (dataPktLen, GFP_KERNEL);
+    /* Headroom is reserved ahead of packet, as for received
+     * frames, so that tags can be pushed in place */
+    pDataPkt = (__u8 *) kmalloc (OFC_DP_PKT_HEADROOM + dataPktLen,
+                                 GFP_KERNEL);
     if (pDataPkt == NULL)
     {
         printk (KERN_CRIT "[%s]: Failed to allocate memory to "
@@ -907,12 +1491,17 @@ int OfcCpProcessPktOut (__u8 *pPkt, __u16 pktLen)
         pActionListHead = NULL;
         return OFC_FAILURE;
     }
-    memset (pDataPkt, 0, dataPktLen);
-    memcpy (pDataPkt, pPktParser, dataPktLen);
+    memset (pDataPkt, 0, OFC_DP_PKT_HEADROOM + dataPktLen);
+    memcpy (pDataPkt + OFC_DP_PKT_HEADROOM, pPktParser, dataPktLen);
                    
     /* Send message to data path task */
     memset (&msgQ, 0, sizeof (msgQ));
     msgQ.msgType = OFC_PACKET_OUT;
+    /* Port n for controller corresponds to dataIfNum n-1, packet
+     * from controller itself has no input port */
+    inPort = ntohl (pPktOut->inPort);
+    msgQ.inPort = ((inPort >= 1) && (inPort <= gNumOpenFlowIf)) ?
+                  (inPort - 1) : OFC_INVALID_DATA_IF;
     msgQ.pPkt = pDataPkt;
     msgQ.pktLen = dataPktLen;
     msgQ.pActionListHead = pActionListHead;
@@ -955,6 +1544,8 @@ int OfcCpProcessFlowMod (__u8 *pPkt, __u16 pktLen)
         case OFPFC_ADD:
         /* Intentional fall through */
         case OFPFC_DELETE:
+        /* Intentional fall through */
+        case OFPFC_DELETE_STRICT:
             pFlowEntry = OfcCpExtractFlow (pFlowMod, flowModLen);
             if (pFlowEntry == NULL)
             {
@@ -1000,6 +1591,15 @@ tOfcFlowEntry *OfcCpExtractFlow (tOfcFlowModHdr *pFlowMod,
 {
     tOfcFlowEntry    *pFlowEntry = NULL;
 
+    /* Flow stats entry of flow must fit in a reply message */
+    if ((sizeof (tOfcFlowStats) + flowModLen - OFC_MATCH_TLV_OFFSET) > 
+        OFC_STATS_SEG_MAX)
+    {
+        printk (KERN_CRIT "Flow Mod match and instructions too "
+                          "long\r\n");
+        return NULL;
+    }
+
     pFlowEntry = (tOfcFlowEntry *) kmalloc (sizeof (tOfcFlowEntry),
                                             GFP_KERNEL);
     if (pFlowEntry == NULL)
@@ -1042,6 +1642,23 @@ tOfcFlowEntry *OfcCpExtractFlow (tOfcFlowModHdr *pFlowMod,
         return NULL;
     }
 
+    /* Keep match and instructions as received, flow stats return
+     * them unchanged */
+    pFlowEntry->matchInstrLen = flowModLen - OFC_MATCH_TLV_OFFSET;
+    pFlowEntry->pMatchInstr = (__u8 *) kmalloc (pFlowEntry->matchInstrLen,
+                                                GFP_KERNEL);
+    if (pFlowEntry->pMatchInstr == NULL)
+    {
+        printk (KERN_CRIT "Failed to allocate memory for flow "
+                          "match and instructions\r\n");
+        OfcDpFreeFlowEntry (pFlowEntry);
+        pFlowEntry = NULL;
+        return NULL;
+    }
+    memcpy (pFlowEntry->pMatchInstr,
+            ((__u8 *) pFlowMod) + OFC_MATCH_TLV_OFFSET,
+            pFlowEntry->matchInstrLen);
+
     return pFlowEntry;
 }
 
@@ -1069,6 +1686,7 @@ int OfcCpAddMatchFieldsInFlow (tOfcFlowModHdr *pFlowMod,
     tMatchListEntry  *pMatchList = NULL;
     __u16            matchTlvLen = 0;
     __u8             oxmTlvLen = 0;
+    __u8             fieldLen = 0;
     __u32            inPort = 0;
 
     if (flowModLen < OFC_MATCH_TLV_OFFSET)
@@ -1086,6 +1704,13 @@ int OfcCpAddMatchFieldsInFlow (tOfcFlowModHdr *pFlowMod,
     }
 
     matchTlvLen = ntohs (pMatchTlv->length);
+    if ((matchTlvLen < (sizeof (pMatchTlv->type) + 
+                        sizeof (pMatchTlv->length))) ||
+        ((OFC_MATCH_TLV_OFFSET + matchTlvLen) > flowModLen))
+    {
+        printk (KERN_CRIT "Invalid match length\r\n");
+        return OFC_FAILURE;
+    }
     /* Discern length of match Oxm TLV */
     matchTlvLen = matchTlvLen - (sizeof (pMatchTlv->type) + 
                                  sizeof (pMatchTlv->length));
@@ -1100,6 +1725,36 @@ int OfcCpAddMatchFieldsInFlow (tOfcFlowModHdr *pFlowMod,
     /* Add each Oxm match to flow entry match list */
     while (matchTlvLen > 0)
     {
+        if ((matchTlvLen < oxmTlvLen) ||
+            (matchTlvLen < (oxmTlvLen + pOfcMatchOxmTlv->length)))
+        {
+            printk (KERN_CRIT "Match field exceeds match length\r\n");
+            OfcDeleteList (&pFlowEntry->matchList);
+            return OFC_FAILURE;
+        }
+
+        if ((ntohs (pOfcMatchOxmTlv->Class) == OFPXMC_NXM_1) &&
+            ((pOfcMatchOxmTlv->field >> 1) == OFCNXM_NX_IP_FRAG))
+        {
+            if (pOfcMatchOxmTlv->length != 
+                ((pOfcMatchOxmTlv->field & OFC_OXM_HAS_MASK) ? 2 : 1))
+            {
+                printk (KERN_CRIT "Invalid match field length\r\n");
+                OfcDeleteList (&pFlowEntry->matchList);
+                return OFC_FAILURE;
+            }
+
+            /* Fragment flags, as matched by Nicira extension */
+            pFlowEntry->matchMask.ipFragFlags = 
+                (pOfcMatchOxmTlv->field & OFC_OXM_HAS_MASK) ?
+                (pOfcMatchOxmTlv->aValue[1] & OFC_FRAG_MASK) :
+                OFC_FRAG_MASK;
+            pFlowEntry->matchFields.ipFragFlags = 
+                pOfcMatchOxmTlv->aValue[0] &
+                pFlowEntry->matchMask.ipFragFlags;
+            pFlowEntry->matchFields.extMatchFlags |= OFC_FLD_IP_FRAG;
+        }
+
         if (ntohs (pOfcMatchOxmTlv->Class) != OFPXMC_OPENFLOW_BASIC)
         {
             matchTlvLen = matchTlvLen - (oxmTlvLen +  
@@ -1111,7 +1766,8 @@ int OfcCpAddMatchFieldsInFlow (tOfcFlowModHdr *pFlowMod,
             continue;
         }
 
-        if ((pOfcMatchOxmTlv->field >> 1) >= OFCXMT_OFB_MAX)
+        if (((pOfcMatchOxmTlv->field >> 1) >= OFCXMT_OFB_MAX) &&
+            ((pOfcMatchOxmTlv->field >> 1) != OFCXMT_OFB_TCP_FLAGS))
         {
             matchTlvLen = matchTlvLen - (oxmTlvLen +  
                                          pOfcMatchOxmTlv->length);
@@ -1122,6 +1778,34 @@ int OfcCpAddMatchFieldsInFlow (tOfcFlowModHdr *pFlowMod,
             continue;
         }
 
+        /* Value, followed by mask if present, must be of length
+         * defined for field, as fields are read at that length */
+        fieldLen = OfcCpGetOxmFieldLen (pOfcMatchOxmTlv->field >> 1);
+        if (pOfcMatchOxmTlv->length != 
+            ((pOfcMatchOxmTlv->field & OFC_OXM_HAS_MASK) ?
+             (2 * fieldLen) : fieldLen))
+        {
+            printk (KERN_CRIT "Invalid match field length\r\n");
+            OfcDeleteList (&pFlowEntry->matchList);
+            return OFC_FAILURE;
+        }
+
+        /* Flow would otherwise match field exactly, unlike what
+         * controller asked for */
+        if ((pOfcMatchOxmTlv->field & OFC_OXM_HAS_MASK) &&
+            (OfcCpIsOxmFieldMaskable (pOfcMatchOxmTlv->field >> 1) 
+             != OFC_TRUE))
+        {
+            printk (KERN_CRIT "Mask not allowed for match field %d\r\n",
+                    pOfcMatchOxmTlv->field >> 1);
+            /* Flow mod and multipart request follow OpenFlow 
+             * header */
+            OfcCpSendErrorMsg (((__u8 *) pFlowMod) - OFC_OPENFLOW_HDR_LEN,
+                               OFPET_BAD_MATCH, OFPBMC_BAD_MASK);
+            OfcDeleteList (&pFlowEntry->matchList);
+            return OFC_FAILURE;
+        }
+
         pMatchList = (tMatchListEntry *) kmalloc (sizeof(tMatchListEntry),
                                                   GFP_KERNEL);
         if (pMatchList == NULL)
@@ -1135,9 +1819,30 @@ int OfcCpAddMatchFieldsInFlow (tOfcFlowModHdr *pFlowMod,
 
         memset (pMatchList, 0, sizeof (tMatchListEntry));
         pMatchList->field = pOfcMatchOxmTlv->field >> 1;
-        pMatchList->length = pOfcMatchOxmTlv->length;
+        pMatchList->hasMask = pOfcMatchOxmTlv->field & OFC_OXM_HAS_MASK;
+        /* Mask follows value and is of same length */
+        pMatchList->length = (pMatchList->hasMask == OFC_TRUE) ?
+                             (pOfcMatchOxmTlv->length / 2) :
+                             pOfcMatchOxmTlv->length;
+        if (pMatchList->length > sizeof (pMatchList->aValue))
+        {
+            printk (KERN_CRIT "Invalid match field length\r\n");
+            kfree (pMatchList);
+            OfcDeleteList (&pFlowEntry->matchList);
+            return OFC_FAILURE;
+        }
         memcpy (pMatchList->aValue, pOfcMatchOxmTlv->aValue,
                 pMatchList->length);
+        if (pMatchList->hasMask == OFC_TRUE)
+        {
+            memcpy (pMatchList->aMask, 
+                    pOfcMatchOxmTlv->aValue + pMatchList->length,
+                    pMatchList->length);
+        }
+        else
+        {
+            memset (pMatchList->aMask, 0xFF, pMatchList->length);
+        }
 
         INIT_LIST_HEAD (&pMatchList->list);
         list_add_tail (&pMatchList->list, &pFlowEntry->matchList);
@@ -1146,92 +1851,206 @@ int OfcCpAddMatchFieldsInFlow (tOfcFlowModHdr *pFlowMod,
         switch (pMatchList->field)
         {
             case OFCXMT_OFB_IN_PORT:
-                memcpy (&inPort, pMatchList->aValue, 
-                        pMatchList->length);
+                memcpy (&inPort, pMatchList->aValue, sizeof (inPort));
                 inPort = ntohl (inPort);
                 pFlowEntry->matchFields.inPort = inPort;
                 break;
 
+            case OFCXMT_OFB_METADATA:
+                pFlowEntry->matchMask.metadata = 
+                    get_unaligned_be64 (pMatchList->aMask);
+                pFlowEntry->matchFields.metadata = 
+                    get_unaligned_be64 (pMatchList->aValue) &
+                    pFlowEntry->matchMask.metadata;
+                break;
+
             case OFCXMT_OFB_ETH_DST:
-                memcpy (pFlowEntry->matchFields.aDstMacAddr,
-                        pMatchList->aValue, pMatchList->length);
+                OfcCpSetMaskedField (pFlowEntry->matchFields.aDstMacAddr,
+                                     pFlowEntry->matchMask.aDstMacAddr,
+                                     pMatchList, OFC_MAC_ADDR_LEN);
                 break;
 
             case OFCXMT_OFB_ETH_SRC:
-                memcpy (pFlowEntry->matchFields.aSrcMacAddr,
-                        pMatchList->aValue, pMatchList->length);
+                OfcCpSetMaskedField (pFlowEntry->matchFields.aSrcMacAddr,
+                                     pFlowEntry->matchMask.aSrcMacAddr,
+                                     pMatchList, OFC_MAC_ADDR_LEN);
                 break;
 
             case OFCXMT_OFB_VLAN_VID:
-                memcpy (&pFlowEntry->matchFields.vlanId,
-                        pMatchList->aValue, pMatchList->length);
+                pFlowEntry->matchMask.vlanId = 
+                    get_unaligned_be16 (pMatchList->aMask) &
+                    OFC_VLAN_MATCH_MASK;
                 pFlowEntry->matchFields.vlanId =
-                    ntohs (pFlowEntry->matchFields.vlanId);
+                    get_unaligned_be16 (pMatchList->aValue) &
+                    pFlowEntry->matchMask.vlanId;
                 break;
 
             case OFCXMT_OFB_ETH_TYPE:
-                memcpy (&pFlowEntry->matchFields.etherType,
-                        pMatchList->aValue, pMatchList->length);
                 pFlowEntry->matchFields.etherType =
-                    ntohs (pFlowEntry->matchFields.etherType);
+                    get_unaligned_be16 (pMatchList->aValue);
                 break;
 
             case OFCXMT_OFB_IP_PROTO:
-                memcpy (&pFlowEntry->matchFields.protocolType,
-                        pMatchList->aValue, pMatchList->length);
+                pFlowEntry->matchFields.protocolType = 
+                    pMatchList->aValue[0];
                 break;
 
             case OFCXMT_OFB_IPV4_SRC:
-                memcpy (&pFlowEntry->matchFields.srcIpAddr,
-                        pMatchList->aValue, pMatchList->length);
+                pFlowEntry->matchMask.srcIpAddr = 
+                    get_unaligned_be32 (pMatchList->aMask);
                 pFlowEntry->matchFields.srcIpAddr =
-                    ntohl (pFlowEntry->matchFields.srcIpAddr);
+                    get_unaligned_be32 (pMatchList->aValue) &
+                    pFlowEntry->matchMask.srcIpAddr;
                 break;
 
             case OFCXMT_OFB_IPV4_DST:
-                memcpy (&pFlowEntry->matchFields.dstIpAddr,
-                        pMatchList->aValue, pMatchList->length);
+                pFlowEntry->matchMask.dstIpAddr = 
+                    get_unaligned_be32 (pMatchList->aMask);
                 pFlowEntry->matchFields.dstIpAddr =
-                    ntohl (pFlowEntry->matchFields.dstIpAddr);
+                    get_unaligned_be32 (pMatchList->aValue) &
+                    pFlowEntry->matchMask.dstIpAddr;
                 break;
 
             case OFCXMT_OFB_TCP_SRC:
-                memcpy (&pFlowEntry->matchFields.srcPortNum,
-                        pMatchList->aValue, pMatchList->length);
+            case OFCXMT_OFB_UDP_SRC:
+                pFlowEntry->matchMask.srcPortNum = 
+                    get_unaligned_be16 (pMatchList->aMask);
                 pFlowEntry->matchFields.srcPortNum =
-                    ntohs (pFlowEntry->matchFields.srcPortNum);
-                pFlowEntry->matchFields.l4HeaderType = OFC_TCP_PROT_TYPE;
+                    get_unaligned_be16 (pMatchList->aValue) &
+                    pFlowEntry->matchMask.srcPortNum;
+                pFlowEntry->matchFields.l4HeaderType = 
+                    (pMatchList->field == OFCXMT_OFB_TCP_SRC) ?
+                    OFC_TCP_PROT_TYPE : OFC_UDP_PROT_TYPE;
                 break;
 
             case OFCXMT_OFB_TCP_DST:
-                memcpy (&pFlowEntry->matchFields.dstPortNum,
-                        pMatchList->aValue, pMatchList->length);
+            case OFCXMT_OFB_UDP_DST:
+                pFlowEntry->matchMask.dstPortNum = 
+                    get_unaligned_be16 (pMatchList->aMask);
                 pFlowEntry->matchFields.dstPortNum =
-                    ntohs (pFlowEntry->matchFields.dstPortNum);
-                pFlowEntry->matchFields.l4HeaderType = OFC_TCP_PROT_TYPE;
+                    get_unaligned_be16 (pMatchList->aValue) &
+                    pFlowEntry->matchMask.dstPortNum;
+                pFlowEntry->matchFields.l4HeaderType = 
+                    (pMatchList->field == OFCXMT_OFB_TCP_DST) ?
+                    OFC_TCP_PROT_TYPE : OFC_UDP_PROT_TYPE;
                 break;
 
-            case OFCXMT_OFB_UDP_SRC:
-                memcpy (&pFlowEntry->matchFields.srcPortNum,
-                        pMatchList->aValue, pMatchList->length);
-                pFlowEntry->matchFields.srcPortNum =
-                    ntohs (pFlowEntry->matchFields.srcPortNum);
-                pFlowEntry->matchFields.l4HeaderType = OFC_UDP_PROT_TYPE;
+            case OFCXMT_OFB_ARP_TPA:
+                pFlowEntry->matchMask.arpFlds.targetIpAddr = 
+                    get_unaligned_be32 (pMatchList->aMask);
+                pFlowEntry->matchFields.arpFlds.targetIpAddr =
+                    get_unaligned_be32 (pMatchList->aValue) &
+                    pFlowEntry->matchMask.arpFlds.targetIpAddr;
                 break;
 
-            case OFCXMT_OFB_UDP_DST:
-                memcpy (&pFlowEntry->matchFields.dstPortNum,
-                        pMatchList->aValue, pMatchList->length);
-                pFlowEntry->matchFields.dstPortNum =
-                    ntohs (pFlowEntry->matchFields.dstPortNum);
-                pFlowEntry->matchFields.l4HeaderType = OFC_UDP_PROT_TYPE;
+            case OFCXMT_OFB_MPLS_LABEL:
+                pFlowEntry->matchFields.mplsLabel =
+                    get_unaligned_be32 (pMatchList->aValue) &
+                    OFC_MPLS_LABEL_MASK;
+                pFlowEntry->matchFields.mplsMatchFlags |= 
+                    OFC_MPLS_LABEL_MATCH;
                 break;
 
-            case OFCXMT_OFB_ARP_TPA:
-                memcpy (&pFlowEntry->matchFields.arpFlds.targetIpAddr,
-                        pMatchList->aValue, pMatchList->length);
-                pFlowEntry->matchFields.arpFlds.targetIpAddr =
-                    ntohl (pFlowEntry->matchFields.arpFlds.targetIpAddr);
+            case OFCXMT_OFB_MPLS_TC:
+                pFlowEntry->matchFields.mplsTc = 
+                    pMatchList->aValue[0] & OFC_MPLS_TC_MASK;
+                pFlowEntry->matchFields.mplsMatchFlags |= 
+                    OFC_MPLS_TC_MATCH;
+                break;
+
+            case OFCXMT_OFB_MPLS_BOS:
+                pFlowEntry->matchFields.mplsBos = 
+                    pMatchList->aValue[0] & OFC_MPLS_BOS_MASK;
+                pFlowEntry->matchFields.mplsMatchFlags |= 
+                    OFC_MPLS_BOS_MATCH;
+                break;
+
+            case OFCXMT_OFB_IPV6_SRC:
+                OfcCpSetMaskedField (pFlowEntry->matchFields.aSrcIpv6Addr,
+                                     pFlowEntry->matchMask.aSrcIpv6Addr,
+                                     pMatchList, OFC_IPV6_ADDR_LEN);
+                pFlowEntry->matchFields.extMatchFlags |= OFC_FLD_IPV6_SRC;
+                break;
+
+            case OFCXMT_OFB_IPV6_DST:
+                OfcCpSetMaskedField (pFlowEntry->matchFields.aDstIpv6Addr,
+                                     pFlowEntry->matchMask.aDstIpv6Addr,
+                                     pMatchList, OFC_IPV6_ADDR_LEN);
+                pFlowEntry->matchFields.extMatchFlags |= OFC_FLD_IPV6_DST;
+                break;
+
+            case OFCXMT_OFB_IPV6_FLABEL:
+                pFlowEntry->matchMask.ipv6FlowLabel = 
+                    get_unaligned_be32 (pMatchList->aMask) &
+                    OFC_IPV6_FLABEL_MASK;
+                pFlowEntry->matchFields.ipv6FlowLabel = 
+                    get_unaligned_be32 (pMatchList->aValue) &
+                    pFlowEntry->matchMask.ipv6FlowLabel;
+                pFlowEntry->matchFields.extMatchFlags |= 
+                    OFC_FLD_IPV6_FLABEL;
+                break;
+
+            case OFCXMT_OFB_ICMPV4_TYPE:
+            case OFCXMT_OFB_ICMPV6_TYPE:
+                pFlowEntry->matchFields.icmpType = pMatchList->aValue[0];
+                pFlowEntry->matchFields.l4HeaderType = 
+                    (pMatchList->field == OFCXMT_OFB_ICMPV4_TYPE) ?
+                    OFC_ICMP_PROT_TYPE : OFC_ICMPV6_PROT_TYPE;
+                pFlowEntry->matchFields.extMatchFlags |= 
+                    OFC_FLD_ICMP_TYPE;
+                break;
+
+            case OFCXMT_OFB_ICMPV4_CODE:
+            case OFCXMT_OFB_ICMPV6_CODE:
+                pFlowEntry->matchFields.icmpCode = pMatchList->aValue[0];
+                pFlowEntry->matchFields.l4HeaderType = 
+                    (pMatchList->field == OFCXMT_OFB_ICMPV4_CODE) ?
+                    OFC_ICMP_PROT_TYPE : OFC_ICMPV6_PROT_TYPE;
+                pFlowEntry->matchFields.extMatchFlags |= 
+                    OFC_FLD_ICMP_CODE;
+                break;
+
+            case OFCXMT_OFB_ARP_OP:
+                pFlowEntry->matchFields.arpFlds.opCode = 
+                    get_unaligned_be16 (pMatchList->aValue);
+                pFlowEntry->matchFields.extMatchFlags |= OFC_FLD_ARP_OP;
+                break;
+
+            case OFCXMT_OFB_ARP_SPA:
+                pFlowEntry->matchMask.arpFlds.senderIpAddr = 
+                    get_unaligned_be32 (pMatchList->aMask);
+                pFlowEntry->matchFields.arpFlds.senderIpAddr = 
+                    get_unaligned_be32 (pMatchList->aValue) &
+                    pFlowEntry->matchMask.arpFlds.senderIpAddr;
+                pFlowEntry->matchFields.extMatchFlags |= OFC_FLD_ARP_SPA;
+                break;
+
+            case OFCXMT_OFB_ARP_SHA:
+                OfcCpSetMaskedField 
+                    (pFlowEntry->matchFields.arpFlds.aSenderMacAddr,
+                     pFlowEntry->matchMask.arpFlds.aSenderMacAddr,
+                     pMatchList, OFC_MAC_ADDR_LEN);
+                pFlowEntry->matchFields.extMatchFlags |= OFC_FLD_ARP_SHA;
+                break;
+
+            case OFCXMT_OFB_ARP_THA:
+                OfcCpSetMaskedField 
+                    (pFlowEntry->matchFields.arpFlds.aTargetMacAddr,
+                     pFlowEntry->matchMask.arpFlds.aTargetMacAddr,
+                     pMatchList, OFC_MAC_ADDR_LEN);
+                pFlowEntry->matchFields.extMatchFlags |= OFC_FLD_ARP_THA;
+                break;
+
+            case OFCXMT_OFB_TCP_FLAGS:
+                pFlowEntry->matchMask.tcpFlags = 
+                    get_unaligned_be16 (pMatchList->aMask) &
+                    OFC_TCP_FLAGS_MASK;
+                pFlowEntry->matchFields.tcpFlags = 
+                    get_unaligned_be16 (pMatchList->aValue) &
+                    pFlowEntry->matchMask.tcpFlags;
+                pFlowEntry->matchFields.l4HeaderType = OFC_TCP_PROT_TYPE;
+                pFlowEntry->matchFields.extMatchFlags |= 
+                    OFC_FLD_TCP_FLAGS;
                 break;
 
             default:
@@ -1249,6 +2068,160 @@ int OfcCpAddMatchFieldsInFlow (tOfcFlowModHdr *pFlowMod,
     return OFC_SUCCESS;
 }
 
+/******************************************************************                                                                          
+* Function: OfcCpGetOxmFieldLen
+*
+* Description: This function returns length of value of OpenFlow
+*              basic match field, as defined by OpenFlow
+*
+* Input: field - OFCXMT_OFB_xxx
+*
+* Output: None
+*
+* Returns: Length of field, 0 if field is not known
+*
+*******************************************************************/
+__u8 OfcCpGetOxmFieldLen (__u8 field)
+{
+    switch (field)
+    {
+        case OFCXMT_OFB_VLAN_PCP:
+        case OFCXMT_OFB_IP_DSCP:
+        case OFCXMT_OFB_IP_ECN:
+        case OFCXMT_OFB_IP_PROTO:
+        case OFCXMT_OFB_ICMPV4_TYPE:
+        case OFCXMT_OFB_ICMPV4_CODE:
+        case OFCXMT_OFB_ICMPV6_TYPE:
+        case OFCXMT_OFB_ICMPV6_CODE:
+        case OFCXMT_OFB_MPLS_TC:
+        case OFCXMT_OFB_MPLS_BOS:
+            return 1;
+
+        case OFCXMT_OFB_ETH_TYPE:
+        case OFCXMT_OFB_VLAN_VID:
+        case OFCXMT_OFB_TCP_SRC:
+        case OFCXMT_OFB_TCP_DST:
+        case OFCXMT_OFB_UDP_SRC:
+        case OFCXMT_OFB_UDP_DST:
+        case OFCXMT_OFB_SCTP_SRC:
+        case OFCXMT_OFB_SCTP_DST:
+        case OFCXMT_OFB_ARP_OP:
+        case OFCXMT_OFB_IPV6_EXTHDR:
+        case OFCXMT_OFB_TCP_FLAGS:
+            return 2;
+
+        case OFCXMT_OFB_PBB_ISID:
+            return 3;
+
+        case OFCXMT_OFB_IN_PORT:
+        case OFCXMT_OFB_IN_PHY_PORT:
+        case OFCXMT_OFB_IPV4_SRC:
+        case OFCXMT_OFB_IPV4_DST:
+        case OFCXMT_OFB_ARP_SPA:
+        case OFCXMT_OFB_ARP_TPA:
+        case OFCXMT_OFB_IPV6_FLABEL:
+        case OFCXMT_OFB_MPLS_LABEL:
+            return 4;
+
+        case OFCXMT_OFB_ETH_DST:
+        case OFCXMT_OFB_ETH_SRC:
+        case OFCXMT_OFB_ARP_SHA:
+        case OFCXMT_OFB_ARP_THA:
+        case OFCXMT_OFB_IPV6_ND_SLL:
+        case OFCXMT_OFB_IPV6_ND_TLL:
+            return OFC_MAC_ADDR_LEN;
+
+        case OFCXMT_OFB_METADATA:
+        case OFCXMT_OFB_TUNNEL_ID:
+            return 8;
+
+        case OFCXMT_OFB_IPV6_SRC:
+        case OFCXMT_OFB_IPV6_DST:
+        case OFCXMT_OFB_IPV6_ND_TARGET:
+            return OFC_IPV6_ADDR_LEN;
+
+        default:
+            return 0;
+    }
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpIsOxmFieldMaskable
+*
+* Description: This function checks whether OpenFlow basic match
+*              field may carry a mask. These are fields OpenFlow
+*              defines as maskable, and TCP/UDP ports and TCP
+*              flags whose masks switch applies.
+*
+* Input: field - OFCXMT_OFB_xxx
+*
+* Output: None
+*
+* Returns: OFC_TRUE/OFC_FALSE
+*
+*******************************************************************/
+int OfcCpIsOxmFieldMaskable (__u8 field)
+{
+    switch (field)
+    {
+        case OFCXMT_OFB_METADATA:
+        case OFCXMT_OFB_ETH_DST:
+        case OFCXMT_OFB_ETH_SRC:
+        case OFCXMT_OFB_VLAN_VID:
+        case OFCXMT_OFB_IPV4_SRC:
+        case OFCXMT_OFB_IPV4_DST:
+        case OFCXMT_OFB_TCP_SRC:
+        case OFCXMT_OFB_TCP_DST:
+        case OFCXMT_OFB_UDP_SRC:
+        case OFCXMT_OFB_UDP_DST:
+        case OFCXMT_OFB_ARP_SPA:
+        case OFCXMT_OFB_ARP_TPA:
+        case OFCXMT_OFB_ARP_SHA:
+        case OFCXMT_OFB_ARP_THA:
+        case OFCXMT_OFB_IPV6_SRC:
+        case OFCXMT_OFB_IPV6_DST:
+        case OFCXMT_OFB_IPV6_FLABEL:
+        case OFCXMT_OFB_PBB_ISID:
+        case OFCXMT_OFB_TUNNEL_ID:
+        case OFCXMT_OFB_IPV6_EXTHDR:
+        case OFCXMT_OFB_TCP_FLAGS:
+            return OFC_TRUE;
+
+        default:
+            return OFC_FALSE;
+    }
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpSetMaskedField
+*
+* Description: This function sets value and mask of a multi-byte
+*              match field of flow. Value is stored masked, so that
+*              flows with same match compare equal.
+*
+* Input: pMatchList - Match field as received in flow mod
+*        length - Length of field
+*
+* Output: pValue - Value of flow match field
+*         pMask - Mask of flow match field
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcCpSetMaskedField (__u8 *pValue, __u8 *pMask,
+                          tMatchListEntry *pMatchList, __u8 length)
+{
+    __u8 index = 0;
+
+    for (index = 0; index < length; index++)
+    {
+        pMask[index] = pMatchList->aMask[index];
+        pValue[index] = pMatchList->aValue[index] & pMask[index];
+    }
+
+    return;
+}
+
 /******************************************************************                                                                          
 * Function: OfcCpAddInstrListInFlow
 *
@@ -1327,8 +2300,50 @@ int OfcCpAddInstrListInFlow (tOfcFlowModHdr *pFlowMod,
                     return OFC_FAILURE;
                 }
 
-                list_add_tail (&pInstrList->list, 
-                               &pFlowEntry->instrList);
+                OfcCpAddInstrInOrder (pInstrList,
+                                      &pFlowEntry->instrList);
+                break;
+
+            case OFCIT_METER:
+                pPktParser = 
+                    (__u8 *) (void *) (((__u8 *) pInstrTlv) + 
+                                       sizeof (pInstrTlv->type) +
+                                       sizeof (pInstrTlv->length));
+                memcpy (&pInstrList->u.meterId, pPktParser,
+                        sizeof (pInstrList->u.meterId));
+                pInstrList->u.meterId = ntohl (pInstrList->u.meterId);
+
+                OfcCpAddInstrInOrder (pInstrList, 
+                                      &pFlowEntry->instrList);
+                break;
+
+            case OFCIT_CLEAR_ACTIONS:
+                OfcCpAddInstrInOrder (pInstrList,
+                                      &pFlowEntry->instrList);
+                break;
+
+            case OFCIT_WRITE_METADATA:
+                if (ntohs (pInstrTlv->length) < OFC_WRITE_METADATA_LEN)
+                {
+                    printk (KERN_CRIT "Invalid write metadata "
+                                      "instruction length\r\n");
+                    kfree (pInstrList);
+                    OfcDeleteList (&pFlowEntry->instrList);
+                    return OFC_FAILURE;
+                }
+                /* Metadata and mask follow 4 bytes of padding */
+                pPktParser = 
+                    (__u8 *) (void *) (((__u8 *) pInstrTlv) + 
+                                       sizeof (pInstrTlv->type) +
+                                       sizeof (pInstrTlv->length) + 4);
+                pInstrList->u.writeMetadata.metadata = 
+                    get_unaligned_be64 (pPktParser);
+                pInstrList->u.writeMetadata.metadataMask = 
+                    get_unaligned_be64 (pPktParser + 
+                                        sizeof (__u64));
+
+                OfcCpAddInstrInOrder (pInstrList,
+                                      &pFlowEntry->instrList);
                 break;
 
             case OFCIT_WRITE_ACTIONS:
@@ -1352,10 +2367,17 @@ int OfcCpAddInstrListInFlow (tOfcFlowModHdr *pFlowMod,
                     return OFC_FAILURE;
                 }
 
-                list_add_tail (&pInstrList->list,
-                               &pFlowEntry->instrList);
+                OfcCpAddInstrInOrder (pInstrList,
+                                      &pFlowEntry->instrList);
+                break;
+
+            default:
+                /* TODO: Support other instructions? */
+                printk (KERN_CRIT "Instruction not supported "
+                                  "presently\r\n");
+                kfree (pInstrList);
+                pInstrList = NULL;
                 break;
-                
         }
 
         instrTlvLen -= (ntohs (pInstrTlv->length));
@@ -1367,24 +2389,99 @@ int OfcCpAddInstrListInFlow (tOfcFlowModHdr *pFlowMod,
 }
 
 /******************************************************************                                                                          
-* Function: OfcCpAddActionListToInstr
+* Function: OfcCpAddInstrInOrder
 *
-* Description: This function adds list of actions in flow
-*              entry instruction list
+* Description: This function adds instruction in flow entry
+*              instruction list in the order in which OpenFlow
+*              executes instructions, so that data path executes
+*              the list from head to tail
 *
-* Input: pActionTlv - Pointer to action TLV
-*        actionTlvLen - Length of action list TLVs
+* Input: pInstrList - Pointer to instruction
 *
-* Output: pInstrList - Pointer to instruction list
+* Output: pInstrListHead - Pointer to instruction list head
 *
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcCpAddActionListToInstr (tOfcActionTlv *pActionTlv,
-                               __u16 actionTlvLen,
-                               tOfcInstrList *pInstrList)
+int OfcCpAddInstrInOrder (tOfcInstrList *pInstrList,
+                          struct list_head *pInstrListHead)
 {
-    tOfcActionList  *pActionList = NULL;
+    /* Execution rank of instruction, indexed by instruction type */
+    static const __u8 aInstrRank[] =
+    {
+        0, /* Unused */
+        5, /* OFCIT_GOTO_TABLE */
+        4, /* OFCIT_WRITE_METADATA */
+        3, /* OFCIT_WRITE_ACTIONS */
+        1, /* OFCIT_APPLY_ACTIONS */
+        2, /* OFCIT_CLEAR_ACTIONS */
+        0  /* OFCIT_METER */
+    };
+    tOfcInstrList    *pInstrParser = NULL;
+    struct list_head *pList = NULL;
+
+    if (pInstrList->instrType >= ARRAY_SIZE (aInstrRank))
+    {
+        return OFC_FAILURE;
+    }
+
+    list_for_each (pList, pInstrListHead)
+    {
+        pInstrParser = (tOfcInstrList *) pList;
+        if (aInstrRank[pInstrParser->instrType] >
+            aInstrRank[pInstrList->instrType])
+        {
+            break;
+        }
+    }
+
+    /* Insert before first instruction that executes later */
+    list_add_tail (&pInstrList->list, pList);
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpAddActionListToInstr
+*
+* Description: This function adds list of actions in flow
+*              entry instruction list
+*
+* Input: pActionTlv - Pointer to action TLV
+*        actionTlvLen - Length of action list TLVs
+*
+* Output: pInstrList - Pointer to instruction list
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpAddActionListToInstr (tOfcActionTlv *pActionTlv,
+                               __u16 actionTlvLen,
+                               tOfcInstrList *pInstrList)
+{
+    return OfcCpAddActionList (pActionTlv, actionTlvLen,
+                               &pInstrList->u.actionList);
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpAddActionList
+*
+* Description: This function extracts list of action TLVs into
+*              action list. It is used for flow instructions as
+*              well as group buckets
+*
+* Input: pActionTlv - Pointer to action TLV
+*        actionTlvLen - Length of action list TLVs
+*
+* Output: pActionListHead - Pointer to action list head
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpAddActionList (tOfcActionTlv *pActionTlv, __u16 actionTlvLen,
+                        struct list_head *pActionListHead)
+{
+    tOfcActionList  *pActionList = NULL;
     __u8            *pPktParser = NULL;
     
     while (actionTlvLen > 0)
@@ -1396,7 +2493,7 @@ int OfcCpAddActionListToInstr (tOfcActionTlv *pActionTlv,
             printk (KERN_CRIT "Failed to allocate memory to action "
                               "list\r\n");
             /* TODO: Delete action list */
-            OfcDeleteList (&pInstrList->u.actionList);
+            OfcDeleteList (pActionListHead);
             return OFC_FAILURE;
         }
 
@@ -1418,7 +2515,62 @@ int OfcCpAddActionListToInstr (tOfcActionTlv *pActionTlv,
                     ntohl (pActionList->u.outPort);
 
                 list_add_tail (&pActionList->list,
-                               &pInstrList->u.actionList);
+                               pActionListHead);
+                break;
+
+            case OFCAT_GROUP:
+                /* Group Id follows action header */
+                pPktParser = (__u8 *) (void *)
+                              (((__u8 *) pActionTlv) +
+                               sizeof (pActionTlv->type) +
+                               sizeof (pActionTlv->length));
+                memcpy (&pActionList->u.groupId, pPktParser,
+                        sizeof (pActionList->u.groupId));
+                pActionList->u.groupId =
+                    ntohl (pActionList->u.groupId);
+
+                list_add_tail (&pActionList->list,
+                               pActionListHead);
+                break;
+
+            case OFCAT_PUSH_VLAN:
+            case OFCAT_PUSH_MPLS:
+            case OFCAT_POP_MPLS:
+                /* EtherType follows action header */
+                pPktParser = (__u8 *) (void *)
+                              (((__u8 *) pActionTlv) +
+                               sizeof (pActionTlv->type) +
+                               sizeof (pActionTlv->length));
+                memcpy (&pActionList->u.etherType, pPktParser,
+                        sizeof (pActionList->u.etherType));
+                pActionList->u.etherType =
+                    ntohs (pActionList->u.etherType);
+
+                list_add_tail (&pActionList->list,
+                               pActionListHead);
+                break;
+
+            case OFCAT_SET_MPLS_TTL:
+            case OFCAT_SET_NW_TTL:
+                /* TTL follows action header */
+                pPktParser = (__u8 *) (void *)
+                              (((__u8 *) pActionTlv) +
+                               sizeof (pActionTlv->type) +
+                               sizeof (pActionTlv->length));
+                pActionList->u.ttl = *pPktParser;
+
+                list_add_tail (&pActionList->list,
+                               pActionListHead);
+                break;
+
+            case OFCAT_POP_VLAN:
+            case OFCAT_DEC_MPLS_TTL:
+            case OFCAT_DEC_NW_TTL:
+            case OFCAT_COPY_TTL_OUT:
+            case OFCAT_COPY_TTL_IN:
+                /* No action arguments */
+                list_add_tail (&pActionList->list,
+                               pActionListHead);
                 break;
 
 #if 0
@@ -1427,19 +2579,19 @@ int OfcCpAddActionListToInstr (tOfcActionTlv *pActionTlv,
                     ntohs (pActionTlv->length),
                     &pActionList->u.setFieldList) != OFC_SUCCESS)
                 {
-                    OfcDeleteList (&pInstrList->u.actionList);
+                    OfcDeleteList (pActionListHead);
                     return OFC_FAILURE;
                 }
 
                 list_add_tail (&pActionList->list,
-                               &pInstrList->u.actionList);
+                               pActionListHead);
                 break;
 #endif
 
             default:
                 /* TODO: Support other actions? */
                 printk (KERN_CRIT "Action not supported presently\r\n");
-                OfcDeleteList (&pInstrList->u.actionList);
+                OfcDeleteList (pActionListHead);
                 return OFC_FAILURE;
         }
 
@@ -1453,323 +2605,1861 @@ int OfcCpAddActionListToInstr (tOfcActionTlv *pActionTlv,
 }
 
 /******************************************************************                                                                          
-* Function: OfcCpProcessMultipartReq
+* Function: OfcCpProcessGroupMod
 *
-* Description: This function processes multicast request packet
-*              and sends appropriate reply
+* Description: This function processes group mod messages received
+*              from the controller and adds, modifies or deletes
+*              groups in the group table
 *
-* Input: pPkt - Pointer to Multipart Request packet
-*        pktLen - Multipart Request packet length
+* Input: pPkt - Pointer to control packet
+*        pktLen - Length of control packet
 *
 * Output: None
 *
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcCpProcessMultipartReq (__u8 *pCntrlPkt, __u16 cntrlPktLen)
+int OfcCpProcessGroupMod (__u8 *pPkt, __u16 pktLen)
 {
-    tOfcMultipartHeader *pMultReq = NULL;
+    tOfcGroupModHdr *pGroupMod = NULL;
+    tOfcGroupEntry  *pGroupEntry = NULL;
+    tDpCpMsgQ       msgQ;
+    __u16           groupModLen = 0;
+    __u16           command = 0;
 
-    printk (KERN_INFO "Multipart Request Rx\r\n");
+    printk (KERN_INFO "Group Mod Message Rx\r\n");
 
-    pMultReq = (tOfcMultipartHeader *)(pCntrlPkt + 
-                                       OFC_OPENFLOW_HDR_LEN);
-    switch (ntohs (pMultReq->type))
+    if (pktLen < (OFC_OPENFLOW_HDR_LEN + sizeof (tOfcGroupModHdr)))
     {
-        case OFPMP_DESC:
-        {
-            if (OfcCpHandleMultipartSwitchDesc (pCntrlPkt, cntrlPktLen) 
-                != OFC_SUCCESS)
-            {
-                printk (KERN_CRIT "Failed to send Multipart Switch"
-                                  " Desc Reply\r\n");
-                return OFC_FAILURE;
-            }
-            break;
-        }
+        printk (KERN_CRIT "Invalid Group Mod message length\r\n");
+        return OFC_FAILURE;
+    }
 
-        case OFPMP_FLOW:
-        {
-#if 0
-            if (ofcCpHandleMultipartFlowStats(pCntrlPkt) != OFC_SUCCESS)
-            {
-                return OFC_FAILURE;
-            }
-#endif
+    pGroupMod =
+        (tOfcGroupModHdr *) (void *) (pPkt + OFC_OPENFLOW_HDR_LEN);
+    groupModLen = pktLen - OFC_OPENFLOW_HDR_LEN;
+    command = ntohs (pGroupMod->command);
+
+    memset (&msgQ, 0, sizeof (msgQ));
+    switch (command)
+    {
+        case OFPGC_ADD:
+            msgQ.msgType = OFC_GROUP_MOD_ADD;
             break;
-        }
 
-        case OFPMP_PORT_DESC:
-        {
-            if (OfcCpHandleMultipartPortDesc (pCntrlPkt, cntrlPktLen) 
-                != OFC_SUCCESS)
-            {
-                printk (KERN_CRIT "Failed to send Multipart Port" 
-                                  " Desc Reply\r\n");
-                return OFC_FAILURE;
-            }
+        case OFPGC_MODIFY:
+            msgQ.msgType = OFC_GROUP_MOD_MODIFY;
+            break;
 
+        case OFPGC_DELETE:
+            msgQ.msgType = OFC_GROUP_MOD_DEL;
             break;
-        }
 
-        case OFPMP_AGGREGATE:
-        case OFPMP_TABLE:
-        case OFPMP_PORT_STATS:
-        case OFPMP_QUEUE:
-        case OFPMP_GROUP:
-        case OFPMP_GROUP_DESC:
-        case OFPMP_GROUP_FEATURES:
-        case OFPMP_METER:
-        case OFPMP_METER_CONFIG:
-        case OFPMP_METER_FEATURES:
-        case OFPMP_TABLE_FEATURES:
-        case OFPMP_EXPERIMENTER:
         default:
-            printk(KERN_INFO "The Multipart Type is not currently supported \n");
+            /* TODO: Send OFPGMFC_BAD_COMMAND error message */
+            printk (KERN_CRIT "Group Mod command not supported!!\r\n");
             return OFC_FAILURE;
+    }
 
+    pGroupEntry = OfcCpExtractGroup (pGroupMod, groupModLen);
+    if (pGroupEntry == NULL)
+    {
+        printk (KERN_CRIT "Failed to extract group from Group"
+                          " Mod message\r\n");
+        return OFC_FAILURE;
     }
 
+    /* Send the extracted group to data path task, which owns
+     * the group table */
+    msgQ.pGroupEntry = pGroupEntry;
+    OfcCpSendToDpQ (&msgQ);
+    OfcDpSendEvent (OFC_CP_TO_DP_EVENT);
+
     return OFC_SUCCESS;
 }
 
 /******************************************************************                                                                          
-* Function: OfcCpHandleMultipartSwitchDesc
+* Function: OfcCpExtractGroup
 *
-* Description: This function handles multipart request for
-*              switch description, and sends description of
-*              OpenFlow client kernel module.
+* Description: This function extracts a group entry from Group Mod
+*              message. Buckets are stored in an array, and slots
+*              of select group are assigned to buckets in
+*              proportion to bucket weight so that data path
+*              selects a bucket with a single lookup.
 *
-* Input: pCntrlPkt - Pointer to Multipart Request packet
-*        cntrlPktLen - Multipart Request packet length
+* Input: pGroupMod - Pointer to group mod header
+*        groupModLen - Length of group mod packet
 *
 * Output: None
 *
-* Returns: OFC_SUCCESS/OFC_FAILURE
+* Returns: Pointer to group entry
 *
 *******************************************************************/
-int OfcCpHandleMultipartSwitchDesc (__u8 *pCntrlPkt, 
-                                    __u16 cntrlPktLen)
+tOfcGroupEntry *OfcCpExtractGroup (tOfcGroupModHdr *pGroupMod,
+                                   __u16 groupModLen)
 {
-    tOfcMultipartHeader  *pMultipartHeader  = NULL;
-    tOfcMultipartSwDesc  *pMultipartSwDesc = NULL;
-    __u8                 *pOpenFlowPkt = NULL;
-    __u16                descLen = 0;
+    tOfcGroupEntry   *pGroupEntry = NULL;
+    tOfcGroupBucket  *pBucket = NULL;
+    tOfcBucketTlv    *pBucketTlv = NULL;
+    tOfcActionTlv    *pActionTlv = NULL;
+    tOfcActionList   *pActionList = NULL;
+    __u32            aCumWeight[OFC_MAX_GROUP_BUCKETS];
+    __u32            totalWeight = 0;
+    __u32            slot = 0;
+    __u16            bucketsLen = 0;
+    __u16            bucketLen = 0;
+    __u8             bucketIndex = 0;
+    __u8             isCmdDelete = OFC_FALSE;
+
+    isCmdDelete = (ntohs (pGroupMod->command) == OFPGC_DELETE) ?
+                  OFC_TRUE : OFC_FALSE;
+
+    pGroupEntry = (tOfcGroupEntry *) kmalloc (sizeof (tOfcGroupEntry),
+                                              GFP_KERNEL);
+    if (pGroupEntry == NULL)
+    {
+        printk (KERN_CRIT "Failed to allocate memory for "
+                          "new group\r\n");
+        return NULL;
+    }
 
-    printk (KERN_INFO "Multipart Switch Desc Rx\r\n");
+    memset (pGroupEntry, 0, sizeof (tOfcGroupEntry));
+    INIT_LIST_HEAD (&pGroupEntry->list);
+    pGroupEntry->groupId = ntohl (pGroupMod->groupId);
+    pGroupEntry->groupType = pGroupMod->type;
+    for (bucketIndex = 0; bucketIndex < OFC_MAX_GROUP_BUCKETS;
+         bucketIndex++)
+    {
+        INIT_LIST_HEAD (&pGroupEntry->aBuckets[bucketIndex].actionList);
+    }
 
-    descLen = sizeof (tOfcMultipartHeader) + 
-              sizeof (tOfcMultipartSwDesc);
-    pMultipartHeader = (tOfcMultipartHeader *) kmalloc (descLen,
-                                                        GFP_KERNEL);
-    if (pMultipartHeader == NULL)
+    if (isCmdDelete == OFC_TRUE)
     {
-        printk (KERN_CRIT "Failed to allocate memory to Multipart"
-                " Switch Desc message\r\n");
-        return OFC_FAILURE;
+        /* Only group Id is needed to delete group */
+        if ((pGroupEntry->groupId > OFPG_MAX) &&
+            (pGroupEntry->groupId != OFPG_ALL))
+        {
+            printk (KERN_CRIT "Invalid group Id %u\r\n",
+                    pGroupEntry->groupId);
+            kfree (pGroupEntry);
+            pGroupEntry = NULL;
+            return NULL;
+        }
+        return pGroupEntry;
     }
 
-    memset(pMultipartHeader, 0, descLen);
-    pMultipartHeader->type = htons(OFPMP_DESC);
+    if ((pGroupEntry->groupId > OFPG_MAX) ||
+        (pGroupEntry->groupType > OFPGT_FF))
+    {
+        /* TODO: Send OFPGMFC_INVALID_GROUP/BAD_TYPE error message */
+        printk (KERN_CRIT "Invalid group Id %u or type %d\r\n",
+                pGroupEntry->groupId, pGroupEntry->groupType);
+        kfree (pGroupEntry);
+        pGroupEntry = NULL;
+        return NULL;
+    }
 
-    pMultipartSwDesc = (tOfcMultipartSwDesc *) (void *)
-                       (((__u8 *) pMultipartHeader) +
-                        sizeof (tOfcMultipartHeader));
+    pGroupEntry->pStats = alloc_percpu (tOfcGroupStats);
+    if (pGroupEntry->pStats == NULL)
+    {
+        printk (KERN_CRIT "Failed to allocate group statistics\r\n");
+        kfree (pGroupEntry);
+        pGroupEntry = NULL;
+        return NULL;
+    }
 
-    strcpy (pMultipartSwDesc->mfcDesc, OFC_MNF_DESC);
-    strcpy (pMultipartSwDesc->hwDesc, OFC_HW_DESC);
-    strcpy (pMultipartSwDesc->swDesc, OFC_SW_DESC);
-    strcpy (pMultipartSwDesc->serialNum, OFC_SERIAL_NUM);
-    strcpy (pMultipartSwDesc->dpDesc, OFC_DATAPATH_DESC);
+    /* Extract buckets */
+    pBucketTlv = (tOfcBucketTlv *) (void *) (((__u8 *) pGroupMod) +
+                                             sizeof (tOfcGroupModHdr));
+    bucketsLen = groupModLen - sizeof (tOfcGroupModHdr);
+    while (bucketsLen >= sizeof (tOfcBucketTlv))
+    {
+        bucketLen = ntohs (pBucketTlv->length);
+        if ((bucketLen < sizeof (tOfcBucketTlv)) ||
+            (bucketLen > bucketsLen))
+        {
+            printk (KERN_CRIT "Invalid bucket length\r\n");
+            OfcDpFreeGroupEntry (pGroupEntry);
+            pGroupEntry = NULL;
+            return NULL;
+        }
 
-    if (OfcCpAddOpenFlowHdr ((__u8 *) pMultipartHeader,
-                             descLen, OFPT_MULTIPART_REPLY,
-                             ((tOfcOfHdr *) pCntrlPkt)->xid, 
-                             &pOpenFlowPkt) != OFC_SUCCESS)
+        if (pGroupEntry->numBuckets >= OFC_MAX_GROUP_BUCKETS)
+        {
+            /* TODO: Send OFPGMFC_OUT_OF_BUCKETS error message */
+            printk (KERN_CRIT "Group supports maximum %d buckets\r\n",
+                    OFC_MAX_GROUP_BUCKETS);
+            OfcDpFreeGroupEntry (pGroupEntry);
+            pGroupEntry = NULL;
+            return NULL;
+        }
+
+        pBucket = &pGroupEntry->aBuckets[pGroupEntry->numBuckets];
+        pBucket->weight = ntohs (pBucketTlv->weight);
+        pBucket->watchPort = ntohl (pBucketTlv->watchPort);
+        pBucket->watchGroup = ntohl (pBucketTlv->watchGroup);
+        pGroupEntry->numBuckets++;
+
+        pActionTlv = (tOfcActionTlv *) (void *) 
+                      (((__u8 *) pBucketTlv) + sizeof (tOfcBucketTlv));
+        if (OfcCpAddActionList (pActionTlv, 
+                                bucketLen - sizeof (tOfcBucketTlv),
+                                &pBucket->actionList)
+            != OFC_SUCCESS)
+        {
+            printk (KERN_CRIT "Failed to add action list in"
+                              " bucket\r\n");
+            OfcDpFreeGroupEntry (pGroupEntry);
+            pGroupEntry = NULL;
+            return NULL;
+        }
+
+        /* Buckets with a single output action do not modify
+         * packet, data path only needs the output port */
+        if (list_is_singular (&pBucket->actionList))
+        {
+            pActionList = (tOfcActionList *) pBucket->actionList.next;
+            if (pActionList->actionType == OFCAT_OUTPUT)
+            {
+                pBucket->isOutputOnly = OFC_TRUE;
+                pBucket->outPort = pActionList->u.outPort;
+            }
+        }
+
+        bucketsLen -= bucketLen;
+        pBucketTlv = (tOfcBucketTlv *) (void *) 
+                      (((__u8 *) pBucketTlv) + bucketLen);
+    }
+
+    if (((pGroupEntry->groupType == OFPGT_INDIRECT) &&
+         (pGroupEntry->numBuckets != 1)) ||
+        ((pGroupEntry->groupType == OFPGT_SELECT) &&
+         (pGroupEntry->numBuckets == 0)))
     {
-        printk (KERN_CRIT "Failed to construct multipart switch "
-                          "description message\r\n");
-        kfree (pMultipartHeader);
-        pMultipartHeader = NULL;
-        return OFC_FAILURE;
+        printk (KERN_CRIT "Invalid number of buckets for group "
+                          "type %d\r\n", pGroupEntry->groupType);
+        OfcDpFreeGroupEntry (pGroupEntry);
+        pGroupEntry = NULL;
+        return NULL;
     }
 
-    if (OfcCpSendCntrlPktFromSock (pOpenFlowPkt, 
-        ntohs (((tOfcOfHdr *) pOpenFlowPkt)->length)) 
-        != OFC_SUCCESS)
+    if (pGroupEntry->groupType != OFPGT_SELECT)
     {
-        printk (KERN_CRIT "Failed to send multipart switch "
-                          "description message\r\n");
-        kfree (pMultipartHeader);
-        pMultipartHeader = NULL;
-        kfree (pOpenFlowPkt);
-        pOpenFlowPkt = NULL;
-        return OFC_FAILURE;
+        return pGroupEntry;
     }
 
-    printk (KERN_INFO "Multipart Switch Desc Tx\r\n");
+    /* Assign select slots to buckets in proportion to weight */
+    memset (aCumWeight, 0, sizeof (aCumWeight));
+    for (bucketIndex = 0; bucketIndex < pGroupEntry->numBuckets;
+         bucketIndex++)
+    {
+        totalWeight += pGroupEntry->aBuckets[bucketIndex].weight;
+        aCumWeight[bucketIndex] = totalWeight;
+    }
 
-    kfree (pMultipartHeader);
-    pMultipartHeader = NULL;
-    kfree (pOpenFlowPkt);
-    pOpenFlowPkt = NULL;
-    return OFC_SUCCESS;
+    if (totalWeight == 0)
+    {
+        /* TODO: Send OFPGMFC_INVALID_GROUP error message */
+        printk (KERN_CRIT "Select group has no bucket with "
+                          "weight\r\n");
+        OfcDpFreeGroupEntry (pGroupEntry);
+        pGroupEntry = NULL;
+        return NULL;
+    }
+
+    bucketIndex = 0;
+    for (slot = 0; slot < OFC_GROUP_SELECT_SLOTS; slot++)
+    {
+        while (((slot * totalWeight) / OFC_GROUP_SELECT_SLOTS) >= 
+               aCumWeight[bucketIndex])
+        {
+            bucketIndex++;
+        }
+        pGroupEntry->aSelectMap[slot] = bucketIndex;
+    }
+
+    return pGroupEntry;
 }
 
 /******************************************************************                                                                          
-* Function: OfcCpHandleMultipartPortDesc
-*
-* Description: This function handles multipart request
-*              for port description, and sends description of all
-*              OpenFlow ports present in the kernel module.
+* Function: OfcCpProcessMeterMod
 *
-* Input: pCntrlPkt - Pointer to Multipart Request packet
-*        cntrlPktLen - Multipart Request packet length
+* Description: This function processes meter mod messages received
+*              from the controller and adds, modifies or deletes
+*              meters in the meter table
+*
+* Input: pPkt - Pointer to control packet
+*        pktLen - Length of control packet
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpProcessMeterMod (__u8 *pPkt, __u16 pktLen)
+{
+    tOfcMeterModHdr *pMeterMod = NULL;
+    tOfcMeterEntry  *pMeterEntry = NULL;
+    tDpCpMsgQ       msgQ;
+    __u16           meterModLen = 0;
+
+    printk (KERN_INFO "Meter Mod Message Rx\r\n");
+
+    if (pktLen < (OFC_OPENFLOW_HDR_LEN + sizeof (tOfcMeterModHdr)))
+    {
+        printk (KERN_CRIT "Invalid Meter Mod message length\r\n");
+        return OFC_FAILURE;
+    }
+
+    pMeterMod =
+        (tOfcMeterModHdr *) (void *) (pPkt + OFC_OPENFLOW_HDR_LEN);
+    meterModLen = pktLen - OFC_OPENFLOW_HDR_LEN;
+
+    memset (&msgQ, 0, sizeof (msgQ));
+    switch (ntohs (pMeterMod->command))
+    {
+        case OFPMC_ADD:
+            msgQ.msgType = OFC_METER_MOD_ADD;
+            break;
+
+        case OFPMC_MODIFY:
+            msgQ.msgType = OFC_METER_MOD_MODIFY;
+            break;
+
+        case OFPMC_DELETE:
+            msgQ.msgType = OFC_METER_MOD_DEL;
+            break;
+
+        default:
+            /* TODO: Send OFPMMFC_BAD_COMMAND error message */
+            printk (KERN_CRIT "Meter Mod command not supported!!\r\n");
+            return OFC_FAILURE;
+    }
+
+    pMeterEntry = OfcCpExtractMeter (pMeterMod, meterModLen);
+    if (pMeterEntry == NULL)
+    {
+        printk (KERN_CRIT "Failed to extract meter from Meter"
+                          " Mod message\r\n");
+        return OFC_FAILURE;
+    }
+
+    /* Send the extracted meter to data path task, which owns
+     * the meter table */
+    msgQ.pMeterEntry = pMeterEntry;
+    OfcCpSendToDpQ (&msgQ);
+    OfcDpSendEvent (OFC_CP_TO_DP_EVENT);
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpExtractMeter
+*
+* Description: This function extracts a meter entry from Meter Mod
+*              message. Token bucket depth and per-CPU batch size
+*              of each band are computed here so that data path
+*              only adds and compares tokens.
+*
+* Input: pMeterMod - Pointer to meter mod header
+*        meterModLen - Length of meter mod packet
+*
+* Output: None
+*
+* Returns: Pointer to meter entry
+*
+*******************************************************************/
+tOfcMeterEntry *OfcCpExtractMeter (tOfcMeterModHdr *pMeterMod,
+                                   __u16 meterModLen)
+{
+    tOfcMeterEntry   *pMeterEntry = NULL;
+    tOfcMeterBand    *pBand = NULL;
+    tOfcMeterBandTlv *pBandTlv = NULL;
+    __u64            nowNs = 0;
+    __u32            burstSize = 0;
+    __u16            bandsLen = 0;
+    __u16            bandLen = 0;
+    __u16            rateFlags = 0;
+
+    pMeterEntry = (tOfcMeterEntry *) kmalloc (sizeof (tOfcMeterEntry),
+                                              GFP_KERNEL);
+    if (pMeterEntry == NULL)
+    {
+        printk (KERN_CRIT "Failed to allocate memory for "
+                          "new meter\r\n");
+        return NULL;
+    }
+
+    memset (pMeterEntry, 0, sizeof (tOfcMeterEntry));
+    INIT_LIST_HEAD (&pMeterEntry->list);
+    pMeterEntry->meterId = ntohl (pMeterMod->meterId);
+    pMeterEntry->flags = ntohs (pMeterMod->flags);
+
+    if (ntohs (pMeterMod->command) == OFPMC_DELETE)
+    {
+        /* Only meter Id is needed to delete meter */
+        return pMeterEntry;
+    }
+
+    rateFlags = pMeterEntry->flags & (OFPMF_KBPS | OFPMF_PKTPS);
+    if (((pMeterEntry->meterId == 0) ||
+         (pMeterEntry->meterId > OFPM_MAX)) &&
+        (pMeterEntry->meterId != OFPM_CONTROLLER) &&
+        (pMeterEntry->meterId != OFPM_SLOWPATH))
+    {
+        /* TODO: Send OFPMMFC_INVALID_METER error message */
+        printk (KERN_CRIT "Invalid meter Id %u\r\n",
+                pMeterEntry->meterId);
+        kfree (pMeterEntry);
+        pMeterEntry = NULL;
+        return NULL;
+    }
+
+    if ((rateFlags != OFPMF_KBPS) && (rateFlags != OFPMF_PKTPS))
+    {
+        /* TODO: Send OFPMMFC_BAD_FLAGS error message */
+        printk (KERN_CRIT "Meter must be either kbps or pktps\r\n");
+        kfree (pMeterEntry);
+        pMeterEntry = NULL;
+        return NULL;
+    }
+
+    pMeterEntry->pCpuState = alloc_percpu (tOfcMeterCpuState);
+    if (pMeterEntry->pCpuState == NULL)
+    {
+        printk (KERN_CRIT "Failed to allocate meter state\r\n");
+        kfree (pMeterEntry);
+        pMeterEntry = NULL;
+        return NULL;
+    }
+
+    /* Extract bands */
+    nowNs = ktime_get_ns();
+    pBandTlv = (tOfcMeterBandTlv *) (void *) 
+                (((__u8 *) pMeterMod) + sizeof (tOfcMeterModHdr));
+    bandsLen = meterModLen - sizeof (tOfcMeterModHdr);
+    while (bandsLen >= sizeof (tOfcMeterBandTlv))
+    {
+        bandLen = ntohs (pBandTlv->length);
+        if ((bandLen < sizeof (tOfcMeterBandTlv)) ||
+            (bandLen > bandsLen))
+        {
+            printk (KERN_CRIT "Invalid meter band length\r\n");
+            OfcDpFreeMeterEntry (pMeterEntry);
+            pMeterEntry = NULL;
+            return NULL;
+        }
+
+        if (pMeterEntry->numBands >= OFC_MAX_METER_BANDS)
+        {
+            /* TODO: Send OFPMMFC_OUT_OF_BANDS error message */
+            printk (KERN_CRIT "Meter supports maximum %d bands\r\n",
+                    OFC_MAX_METER_BANDS);
+            OfcDpFreeMeterEntry (pMeterEntry);
+            pMeterEntry = NULL;
+            return NULL;
+        }
+
+        pBand = &pMeterEntry->aBands[pMeterEntry->numBands];
+        pBand->type = ntohs (pBandTlv->type);
+        pBand->rate = ntohl (pBandTlv->rate);
+        pBand->burstSize = ntohl (pBandTlv->burstSize);
+        pBand->precLevel = pBandTlv->precLevel;
+
+        if (((pBand->type != OFPMBT_DROP) &&
+             (pBand->type != OFPMBT_DSCP_REMARK)) ||
+            (pBand->rate == 0))
+        {
+            /* TODO: Send OFPMMFC_BAD_BAND/BAD_RATE error message */
+            printk (KERN_CRIT "Invalid meter band type %d or "
+                              "rate %u\r\n", pBand->type, pBand->rate);
+            OfcDpFreeMeterEntry (pMeterEntry);
+            pMeterEntry = NULL;
+            return NULL;
+        }
+
+        /* Without burst flag, bucket holds one second of traffic */
+        burstSize = ((pMeterEntry->flags & OFPMF_BURST) &&
+                     (pBand->burstSize != 0)) ? 
+                    pBand->burstSize : pBand->rate;
+        pBand->burstUnits = (__s64) burstSize * OFC_METER_UNITS_PER_BURST;
+        pBand->batchUnits = pBand->burstUnits / 
+                            (OFC_METER_BATCH_DIV * num_possible_cpus());
+
+        /* Bucket starts full */
+        atomic64_set (&pBand->tokens, pBand->burstUnits);
+        atomic64_set (&pBand->lastRefillNs, nowNs);
+        pMeterEntry->numBands++;
+
+        bandsLen -= bandLen;
+        pBandTlv = (tOfcMeterBandTlv *) (void *) 
+                    (((__u8 *) pBandTlv) + bandLen);
+    }
+
+    return pMeterEntry;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpProcessPortMod
+*
+* Description: This function processes port mod messages received
+*              from the controller and updates port configuration
+*              in data path
+*
+* Input: pPkt - Pointer to control packet
+*        pktLen - Length of control packet
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpProcessPortMod (__u8 *pPkt, __u16 pktLen)
+{
+    tOfcPortModHdr  *pPortMod = NULL;
+    tDpCpMsgQ       msgQ;
+    __u32           portNo = 0;
+
+    printk (KERN_INFO "Port Mod Message Rx\r\n");
+
+    if (pktLen < (OFC_OPENFLOW_HDR_LEN + sizeof (tOfcPortModHdr)))
+    {
+        printk (KERN_CRIT "Invalid Port Mod message length\r\n");
+        return OFC_FAILURE;
+    }
+
+    pPortMod = (tOfcPortModHdr *) (void *) (pPkt + OFC_OPENFLOW_HDR_LEN);
+    portNo = ntohl (pPortMod->portNo);
+    if ((portNo < 1) || (portNo > gNumOpenFlowIf))
+    {
+        /* TODO: Send OFPPMFC_BAD_PORT error message */
+        printk (KERN_CRIT "Invalid port %u in Port Mod\r\n", portNo);
+        return OFC_FAILURE;
+    }
+
+    /* Port configuration is owned by data path task */
+    memset (&msgQ, 0, sizeof (msgQ));
+    msgQ.msgType = OFC_PORT_MOD;
+    msgQ.inPort = portNo - 1;
+    msgQ.portConfig = ntohl (pPortMod->config);
+    msgQ.portConfigMask = ntohl (pPortMod->mask);
+    OfcCpSendToDpQ (&msgQ);
+    OfcDpSendEvent (OFC_CP_TO_DP_EVENT);
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpProcessMultipartReq
+*
+* Description: This function processes multicast request packet
+*              and sends appropriate reply
+*
+* Input: pPkt - Pointer to Multipart Request packet
+*        pktLen - Multipart Request packet length
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpProcessMultipartReq (__u8 *pCntrlPkt, __u16 cntrlPktLen)
+{
+    tOfcMultipartHeader *pMultReq = NULL;
+
+    printk (KERN_INFO "Multipart Request Rx\r\n");
+
+    pMultReq = (tOfcMultipartHeader *)(pCntrlPkt + 
+                                       OFC_OPENFLOW_HDR_LEN);
+    switch (ntohs (pMultReq->type))
+    {
+        case OFPMP_DESC:
+        {
+            if (OfcCpHandleMultipartSwitchDesc (pCntrlPkt, cntrlPktLen) 
+                != OFC_SUCCESS)
+            {
+                printk (KERN_CRIT "Failed to send Multipart Switch"
+                                  " Desc Reply\r\n");
+                return OFC_FAILURE;
+            }
+            break;
+        }
+
+        case OFPMP_FLOW:
+        case OFPMP_AGGREGATE:
+        {
+            if (OfcCpHandleMultipartFlowStats (pCntrlPkt, cntrlPktLen)
+                != OFC_SUCCESS)
+            {
+                printk (KERN_CRIT "Failed to process Multipart Flow"
+                                  " Stats Request\r\n");
+                return OFC_FAILURE;
+            }
+            break;
+        }
+
+        case OFPMP_PORT_DESC:
+        {
+            if (OfcCpHandleMultipartPortDesc (pCntrlPkt, cntrlPktLen) 
+                != OFC_SUCCESS)
+            {
+                printk (KERN_CRIT "Failed to send Multipart Port" 
+                                  " Desc Reply\r\n");
+                return OFC_FAILURE;
+            }
+
+            break;
+        }
+
+        case OFPMP_PORT_STATS:
+        {
+            if (OfcCpHandleMultipartPortStats (pCntrlPkt, cntrlPktLen)
+                != OFC_SUCCESS)
+            {
+                printk (KERN_CRIT "Failed to send Multipart Port"
+                                  " Stats Reply\r\n");
+                return OFC_FAILURE;
+            }
+            break;
+        }
+
+        case OFPMP_TABLE:
+        {
+            if (OfcCpHandleMultipartTableStats (pCntrlPkt, cntrlPktLen)
+                != OFC_SUCCESS)
+            {
+                printk (KERN_CRIT "Failed to send Multipart Table"
+                                  " Stats Reply\r\n");
+                return OFC_FAILURE;
+            }
+            break;
+        }
+
+        case OFPMP_QUEUE:
+        case OFPMP_GROUP:
+        case OFPMP_GROUP_DESC:
+        case OFPMP_GROUP_FEATURES:
+        case OFPMP_METER:
+        case OFPMP_METER_CONFIG:
+        case OFPMP_METER_FEATURES:
+        case OFPMP_TABLE_FEATURES:
+        case OFPMP_EXPERIMENTER:
+        default:
+            printk(KERN_INFO "The Multipart Type is not currently supported \n");
+            return OFC_FAILURE;
+
+    }
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpHandleMultipartSwitchDesc
+*
+* Description: This function handles multipart request for
+*              switch description, and sends description of
+*              OpenFlow client kernel module.
+*
+* Input: pCntrlPkt - Pointer to Multipart Request packet
+*        cntrlPktLen - Multipart Request packet length
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpHandleMultipartSwitchDesc (__u8 *pCntrlPkt, 
+                                    __u16 cntrlPktLen)
+{
+    tOfcMultipartHeader  *pMultipartHeader  = NULL;
+    tOfcMultipartSwDesc  *pMultipartSwDesc = NULL;
+    __u8                 *pOpenFlowPkt = NULL;
+    __u16                descLen = 0;
+
+    printk (KERN_INFO "Multipart Switch Desc Rx\r\n");
+
+    descLen = sizeof (tOfcMultipartHeader) + 
+              sizeof (tOfcMultipartSwDesc);
+    pMultipartHeader = (tOfcMultipartHeader *) kmalloc (descLen,
+                                                        GFP_KERNEL);
+    if (pMultipartHeader == NULL)
+    {
+        printk (KERN_CRIT "Failed to allocate memory to Multipart"
+                " Switch Desc message\r\n");
+        return OFC_FAILURE;
+    }
+
+    memset(pMultipartHeader, 0, descLen);
+    pMultipartHeader->type = htons(OFPMP_DESC);
+
+    pMultipartSwDesc = (tOfcMultipartSwDesc *) (void *)
+                       (((__u8 *) pMultipartHeader) +
+                        sizeof (tOfcMultipartHeader));
+
+    strcpy (pMultipartSwDesc->mfcDesc, OFC_MNF_DESC);
+    strcpy (pMultipartSwDesc->hwDesc, OFC_HW_DESC);
+    strcpy (pMultipartSwDesc->swDesc, OFC_SW_DESC);
+    strcpy (pMultipartSwDesc->serialNum, OFC_SERIAL_NUM);
+    strcpy (pMultipartSwDesc->dpDesc, OFC_DATAPATH_DESC);
+
+    if (OfcCpAddOpenFlowHdr ((__u8 *) pMultipartHeader,
+                             descLen, OFPT_MULTIPART_REPLY,
+                             ((tOfcOfHdr *) pCntrlPkt)->xid, 
+                             &pOpenFlowPkt) != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Failed to construct multipart switch "
+                          "description message\r\n");
+        kfree (pMultipartHeader);
+        pMultipartHeader = NULL;
+        return OFC_FAILURE;
+    }
+
+    if (OfcCpSendCntrlPktFromSock (pOpenFlowPkt, 
+        ntohs (((tOfcOfHdr *) pOpenFlowPkt)->length)) 
+        != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Failed to send multipart switch "
+                          "description message\r\n");
+        kfree (pMultipartHeader);
+        pMultipartHeader = NULL;
+        kfree (pOpenFlowPkt);
+        pOpenFlowPkt = NULL;
+        return OFC_FAILURE;
+    }
+
+    printk (KERN_INFO "Multipart Switch Desc Tx\r\n");
+
+    kfree (pMultipartHeader);
+    pMultipartHeader = NULL;
+    kfree (pOpenFlowPkt);
+    pOpenFlowPkt = NULL;
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpHandleMultipartPortDesc
+*
+* Description: This function handles multipart request
+*              for port description, and sends description of all
+*              OpenFlow ports present in the kernel module.
+*
+* Input: pCntrlPkt - Pointer to Multipart Request packet
+*        cntrlPktLen - Multipart Request packet length
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpHandleMultipartPortDesc (__u8 *pCntrlPkt, __u16 cntrlPktLen)
+{
+    tOfcMultipartHeader    *pMultipartHeader     = NULL;
+    tOfcMultipartPortDesc  *pMultipartPortDesc   = NULL;
+    struct net_device      *pNetDevice           = NULL;
+    __u8                   *pOpenFlowPkt         = NULL;
+    __u32                  pktLength             = 0;
+    int                    dataIfNum             = 0;
+
+    printk (KERN_INFO "Multipart Port Desc Rx\r\n");
+
+    pMultipartHeader = (tOfcMultipartHeader *) kmalloc (OFC_MTU_SIZE, 
+                                                        GFP_KERNEL);
+    if (pMultipartHeader == NULL)
+    {
+        printk(KERN_CRIT "Failed to allocate memory for multipart"
+               " port desc message\r\n");
+        return OFC_FAILURE;
+    }
+
+    memset (pMultipartHeader, 0, OFC_MTU_SIZE);
+    pktLength = sizeof (tOfcMultipartHeader);
+    pMultipartHeader->type = htons (OFPMP_PORT_DESC);
+
+    pMultipartPortDesc = (tOfcMultipartPortDesc *) (void *) 
+                         (((__u8 *) pMultipartHeader) + 
+                          sizeof (tOfcMultipartHeader));
+
+    for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; dataIfNum++)
+    {
+        pNetDevice = OfcGetNetDevByName (gpOpenFlowIf[dataIfNum]);
+        if (pNetDevice == NULL)
+        {
+            printk (KERN_CRIT "[%s]: Failed to fetch OpenFlow "
+                              "interface name\r\n", __func__);
+            continue;
+        }
+
+        /* Port n corresponds to n+1 in controller */
+        pMultipartPortDesc->portNo = htonl (dataIfNum + 1);
+        memcpy (pMultipartPortDesc->hwAddr, pNetDevice->dev_addr, 
+                OFC_MAC_ADDR_LEN);
+        strcpy (pMultipartPortDesc->ifName, 
+                gpOpenFlowIf[dataIfNum]);
+
+        if (!netif_carrier_ok (pNetDevice))
+        {
+            pMultipartPortDesc->state |= OFPPS_LINK_DOWN;
+        }
+        else
+        {
+            pMultipartPortDesc->state &= (~(OFPPS_LINK_DOWN));
+        }
+        pMultipartPortDesc->state = htonl (pMultipartPortDesc->state);
+        pMultipartPortDesc->config = 
+            htonl (gOfcDpGlobals.aPortConfig[dataIfNum]);
+
+        /* Not updating state, current, advertised, supported,
+         * curr speed, max speed because data interfaces are
+         * virtual interfaces in ExoGeni that do not store
+         * speed information in ethtool */
+
+        pktLength += sizeof (tOfcMultipartPortDesc);
+        pMultipartPortDesc = (tOfcMultipartPortDesc *) (void *)
+                             (((__u8 *) pMultipartPortDesc) +
+                              sizeof (tOfcMultipartPortDesc));
+    }
+
+    if (OfcCpAddOpenFlowHdr ((__u8 *) pMultipartHeader,
+                             pktLength, OFPT_MULTIPART_REPLY,
+                             ((tOfcOfHdr *) pCntrlPkt)->xid, 
+                             &pOpenFlowPkt) != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Failed to construct multipart port "
+                          "description message\r\n");
+        kfree (pMultipartHeader);
+        pMultipartHeader = NULL;
+        return OFC_FAILURE;
+    }
+
+    if (OfcCpSendCntrlPktFromSock (pOpenFlowPkt, 
+        ntohs (((tOfcOfHdr *) pOpenFlowPkt)->length)) 
+        != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Failed to send multipart port "
+                          "description message\r\n");
+        kfree (pMultipartHeader);
+        pMultipartHeader = NULL;
+        kfree (pOpenFlowPkt);
+        pOpenFlowPkt = NULL;
+        return OFC_FAILURE;
+    }
+
+    printk (KERN_INFO "Multipart Port Desc Tx\r\n");
+
+    kfree (pMultipartHeader);
+    pMultipartHeader = NULL;
+    kfree (pOpenFlowPkt);
+    pOpenFlowPkt = NULL;
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpHandleMultipartPortStats
+*
+* Description: This function handles multipart request for port
+*              statistics, and sends statistics of requested port
+*              or of all ports
+*
+* Input: pCntrlPkt - Pointer to Multipart Request packet
+*        cntrlPktLen - Multipart Request packet length
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpHandleMultipartPortStats (__u8 *pCntrlPkt, __u16 cntrlPktLen)
+{
+    tOfcMultipartHeader    *pMultipartHeader = NULL;
+    tOfcPortStatsReq       *pPortStatsReq = NULL;
+    tOfcPortStatsReply     *pPortStatsReply = NULL;
+    tOfcPortStats          portStats;
+    __u8                   *pOpenFlowPkt = NULL;
+    __u32                  pktLength = 0;
+    __u32                  portNo = 0;
+    __u64                  durationNs = 0;
+    __u32                  durationNsec = 0;
+    int                    dataIfNum = 0;
+
+    printk (KERN_INFO "Multipart Port Stats Rx\r\n");
+
+    if (cntrlPktLen < (OFC_OPENFLOW_HDR_LEN + sizeof (tOfcMultipartHeader) +
+                       sizeof (tOfcPortStatsReq)))
+    {
+        printk (KERN_CRIT "Invalid port stats request length\r\n");
+        OfcCpSendErrorMsg (pCntrlPkt, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN);
+        return OFC_FAILURE;
+    }
+
+    pPortStatsReq = (tOfcPortStatsReq *) (void *)
+                    (pCntrlPkt + OFC_OPENFLOW_HDR_LEN + 
+                     sizeof (tOfcMultipartHeader));
+    portNo = ntohl (pPortStatsReq->portNo);
+    if ((portNo != OFPP_ANY) && 
+        ((portNo == 0) || (portNo > gNumOpenFlowIf)))
+    {
+        printk (KERN_CRIT "Invalid port %u in port stats "
+                          "request\r\n", portNo);
+        OfcCpSendErrorMsg (pCntrlPkt, OFPET_BAD_REQUEST, OFPBRC_BAD_PORT);
+        return OFC_FAILURE;
+    }
+
+    pMultipartHeader = (tOfcMultipartHeader *) kmalloc (OFC_MTU_SIZE, 
+                                                        GFP_KERNEL);
+    if (pMultipartHeader == NULL)
+    {
+        printk(KERN_CRIT "Failed to allocate memory for multipart"
+               " port stats message\r\n");
+        return OFC_FAILURE;
+    }
+
+    memset (pMultipartHeader, 0, OFC_MTU_SIZE);
+    pktLength = sizeof (tOfcMultipartHeader);
+    pMultipartHeader->type = htons (OFPMP_PORT_STATS);
+
+    pPortStatsReply = (tOfcPortStatsReply *) (void *) 
+                      (((__u8 *) pMultipartHeader) + 
+                       sizeof (tOfcMultipartHeader));
+
+    /* All ports share start time of port statistics */
+    durationNs = ktime_get_ns() - gOfcDpGlobals.portStartNs;
+    durationNsec = do_div (durationNs, NSEC_PER_SEC);
+
+    for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; dataIfNum++)
+    {
+        /* Port n corresponds to n+1 in controller */
+        if ((portNo != OFPP_ANY) && (portNo != (dataIfNum + 1)))
+        {
+            continue;
+        }
+
+        /* Counters are summed from per-CPU copies without stopping
+         * data path */
+        if (OfcDpGetPortStats (dataIfNum, &portStats) != OFC_SUCCESS)
+        {
+            continue;
+        }
+
+        pPortStatsReply->portNo = htonl (dataIfNum + 1);
+        OfcSetEightByte (&pPortStatsReply->rxPktCount, 
+                         portStats.rxPktCount);
+        OfcSetEightByte (&pPortStatsReply->txPktCount, 
+                         portStats.txPktCount);
+        OfcSetEightByte (&pPortStatsReply->rxByteCount,
+                         portStats.rxByteCount);
+        OfcSetEightByte (&pPortStatsReply->txByteCount,
+                         portStats.txByteCount);
+        OfcSetEightByte (&pPortStatsReply->rxDropCount,
+                         portStats.rxDropCount);
+        OfcSetEightByte (&pPortStatsReply->txDropCount,
+                         portStats.txDropCount);
+        OfcSetEightByte (&pPortStatsReply->rxErrorCount,
+                         portStats.rxErrorCount);
+        OfcSetEightByte (&pPortStatsReply->txErrorCount,
+                         portStats.txErrorCount);
+
+        /* Unsupported counters are set to all ones */
+        memset (&pPortStatsReply->rxFrameErrCount, 0xff,
+                4 * sizeof (tOfcEightByte));
+        pPortStatsReply->durationSec = htonl ((__u32) durationNs);
+        pPortStatsReply->durationNsec = htonl (durationNsec);
+
+        pktLength += sizeof (tOfcPortStatsReply);
+        pPortStatsReply = (tOfcPortStatsReply *) (void *)
+                          (((__u8 *) pPortStatsReply) +
+                           sizeof (tOfcPortStatsReply));
+    }
+
+    if (OfcCpAddOpenFlowHdr ((__u8 *) pMultipartHeader,
+                             pktLength, OFPT_MULTIPART_REPLY,
+                             ((tOfcOfHdr *) pCntrlPkt)->xid, 
+                             &pOpenFlowPkt) != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Failed to construct multipart port "
+                          "stats message\r\n");
+        kfree (pMultipartHeader);
+        pMultipartHeader = NULL;
+        return OFC_FAILURE;
+    }
+
+    if (OfcCpSendCntrlPktFromSock (pOpenFlowPkt, 
+        ntohs (((tOfcOfHdr *) pOpenFlowPkt)->length)) 
+        != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Failed to send multipart port "
+                          "stats message\r\n");
+        kfree (pMultipartHeader);
+        pMultipartHeader = NULL;
+        kfree (pOpenFlowPkt);
+        pOpenFlowPkt = NULL;
+        return OFC_FAILURE;
+    }
+
+    printk (KERN_INFO "Multipart Port Stats Tx\r\n");
+
+    kfree (pMultipartHeader);
+    pMultipartHeader = NULL;
+    kfree (pOpenFlowPkt);
+    pOpenFlowPkt = NULL;
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpHandleMultipartTableStats
+*
+* Description: This function handles multipart request for table
+*              statistics. Counters of flow tables are written only
+*              by data path task, and are read here without lock
+*
+* Input: pCntrlPkt - Pointer to Multipart Request packet
+*        cntrlPktLen - Multipart Request packet length
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpHandleMultipartTableStats (__u8 *pCntrlPkt, 
+                                    __u16 cntrlPktLen)
+{
+    tOfcMultipartHeader    *pMultipartHeader = NULL;
+    tOfcTableStats         *pTableStats = NULL;
+    tOfcFlowTable          *pFlowTable = NULL;
+    struct list_head       *pList = NULL;
+    __u8                   *pOpenFlowPkt = NULL;
+    __u32                  pktLength = 0;
+
+    printk (KERN_INFO "Multipart Table Stats Rx\r\n");
+
+    pktLength = sizeof (tOfcMultipartHeader) + 
+                (OFC_MAX_FLOW_TABLES * sizeof (tOfcTableStats));
+    pMultipartHeader = (tOfcMultipartHeader *) kmalloc (pktLength, 
+                                                        GFP_KERNEL);
+    if (pMultipartHeader == NULL)
+    {
+        printk(KERN_CRIT "Failed to allocate memory for multipart"
+               " table stats message\r\n");
+        return OFC_FAILURE;
+    }
+
+    memset (pMultipartHeader, 0, pktLength);
+    pktLength = sizeof (tOfcMultipartHeader);
+    pMultipartHeader->type = htons (OFPMP_TABLE);
+
+    pTableStats = (tOfcTableStats *) (void *) 
+                  (((__u8 *) pMultipartHeader) + 
+                   sizeof (tOfcMultipartHeader));
+
+    /* Flow tables are created at init and never deleted, so list
+     * can be walked while data path is running */
+    list_for_each (pList, &gOfcDpGlobals.flowTableListHead)
+    {
+        pFlowTable = (tOfcFlowTable *) pList;
+
+        pTableStats->tableId = (__u8) pFlowTable->tableId;
+        pTableStats->activeCount = 
+            htonl (ACCESS_ONCE (pFlowTable->activeCount));
+        OfcSetEightByte (&pTableStats->lookupCount,
+                         ACCESS_ONCE (pFlowTable->lookupCount));
+        OfcSetEightByte (&pTableStats->matchCount,
+                         ACCESS_ONCE (pFlowTable->matchCount));
+
+        pktLength += sizeof (tOfcTableStats);
+        pTableStats++;
+    }
+
+    if (OfcCpAddOpenFlowHdr ((__u8 *) pMultipartHeader,
+                             pktLength, OFPT_MULTIPART_REPLY,
+                             ((tOfcOfHdr *) pCntrlPkt)->xid, 
+                             &pOpenFlowPkt) != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Failed to construct multipart table "
+                          "stats message\r\n");
+        kfree (pMultipartHeader);
+        pMultipartHeader = NULL;
+        return OFC_FAILURE;
+    }
+
+    if (OfcCpSendCntrlPktFromSock (pOpenFlowPkt, 
+        ntohs (((tOfcOfHdr *) pOpenFlowPkt)->length)) 
+        != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Failed to send multipart table "
+                          "stats message\r\n");
+        kfree (pMultipartHeader);
+        pMultipartHeader = NULL;
+        kfree (pOpenFlowPkt);
+        pOpenFlowPkt = NULL;
+        return OFC_FAILURE;
+    }
+
+    printk (KERN_INFO "Multipart Table Stats Tx\r\n");
+
+    kfree (pMultipartHeader);
+    pMultipartHeader = NULL;
+    kfree (pOpenFlowPkt);
+    pOpenFlowPkt = NULL;
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpHandleMultipartFlowStats
+*
+* Description: This function handles multipart request for flow
+*              or aggregate stats. Request is sent to data path task
+*              after earlier flow mods, and data path returns reply
+*              in segments, see OfcDpCollectFlowStats
+*
+* Input: pCntrlPkt - Pointer to Multipart Request packet
+*        cntrlPktLen - Multipart Request packet length
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpHandleMultipartFlowStats (__u8 *pCntrlPkt, __u16 cntrlPktLen)
+{
+    tOfcMultipartHeader *pMultReq = NULL;
+    tOfcFlowStatsReq    *pFlowStatsReq = NULL;
+    tOfcFlowEntry       *pFilter = NULL;
+    tOfcStatsReq        *pStatsReq = NULL;
+    tDpCpMsgQ           msgQ;
+    int                 segSize = 0;
+
+    printk (KERN_INFO "Multipart Flow Stats Rx\r\n");
+
+    if (cntrlPktLen < (OFC_OPENFLOW_HDR_LEN + sizeof (tOfcMultipartHeader) +
+                       sizeof (tOfcFlowStatsReq)))
+    {
+        printk (KERN_CRIT "Invalid flow stats request length\r\n");
+        OfcCpSendErrorMsg (pCntrlPkt, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN);
+        return OFC_FAILURE;
+    }
+
+    pMultReq = (tOfcMultipartHeader *) (void *) 
+               (pCntrlPkt + OFC_OPENFLOW_HDR_LEN);
+    pFlowStatsReq = (tOfcFlowStatsReq *) (void *)
+                    (((__u8 *) pMultReq) + sizeof (tOfcMultipartHeader));
+
+    pFilter = (tOfcFlowEntry *) kmalloc (sizeof (tOfcFlowEntry),
+                                         GFP_KERNEL);
+    if (pFilter == NULL)
+    {
+        printk (KERN_CRIT "Failed to allocate memory for flow "
+                          "stats filter\r\n");
+        return OFC_FAILURE;
+    }
+
+    memset (pFilter, 0, sizeof (tOfcFlowEntry));
+    pFilter->tableId = pFlowStatsReq->tableId;
+    pFilter->outPort = ntohl (pFlowStatsReq->outPort);
+    pFilter->outGrp = ntohl (pFlowStatsReq->outGrp);
+    pFilter->cookie = pFlowStatsReq->cookie;
+    pFilter->cookieMask = pFlowStatsReq->cookieMask;
+    INIT_LIST_HEAD (&pFilter->matchList);
+    INIT_LIST_HEAD (&pFilter->instrList);
+
+    /* Match is at same offset from multipart header as from flow
+     * mod header */
+    if (OfcCpAddMatchFieldsInFlow ((tOfcFlowModHdr *) (void *) pMultReq,
+                                   cntrlPktLen - OFC_OPENFLOW_HDR_LEN,
+                                   pFilter) != OFC_SUCCESS)
+    {
+        OfcDpFreeFlowEntry (pFilter);
+        pFilter = NULL;
+        return OFC_FAILURE;
+    }
+
+    pStatsReq = (tOfcStatsReq *) kmalloc (sizeof (tOfcStatsReq),
+                                          GFP_KERNEL);
+    if (pStatsReq == NULL)
+    {
+        printk (KERN_CRIT "Failed to allocate memory for flow "
+                          "stats request\r\n");
+        OfcDpFreeFlowEntry (pFilter);
+        pFilter = NULL;
+        return OFC_FAILURE;
+    }
+
+    /* Reply segments are sized to half of socket send buffer, so
+     * that a segment can be queued while previous one is sent */
+    segSize = gOfcCpGlobals.pRxConn->pSocket->sk->sk_sndbuf / 2;
+    segSize -= OFC_MULTIPART_HDR_ROOM;
+    if (segSize < OFC_STATS_SEG_MIN)
+    {
+        segSize = OFC_STATS_SEG_MIN;
+    }
+    else if (segSize > OFC_STATS_SEG_MAX)
+    {
+        segSize = OFC_STATS_SEG_MAX;
+    }
+
+    memset (pStatsReq, 0, sizeof (tOfcStatsReq));
+    pStatsReq->pConn = gOfcCpGlobals.pRxConn;
+    pStatsReq->xid = ((tOfcOfHdr *) pCntrlPkt)->xid;
+    pStatsReq->type = ntohs (pMultReq->type);
+    pStatsReq->segSize = segSize;
+    pStatsReq->pFilter = pFilter;
+
+    memset (&msgQ, 0, sizeof (msgQ));
+    msgQ.msgType = OFC_FLOW_STATS;
+    msgQ.pStatsReq = pStatsReq;
+    OfcCpSendToDpQ (&msgQ);
+    OfcDpSendEvent (OFC_CP_TO_DP_EVENT);
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpSendStatsReply
+*
+* Description: This function sends a flow or aggregate stats reply
+*              segment collected by data path. All segments except
+*              the last carry OFPMPF_REPLY_MORE flag
+*
+* Input: pMsgQ - Message with reply segment from data path
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpSendStatsReply (tDpCpMsgQ *pMsgQ)
+{
+    tOfcStatsReq        *pStatsReq = pMsgQ->pStatsReq;
+    tOfcOfHdr           *pOfHdr = NULL;
+    tOfcMultipartHeader *pMultipartHeader = NULL;
+    int                 retVal = OFC_FAILURE;
+
+    /* Data path reserved room for headers at start of segment */
+    pOfHdr = (tOfcOfHdr *) (void *) pMsgQ->pPkt;
+    pOfHdr->version = OFC_VERSION;
+    pOfHdr->type = OFPT_MULTIPART_REPLY;
+    pOfHdr->length = htons ((__u16) pMsgQ->pktLen);
+    pOfHdr->xid = pStatsReq->xid;
+
+    pMultipartHeader = (tOfcMultipartHeader *) (void *)
+                       (pMsgQ->pPkt + OFC_OPENFLOW_HDR_LEN);
+    memset (pMultipartHeader, 0, sizeof (tOfcMultipartHeader));
+    pMultipartHeader->type = htons (pStatsReq->type);
+    pMultipartHeader->flags = (pMsgQ->isLastSeg == OFC_TRUE) ? 0 :
+                              htons (OFPMPF_REPLY_MORE);
+
+    /* Connection may have been lost while stats were collected */
+    if (pStatsReq->pConn->state == OFC_CNTRL_CONNECTED)
+    {
+        retVal = OfcCpSendCntrlPktOnConn (pStatsReq->pConn, pMsgQ->pPkt,
+                                          pMsgQ->pktLen);
+        if (retVal != OFC_SUCCESS)
+        {
+            printk (KERN_CRIT "Failed to send multipart flow stats "
+                              "reply\r\n");
+        }
+    }
+
+    kfree (pMsgQ->pPkt);
+    pMsgQ->pPkt = NULL;
+    if (pMsgQ->isLastSeg == OFC_TRUE)
+    {
+        printk (KERN_INFO "Multipart Flow Stats Tx\r\n");
+        kfree (pStatsReq);
+        pStatsReq = NULL;
+    }
+
+    return retVal;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpSendBarrierReply
+*
+* Description: This function sends barrier reply message to the
+*              controller.
+*
+* Input: pConn - Controller connection barrier was received on
+*        xid - Transaction ID.
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpSendBarrierReply (tOfcCntrlConn *pConn, __u32 xid)
+{
+    __u8  *pBarrierReply = NULL;
+
+    if (OfcCpAddOpenFlowHdr (NULL, 0, OFPT_BARRIER_REPLY, xid, 
+                             &pBarrierReply)
+        != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Failed to construct Barrier Reply\r\n");
+        return OFC_FAILURE;
+    }
+
+    if (OfcCpSendCntrlPktOnConn (pConn, pBarrierReply, 
+                                 OFC_OPENFLOW_HDR_LEN)
+        != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Failed to send Barrier Reply\r\n");
+        kfree (pBarrierReply);
+        pBarrierReply = NULL;
+        return OFC_FAILURE;
+    }
+
+    printk (KERN_INFO "Barrier Reply Tx\r\n");
+
+    kfree (pBarrierReply);
+    pBarrierReply = NULL;
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpProcessBarrierReq
+*
+* Description: This function processes barrier request. Barrier
+*              reply is sent once data path has applied all
+*              messages sent to it before the barrier, so that
+*              controller can pipeline messages between barriers.
+*
+* Input: xid - Transaction ID.
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpProcessBarrierReq (__u32 xid)
+{
+    tOfcBarrierEntry *pBarrier = NULL;
+    __u32            commitSeqNum = 0;
+
+    printk (KERN_INFO "Barrier Request Rx\r\n");
+
+    commitSeqNum = smp_load_acquire (&gOfcDpGlobals.commitSeqNum);
+    if ((commitSeqNum == gOfcCpGlobals.cmdSeqNum) &&
+        (list_empty (&gOfcCpGlobals.barrierList)))
+    {
+        /* No message pending in data path */
+        return OfcCpSendBarrierReply (gOfcCpGlobals.pRxConn, xid);
+    }
+
+    pBarrier = (tOfcBarrierEntry *) kmalloc (sizeof(tOfcBarrierEntry),
+                                             GFP_KERNEL);
+    if (pBarrier == NULL)
+    {
+        printk (KERN_CRIT "Failed to allocate memory to barrier "
+                          "entry\r\n");
+        return OFC_FAILURE;
+    }
+
+    memset (pBarrier, 0, sizeof(tOfcBarrierEntry));
+    pBarrier->pConn = gOfcCpGlobals.pRxConn;
+    pBarrier->xid = xid;
+    pBarrier->seqNum = gOfcCpGlobals.cmdSeqNum;
+    list_add_tail (&pBarrier->node, &gOfcCpGlobals.barrierList);
+
+    /* Data path may have applied messages before barrier was
+     * queued */
+    OfcCpRxDataPathCommit();
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpRxDataPathCommit
+*
+* Description: This function sends barrier replies for barriers
+*              whose earlier messages have been applied by data
+*              path. Barriers are replied in order they were
+*              received.
+*
+* Input: None
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcCpRxDataPathCommit (void)
+{
+    tOfcBarrierEntry *pBarrier = NULL;
+    struct list_head *pNode = NULL;
+    struct list_head *pTemp = NULL;
+    __u32            commitSeqNum = 0;
+
+    commitSeqNum = smp_load_acquire (&gOfcDpGlobals.commitSeqNum);
+
+    /* Stats replies queued by data path before commit must reach
+     * the controller before barrier replies */
+    OfcCpRxDataPathMsg (OFC_TRUE);
+
+    list_for_each_safe (pNode, pTemp, &gOfcCpGlobals.barrierList)
+    {
+        pBarrier = list_entry (pNode, tOfcBarrierEntry, node);
+
+        /* Sequence numbers wrap, compare as signed difference */
+        if ((__s32) (commitSeqNum - pBarrier->seqNum) < 0)
+        {
+            break;
+        }
+
+        OfcCpSendBarrierReply (pBarrier->pConn, pBarrier->xid);
+        list_del (&pBarrier->node);
+        kfree (pBarrier);
+        pBarrier = NULL;
+    }
+
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpDeleteBarriers
+*
+* Description: This function discards pending barriers received on
+*              a controller connection that is closed
+*
+* Input: pConn - Controller connection
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcCpDeleteBarriers (tOfcCntrlConn *pConn)
+{
+    tOfcBarrierEntry *pBarrier = NULL;
+    struct list_head *pNode = NULL;
+    struct list_head *pTemp = NULL;
+
+    list_for_each_safe (pNode, pTemp, &gOfcCpGlobals.barrierList)
+    {
+        pBarrier = list_entry (pNode, tOfcBarrierEntry, node);
+        if (pBarrier->pConn == pConn)
+        {
+            list_del (&pBarrier->node);
+            kfree (pBarrier);
+            pBarrier = NULL;
+        }
+    }
+
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpSendErrorMsg
+*
+* Description: This function sends error message to the controller
+*              in response to a failed request
+*
+* Input: pCntrlPkt - Pointer to failed control packet
+*        errType - Error type (OFPET_xxx)
+*        errCode - Error code of error type
 *
 * Output: None
 *
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcCpHandleMultipartPortDesc (__u8 *pCntrlPkt, __u16 cntrlPktLen)
+int OfcCpSendErrorMsg (__u8 *pCntrlPkt, __u16 errType, __u16 errCode)
 {
-    tOfcMultipartHeader    *pMultipartHeader     = NULL;
-    tOfcMultipartPortDesc  *pMultipartPortDesc   = NULL;
-    struct net_device      *pNetDevice           = NULL;
-    __u8                   *pOpenFlowPkt         = NULL;
-    __u32                  pktLength             = 0;
-    int                    dataIfNum             = 0;
+    tOfcErrorMsg *pErrMsg = NULL;
+    __u8         *pOpenFlowPkt = NULL;
+    __u16        dataLen = 0;
 
-    printk (KERN_INFO "Multipart Port Desc Rx\r\n");
+    /* Error message carries start of failed request */
+    dataLen = ntohs (((tOfcOfHdr *) pCntrlPkt)->length);
+    if (dataLen > OFC_ERROR_DATA_LEN)
+    {
+        dataLen = OFC_ERROR_DATA_LEN;
+    }
 
-    pMultipartHeader = (tOfcMultipartHeader *) kmalloc (OFC_MTU_SIZE, 
-                                                        GFP_KERNEL);
-    if (pMultipartHeader == NULL)
+    pErrMsg = (tOfcErrorMsg *) kmalloc (sizeof(tOfcErrorMsg) + dataLen,
+                                        GFP_KERNEL);
+    if (pErrMsg == NULL)
     {
-        printk(KERN_CRIT "Failed to allocate memory for multipart"
-               " port desc message\r\n");
+        printk (KERN_CRIT "Failed to allocate memory to Error "
+                          "message\r\n");
         return OFC_FAILURE;
     }
 
-    memset (pMultipartHeader, 0, OFC_MTU_SIZE);
-    pktLength = sizeof (tOfcMultipartHeader);
-    pMultipartHeader->type = htons (OFPMP_PORT_DESC);
+    pErrMsg->type = htons (errType);
+    pErrMsg->code = htons (errCode);
+    memcpy (pErrMsg + 1, pCntrlPkt, dataLen);
 
-    pMultipartPortDesc = (tOfcMultipartPortDesc *) (void *) 
-                         (((__u8 *) pMultipartHeader) + 
-                          sizeof (tOfcMultipartHeader));
+    if (OfcCpAddOpenFlowHdr ((__u8 *) pErrMsg, 
+                             sizeof(tOfcErrorMsg) + dataLen, OFPT_ERROR,
+                             ((tOfcOfHdr *) pCntrlPkt)->xid, 
+                             &pOpenFlowPkt)
+        != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Failed to construct Error message\r\n");
+        kfree (pErrMsg);
+        pErrMsg = NULL;
+        return OFC_FAILURE;
+    }
 
-    for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; dataIfNum++)
+    if (OfcCpSendCntrlPktFromSock (pOpenFlowPkt, 
+        ntohs (((tOfcOfHdr *) pOpenFlowPkt)->length)) != OFC_SUCCESS)
     {
-        pNetDevice = OfcGetNetDevByName (gpOpenFlowIf[dataIfNum]);
-        if (pNetDevice == NULL)
-        {
-            printk (KERN_CRIT "[%s]: Failed to fetch OpenFlow "
-                              "interface name\r\n", __func__);
-            continue;
-        }
+        printk (KERN_CRIT "Failed to send Error message\r\n");
+        kfree (pErrMsg);
+        pErrMsg = NULL;
+        kfree (pOpenFlowPkt);
+        pOpenFlowPkt = NULL;
+        return OFC_FAILURE;
+    }
 
-        /* Port n corresponds to n+1 in controller */
-        pMultipartPortDesc->portNo = htonl (dataIfNum + 1);
-        memcpy (pMultipartPortDesc->hwAddr, pNetDevice->dev_addr, 
-                OFC_MAC_ADDR_LEN);
-        strcpy (pMultipartPortDesc->ifName, 
-                gpOpenFlowIf[dataIfNum]);
+    printk (KERN_INFO "Error message Tx (type:%d, code:%d)\r\n", 
+            errType, errCode);
 
-        if (!netif_carrier_ok (pNetDevice))
+    kfree (pErrMsg);
+    pErrMsg = NULL;
+    kfree (pOpenFlowPkt);
+    pOpenFlowPkt = NULL;
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpProcessRoleRequest
+*
+* Description: This function changes role of controller the role
+*              request is received from, and sends role reply.
+*              A controller becoming master demotes current master
+*              to slave. Master and slave requests carrying older
+*              generation id than last one are rejected as stale.
+*
+* Input: pCntrlPkt - Pointer to control packet (Role Request)
+*        cntrlPktLen - Control packet length
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpProcessRoleRequest (__u8 *pCntrlPkt, __u16 cntrlPktLen)
+{
+    tOfcRoleMsg  *pRoleReq = NULL;
+    tOfcRoleMsg  roleReply;
+    tOfcCntrl    *pCntrl = NULL;
+    __u8         *pOpenFlowPkt = NULL;
+    __u64        generationId = 0;
+    __u32        role = 0;
+    int          cntrlIndex = 0;
+
+    printk (KERN_INFO "Role Request Rx\r\n");
+
+    if (cntrlPktLen < (OFC_OPENFLOW_HDR_LEN + sizeof(tOfcRoleMsg)))
+    {
+        OfcCpSendErrorMsg (pCntrlPkt, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN);
+        return OFC_FAILURE;
+    }
+
+    pRoleReq = (tOfcRoleMsg *) ((void *) 
+               (pCntrlPkt + OFC_OPENFLOW_HDR_LEN));
+    role = ntohl (pRoleReq->role);
+    generationId = ((__u64) ntohl (pRoleReq->generationId.hi) << 32) |
+                   ntohl (pRoleReq->generationId.lo);
+    pCntrl = &gOfcCpGlobals.aCntrl[gOfcCpGlobals.pRxConn->cntrlIndex];
+
+    if (role > OFPCR_ROLE_SLAVE)
+    {
+        OfcCpSendErrorMsg (pCntrlPkt, OFPET_ROLE_REQUEST_FAILED, 
+                           OFPRRFC_BAD_ROLE);
+        return OFC_FAILURE;
+    }
+
+    if ((role == OFPCR_ROLE_MASTER) || (role == OFPCR_ROLE_SLAVE))
+    {
+        /* Generation id wraps, compare as signed difference */
+        if ((gOfcCpGlobals.isGenerationIdSet == OFC_TRUE) &&
+            ((__s64) (generationId - gOfcCpGlobals.generationId) < 0))
         {
-            pMultipartPortDesc->state |= OFPPS_LINK_DOWN;
+            OfcCpSendErrorMsg (pCntrlPkt, OFPET_ROLE_REQUEST_FAILED, 
+                               OFPRRFC_STALE);
+            return OFC_FAILURE;
         }
-        else
+        gOfcCpGlobals.generationId = generationId;
+        gOfcCpGlobals.isGenerationIdSet = OFC_TRUE;
+    }
+
+    if (role == OFPCR_ROLE_MASTER)
+    {
+        for (cntrlIndex = 0; cntrlIndex < gNumCntrl; cntrlIndex++)
         {
-            pMultipartPortDesc->state &= (~(OFPPS_LINK_DOWN));
+            if (gOfcCpGlobals.aCntrl[cntrlIndex].role == 
+                OFPCR_ROLE_MASTER)
+            {
+                gOfcCpGlobals.aCntrl[cntrlIndex].role = OFPCR_ROLE_SLAVE;
+            }
         }
-        pMultipartPortDesc->state = htonl (pMultipartPortDesc->state);
-
-        /* Not updating state, current, advertised, supported,
-         * curr speed, max speed because data interfaces are
-         * virtual interfaces in ExoGeni that do not store
-         * speed information in ethtool */
+    }
 
-        pktLength += sizeof (tOfcMultipartPortDesc);
-        pMultipartPortDesc = (tOfcMultipartPortDesc *) (void *)
-                             (((__u8 *) pMultipartPortDesc) +
-                              sizeof (tOfcMultipartPortDesc));
+    if (role != OFPCR_ROLE_NOCHANGE)
+    {
+        pCntrl->role = role;
+        OfcCpUpdatePktInReasons();
     }
 
-    if (OfcCpAddOpenFlowHdr ((__u8 *) pMultipartHeader,
-                             pktLength, OFPT_MULTIPART_REPLY,
-                             ((tOfcOfHdr *) pCntrlPkt)->xid, 
-                             &pOpenFlowPkt) != OFC_SUCCESS)
+    memset (&roleReply, 0, sizeof(roleReply));
+    roleReply.role = htonl (pCntrl->role);
+    roleReply.generationId.hi = htonl (gOfcCpGlobals.generationId >> 32);
+    roleReply.generationId.lo = htonl (gOfcCpGlobals.generationId & 
+                                       0xFFFFFFFF);
+
+    if (OfcCpAddOpenFlowHdr ((__u8 *) &roleReply, sizeof(roleReply),
+                             OFPT_ROLE_REPLY, 
+                             ((tOfcOfHdr *) pCntrlPkt)->xid,
+                             &pOpenFlowPkt)
+        != OFC_SUCCESS)
     {
-        printk (KERN_CRIT "Failed to construct multipart port "
-                          "description message\r\n");
-        kfree (pMultipartHeader);
-        pMultipartHeader = NULL;
+        printk (KERN_CRIT "Failed to construct Role Reply\r\n");
         return OFC_FAILURE;
     }
 
     if (OfcCpSendCntrlPktFromSock (pOpenFlowPkt, 
-        ntohs (((tOfcOfHdr *) pOpenFlowPkt)->length)) 
-        != OFC_SUCCESS)
+        ntohs (((tOfcOfHdr *) pOpenFlowPkt)->length)) != OFC_SUCCESS)
     {
-        printk (KERN_CRIT "Failed to send multipart port "
-                          "description message\r\n");
-        kfree (pMultipartHeader);
-        pMultipartHeader = NULL;
+        printk (KERN_CRIT "Failed to send Role Reply\r\n");
         kfree (pOpenFlowPkt);
         pOpenFlowPkt = NULL;
         return OFC_FAILURE;
     }
 
-    printk (KERN_INFO "Multipart Port Desc Tx\r\n");
+    printk (KERN_INFO "Role Reply Tx (role:%u)\r\n", pCntrl->role);
 
-    kfree (pMultipartHeader);
-    pMultipartHeader = NULL;
     kfree (pOpenFlowPkt);
     pOpenFlowPkt = NULL;
     return OFC_SUCCESS;
 }
 
 /******************************************************************                                                                          
-* Function: OfcCpSendBarrierReply
+* Function: OfcCpProcessSetAsync
 *
-* Description: This function sends barrier reply message to the
-*              controller.
+* Description: This function sets asynchronous message masks of
+*              connection the Set Async message is received on
 *
-* Input: xid - Transaction ID.
+* Input: pCntrlPkt - Pointer to control packet (Set Async)
+*        cntrlPktLen - Control packet length
 *
 * Output: None
 *
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcCpSendBarrierReply (__u32 xid)
+int OfcCpProcessSetAsync (__u8 *pCntrlPkt, __u16 cntrlPktLen)
 {
-    __u8  *pBarrierReply = NULL;
+    tOfcAsyncConfig *pSetAsync = NULL;
+    tOfcAsyncConfig *pConfig = NULL;
+    int             index = 0;
 
-    printk (KERN_INFO "Barrier Request Rx\r\n");
+    printk (KERN_INFO "Set Async Rx\r\n");
 
-    if (OfcCpAddOpenFlowHdr (NULL, 0, OFPT_BARRIER_REPLY, xid, 
-                             &pBarrierReply)
-        != OFC_SUCCESS)
+    if (cntrlPktLen != (OFC_OPENFLOW_HDR_LEN + sizeof(tOfcAsyncConfig)))
     {
-        printk (KERN_CRIT "Failed to construct Barrier Reply\r\n");
+        OfcCpSendErrorMsg (pCntrlPkt, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN);
         return OFC_FAILURE;
     }
 
-    if (OfcCpSendCntrlPktFromSock (pBarrierReply, OFC_OPENFLOW_HDR_LEN)
+    pSetAsync = (tOfcAsyncConfig *) ((void *) 
+                (pCntrlPkt + OFC_OPENFLOW_HDR_LEN));
+    pConfig = &gOfcCpGlobals.pRxConn->asyncConfig;
+    for (index = OFC_ASYNC_MASTER; index <= OFC_ASYNC_SLAVE; index++)
+    {
+        pConfig->aPktInMask[index] = ntohl (pSetAsync->aPktInMask[index]);
+        pConfig->aPortStatusMask[index] = 
+            ntohl (pSetAsync->aPortStatusMask[index]);
+        pConfig->aFlowRemovedMask[index] = 
+            ntohl (pSetAsync->aFlowRemovedMask[index]);
+    }
+
+    OfcCpUpdatePktInReasons();
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpProcessGetAsyncReq
+*
+* Description: This function replies with asynchronous message
+*              masks of connection the request is received on
+*
+* Input: pCntrlPkt - Pointer to control packet (Get Async Request)
+*        cntrlPktLen - Control packet length
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCpProcessGetAsyncReq (__u8 *pCntrlPkt, __u16 cntrlPktLen)
+{
+    tOfcAsyncConfig asyncReply;
+    tOfcAsyncConfig *pConfig = NULL;
+    __u8            *pOpenFlowPkt = NULL;
+    int             index = 0;
+
+    printk (KERN_INFO "Get Async Request Rx\r\n");
+
+    pConfig = &gOfcCpGlobals.pRxConn->asyncConfig;
+    memset (&asyncReply, 0, sizeof(asyncReply));
+    for (index = OFC_ASYNC_MASTER; index <= OFC_ASYNC_SLAVE; index++)
+    {
+        asyncReply.aPktInMask[index] = htonl (pConfig->aPktInMask[index]);
+        asyncReply.aPortStatusMask[index] = 
+            htonl (pConfig->aPortStatusMask[index]);
+        asyncReply.aFlowRemovedMask[index] = 
+            htonl (pConfig->aFlowRemovedMask[index]);
+    }
+
+    if (OfcCpAddOpenFlowHdr ((__u8 *) &asyncReply, sizeof(asyncReply),
+                             OFPT_GET_ASYNC_CONFIG_REPLY, 
+                             ((tOfcOfHdr *) pCntrlPkt)->xid,
+                             &pOpenFlowPkt)
         != OFC_SUCCESS)
     {
-        printk (KERN_CRIT "Failed to send Barrier Reply\r\n");
-        kfree (pBarrierReply);
-        pBarrierReply = NULL;
+        printk (KERN_CRIT "Failed to construct Get Async Reply\r\n");
         return OFC_FAILURE;
     }
 
-    printk (KERN_INFO "Barrier Reply Tx\r\n");
+    if (OfcCpSendCntrlPktFromSock (pOpenFlowPkt, 
+        ntohs (((tOfcOfHdr *) pOpenFlowPkt)->length)) != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Failed to send Get Async Reply\r\n");
+        kfree (pOpenFlowPkt);
+        pOpenFlowPkt = NULL;
+        return OFC_FAILURE;
+    }
 
-    kfree (pBarrierReply);
-    pBarrierReply = NULL;
+    kfree (pOpenFlowPkt);
+    pOpenFlowPkt = NULL;
     return OFC_SUCCESS;
 }
+
+/******************************************************************                                                                          
+* Function: OfcCpSetDefaultAsync
+*
+* Description: This function sets asynchronous message masks of a
+*              new connection as defined by OpenFlow: master and
+*              equal get all messages, slave gets port status only
+*
+* Input: pConn - Controller connection
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcCpSetDefaultAsync (tOfcCntrlConn *pConn)
+{
+    tOfcAsyncConfig *pConfig = &pConn->asyncConfig;
+
+    memset (pConfig, 0, sizeof (tOfcAsyncConfig));
+    pConfig->aPktInMask[OFC_ASYNC_MASTER] = OFC_DEF_PKT_IN_MASK;
+    pConfig->aPortStatusMask[OFC_ASYNC_MASTER] = OFC_DEF_PORT_STATUS_MASK;
+    pConfig->aPortStatusMask[OFC_ASYNC_SLAVE] = OFC_DEF_PORT_STATUS_MASK;
+    pConfig->aFlowRemovedMask[OFC_ASYNC_MASTER] = 
+        OFC_DEF_FLOW_REMOVED_MASK;
+
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpIsAsyncEnabled
+*
+* Description: This function checks asynchronous message mask of
+*              connection for current role of its controller
+*
+* Input: pConn - Controller connection
+*        msgType - OFPT_PACKET_IN/OFPT_PORT_STATUS/OFPT_FLOW_REMOVED
+*        reason - Reason of message
+*
+* Output: None
+*
+* Returns: OFC_TRUE if message is sent on connection, OFC_FALSE
+*          otherwise
+*
+*******************************************************************/
+int OfcCpIsAsyncEnabled (tOfcCntrlConn *pConn, __u8 msgType, 
+                         __u8 reason)
+{
+    tOfcAsyncConfig *pConfig = &pConn->asyncConfig;
+    __u32           mask = 0;
+    int             index = OFC_ASYNC_MASTER;
+
+    if (reason >= 32)
+    {
+        return OFC_FALSE;
+    }
+
+    if (gOfcCpGlobals.aCntrl[pConn->cntrlIndex].role == OFPCR_ROLE_SLAVE)
+    {
+        index = OFC_ASYNC_SLAVE;
+    }
+
+    switch (msgType)
+    {
+        case OFPT_PACKET_IN:
+            mask = pConfig->aPktInMask[index];
+            break;
+
+        case OFPT_PORT_STATUS:
+            mask = pConfig->aPortStatusMask[index];
+            break;
+
+        case OFPT_FLOW_REMOVED:
+            mask = pConfig->aFlowRemovedMask[index];
+            break;
+
+        default:
+            return OFC_TRUE;
+    }
+
+    return (mask & (1 << reason)) ? OFC_TRUE : OFC_FALSE;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpUpdatePktInReasons
+*
+* Description: This function collects packet-in reasons enabled on
+*              any connected controller connection. Data path reads
+*              them before copying a packet for packet-in, so
+*              packets no controller wants are not copied at all.
+*              Called when connections, roles or masks change.
+*
+* Input: None
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcCpUpdatePktInReasons (void)
+{
+    tOfcCntrlConn *pConn = NULL;
+    __u32         reasonMask = 0;
+    int           cntrlIndex = 0;
+    int           auxId = 0;
+    __u8          reason = 0;
+
+    for (cntrlIndex = 0; cntrlIndex < gNumCntrl; cntrlIndex++)
+    {
+        for (auxId = 0; auxId <= gNumAuxConn; auxId++)
+        {
+            pConn = &gOfcCpGlobals.aCntrl[cntrlIndex].aConn[auxId];
+            if (pConn->state != OFC_CNTRL_CONNECTED)
+            {
+                continue;
+            }
+
+            for (reason = OFCR_NO_MATCH; reason <= OFCR_ACTION; reason++)
+            {
+                if (OfcCpIsAsyncEnabled (pConn, OFPT_PACKET_IN, reason)
+                    == OFC_TRUE)
+                {
+                    reasonMask |= (1 << reason);
+                }
+            }
+        }
+    }
+
+    ACCESS_ONCE (gOfcCpGlobals.pktInReasonMask) = reasonMask;
+    return;
+}
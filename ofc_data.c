@@ -14,7 +14,27 @@
 #include "ofc_hdrs.h"
 
 tOfcDpGlobals gOfcDpGlobals;
+
+/* Table-miss flow as reported in flow stats: empty OXM match and
+ * apply actions instruction with output to controller */
+__u8 gaTableMissMatchInstr[] =
+{
+    0x00, 0x01, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x04, 0x00, 0x18, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x10, 0xff, 0xff, 0xff, 0xfd,
+    0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
 extern int  gNumOpenFlowIf;
+extern unsigned int gDataIoMode;
+extern unsigned int gRxPollUsecs;
+extern unsigned int gFailMode;
+extern unsigned int gPktRxQLen;
+extern unsigned int gCpMsgQLen;
+extern unsigned int gPktInRate;
+extern unsigned int gPortPktInRate;
+extern tOfcCpGlobals gOfcCpGlobals;
+extern tOfcGlobals gOfcGlobals;
+extern struct mutex gOfcThreadLock;
 
 /******************************************************************                                                                          
 * Function: OfcDpMainInit
@@ -31,16 +51,38 @@ extern int  gNumOpenFlowIf;
 *******************************************************************/
 int OfcDpMainInit (void)
 {
+    int hashIndex = 0;
+    int dataIfNum = 0;
+    int pktInClass = 0;
+
     memset (&gOfcDpGlobals, 0, sizeof (gOfcDpGlobals));
 
-    /* Initialize semaphore */
-    sema_init (&gOfcDpGlobals.semId, 1);
-    sema_init (&gOfcDpGlobals.dataPktQSemId, 1);
-    sema_init (&gOfcDpGlobals.cpMsgQSemId, 1);
+    /* Entries of pending miss table start invalid */
+    gOfcDpGlobals.pendingMissGen = 1;
+
+    for (pktInClass = 0; pktInClass < OFC_MAX_PKT_IN_CLASS; pktInClass++)
+    {
+        OfcDpInitTokenBucket (&gOfcDpGlobals.aPktInBucket[pktInClass],
+                              gPktInRate);
+        for (dataIfNum = 0; dataIfNum < OFC_MAX_OF_IF_NUM; dataIfNum++)
+        {
+            OfcDpInitTokenBucket (&gOfcDpGlobals.aaPortPktInBucket
+                                  [dataIfNum][pktInClass],
+                                  gPortPktInRate);
+        }
+    }
 
     /* Initialize lists and queues */
-    INIT_LIST_HEAD (&gOfcDpGlobals.pktRxIfListHead);
-    INIT_LIST_HEAD (&gOfcDpGlobals.cpMsgListHead);
+    OfcQueueInit (&gOfcDpGlobals.pktRxQ, gPktRxQLen);
+    OfcQueueInit (&gOfcDpGlobals.cpMsgQ, gCpMsgQLen);
+    for (hashIndex = 0; hashIndex < OFC_GROUP_HASH_SIZE; hashIndex++)
+    {
+        INIT_LIST_HEAD (&gOfcDpGlobals.aGroupHashList[hashIndex]);
+    }
+    for (hashIndex = 0; hashIndex < OFC_METER_HASH_SIZE; hashIndex++)
+    {
+        INIT_LIST_HEAD (&gOfcDpGlobals.aMeterHashList[hashIndex]);
+    }
 
     if (OfcDpCreateFlowTables() != OFC_SUCCESS)
     {
@@ -48,14 +90,42 @@ int OfcDpMainInit (void)
         return OFC_FAILURE;
     }
 
+    if (OfcDpCreateGroupPktBufs() != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Group buffer creation failed!!\r\n");
+        return OFC_FAILURE;
+    }
+
+    /* Port statistics are updated from the time packets are
+     * received, create them before rings and sockets */
+    if (OfcDpCreatePortStats() != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Port statistics creation failed!!\r\n");
+        return OFC_FAILURE;
+    }
+
+    if (gDataIoMode != OFC_DATA_IO_SOCKET)
+    {
+        /* Create receive rings on OpenFlow interfaces, packets
+         * are transmitted through device queue */
+        if (OfcDpCreateDataRings() != OFC_SUCCESS)
+        {
+            printk (KERN_CRIT "Data ring creation failed!!\r\n");
+            return OFC_FAILURE;
+        }
+    }
     /* Create raw sockets to transmit and receive data packets from
        OpenFlow interfaces  */
-    if (OfcDpCreateSocketsForDataPkts() != OFC_SUCCESS)
+    else if (OfcDpCreateSocketsForDataPkts() != OFC_SUCCESS)
     {
         printk (KERN_CRIT "Data socket creation failed!!\r\n");
         return OFC_FAILURE;
     }
 
+    /* All ports forward packets until configured by
+     * controller */
+    OfcDpUpdateFwdPortMask();
+
     /* Create threads for receiving data packets from raw sockets
      * and posting them to data path task */
     if (OfcDpCreateThreadsForRxDataPkts() != OFC_SUCCESS)
@@ -67,6 +137,40 @@ int OfcDpMainInit (void)
     return OFC_SUCCESS;
 }
 
+/******************************************************************                                                                          
+* Function: OfcDpMainDeInit
+*
+* Description: This function releases what data path task init
+*              created. Rx threads are stopped and packet handlers
+*              detached before memory is released. Called when
+*              init fails part way, and when module is unloaded
+*              once data path and control path tasks are stopped
+*
+* Input: None
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpMainDeInit (void)
+{
+    if (gDataIoMode != OFC_DATA_IO_SOCKET)
+    {
+        OfcDpDeleteDataRings();
+    }
+    else
+    {
+        OfcDpDeleteSocketsForDataPkts();
+    }
+
+    OfcDpDeletePortStats();
+    OfcDpDeleteGroupPktBufs();
+    OfcDpDeleteFlowTables();
+
+    return;
+}
+
 /******************************************************************                                                                          
 * Function: OfcDpMainTask
 *
@@ -84,15 +188,27 @@ int OfcDpMainTask (void *args)
     int event = 0;
 
     /* Initialize memory and structures */
-    if (OfcDpMainInit() != OFC_SUCCESS)
+    gOfcGlobals.dpInitStatus = OfcDpMainInit();
+    if (gOfcGlobals.dpInitStatus != OFC_SUCCESS)
     {
-        /* Check if thread needs to be killed */
         printk (KERN_CRIT "OpenFlow data path task intialization " 
                           "failed!!\r\n");
-        return OFC_FAILURE;
+        /* Task is not rebound from module parameters once it
+         * exits */
+        mutex_lock (&gOfcThreadLock);
+        gOfcGlobals.pOfcDpThread = NULL;
+        mutex_unlock (&gOfcThreadLock);
+        OfcDpMainDeInit();
+
+        /* Module init fails once notified and module code may be
+         * freed, so thread exits without returning to it */
+        complete_and_exit (&gOfcGlobals.dpInitDone, OFC_FAILURE);
     }
 
-    while (1)
+    /* Notify module init that data path is ready */
+    complete (&gOfcGlobals.dpInitDone);
+
+    while (!kthread_should_stop())
     {
         if (OfcDpReceiveEvent (OFC_PKT_RX_EVENT | OFC_CP_TO_DP_EVENT, 
             &event) == OFC_SUCCESS)
@@ -130,12 +246,11 @@ int OfcDpMainTask (void *args)
 int OfcDpRxDataPacket (void)
 {
     tDataPktRxIfQ *pMsgQ = NULL;
+    tOfcDpPkt     dpPkt;
     __u8          *pDataPkt = NULL;
     __u32         pktLen = 0;
     __u8          dataIfNum = 0;
 
-    down_interruptible (&gOfcDpGlobals.dataPktQSemId);
-
     while ((pMsgQ = OfcDpRecvFromDataPktQ()) != NULL)
     {
         dataIfNum = pMsgQ->dataIfNum;
@@ -151,8 +266,39 @@ int OfcDpRxDataPacket (void)
             continue;
         }
  
+        if (pMsgQ->isRingBlock == OFC_TRUE)
+        {
+            /* Block of frames received on ring, block is returned
+             * to ring instead of being freed */
+            OfcDpRxRingBlock (dataIfNum, pDataPkt);
+            OfcDpReleaseRingBlock (pDataPkt);
+            pDataPkt = NULL;
+            kfree (pMsgQ);
+            pMsgQ = NULL;
+            continue;
+        }
+
+        if (gOfcDpGlobals.aPortConfig[dataIfNum] & 
+            (OFPPC_NO_RECV | OFPPC_PORT_DOWN))
+        {
+            /* Port does not receive packets */
+            this_cpu_inc (gOfcDpGlobals.apPortStats[dataIfNum]->rxDropCount);
+            kfree (pDataPkt);
+            pDataPkt = NULL;
+            kfree (pMsgQ);
+            pMsgQ = NULL;
+            continue;
+        }
+
+        /* Frame was received after the reserved headroom */
+        memset (&dpPkt, 0, sizeof (dpPkt));
+        dpPkt.pBuf = pDataPkt;
+        dpPkt.pPkt = pDataPkt + OFC_DP_PKT_HEADROOM;
+        dpPkt.pktLen = pktLen;
+        dpPkt.inPort = dataIfNum;
+
         /* Process packet using OpenFlow Pipeline */
-        OfcDpProcessPktOpenFlowPipeline (pDataPkt, pktLen, dataIfNum);
+        OfcDpProcessPktOpenFlowPipeline (&dpPkt);
 
         /* Release message */
         kfree (pDataPkt);
@@ -161,7 +307,60 @@ int OfcDpRxDataPacket (void)
         pMsgQ = NULL;
     }
 
-    up (&gOfcDpGlobals.dataPktQSemId);
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpRxRingBlock
+*
+* Description: This function processes frames of a retired receive
+*              ring block using OpenFlow pipeline. Frames are
+*              processed in place, the headroom ahead of each frame
+*              is used for pushing tags.
+*
+* Input: dataIfNum - OpenFlow interface number
+*        pBlock - Pointer to ring block
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpRxRingBlock (__u8 dataIfNum, __u8 *pBlock)
+{
+    struct tpacket_block_desc *pBlockDesc = NULL;
+    struct tpacket3_hdr       *pFrameHdr = NULL;
+    tOfcDpPkt                 dpPkt;
+    __u32                     pktIndex = 0;
+
+    pBlockDesc = (struct tpacket_block_desc *) pBlock;
+
+    if (gOfcDpGlobals.aPortConfig[dataIfNum] & 
+        (OFPPC_NO_RECV | OFPPC_PORT_DOWN))
+    {
+        /* Port does not receive packets */
+        this_cpu_add (gOfcDpGlobals.apPortStats[dataIfNum]->rxDropCount,
+                      pBlockDesc->hdr.bh1.num_pkts);
+        return OFC_SUCCESS;
+    }
+
+    pFrameHdr = (struct tpacket3_hdr *) 
+                (pBlock + pBlockDesc->hdr.bh1.offset_to_first_pkt);
+    for (pktIndex = 0; pktIndex < pBlockDesc->hdr.bh1.num_pkts; 
+         pktIndex++)
+    {
+        memset (&dpPkt, 0, sizeof (dpPkt));
+        dpPkt.pPkt = (__u8 *) pFrameHdr + pFrameHdr->tp_mac;
+        dpPkt.pBuf = dpPkt.pPkt - OFC_DP_PKT_HEADROOM;
+        dpPkt.pktLen = pFrameHdr->tp_snaplen;
+        dpPkt.inPort = dataIfNum;
+
+        /* Process packet using OpenFlow Pipeline */
+        OfcDpProcessPktOpenFlowPipeline (&dpPkt);
+
+        pFrameHdr = (struct tpacket3_hdr *) 
+                    ((__u8 *) pFrameHdr + pFrameHdr->tp_next_offset);
+    }
 
     return OFC_SUCCESS;
 }
@@ -183,8 +382,22 @@ int OfcDpRxControlPathMsg (void)
 {
     tDpCpMsgQ      *pMsgQ = NULL;
     tOfcFlowEntry  *pFlowEntry = NULL;
+    tOfcGroupEntry *pGroupEntry = NULL;
+    tOfcMeterEntry *pMeterEntry = NULL;
+    int            isCommitted = OFC_FALSE;
 
-    down_interruptible (&gOfcDpGlobals.cpMsgQSemId);
+    /* Stats request in progress is collected in batches in between
+     * data packets. Later messages wait so that flow tables do not
+     * change under the request */
+    if (gOfcDpGlobals.pStatsReq != NULL)
+    {
+        OfcDpCollectFlowStats();
+        if (gOfcDpGlobals.pStatsReq != NULL)
+        {
+            OfcDpSendEvent (OFC_CP_TO_DP_EVENT);
+            return OFC_SUCCESS;
+        }
+    }
 
     while ((pMsgQ = OfcDpRecvFromCpMsgQ()) != NULL)
     {
@@ -196,13 +409,13 @@ int OfcDpRxControlPathMsg (void)
                 {
                     printk (KERN_CRIT "Data path did not receive flow " 
                                       "entry from control path\r\n");
-                    kfree (pMsgQ);
-                    pMsgQ = NULL;
-                    continue;
+                    break;
                 }
 
                 OfcDpInsertFlowEntry (pFlowEntry);
-                OfcDumpFlows(0);
+
+                /* Flows waiting for controller may be installed */
+                gOfcDpGlobals.pendingMissGen++;
                 break;
 
             case OFC_FLOW_MOD_DEL:
@@ -211,32 +424,131 @@ int OfcDpRxControlPathMsg (void)
                 {   
                     printk (KERN_CRIT "Data path did not receive flow "
                                       "entry from control path\r\n");
-                    kfree (pMsgQ);
-                    pMsgQ = NULL;
-                    continue;
+                    break;
                 }
 
                 OfcDpDeleteFlowEntry (pFlowEntry);
-                OfcDumpFlows(0);
+
+                /* Deleted flows miss again */
+                gOfcDpGlobals.pendingMissGen++;
                 break;
 
             case OFC_PACKET_OUT:
                 OfcDpExecPktOutActions (pMsgQ->pPkt, pMsgQ->pktLen,
+                                        pMsgQ->inPort,
                                         pMsgQ->pActionListHead);
                 break;
 
+            case OFC_PORT_MOD:
+                OfcDpUpdatePortConfig (pMsgQ->inPort, pMsgQ->portConfig,
+                                       pMsgQ->portConfigMask);
+                break;
+
+            case OFC_GROUP_MOD_ADD:
+            case OFC_GROUP_MOD_MODIFY:
+            case OFC_GROUP_MOD_DEL:
+                pGroupEntry = pMsgQ->pGroupEntry;
+                if (pGroupEntry == NULL)
+                {
+                    printk (KERN_CRIT "Data path did not receive group "
+                                      "entry from control path\r\n");
+                    break;
+                }
+
+                if (pMsgQ->msgType == OFC_GROUP_MOD_ADD)
+                {
+                    OfcDpInsertGroupEntry (pGroupEntry);
+                }
+                else if (pMsgQ->msgType == OFC_GROUP_MOD_MODIFY)
+                {
+                    OfcDpModifyGroupEntry (pGroupEntry);
+                }
+                else
+                {
+                    /* Entry only carries group Id for delete */
+                    OfcDpDeleteGroupEntry (pGroupEntry->groupId);
+                    OfcDpFreeGroupEntry (pGroupEntry);
+                }
+                pGroupEntry = NULL;
+                OfcDumpGroups();
+                break;
+
+            case OFC_METER_MOD_ADD:
+            case OFC_METER_MOD_MODIFY:
+            case OFC_METER_MOD_DEL:
+                pMeterEntry = pMsgQ->pMeterEntry;
+                if (pMeterEntry == NULL)
+                {
+                    printk (KERN_CRIT "Data path did not receive meter "
+                                      "entry from control path\r\n");
+                    break;
+                }
+
+                if (pMsgQ->msgType == OFC_METER_MOD_ADD)
+                {
+                    OfcDpInsertMeterEntry (pMeterEntry);
+                }
+                else if (pMsgQ->msgType == OFC_METER_MOD_MODIFY)
+                {
+                    OfcDpModifyMeterEntry (pMeterEntry);
+                }
+                else
+                {
+                    /* Entry only carries meter Id for delete */
+                    OfcDpDeleteMeterEntry (pMeterEntry->meterId);
+                    OfcDpFreeMeterEntry (pMeterEntry);
+                }
+                pMeterEntry = NULL;
+                OfcDumpMeters();
+                break;
+
+            case OFC_FLOW_STATS:
+                /* Request is committed once its last reply segment
+                 * is sent, see OfcDpCollectFlowStats */
+                pMsgQ->pStatsReq->seqNum = pMsgQ->seqNum;
+                gOfcDpGlobals.pStatsReq = pMsgQ->pStatsReq;
+                OfcDpCollectFlowStats();
+                break;
+
             default:
                 printk (KERN_CRIT "Invalid message received from "
                                   "control path task\r\n");
                 break;
         }
 
+        /* Messages are applied in order, so sequence number of last
+         * applied message acknowledges all earlier messages */
+        if (pMsgQ->msgType != OFC_FLOW_STATS)
+        {
+            smp_store_release (&gOfcDpGlobals.commitSeqNum,
+                               pMsgQ->seqNum);
+            isCommitted = OFC_TRUE;
+        }
+
         /* Release message */
         kfree (pMsgQ);
         pMsgQ = NULL;
+
+        if (gOfcDpGlobals.pStatsReq != NULL)
+        {
+            /* Continue stats after pending data packets */
+            OfcDpSendEvent (OFC_CP_TO_DP_EVENT);
+            break;
+        }
+    }
+
+    if (isCommitted == OFC_TRUE)
+    {
+        /* Acknowledge whole batch with one event */
+        OfcCpSendEvent (OFC_DP_COMMIT_EVENT);
     }
 
-    up (&gOfcDpGlobals.cpMsgQSemId);
+    if (OfcQueueIsResumed (&gOfcDpGlobals.cpMsgQ) == OFC_TRUE)
+    {
+        /* Control path stopped reading controller sockets while
+         * queue was throttled */
+        OfcCpSendEvent (OFC_CTRL_PKT_EVENT);
+    }
 
     return OFC_SUCCESS;
 }
@@ -245,9 +557,13 @@ int OfcDpRxControlPathMsg (void)
 * Function: OfcDpRxDataPktThread
 *
 * Description: This function receives data packets from raw
-*              sockets and posts event to data path task.
+*              sockets and posts event to data path task. Thread
+*              busy polls for gRxPollUsecs after last packet, so
+*              that packets of a busy interface are received with
+*              low latency, and blocks when interface is idle to
+*              save CPU. Thread backs off exponentially on errors.
 *
-* Input: args - Pointer to OpenFlow interface number
+* Input: args - Pointer to rx thread arguments
 *
 * Output: None
 *
@@ -256,34 +572,133 @@ int OfcDpRxControlPathMsg (void)
 *******************************************************************/
 int OfcDpRxDataPktThread (void *args)
 {
-    __u8    *pDataPkt = NULL;
-    __u32   pktLen = 0;
-    int     dataIfNum = 0;
+    tOfcRxThreadArgs  *pArgs = (tOfcRxThreadArgs *) args;
+    tOfcRxThreadStats *pStats = &pArgs->stats;
+    __u8              *pDataPkt = NULL;
+    __u32             pktLen = 0;
+    int               dataIfNum = pArgs->dataIfNum;
+    int               rxQueue = pArgs->rxQueue;
+    int               isPoll = OFC_FALSE;
+    int               error = 0;
+    int               retVal = OFC_SUCCESS;
+    __u32             backoffMs = 0;
+    __u64             lastRxNs = 0;
+    __u64             startNs = 0;
+    __u64             endNs = 0;
 
-    dataIfNum = *((int *) args);
-    printk (KERN_INFO "dataIfNum:%d, spawned\r\n", dataIfNum);
+    printk (KERN_INFO "dataIfNum:%d, rxQueue:%d, spawned\r\n", 
+            dataIfNum, rxQueue);
+    complete (&gOfcDpGlobals.rxThreadStarted);
 
-    while (1)
-    {
+    pStats->lastReportNs = ktime_get_ns();
 
-        if (OfcDpRcvDataPktFromSock (dataIfNum, &pDataPkt, &pktLen)
-            != OFC_SUCCESS)
+    while (!kthread_should_stop())
+    {
+        if (OfcQueueIsThrottled (&gOfcDpGlobals.pktRxQ) == OFC_TRUE)
         {
-            pDataPkt = NULL;
-            pktLen = 0;
+            /* Data path is behind, leave packets in socket or ring
+             * until it catches up. Excess packets are dropped there
+             * instead of being queued in memory */
+            pStats->throttleCount++;
+            usleep_range (OFC_RX_THROTTLE_USECS, 
+                          2 * OFC_RX_THROTTLE_USECS);
             continue;
         }
 
-        printk (KERN_INFO "dataIfNum:%d, Data Packet Rx\r\n", 
-                dataIfNum);
+        startNs = ktime_get_ns();
+        isPoll = ((gRxPollUsecs != 0) && 
+                  ((startNs - lastRxNs) < 
+                   ((__u64) gRxPollUsecs * NSEC_PER_USEC))) ?
+                 OFC_TRUE : OFC_FALSE;
+
+        if (gDataIoMode != OFC_DATA_IO_SOCKET)
+        {
+            /* Whole block of frames is posted to data path task */
+            retVal = OfcDpRcvRingBlock (dataIfNum, rxQueue, isPoll,
+                                        &pDataPkt);
+            error = (retVal == OFC_SUCCESS) ? 0 : -EAGAIN;
+        }
+        else
+        {
+            retVal = OfcDpRcvDataPktFromSock (dataIfNum, rxQueue, 
+                         (isPoll == OFC_TRUE) ? MSG_DONTWAIT : 0,
+                         &pDataPkt, &pktLen, &error);
+        }
+
+        endNs = ktime_get_ns();
+        if (isPoll == OFC_TRUE)
+        {
+            pStats->pollNs += endNs - startNs;
+        }
+        else
+        {
+            pStats->sleepNs += endNs - startNs;
+        }
+
+        if (retVal == OFC_SUCCESS)
+        {
+            if (OfcDpSendToDataPktQ (dataIfNum, pDataPkt, pktLen, 
+                                     (gDataIoMode != OFC_DATA_IO_SOCKET) ?
+                                     OFC_TRUE : OFC_FALSE) != OFC_SUCCESS)
+            {
+                if (gDataIoMode != OFC_DATA_IO_SOCKET)
+                {
+                    /* Frames of block are dropped */
+                    this_cpu_add 
+                        (gOfcDpGlobals.apPortStats[dataIfNum]->rxDropCount,
+                         ((struct tpacket_block_desc *) pDataPkt)->
+                         hdr.bh1.num_pkts);
+                    OfcDpReleaseRingBlock (pDataPkt);
+                }
+                else
+                {
+                    this_cpu_inc 
+                        (gOfcDpGlobals.apPortStats[dataIfNum]->rxDropCount);
+                    kfree (pDataPkt);
+                }
+            }
+            OfcDpSendEvent (OFC_PKT_RX_EVENT);
 
-        down_interruptible (&gOfcDpGlobals.dataPktQSemId);
-        OfcDpSendToDataPktQ (dataIfNum, pDataPkt, pktLen);
-        up (&gOfcDpGlobals.dataPktQSemId);
-        OfcDpSendEvent (OFC_PKT_RX_EVENT);
+            pStats->rxCount++;
+            lastRxNs = endNs;
+            backoffMs = 0;
+        }
+        else if ((error == -EAGAIN) || (error == 0))
+        {
+            /* No packet yet, or packet was discarded */
+            if (isPoll == OFC_TRUE)
+            {
+                pStats->emptyPollCount++;
+                cond_resched();
+            }
+        }
+        else
+        {
+            /* Socket error, sleep before retrying so that thread
+             * does not spin on a failing socket */
+            pStats->errCount++;
+            backoffMs = (backoffMs == 0) ? OFC_RX_BACKOFF_MIN_MS :
+                        min (backoffMs * 2, (__u32) OFC_RX_BACKOFF_MAX_MS);
+            printk (KERN_CRIT "dataIfNum:%d, rxQueue:%d, rx error:%d, "
+                    "retry in %ums\r\n", dataIfNum, rxQueue, error, 
+                    backoffMs);
+            msleep (backoffMs);
+            pStats->backoffNs += ktime_get_ns() - endNs;
+        }
 
         pDataPkt = NULL;
         pktLen = 0;
+
+        if ((endNs - pStats->lastReportNs) > OFC_RX_STATS_INTERVAL_NS)
+        {
+            OfcDumpRxThreadStats (pArgs);
+            if ((dataIfNum == 0) && (rxQueue == 0))
+            {
+                /* Queues are shared, reported by first rx thread */
+                OfcDumpQueueStats();
+            }
+            pStats->lastReportNs = endNs;
+        }
     }
 
     return OFC_SUCCESS;
@@ -351,6 +766,12 @@ int OfcDpCreateFlowTables (void)
         INIT_LIST_HEAD (&pTableMissFlow->matchList);
         INIT_LIST_HEAD (&pTableMissFlow->instrList);
 
+        /* Flow is added before its instructions, so that flow
+         * tables are released as a whole if allocation fails */
+        list_add_tail (&pTableMissFlow->list,
+                       &pFlowTable->flowEntryList);
+        pFlowTable->activeCount = 1;
+
         /* No match list, therefore all packets would match */
         /* Instruction list: Apply Action */
         pInstr = (tOfcInstrList *) kmalloc (sizeof(tOfcInstrList),
@@ -383,58 +804,118 @@ int OfcDpCreateFlowTables (void)
         pActions->u.outPort = OFPP_CONTROLLER;
         list_add_tail (&pActions->list, &pInstr->u.actionList);
 
-        list_add_tail (&pTableMissFlow->list,
-                       &pFlowTable->flowEntryList);
+        pTableMissFlow->pMatchInstr =
+            (__u8 *) kmalloc (sizeof (gaTableMissMatchInstr),
+                              GFP_KERNEL);
+        if (pTableMissFlow->pMatchInstr != NULL)
+        {
+            memcpy (pTableMissFlow->pMatchInstr, gaTableMissMatchInstr,
+                    sizeof (gaTableMissMatchInstr));
+            pTableMissFlow->matchInstrLen =
+                sizeof (gaTableMissMatchInstr);
+        }
+        pTableMissFlow->installNs = ktime_get_ns();
     }
 
     return OFC_SUCCESS;
 }
 
+/******************************************************************                                                                          
+* Function: OfcDpDeleteFlowTables
+*
+* Description: This function deletes flow tables along with their
+*              flow entries
+*
+* Input: None
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpDeleteFlowTables (void)
+{
+    tOfcFlowTable     *pFlowTable = NULL;
+    struct list_head  *pTableList = NULL;
+    struct list_head  *pTmpTableList = NULL;
+    struct list_head  *pList = NULL;
+    struct list_head  *pTmpList = NULL;
+
+    if (gOfcDpGlobals.flowTableListHead.next == NULL)
+    {
+        /* Flow tables were not created */
+        return;
+    }
+
+    list_for_each_safe (pTableList, pTmpTableList, 
+                        &gOfcDpGlobals.flowTableListHead)
+    {
+        pFlowTable = (tOfcFlowTable *) pTableList;
+        list_for_each_safe (pList, pTmpList, &pFlowTable->flowEntryList)
+        {
+            list_del_init (pList);
+            OfcDpFreeFlowEntry ((tOfcFlowEntry *) pList);
+        }
+        list_del_init (&pFlowTable->list);
+        kfree (pFlowTable);
+        pFlowTable = NULL;
+    }
+
+    return;
+}
+
 /******************************************************************                                                                          
 * Function: OfcDpProcessPktOpenFlowPipeline
 *
 * Description: This function processes packet via OpenFlow
 *              processing pipeline
 *
-* Input: pPkt - Pointer to data packet
-*        pktLen - Packet length
-*        inPort - Input port
+* Input: pDpPkt - Pointer to data packet
 *
 * Output: None
 *
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcDpProcessPktOpenFlowPipeline (__u8 *pPkt, __u32 pktLen, 
-                                     __u8 inPort)
+int OfcDpProcessPktOpenFlowPipeline (tOfcDpPkt *pDpPkt)
 {
     tOfcFlowTable   *pFlowTable = NULL;
     tOfcFlowEntry   *pMatchFlow = NULL;
-    tDpCpMsgQ       msgQ;
     tOfcMatchFields pktMatchFields;
-    __u8            *pDataPkt = NULL;
-    __u8            maxOutPorts = OFC_MAX_FLOW_TABLES * 
-                                  (gNumOpenFlowIf + OFPP_NUM);
-    __u32           aOutPortList[maxOutPorts];
-    __u32           outPort = 0;
+    __u32           aOutPortList[OFC_MAX_OUT_PORTS];
     __u8            numOutPorts = 0;
-    __u8            portIndex = 0;
     __u8            tableId = 0;
     __u8            isTableMiss = OFC_FALSE;
-    __u8            dataIfNum = 0;
-
-    printk (KERN_INFO "Processing data packet...\r\n");
+    __u8            inPort = pDpPkt->inPort;
 
     memset (aOutPortList, 0, sizeof(aOutPortList));
     memset (&pktMatchFields, 0, sizeof(pktMatchFields));
 
-    /* Extract packet headers to match flow */
-    OfcDpExtractPktHdrs (pPkt, pktLen, inPort, &pktMatchFields);
+    /* Extract packet headers referenced by installed flows */
+    memset (&pDpPkt->meta, 0, sizeof (pDpPkt->meta));
+    OfcDpExtractPktHdrs (pDpPkt->pPkt, pDpPkt->pktLen, inPort,
+                         gOfcDpGlobals.matchFieldMask, &pktMatchFields,
+                         &pDpPkt->meta);
+    pDpPkt->pMatchFields = &pktMatchFields;
+    pDpPkt->parsedFieldMask = gOfcDpGlobals.matchFieldMask;
 
     /* Start processing with flows in table 0 */
     tableId = OFC_FIRST_TABLE_INDEX;
     while (tableId < OFC_MAX_FLOW_TABLES)
     {
+        /* Actions of previous table may have pushed or popped
+         * headers, refresh match fields before next lookup */
+        if (pDpPkt->isHdrModified == OFC_TRUE)
+        {
+            memset (&pktMatchFields, 0, sizeof(pktMatchFields));
+            memset (&pDpPkt->meta, 0, sizeof (pDpPkt->meta));
+            OfcDpExtractPktHdrs (pDpPkt->pPkt, pDpPkt->pktLen, inPort,
+                                 gOfcDpGlobals.matchFieldMask,
+                                 &pktMatchFields, &pDpPkt->meta);
+            pDpPkt->parsedFieldMask = gOfcDpGlobals.matchFieldMask;
+            pDpPkt->isHdrModified = OFC_FALSE;
+        }
+
         pFlowTable = OfcDpGetFlowTableEntry (tableId);
         if (pFlowTable == NULL)
         {
@@ -445,6 +926,9 @@ int OfcDpProcessPktOpenFlowPipeline (__u8 *pPkt, __u32 pktLen,
         /* Update flow table lookup count for statistics */
         pFlowTable->lookupCount++;
 
+        /* Metadata is matched along with packet headers */
+        pktMatchFields.metadata = pDpPkt->metadata;
+
         /* Get best match flow */
         pMatchFlow = OfcDpGetBestMatchFlow (pktMatchFields,
                                             &pFlowTable->flowEntryList,
@@ -459,35 +943,87 @@ int OfcDpProcessPktOpenFlowPipeline (__u8 *pPkt, __u32 pktLen,
         /* Update flow statistics */
         pFlowTable->matchCount++;
         pMatchFlow->pktMatchCount++;
-        pMatchFlow->byteMatchCount += pktLen;
+        pMatchFlow->byteMatchCount += pDpPkt->pktLen;
+        pDpPkt->pMatchFlow = pMatchFlow;
+        pDpPkt->isTableMiss = isTableMiss;
 
         /* This will be updated during instruction execution */
         /* If instruction is not GOTO_TABLE then loop will terminate */
         tableId = OFC_MAX_FLOW_TABLES;
 
         /* Execute flow instruction */
-        if (OfcDpExecuteFlowInstr (pPkt, pktLen, inPort, 
-                                   &pMatchFlow->instrList, 
+        if (OfcDpExecuteFlowInstr (pDpPkt, &pMatchFlow->instrList,
                                    &tableId, aOutPortList, &numOutPorts) 
             != OFC_SUCCESS)
         {
             printk (KERN_CRIT "Failed to execute flow instruction\r\n ");
             return OFC_FAILURE;
         }
+
+        if (pDpPkt->isDropped == OFC_TRUE)
+        {
+            /* Packet exceeded meter rate */
+            return OFC_SUCCESS;
+        }
     }
 
-    /* Apply action list (TODO) */
+    /* Execute accumulated action set */
+    if (OfcDpExecuteActionSet (pDpPkt, aOutPortList, &numOutPorts)
+        != OFC_SUCCESS)
+    {
+        return OFC_FAILURE;
+    }
 
     /* Send packet to output ports */
+    return OfcDpOutputPkt (pDpPkt, aOutPortList, numOutPorts);
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpOutputPkt
+*
+* Description: This function sends packet to each port of output
+*              port list, including reserved ports
+*
+* Input: pDpPkt - Pointer to data packet
+*        pOutPortList - Pointer to output port list
+*        numOutPorts - Number of ports in output port list
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpOutputPkt (tOfcDpPkt *pDpPkt, __u32 *pOutPortList,
+                    __u8 numOutPorts)
+{
+    tOfcFlowEntry   *pMatchFlow = pDpPkt->pMatchFlow;
+    tOfcDpPkt       meterDpPkt;
+    tDpCpMsgQ       msgQ;
+    __u8            *pDataPkt = NULL;
+    __u8            *pPkt = pDpPkt->pPkt;
+    __u32           pktLen = pDpPkt->pktLen;
+    __u32           outPort = 0;
+    __u32           txPortMask = 0;
+    __u32           inPortMask = 0;
+    __u32           flowHash = 0;
+    __u8            portIndex = 0;
+    __u8            pktInReason = 0;
+    __u8            inPort = pDpPkt->inPort;
+    int             pktInClass = 0;
+
+    if (inPort < gNumOpenFlowIf)
+    {
+        inPortMask = (1 << inPort);
+    }
+
+    /* Physical ports are collected in a mask so that packet is
+     * built once and transmitted on all ports together */
     for (portIndex = 0; portIndex < numOutPorts; portIndex++)
     {
-        outPort = aOutPortList[portIndex];
+        outPort = pOutPortList[portIndex];
 
-        /* TODO: Support OFPP_NORMAL || OFPP_LOCAL?? */
-        /* TODO: Support OFPP_FLOOD */
-        if ((outPort == OFPP_NORMAL) || 
-            (outPort == OFPP_LOCAL) ||
-            (outPort == OFPP_FLOOD))
+        /* TODO: Support OFPP_LOCAL?? */
+        if (outPort == OFPP_LOCAL)
         {
             printk (KERN_INFO "[%s]: OutPort:0x%x not supported\r\n",
                     __func__, outPort);
@@ -496,67 +1032,179 @@ int OfcDpProcessPktOpenFlowPipeline (__u8 *pPkt, __u32 pktLen,
 
         if (outPort == OFPP_CONTROLLER)
         {
-            /* Send packet-in to controller */
-            /* This is done by sending the packet to control
-             * path task */
-            pDataPkt = (__u8 *) kmalloc (pktLen, GFP_KERNEL);
-            if (pDataPkt == NULL)
+            if (pMatchFlow == NULL)
             {
-                printk (KERN_CRIT "[%s]: Failed to allocate memory to "
-                                  "data packet\r\n", __func__);
+                /* Packet-out to controller is not supported */
                 continue;
             }
-            memset (pDataPkt, 0, pktLen);
-            memcpy (pDataPkt, pPkt, pktLen);
-            memset (&msgQ, 0, sizeof(msgQ));
 
-            msgQ.pPkt = pDataPkt;
-            msgQ.pktLen = pktLen;
-            /* Port n in switch corresponds to port n+1 for controller */
-            msgQ.inPort = inPort + 1;
-            msgQ.msgType = (isTableMiss == OFC_TRUE) ? OFCR_NO_MATCH :
-                                                       OFCR_ACTION;
-            msgQ.tableId = pMatchFlow->tableId;
-            msgQ.pFlowEntry = pMatchFlow;
-            if (isTableMiss == OFC_TRUE)
+            if ((inPort < gNumOpenFlowIf) &&
+                (gOfcDpGlobals.aPortConfig[inPort] & OFPPC_NO_PACKET_IN))
             {
-                msgQ.cookie.hi = 0xFFFFFFFF;
-                msgQ.cookie.lo = 0xFFFFFFFF;
+                continue;
             }
-            else
+
+            if (ACCESS_ONCE (gOfcCpGlobals.numCntrlUp) == 0)
             {
-                memcpy (&msgQ.cookie, &pMatchFlow->cookie, 
-                        sizeof(msgQ.cookie));
+                /* Controller unreachable. Packet is dropped in fail
+                 * secure mode, fail standalone mode forwards it as
+                 * learning switch */
+                if (gFailMode == OFC_FAIL_STANDALONE)
+                {
+                    txPortMask |= OfcDpNormalForward (pDpPkt);
+                }
+                continue;
+            }
+
+            /* Packet is not copied if no controller connection
+             * takes packet-ins of this reason */
+            pktInReason = (pDpPkt->isTableMiss == OFC_TRUE) ?
+                          OFCR_NO_MATCH : OFCR_ACTION;
+            if (!(ACCESS_ONCE (gOfcCpGlobals.pktInReasonMask) & 
+                  (1 << pktInReason)))
+            {
+                continue;
+            }
+
+            /* Later packets of a new flow also miss until controller
+             * installs the flow, only first of them is sent. Flow
+             * is identified by all headers, not only those matched
+             * by installed flows. */
+            OfcDpExtractAllPktHdrs (pDpPkt);
+            flowHash = jhash (pDpPkt->pMatchFields, 
+                              sizeof (tOfcMatchFields), 0);
+            if ((pDpPkt->isTableMiss == OFC_TRUE) &&
+                (OfcDpIsPendingMiss (pDpPkt->pMatchFields, 
+                                     pMatchFlow->tableId, flowHash)
+                 == OFC_TRUE))
+            {
+                gOfcDpGlobals.pendingMissCount++;
+                continue;
+            }
+
+            /* Controller is not keeping up with packet-ins, send a
+             * sample of them until queue drains. Data traffic is
+             * not affected */
+            if ((OfcQueueIsThrottled (&gOfcCpGlobals.dpMsgQ) == OFC_TRUE) &&
+                ((++gOfcDpGlobals.pktInSampleCount % 
+                  OFC_PKT_IN_SAMPLE_RATE) != 0))
+            {
+                atomic_long_inc (&gOfcCpGlobals.dpMsgQ.dropCount);
+                continue;
+            }
+
+            /* Send packet-in to controller */
+            /* This is done by sending the packet to control
+             * path task */
+            pDataPkt = (__u8 *) kmalloc (pktLen, GFP_KERNEL);
+            if (pDataPkt == NULL)
+            {
+                printk (KERN_CRIT "[%s]: Failed to allocate memory to "
+                                  "data packet\r\n", __func__);
+                continue;
+            }
+            memset (pDataPkt, 0, pktLen);
+            memcpy (pDataPkt, pPkt, pktLen);
+
+            /* Packet-ins are rate limited by controller meter */
+            memset (&meterDpPkt, 0, sizeof (meterDpPkt));
+            meterDpPkt.pBuf = pDataPkt;
+            meterDpPkt.pPkt = pDataPkt;
+            meterDpPkt.pktLen = pktLen;
+            if ((OfcDpApplyMeter (&meterDpPkt, OFPM_CONTROLLER)
+                 == OFC_SUCCESS) && (meterDpPkt.isDropped == OFC_TRUE))
+            {
+                kfree (pDataPkt);
+                pDataPkt = NULL;
+                continue;
             }
 
-            OfcDpSendToCpQ (&msgQ);
+            memset (&msgQ, 0, sizeof(msgQ));
+
+            msgQ.pPkt = pDataPkt;
+            msgQ.pktLen = pktLen;
+            /* Port n in switch corresponds to port n+1 for controller */
+            msgQ.inPort = inPort + 1;
+            msgQ.msgType = pktInReason;
+            msgQ.tableId = pMatchFlow->tableId;
+            memcpy (&msgQ.matchFields, &pMatchFlow->matchFields,
+                    sizeof(msgQ.matchFields));
+            msgQ.flowHash = flowHash;
+            if (pDpPkt->isTableMiss == OFC_TRUE)
+            {
+                msgQ.cookie.hi = 0xFFFFFFFF;
+                msgQ.cookie.lo = 0xFFFFFFFF;
+            }
+            else
+            {
+                memcpy (&msgQ.cookie, &pMatchFlow->cookie, 
+                        sizeof(msgQ.cookie));
+            }
+
+            /* A storm on one port must not take all of controller
+             * connection. Checked last, so that tokens are taken
+             * only by packet-ins that are sent */
+            pktInClass = (pDpPkt->isTableMiss == OFC_TRUE) ?
+                         OFC_PKT_IN_MISS : OFC_PKT_IN_ACTION;
+            if (OfcDpIsPktInAllowed (inPort, pktInClass) != OFC_TRUE)
+            {
+                kfree (pDataPkt);
+                pDataPkt = NULL;
+                continue;
+            }
+
+            if (OfcDpSendToCpQ (&msgQ) != OFC_SUCCESS)
+            {
+                /* Packet-in queue is full */
+                OfcDpReturnPktInTokens (inPort, pktInClass);
+                kfree (pDataPkt);
+                pDataPkt = NULL;
+                continue;
+            }
             OfcCpSendEvent (OFC_DP_TO_CP_EVENT);
+
+            /* Later packets of flow are held back only once its
+             * packet-in is on the way to controller */
+            if (pDpPkt->isTableMiss == OFC_TRUE)
+            {
+                OfcDpAddPendingMiss (pDpPkt->pMatchFields, 
+                                     pMatchFlow->tableId, flowHash);
+            }
         }
         else if (outPort == OFPP_ALL)
         {
-            /* Send packet through all OpenFlow ports */
-            for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; 
-                 dataIfNum++)
-            {
-                if (dataIfNum == inPort)
-                {
-                    /* Do not send packet through input port */
-                    continue;
-                }
-                OfcDpSendDataPktOnSock (dataIfNum, pPkt, pktLen);
-            }
+            /* Send packet through all OpenFlow ports except input
+             * port */
+            txPortMask |= OFC_ALL_PORT_MASK & ~inPortMask;
+        }
+        else if (outPort == OFPP_FLOOD)
+        {
+            /* There is no spanning tree, flooding leaves out only
+             * input port and ports configured with OFPPC_NO_FLOOD */
+            txPortMask |= gOfcDpGlobals.floodPortMask & ~inPortMask;
+        }
+        else if (outPort == OFPP_NORMAL)
+        {
+            txPortMask |= OfcDpNormalForward (pDpPkt);
         }
         else if (outPort == OFPP_IN_PORT)
         {
-            OfcDpSendDataPktOnSock (inPort, pPkt, pktLen);
+            txPortMask |= inPortMask;
         }
-        else
+        else if ((outPort >= 1) && (outPort <= gNumOpenFlowIf))
         {
             /* Output port n corresponds to dataIfNum n-1 */
-            OfcDpSendDataPktOnSock (outPort - 1, pPkt, pktLen);
+            txPortMask |= (1 << (outPort - 1));
         }
     }
 
+    /* Ports configured down or no-forward do not transmit */
+    txPortMask &= gOfcDpGlobals.fwdPortMask;
+    if (txPortMask != 0)
+    {
+        OfcDpXmitPktOnPorts (pPkt, pktLen, txPortMask);
+    }
+
     return OFC_SUCCESS;
 }
 
@@ -593,33 +1241,49 @@ tOfcFlowEntry *OfcDpGetBestMatchFlow (tOfcMatchFields pktMatchFields,
         pFlowEntry = (tOfcFlowEntry *) pList;
         /* Match fields for this flow entry */
 
-        if (memcmp (pFlowEntry->matchFields.aDstMacAddr, 
+        if (memcmp (pFlowEntry->matchMask.aDstMacAddr, 
                     aNullMacAddr, OFC_MAC_ADDR_LEN))
         {
             /* Match destination MAC address */
-            if (memcmp (pFlowEntry->matchFields.aDstMacAddr,
-                        pktMatchFields.aDstMacAddr, OFC_MAC_ADDR_LEN))
+            if (OfcDpIsMaskedMatch (pFlowEntry->matchFields.aDstMacAddr,
+                                    pFlowEntry->matchMask.aDstMacAddr,
+                                    pktMatchFields.aDstMacAddr,
+                                    OFC_MAC_ADDR_LEN) != OFC_TRUE)
             {
                 continue;
             }
         }
 
-        if (memcmp (pFlowEntry->matchFields.aSrcMacAddr,
+        if (memcmp (pFlowEntry->matchMask.aSrcMacAddr,
                     aNullMacAddr, OFC_MAC_ADDR_LEN))
         {
             /* Match source MAC address */
-            if (memcmp (pFlowEntry->matchFields.aSrcMacAddr,
-                        pktMatchFields.aSrcMacAddr, OFC_MAC_ADDR_LEN))
+            if (OfcDpIsMaskedMatch (pFlowEntry->matchFields.aSrcMacAddr,
+                                    pFlowEntry->matchMask.aSrcMacAddr,
+                                    pktMatchFields.aSrcMacAddr,
+                                    OFC_MAC_ADDR_LEN) != OFC_TRUE)
             {
                 continue;
             }
         }
 
-        if (pFlowEntry->matchFields.vlanId != 0)
+        if (pFlowEntry->matchMask.vlanId != 0)
         {
-            /* Match VLAN ID */
+            /* Match VLAN ID, flow may match untagged packets with
+             * OFPVID_NONE or any tag with OFPVID_PRESENT */
             if (pFlowEntry->matchFields.vlanId != 
-                pktMatchFields.vlanId)
+                (pktMatchFields.vlanId & pFlowEntry->matchMask.vlanId))
+            {
+                continue;
+            }
+        }
+
+        if (pFlowEntry->matchMask.metadata != 0)
+        {
+            /* Match metadata written by previous tables */
+            if (pFlowEntry->matchFields.metadata !=
+                (pktMatchFields.metadata & 
+                 pFlowEntry->matchMask.metadata))
             {
                 continue;
             }
@@ -635,21 +1299,23 @@ tOfcFlowEntry *OfcDpGetBestMatchFlow (tOfcMatchFields pktMatchFields,
             }
         }
 
-        if (pFlowEntry->matchFields.srcIpAddr != 0)
+        if (pFlowEntry->matchMask.srcIpAddr != 0)
         {
-            /* Match source IP address */
+            /* Match source IP address prefix */
             if (pFlowEntry->matchFields.srcIpAddr !=
-                pktMatchFields.srcIpAddr)
+                (pktMatchFields.srcIpAddr & 
+                 pFlowEntry->matchMask.srcIpAddr))
             {
                 continue;
             }
         }
 
-        if (pFlowEntry->matchFields.dstIpAddr != 0)
+        if (pFlowEntry->matchMask.dstIpAddr != 0)
         {
-            /* Match destination IP address */
+            /* Match destination IP address prefix */
             if (pFlowEntry->matchFields.dstIpAddr !=
-                pktMatchFields.dstIpAddr)
+                (pktMatchFields.dstIpAddr &
+                 pFlowEntry->matchMask.dstIpAddr))
             {
                 continue;
             }
@@ -665,7 +1331,7 @@ tOfcFlowEntry *OfcDpGetBestMatchFlow (tOfcMatchFields pktMatchFields,
             }
         }
 
-        if (pFlowEntry->matchFields.srcPortNum != 0)
+        if (pFlowEntry->matchMask.srcPortNum != 0)
         {
             /* Check for L4 protocol type */
             if (pFlowEntry->matchFields.l4HeaderType != 
@@ -675,13 +1341,14 @@ tOfcFlowEntry *OfcDpGetBestMatchFlow (tOfcMatchFields pktMatchFields,
             }
             /* Match L4 source port number */
             if (pFlowEntry->matchFields.srcPortNum !=
-                pktMatchFields.srcPortNum)
+                (pktMatchFields.srcPortNum &
+                 pFlowEntry->matchMask.srcPortNum))
             {
                 continue;
             }
         }
 
-        if (pFlowEntry->matchFields.dstPortNum != 0)
+        if (pFlowEntry->matchMask.dstPortNum != 0)
         {
             /* Check for L4 protocol type */
             if (pFlowEntry->matchFields.l4HeaderType != 
@@ -691,17 +1358,60 @@ tOfcFlowEntry *OfcDpGetBestMatchFlow (tOfcMatchFields pktMatchFields,
             }
             /* Match L4 destination port number */
             if (pFlowEntry->matchFields.dstPortNum !=
-                pktMatchFields.dstPortNum)
+                (pktMatchFields.dstPortNum &
+                 pFlowEntry->matchMask.dstPortNum))
             {
                 continue;
             }
         }
 
-        if (pFlowEntry->matchFields.arpFlds.targetIpAddr != 0)
+        if (pFlowEntry->matchMask.arpFlds.targetIpAddr != 0)
         {
             /* Match ARP target IP address */
             if (pFlowEntry->matchFields.arpFlds.targetIpAddr !=
-                pktMatchFields.arpFlds.targetIpAddr)
+                (pktMatchFields.arpFlds.targetIpAddr &
+                 pFlowEntry->matchMask.arpFlds.targetIpAddr))
+            {
+                continue;
+            }
+        }
+
+        if (pFlowEntry->matchFields.mplsMatchFlags != 0)
+        {
+            /* Match outermost MPLS label stack entry */
+            if (!pktMatchFields.mplsMatchFlags)
+            {
+                continue;
+            }
+            if ((pFlowEntry->matchFields.mplsMatchFlags & 
+                 OFC_MPLS_LABEL_MATCH) &&
+                (pFlowEntry->matchFields.mplsLabel != 
+                 pktMatchFields.mplsLabel))
+            {
+                continue;
+            }
+            if ((pFlowEntry->matchFields.mplsMatchFlags & 
+                 OFC_MPLS_TC_MATCH) &&
+                (pFlowEntry->matchFields.mplsTc != 
+                 pktMatchFields.mplsTc))
+            {
+                continue;
+            }
+            if ((pFlowEntry->matchFields.mplsMatchFlags & 
+                 OFC_MPLS_BOS_MATCH) &&
+                (pFlowEntry->matchFields.mplsBos != 
+                 pktMatchFields.mplsBos))
+            {
+                continue;
+            }
+        }
+
+        if (pFlowEntry->matchFields.extMatchFlags != 0)
+        {
+            /* Match IPv6, ICMP, ARP, TCP flags and fragment fields */
+            if (OfcDpIsExtFieldsMatch (&pFlowEntry->matchFields,
+                                       &pFlowEntry->matchMask,
+                                       &pktMatchFields) != OFC_TRUE)
             {
                 continue;
             }
@@ -731,9 +1441,12 @@ tOfcFlowEntry *OfcDpGetBestMatchFlow (tOfcMatchFields pktMatchFields,
         break;
     }
 
-    /* Check whether the best match flow is table-miss flow */
-    if (!memcmp (&pBestMatchFlow->matchFields, &tableMissEntry, 
-                 sizeof(tOfcMatchFields)))
+    /* Check whether the best match flow is table-miss flow. A
+     * masked field may have zero value, so mask is checked too */
+    if ((!memcmp (&pBestMatchFlow->matchFields, &tableMissEntry, 
+                  sizeof(tOfcMatchFields))) &&
+        (!memcmp (&pBestMatchFlow->matchMask, &tableMissEntry, 
+                  sizeof(tOfcMatchFields))))
     {
         /* Table-miss occurred */
         *pIsTableMiss = OFC_TRUE;
@@ -748,9 +1461,7 @@ tOfcFlowEntry *OfcDpGetBestMatchFlow (tOfcMatchFields pktMatchFields,
 * Description: This function processes instruction of matching
 *              flow entry
 *
-* Input: pPkt - Pointer to data packet
-*        pktLen - Packet length
-*        inPort - Input port
+* Input: pDpPkt - Pointer to data packet
 *        pInstr - Pointer to instruction list
 *
 * Output: pTableId - Pointer to new table Id
@@ -760,7 +1471,7 @@ tOfcFlowEntry *OfcDpGetBestMatchFlow (tOfcMatchFields pktMatchFields,
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcDpExecuteFlowInstr (__u8 *pPkt, __u32 pktLen, __u8 inPort,
+int OfcDpExecuteFlowInstr (tOfcDpPkt *pDpPkt,
                            struct list_head *pInstrList, __u8 *pTableId, 
                            __u32 *pOutPortList, __u8 *pNumOutPorts)
 {
@@ -775,16 +1486,48 @@ int OfcDpExecuteFlowInstr (__u8 *pPkt, __u32 pktLen, __u8 inPort,
         {
             case OFCIT_APPLY_ACTIONS:
                 pActions = &pInstr->u.actionList;
-                OfcDpApplyInstrActions (pPkt, pktLen, inPort,
-                                        pActions, pOutPortList,
-                                        pNumOutPorts);
+                if (OfcDpApplyInstrActions (pDpPkt, pActions,
+                                            pOutPortList, pNumOutPorts)
+                    != OFC_SUCCESS)
+                {
+                    /* Packet cannot be forwarded further */
+                    return OFC_FAILURE;
+                }
+                break;
+
+            case OFCIT_METER:
+                /* Instructions are kept in execution order by
+                 * control path, meter is first */
+                if (OfcDpApplyMeter (pDpPkt, pInstr->u.meterId)
+                    != OFC_SUCCESS)
+                {
+                    /* Meter of flow no longer exists */
+                    pDpPkt->isDropped = OFC_TRUE;
+                }
+                if (pDpPkt->isDropped == OFC_TRUE)
+                {
+                    return OFC_SUCCESS;
+                }
                 break;
 
-            /* TODO: These instructions */
             case OFCIT_CLEAR_ACTIONS:
+                pDpPkt->actionSetMask = 0;
                 break;
 
             case OFCIT_WRITE_ACTIONS:
+                if (OfcDpWriteActionSet (pDpPkt, &pInstr->u.actionList)
+                    != OFC_SUCCESS)
+                {
+                    return OFC_FAILURE;
+                }
+                break;
+
+            case OFCIT_WRITE_METADATA:
+                pDpPkt->metadata = 
+                    (pDpPkt->metadata & 
+                     ~pInstr->u.writeMetadata.metadataMask) |
+                    (pInstr->u.writeMetadata.metadata &
+                     pInstr->u.writeMetadata.metadataMask);
                 break;
 
             case OFCIT_GOTO_TABLE:
@@ -803,11 +1546,11 @@ int OfcDpExecuteFlowInstr (__u8 *pPkt, __u32 pktLen, __u8 inPort,
 * Function: OfcDpApplyInstrActions
 *
 * Description: This function applies the actions list specified in
-*              flow entry instructions
+*              flow entry instructions. Packet is sent to output
+*              ports of the list before it returns, so that later
+*              instructions and action set do not alter it.
 *
-* Input: pPkt - Pointer to data packet
-*        pktLen - Packet length
-*        inPort - Input port
+* Input: pDpPkt - Pointer to data packet
 *        pActions - Pointer to action list
 *
 * Output: pOutPortList - Pointer to output port list
@@ -815,311 +1558,3525 @@ int OfcDpExecuteFlowInstr (__u8 *pPkt, __u32 pktLen, __u8 inPort,
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcDpApplyInstrActions (__u8 *pPkt, __u32 pktLen, __u8 inPort,
+int OfcDpApplyInstrActions (tOfcDpPkt *pDpPkt,
                             struct list_head *pActionsList,
                             __u32 *pOutPortList, __u8 *pNumOutPorts)
 {
     tOfcActionList   *pActions = NULL;
     struct list_head *pList = NULL;
-    __u8             numPorts = *pNumOutPorts;
 
     list_for_each (pList, pActionsList)
     {
         pActions = (tOfcActionList *) pList;
-        switch (pActions->actionType)
+        if (OfcDpApplyAction (pDpPkt, pActions, pOutPortList,
+                              pNumOutPorts) != OFC_SUCCESS)
         {
-            case OFCAT_OUTPUT:
-                pOutPortList[numPorts++] = pActions->u.outPort;
-                *pNumOutPorts = numPorts;
-                break;
-
-            /* TODO: Set Fields action */
-            default:
-                printk (KERN_CRIT "Unsupported action!!\r\n");
-                return OFC_FAILURE;
+            printk (KERN_INFO "[%s]: Action %d failed, dropping "
+                              "packet\r\n", __func__,
+                              pActions->actionType);
+            return OFC_FAILURE;
         }
     }
 
+    OfcDpFlushOutput (pDpPkt, pOutPortList, pNumOutPorts);
     return OFC_SUCCESS;
 }
 
 /******************************************************************                                                                          
-* Function: OfcDpInsertFlowEntry
+* Function: OfcDpApplyAction
 *
-* Description: This function inserts flow entry in flow table
+* Description: This function applies a single action on packet.
+*              Output actions add port to output port list, so
+*              that consecutive outputs share one transmit. The
+*              list is sent before any other action, since that
+*              may modify the packet.
 *
-* Input: pFlowEntry - Pointer to flow entry
+* Input: pDpPkt - Pointer to data packet
+*        pActions - Pointer to action
 *
-* Output: None
+* Output: pOutPortList - Pointer to output port list
+*         pNumOutPorts - Number of ports in output port list
 *
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcDpInsertFlowEntry (tOfcFlowEntry *pFlowEntry)
+int OfcDpApplyAction (tOfcDpPkt *pDpPkt, tOfcActionList *pActions,
+                      __u32 *pOutPortList, __u8 *pNumOutPorts)
 {
-    tOfcFlowTable     *pFlowTable = NULL;
-    tOfcFlowEntry     *pFlowEntryParser = NULL;
-    struct list_head  *pList = NULL;
-    __u8              tableId = 0;
+    int retVal = OFC_SUCCESS;
 
-    tableId = pFlowEntry->tableId;
-    pFlowTable = OfcDpGetFlowTableEntry (tableId);
-    if (pFlowTable == NULL)
+    if (pActions->actionType != OFCAT_OUTPUT)
     {
-        printk (KERN_CRIT "Invalid flow table Id in flow entry\r\n");
-        kfree (pFlowEntry);
-        pFlowEntry = NULL;
-        return OFC_FAILURE;
+        /* Earlier outputs get packet as it is now */
+        OfcDpFlushOutput (pDpPkt, pOutPortList, pNumOutPorts);
     }
 
-    /* Entries are inserted in decreasing order of priorities i.e.
-     * flow entries with greater priorities are inserted ahead of
-     * flow entries with lower priorities. If two flows have
-     * equal priority then the new flow is inserted ahead of the
-     * older flow */
-    list_for_each (pList, &pFlowTable->flowEntryList)
+    switch (pActions->actionType)
     {
-        pFlowEntryParser = (tOfcFlowEntry *) pList;
+        case OFCAT_OUTPUT:
+            if (*pNumOutPorts >= OFC_MAX_OUT_PORTS)
+            {
+                /* Send earlier outputs to make room */
+                OfcDpFlushOutput (pDpPkt, pOutPortList, pNumOutPorts);
+            }
+            pOutPortList[(*pNumOutPorts)++] = pActions->u.outPort;
+            break;
 
-        if (pFlowEntry->priority < pFlowEntryParser->priority)
-        {
-            continue;
-        }
+        case OFCAT_GROUP:
+            retVal = OfcDpExecuteGroup (pDpPkt, pActions->u.groupId);
+            break;
 
-        printk (KERN_INFO "Inserting entry in flow table\r\n");
-        /* Insert new flow before this flow entry */
-        INIT_LIST_HEAD (&pFlowEntry->list);
-        list_add_tail (&pFlowEntry->list, &pFlowEntryParser->list);
-        break;
+        case OFCAT_PUSH_VLAN:
+            retVal = OfcDpPushVlanTag (pDpPkt, pActions->u.etherType);
+            break;
+
+        case OFCAT_POP_VLAN:
+            retVal = OfcDpPopVlanTag (pDpPkt);
+            break;
+
+        case OFCAT_PUSH_MPLS:
+            retVal = OfcDpPushMplsShim (pDpPkt, pActions->u.etherType);
+            break;
+
+        case OFCAT_POP_MPLS:
+            retVal = OfcDpPopMplsShim (pDpPkt, pActions->u.etherType);
+            break;
+
+        case OFCAT_SET_MPLS_TTL:
+        case OFCAT_DEC_MPLS_TTL:
+        case OFCAT_SET_NW_TTL:
+        case OFCAT_DEC_NW_TTL:
+            retVal = OfcDpSetTtl (pDpPkt, pActions->actionType,
+                                  pActions->u.ttl);
+            break;
+
+        case OFCAT_COPY_TTL_OUT:
+        case OFCAT_COPY_TTL_IN:
+            retVal = OfcDpCopyTtl (pDpPkt, pActions->actionType);
+            break;
+
+        /* TODO: Set Fields action */
+        default:
+            printk (KERN_CRIT "Unsupported action!!\r\n");
+            return OFC_FAILURE;
     }
 
-    return OFC_SUCCESS;
+    return retVal;
 }
 
 /******************************************************************                                                                          
-* Function: OfcDpDeleteFlowEntry
+* Function: OfcDpFlushOutput
 *
-* Description: This function deletes flow entry from flow table
+* Description: This function sends packet to ports collected in
+*              output port list by output actions, and empties the
+*              list
 *
-* Input: pFlowEntry - Pointer to flow entry
+* Input: pDpPkt - Pointer to data packet
+*        pOutPortList - Pointer to output port list
+*
+* Output: pNumOutPorts - Number of ports in output port list, zero
+*                        on return
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpFlushOutput (tOfcDpPkt *pDpPkt, __u32 *pOutPortList,
+                       __u8 *pNumOutPorts)
+{
+    if (*pNumOutPorts == 0)
+    {
+        return;
+    }
+
+    OfcDpOutputPkt (pDpPkt, pOutPortList, *pNumOutPorts);
+    *pNumOutPorts = 0;
+
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpWriteActionSet
+*
+* Description: This function merges actions of write-actions
+*              instruction into packet action set. Action set holds
+*              one action of each type, so an action replaces any
+*              action of same type already in the set.
+*
+* Input: pDpPkt - Pointer to data packet
+*        pActionsList - Pointer to action list
 *
 * Output: None
 *
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcDpDeleteFlowEntry (tOfcFlowEntry *pFlowEntry)
+int OfcDpWriteActionSet (tOfcDpPkt *pDpPkt,
+                         struct list_head *pActionsList)
 {
-    tOfcFlowTable     *pFlowTable = NULL;
-    tOfcFlowEntry     *pFlowEntryParser = NULL;
-    tOfcInstrList     *pInstrList = NULL;
-    struct list_head  *pList = NULL;
-    struct list_head  *pList2 = NULL;
-    __u8              tableId = 0;
+    tOfcActionList   *pActions = NULL;
+    struct list_head *pList = NULL;
 
-    tableId = pFlowEntry->tableId;
-    pFlowTable = OfcDpGetFlowTableEntry (tableId);
-    if (pFlowTable == NULL)
+    list_for_each (pList, pActionsList)
     {
-        printk (KERN_CRIT "Invalid flow table Id in flow entry\r\n");
-        list_for_each (pList2, &pFlowEntry->instrList)
-        {
-            pInstrList = (tOfcInstrList *) pList2;
-            OfcDeleteList (&pInstrList->u.actionList);
-        }  
-        OfcDeleteList (&pFlowEntry->instrList);
-        OfcDeleteList (&pFlowEntry->matchList);
-        kfree (pFlowEntry);
-        pFlowEntry = NULL;
-        return OFC_FAILURE;
+        pActions = (tOfcActionList *) pList;
+        if (pActions->actionType >= OFC_ACTION_SET_SIZE)
+        {
+            return OFC_FAILURE;
+        }
+
+        /* Flow entries are not freed while packet is in pipeline,
+         * therefore action is referenced instead of copied */
+        pDpPkt->apActionSet[pActions->actionType] = pActions;
+        pDpPkt->actionSetMask |= (1 << pActions->actionType);
     }
 
-#if 0
-    printk (KERN_INFO "Dumping pFlowEntry:\r\n");
-    OfcDumpFlowFields (pFlowEntry);
-    printk (KERN_INFO "\r\n");
-#endif
-    list_for_each (pList, &pFlowTable->flowEntryList)
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpExecuteActionSet
+*
+* Description: This function executes packet action set at end of
+*              pipeline, in the order specified by OpenFlow. Output
+*              action is ignored if action set has group action.
+*
+* Input: pDpPkt - Pointer to data packet
+*
+* Output: pOutPortList - Pointer to output port list
+*         pNumOutPorts - Number of ports in output port list
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpExecuteActionSet (tOfcDpPkt *pDpPkt, __u32 *pOutPortList,
+                           __u8 *pNumOutPorts)
+{
+    /* Action set execution order */
+    static const __u16 aActionSetOrder[] =
     {
-        pFlowEntryParser = (tOfcFlowEntry *) pList;
+        OFCAT_COPY_TTL_IN,
+        OFCAT_POP_VLAN,
+        OFCAT_POP_MPLS,
+        OFCAT_PUSH_MPLS,
+        OFCAT_PUSH_VLAN,
+        OFCAT_COPY_TTL_OUT,
+        OFCAT_DEC_MPLS_TTL,
+        OFCAT_DEC_NW_TTL,
+        OFCAT_SET_MPLS_TTL,
+        OFCAT_SET_NW_TTL,
+        OFCAT_GROUP,
+        OFCAT_OUTPUT
+    };
+    tOfcActionList *pActions = NULL;
+    __u32          actionSetMask = pDpPkt->actionSetMask;
+    __u16          actionType = 0;
+    __u8           index = 0;
 
-#if 0
-        printk (KERN_INFO "Dumping pFlowEntryParser:\r\n");
-        OfcDumpFlowFields (pFlowEntryParser);
-        printk (KERN_INFO "\r\n");
-#endif
+    if (actionSetMask == 0)
+    {
+        return OFC_SUCCESS;
+    }
 
-        if (pFlowEntryParser->hardTimeout != 
-            pFlowEntry->hardTimeout)
-        {
-            continue;
-        }
-        if (pFlowEntryParser->idleTimeout !=
-            pFlowEntry->idleTimeout)
-        {
-            continue;
-        }
+    if (actionSetMask & (1 << OFCAT_GROUP))
+    {
+        actionSetMask &= ~(1 << OFCAT_OUTPUT);
+    }
 
-        if (memcmp (&pFlowEntryParser->cookie, &pFlowEntry->cookie,
-                    sizeof (pFlowEntry->cookie)))
-        {
-            continue;
-        }
-        if (memcmp (&pFlowEntryParser->cookieMask,
-                    &pFlowEntry->cookieMask,
-                    sizeof (pFlowEntry->cookieMask)))
+    for (index = 0; index < ARRAY_SIZE (aActionSetOrder); index++)
+    {
+        actionType = aActionSetOrder[index];
+        if (!(actionSetMask & (1 << actionType)))
         {
             continue;
         }
 
-        if (pFlowEntryParser->flags != pFlowEntry->flags)
+        pActions = pDpPkt->apActionSet[actionType];
+        if (OfcDpApplyAction (pDpPkt, pActions, pOutPortList,
+                              pNumOutPorts) != OFC_SUCCESS)
         {
-            continue;
+            printk (KERN_INFO "[%s]: Action %d failed, dropping "
+                              "packet\r\n", __func__, actionType);
+            return OFC_FAILURE;
         }
+    }
 
-        if (pFlowEntryParser->priority != pFlowEntry->priority)
-        {
-            continue;
-        }
+    return OFC_SUCCESS;
+}
 
-        if (pFlowEntryParser->bufId != pFlowEntry->bufId)
+/******************************************************************                                                                          
+* Function: OfcDpGetL2HdrLen
+*
+* Description: This function computes the length of ethernet
+*              header including VLAN tags, i.e. the offset of the
+*              EtherType field that identifies the L3 payload.
+*              Offset found by packet parser is used if headers
+*              were not pushed or popped since.
+*
+* Input: pDpPkt - Pointer to data packet
+*
+* Output: pL2HdrLen - Offset of innermost EtherType
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpGetL2HdrLen (tOfcDpPkt *pDpPkt, __u16 *pL2HdrLen)
+{
+    __u16   offset = OFC_ETH_ADDRS_LEN;
+    __u16   etherType = 0;
+
+    if (pDpPkt->meta.l2HdrLen != 0)
+    {
+        *pL2HdrLen = pDpPkt->meta.l2HdrLen;
+        return OFC_SUCCESS;
+    }
+
+    while ((offset + OFC_ETHTYPE_LEN) <= pDpPkt->pktLen)
+    {
+        memcpy (&etherType, pDpPkt->pPkt + offset, sizeof (etherType));
+        etherType = ntohs (etherType);
+        if ((etherType != OFC_VLAN_TPID) && (etherType != OFC_QINQ_TPID))
         {
-            continue;
+            *pL2HdrLen = offset;
+            return OFC_SUCCESS;
         }
-        if (pFlowEntryParser->outPort != pFlowEntry->outPort)
+        offset += OFC_VLAN_TAG_LEN;
+    }
+
+    return OFC_FAILURE;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpPushVlanTag
+*
+* Description: This function pushes a new outermost VLAN tag. The
+*              MAC addresses are moved into packet headroom so the
+*              payload is never copied. VID and PCP are copied from
+*              the existing outer tag, if any.
+*
+* Input: pDpPkt - Pointer to data packet
+*        tpid - EtherType of new tag (0x8100 or 0x88a8)
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpPushVlanTag (tOfcDpPkt *pDpPkt, __u16 tpid)
+{
+    __u8    *pTag = NULL;
+    __u16   outerType = 0;
+    __u16   tci = 0;
+
+    if ((pDpPkt->pPkt - pDpPkt->pBuf) < OFC_VLAN_TAG_LEN)
+    {
+        printk (KERN_CRIT "[%s]: Insufficient headroom\r\n", __func__);
+        return OFC_FAILURE;
+    }
+    if (pDpPkt->pktLen < (OFC_ETH_ADDRS_LEN + OFC_ETHTYPE_LEN))
+    {
+        return OFC_FAILURE;
+    }
+
+    memcpy (&outerType, pDpPkt->pPkt + OFC_ETH_ADDRS_LEN,
+            sizeof (outerType));
+    if ((ntohs (outerType) == OFC_VLAN_TPID) ||
+        (ntohs (outerType) == OFC_QINQ_TPID))
+    {
+        memcpy (&tci, pDpPkt->pPkt + OFC_ETH_ADDRS_LEN + OFC_ETHTYPE_LEN,
+                sizeof (tci));
+    }
+
+    memmove (pDpPkt->pPkt - OFC_VLAN_TAG_LEN, pDpPkt->pPkt,
+             OFC_ETH_ADDRS_LEN);
+    pDpPkt->pPkt -= OFC_VLAN_TAG_LEN;
+    pDpPkt->pktLen += OFC_VLAN_TAG_LEN;
+
+    pTag = pDpPkt->pPkt + OFC_ETH_ADDRS_LEN;
+    tpid = htons (tpid);
+    memcpy (pTag, &tpid, sizeof (tpid));
+    memcpy (pTag + OFC_ETHTYPE_LEN, &tci, sizeof (tci));
+
+    pDpPkt->isHdrModified = OFC_TRUE;
+    memset (&pDpPkt->meta, 0, sizeof (pDpPkt->meta));
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpPopVlanTag
+*
+* Description: This function removes the outermost VLAN tag by
+*              sliding the MAC addresses over it
+*
+* Input: pDpPkt - Pointer to data packet
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpPopVlanTag (tOfcDpPkt *pDpPkt)
+{
+    __u16   outerType = 0;
+
+    if (pDpPkt->pktLen < (OFC_ETH_ADDRS_LEN + OFC_VLAN_TAG_LEN +
+                          OFC_ETHTYPE_LEN))
+    {
+        return OFC_FAILURE;
+    }
+
+    memcpy (&outerType, pDpPkt->pPkt + OFC_ETH_ADDRS_LEN,
+            sizeof (outerType));
+    if ((ntohs (outerType) != OFC_VLAN_TPID) &&
+        (ntohs (outerType) != OFC_QINQ_TPID))
+    {
+        printk (KERN_INFO "[%s]: No VLAN tag in packet\r\n", __func__);
+        return OFC_FAILURE;
+    }
+
+    memmove (pDpPkt->pPkt + OFC_VLAN_TAG_LEN, pDpPkt->pPkt,
+             OFC_ETH_ADDRS_LEN);
+    pDpPkt->pPkt += OFC_VLAN_TAG_LEN;
+    pDpPkt->pktLen -= OFC_VLAN_TAG_LEN;
+
+    pDpPkt->isHdrModified = OFC_TRUE;
+    memset (&pDpPkt->meta, 0, sizeof (pDpPkt->meta));
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpPushMplsShim
+*
+* Description: This function pushes a new outermost MPLS label
+*              stack entry after the ethernet header. Label, TC and
+*              TTL are copied from the existing outer label. For an
+*              IP packet the TTL is copied from the IP header.
+*
+* Input: pDpPkt - Pointer to data packet
+*        etherType - MPLS EtherType (0x8847 or 0x8848)
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpPushMplsShim (tOfcDpPkt *pDpPkt, __u16 etherType)
+{
+    __u16   l2HdrLen = 0;
+    __u16   innerType = 0;
+    __u32   shim = 0;
+    __u8    *pL3Hdr = NULL;
+
+    if ((pDpPkt->pPkt - pDpPkt->pBuf) < OFC_MPLS_SHIM_LEN)
+    {
+        printk (KERN_CRIT "[%s]: Insufficient headroom\r\n", __func__);
+        return OFC_FAILURE;
+    }
+    if (OfcDpGetL2HdrLen (pDpPkt, &l2HdrLen) != OFC_SUCCESS)
+    {
+        return OFC_FAILURE;
+    }
+
+    memcpy (&innerType, pDpPkt->pPkt + l2HdrLen, sizeof (innerType));
+    innerType = ntohs (innerType);
+    pL3Hdr = pDpPkt->pPkt + l2HdrLen + OFC_ETHTYPE_LEN;
+
+    if ((innerType == OFC_MPLS_ETHTYPE) || 
+        (innerType == OFC_MPLSM_ETHTYPE))
+    {
+        if ((l2HdrLen + OFC_ETHTYPE_LEN + OFC_MPLS_SHIM_LEN) > 
+            pDpPkt->pktLen)
         {
-            continue;
+            return OFC_FAILURE;
         }
-        if (pFlowEntryParser->outGrp != pFlowEntry->outGrp)
+        /* New entry is not bottom of stack */
+        memcpy (&shim, pL3Hdr, sizeof (shim));
+        shim = ntohl (shim);
+        shim &= ~(OFC_MPLS_BOS_MASK << OFC_MPLS_BOS_SHIFT);
+    }
+    else
+    {
+        shim = OFC_MPLS_BOS_MASK << OFC_MPLS_BOS_SHIFT;
+        if ((innerType == OFC_IP_ETHTYPE) &&
+            ((l2HdrLen + OFC_ETHTYPE_LEN + OFC_IP_TTL_OFFSET) < 
+             pDpPkt->pktLen))
         {
-            continue;
+            shim |= pL3Hdr[OFC_IP_TTL_OFFSET];
         }
-
-        if (pFlowEntryParser->tableId != pFlowEntry->tableId)
+        else if ((innerType == OFC_IPV6_ETHTYPE) &&
+                 ((l2HdrLen + OFC_ETHTYPE_LEN + 
+                   OFC_IPV6_HOP_LIMIT_OFFSET) < pDpPkt->pktLen))
         {
-            continue;
+            shim |= pL3Hdr[OFC_IPV6_HOP_LIMIT_OFFSET];
         }
+    }
 
-        if (memcmp (&pFlowEntryParser->matchFields,
-                    &pFlowEntry->matchFields,
-                    sizeof (pFlowEntry->matchFields)))
-        {
-            continue;
-        }
+    /* Slide ethernet header (including EtherType) into headroom */
+    memmove (pDpPkt->pPkt - OFC_MPLS_SHIM_LEN, pDpPkt->pPkt,
+             l2HdrLen + OFC_ETHTYPE_LEN);
+    pDpPkt->pPkt -= OFC_MPLS_SHIM_LEN;
+    pDpPkt->pktLen += OFC_MPLS_SHIM_LEN;
 
-        /* TODO: Match instruction list for deletion as well */
+    etherType = htons (etherType);
+    memcpy (pDpPkt->pPkt + l2HdrLen, &etherType, sizeof (etherType));
+    shim = htonl (shim);
+    memcpy (pDpPkt->pPkt + l2HdrLen + OFC_ETHTYPE_LEN, &shim,
+            sizeof (shim));
 
-        printk (KERN_INFO "Deleting entry from flow table\r\n");
+    pDpPkt->isHdrModified = OFC_TRUE;
+    memset (&pDpPkt->meta, 0, sizeof (pDpPkt->meta));
+    return OFC_SUCCESS;
+}
 
-        /* Flow entry found, delete it */
-        list_del_init (pList);
-        list_for_each (pList2, 
-                       &pFlowEntryParser->instrList)
+/******************************************************************                                                                          
+* Function: OfcDpPopMplsShim
+*
+* Description: This function removes the outermost MPLS label
+*              stack entry and sets the EtherType of the payload
+*
+* Input: pDpPkt - Pointer to data packet
+*        etherType - EtherType of the resulting payload
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpPopMplsShim (tOfcDpPkt *pDpPkt, __u16 etherType)
+{
+    __u16   l2HdrLen = 0;
+    __u16   outerType = 0;
+
+    if (OfcDpGetL2HdrLen (pDpPkt, &l2HdrLen) != OFC_SUCCESS)
+    {
+        return OFC_FAILURE;
+    }
+
+    memcpy (&outerType, pDpPkt->pPkt + l2HdrLen, sizeof (outerType));
+    outerType = ntohs (outerType);
+    if (((outerType != OFC_MPLS_ETHTYPE) && 
+         (outerType != OFC_MPLSM_ETHTYPE)) ||
+        ((l2HdrLen + OFC_ETHTYPE_LEN + OFC_MPLS_SHIM_LEN) > 
+         pDpPkt->pktLen))
+    {
+        printk (KERN_INFO "[%s]: No MPLS label in packet\r\n", 
+                __func__);
+        return OFC_FAILURE;
+    }
+
+    memmove (pDpPkt->pPkt + OFC_MPLS_SHIM_LEN, pDpPkt->pPkt,
+             l2HdrLen + OFC_ETHTYPE_LEN);
+    pDpPkt->pPkt += OFC_MPLS_SHIM_LEN;
+    pDpPkt->pktLen -= OFC_MPLS_SHIM_LEN;
+
+    etherType = htons (etherType);
+    memcpy (pDpPkt->pPkt + l2HdrLen, &etherType, sizeof (etherType));
+
+    pDpPkt->isHdrModified = OFC_TRUE;
+    memset (&pDpPkt->meta, 0, sizeof (pDpPkt->meta));
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpSetTtl
+*
+* Description: This function sets or decrements the TTL of the
+*              outermost MPLS label, or of the IPv4/IPv6 header.
+*              IPv4 header checksum is updated incrementally.
+*
+* Input: pDpPkt - Pointer to data packet
+*        actionType - OFCAT_SET/DEC_MPLS_TTL, OFCAT_SET/DEC_NW_TTL
+*        ttl - New TTL for set actions
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE (TTL expired or header absent)
+*
+*******************************************************************/
+int OfcDpSetTtl (tOfcDpPkt *pDpPkt, __u16 actionType, __u8 ttl)
+{
+    __u16   l2HdrLen = 0;
+    __u16   etherType = 0;
+    __u8    *pL3Hdr = NULL;
+    __u8    *pTtl = NULL;
+    __u8    isDec = OFC_FALSE;
+
+    if (OfcDpGetL2HdrLen (pDpPkt, &l2HdrLen) != OFC_SUCCESS)
+    {
+        return OFC_FAILURE;
+    }
+
+    memcpy (&etherType, pDpPkt->pPkt + l2HdrLen, sizeof (etherType));
+    etherType = ntohs (etherType);
+    pL3Hdr = pDpPkt->pPkt + l2HdrLen + OFC_ETHTYPE_LEN;
+    isDec = ((actionType == OFCAT_DEC_MPLS_TTL) || 
+             (actionType == OFCAT_DEC_NW_TTL)) ? OFC_TRUE : OFC_FALSE;
+
+    if ((actionType == OFCAT_SET_MPLS_TTL) ||
+        (actionType == OFCAT_DEC_MPLS_TTL))
+    {
+        if (((etherType != OFC_MPLS_ETHTYPE) && 
+             (etherType != OFC_MPLSM_ETHTYPE)) ||
+            ((l2HdrLen + OFC_ETHTYPE_LEN + OFC_MPLS_SHIM_LEN) > 
+             pDpPkt->pktLen))
         {
-            pInstrList = (tOfcInstrList *) pList2;
-            OfcDeleteList (&pInstrList->u.actionList);
+            return OFC_FAILURE;
         }
-        OfcDeleteList (&pFlowEntryParser->instrList);
-        OfcDeleteList (&pFlowEntryParser->matchList);
-        kfree (pFlowEntryParser);
-        pFlowEntryParser = NULL;
-        break;
+        /* TTL is the last byte of label stack entry */
+        pTtl = pL3Hdr + OFC_MPLS_SHIM_LEN - 1;
+    }
+    else if ((etherType == OFC_IP_ETHTYPE) &&
+             ((l2HdrLen + OFC_ETHTYPE_LEN + OFC_IP_CHKSUM_OFFSET + 
+               sizeof (__u16)) <= pDpPkt->pktLen))
+    {
+        pTtl = pL3Hdr + OFC_IP_TTL_OFFSET;
+    }
+    else if ((etherType == OFC_IPV6_ETHTYPE) &&
+             ((l2HdrLen + OFC_ETHTYPE_LEN + OFC_IPV6_HOP_LIMIT_OFFSET) <
+              pDpPkt->pktLen))
+    {
+        pTtl = pL3Hdr + OFC_IPV6_HOP_LIMIT_OFFSET;
+    }
+    else
+    {
+        return OFC_FAILURE;
     }
 
-    list_for_each (pList2, &pFlowEntry->instrList)
+    if (isDec == OFC_TRUE)
     {
-        pInstrList = (tOfcInstrList *) pList2;
-        OfcDeleteList (&pInstrList->u.actionList);
-    }   
-    OfcDeleteList (&pFlowEntry->instrList);
-    OfcDeleteList (&pFlowEntry->matchList);
-    kfree (pFlowEntry);
-    pFlowEntry = NULL;
+        if (*pTtl <= 1)
+        {
+            /* TTL expired, packet must not be forwarded */
+            return OFC_FAILURE;
+        }
+        ttl = *pTtl - 1;
+    }
+
+    if (etherType == OFC_IP_ETHTYPE)
+    {
+        OfcDpUpdateIpv4Ttl (pL3Hdr, ttl);
+    }
+    else
+    {
+        *pTtl = ttl;
+    }
 
     return OFC_SUCCESS;
 }
+
 /******************************************************************                                                                          
-* Function: OfcDpExecPktOutActions
+* Function: OfcDpUpdateIpv4Ttl
 *
-* Description: This function executes actions specified in the
-*              packet-out message
+* Description: This function writes IPv4 TTL and updates the
+*              header checksum incrementally (RFC 1624) instead of
+*              recomputing it over the whole header
 *
-* Input: pPkt - Pointer to data packet
-*        pktLen - Length of packet
-*        pActionsListHead - Actions list head
+* Input: pIpHdr - Pointer to IPv4 header
+*        ttl - New TTL
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS
+*
+*******************************************************************/
+int OfcDpUpdateIpv4Ttl (__u8 *pIpHdr, __u8 ttl)
+{
+    __u16   oldWord = 0;
+    __u16   newWord = 0;
+
+    /* TTL shares a 16 bit checksum word with protocol field */
+    memcpy (&oldWord, pIpHdr + OFC_IP_TTL_OFFSET, sizeof (oldWord));
+    pIpHdr[OFC_IP_TTL_OFFSET] = ttl;
+    memcpy (&newWord, pIpHdr + OFC_IP_TTL_OFFSET, sizeof (newWord));
+
+    return OfcDpUpdateIpv4Chksum (pIpHdr, oldWord, newWord);
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpUpdateIpv4Chksum
+*
+* Description: This function incrementally updates IPv4 header
+*              checksum (RFC 1624) after a 16 bit word of header
+*              has changed
+*
+* Input: pIpHdr - Pointer to IPv4 header
+*        oldWord - Previous value of word (network order)
+*        newWord - New value of word (network order)
 *
 * Output: None
 *
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcDpExecPktOutActions (__u8 *pPkt, __u16 pktLen,
-                            struct list_head *pActionsListHead)
+int OfcDpUpdateIpv4Chksum (__u8 *pIpHdr, __u16 oldWord, __u16 newWord)
 {
-    __u8    maxOutPorts = OFC_MAX_FLOW_TABLES *
-                          (gNumOpenFlowIf + OFPP_NUM);
-    __u32   outPort = 0;
-    __u32   aOutPortList[maxOutPorts];
-    __u8    numOutPorts = 0;
-    __u8    portIndex = 0;
-    __u8    dataIfNum = 0;
+    __u16   chkSum = 0;
+    __u32   csum = 0;
 
-    printk (KERN_INFO "Packet-Out Rx from control path " 
-                      "task\r\n");
+    memcpy (&chkSum, pIpHdr + OFC_IP_CHKSUM_OFFSET, sizeof (chkSum));
 
-    if ((pPkt == NULL) || (pActionsListHead == NULL))
+    csum = (__u16) ~ntohs (chkSum);
+    csum += (__u16) ~ntohs (oldWord);
+    csum += ntohs (newWord);
+    csum = (csum & 0xFFFF) + (csum >> 16);
+    csum = (csum & 0xFFFF) + (csum >> 16);
+    chkSum = htons ((__u16) ~csum);
+    memcpy (pIpHdr + OFC_IP_CHKSUM_OFFSET, &chkSum, sizeof (chkSum));
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpCopyTtl
+*
+* Description: This function copies TTL between outermost MPLS
+*              label and the next-to-outermost header (inner label
+*              or IP header)
+*
+* Input: pDpPkt - Pointer to data packet
+*        actionType - OFCAT_COPY_TTL_OUT/OFCAT_COPY_TTL_IN
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpCopyTtl (tOfcDpPkt *pDpPkt, __u16 actionType)
+{
+    __u16   l2HdrLen = 0;
+    __u16   etherType = 0;
+    __u32   shim = 0;
+    __u8    *pOuterTtl = NULL;
+    __u8    *pInner = NULL;
+    __u32   innerOffset = 0;
+    __u8    ipVersion = 0;
+
+    if (OfcDpGetL2HdrLen (pDpPkt, &l2HdrLen) != OFC_SUCCESS)
     {
-        printk (KERN_CRIT "[%s]: Invalid inputs\r\n", __func__);
         return OFC_FAILURE;
     }
 
-    memset (aOutPortList, 0, sizeof (aOutPortList));
-    if (OfcDpApplyInstrActions (pPkt, pktLen, 0,
-                                pActionsListHead, aOutPortList,
-                                &numOutPorts)
-        != OFC_SUCCESS)
+    memcpy (&etherType, pDpPkt->pPkt + l2HdrLen, sizeof (etherType));
+    etherType = ntohs (etherType);
+    innerOffset = l2HdrLen + OFC_ETHTYPE_LEN + OFC_MPLS_SHIM_LEN;
+    if (((etherType != OFC_MPLS_ETHTYPE) && 
+         (etherType != OFC_MPLSM_ETHTYPE)) ||
+        (innerOffset >= pDpPkt->pktLen))
     {
-        OfcDeleteList (pActionsListHead);
-        kfree (pActionsListHead);
-        pActionsListHead = NULL;
-        kfree (pPkt);
-        pPkt = NULL;
         return OFC_FAILURE;
     }
 
-    for (portIndex = 0; portIndex < numOutPorts; portIndex++)
+    memcpy (&shim, pDpPkt->pPkt + l2HdrLen + OFC_ETHTYPE_LEN, 
+            sizeof (shim));
+    shim = ntohl (shim);
+    pOuterTtl = pDpPkt->pPkt + innerOffset - 1;
+    pInner = pDpPkt->pPkt + innerOffset;
+
+    if (!((shim >> OFC_MPLS_BOS_SHIFT) & OFC_MPLS_BOS_MASK))
     {
-        outPort = aOutPortList[portIndex];
-        printk (KERN_INFO "outPort:0x%x\r\n", outPort);
-        if ((outPort == OFPP_CONTROLLER) || 
-            (outPort == OFPP_NORMAL) || 
-            (outPort == OFPP_LOCAL) ||
-            (outPort == OFPP_FLOOD) ||
-            (outPort == OFPP_IN_PORT))
+        /* Next-to-outermost header is another label */
+        if ((innerOffset + OFC_MPLS_SHIM_LEN) > pDpPkt->pktLen)
         {
-            continue;
+            return OFC_FAILURE;
+        }
+        if (actionType == OFCAT_COPY_TTL_OUT)
+        {
+            *pOuterTtl = pInner[OFC_MPLS_SHIM_LEN - 1];
+        }
+        else
+        {
+            pInner[OFC_MPLS_SHIM_LEN - 1] = *pOuterTtl;
         }
+        return OFC_SUCCESS;
+    }
 
-        if (outPort == OFPP_ALL)
+    /* Bottom of stack, payload type is inferred from IP version */
+    ipVersion = pInner[0] >> 4;
+    if (ipVersion == 4)
+    {
+        if (actionType == OFCAT_COPY_TTL_OUT)
         {
-            /* Send packet through all OpenFlow ports */
-            for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; 
-                 dataIfNum++)
+            if ((innerOffset + OFC_IP_TTL_OFFSET) >= pDpPkt->pktLen)
             {
-                OfcDpSendDataPktOnSock (dataIfNum, pPkt, pktLen);
+                return OFC_FAILURE;
             }
+            *pOuterTtl = pInner[OFC_IP_TTL_OFFSET];
+            return OFC_SUCCESS;
+        }
+        if ((innerOffset + OFC_IP_CHKSUM_OFFSET + sizeof (__u16)) >
+            pDpPkt->pktLen)
+        {
+            return OFC_FAILURE;
+        }
+        OfcDpUpdateIpv4Ttl (pInner, *pOuterTtl);
+        return OFC_SUCCESS;
+    }
+    else if (ipVersion == 6)
+    {
+        if ((innerOffset + OFC_IPV6_HOP_LIMIT_OFFSET) >= pDpPkt->pktLen)
+        {
+            return OFC_FAILURE;
+        }
+        if (actionType == OFCAT_COPY_TTL_OUT)
+        {
+            *pOuterTtl = pInner[OFC_IPV6_HOP_LIMIT_OFFSET];
         }
         else
         {
-            /* Output port n corresponds to dataIfNum n-1 */
-            OfcDpSendDataPktOnSock (outPort - 1, pPkt, pktLen);
+            pInner[OFC_IPV6_HOP_LIMIT_OFFSET] = *pOuterTtl;
         }
+        return OFC_SUCCESS;
     }
-    
-    OfcDeleteList (pActionsListHead);
-    kfree (pActionsListHead);
-    pActionsListHead = NULL;
-    kfree (pPkt);
-    pPkt = NULL;
+
+    return OFC_FAILURE;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpInsertFlowEntry
+*
+* Description: This function inserts flow entry in flow table
+*
+* Input: pFlowEntry - Pointer to flow entry
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpInsertFlowEntry (tOfcFlowEntry *pFlowEntry)
+{
+    tOfcFlowTable     *pFlowTable = NULL;
+    tOfcFlowEntry     *pFlowEntryParser = NULL;
+    struct list_head  *pList = NULL;
+    __u8              tableId = 0;
+
+    tableId = pFlowEntry->tableId;
+    pFlowTable = OfcDpGetFlowTableEntry (tableId);
+    if (pFlowTable == NULL)
+    {
+        printk (KERN_CRIT "Invalid flow table Id in flow entry\r\n");
+        OfcDpFreeFlowEntry (pFlowEntry);
+        pFlowEntry = NULL;
+        return OFC_FAILURE;
+    }
+
+    /* Flow duration in flow stats is measured from here */
+    pFlowEntry->installNs = ktime_get_ns();
+
+    /* Entries are inserted in decreasing order of priorities i.e.
+     * flow entries with greater priorities are inserted ahead of
+     * flow entries with lower priorities. If two flows have
+     * equal priority then the new flow is inserted ahead of the
+     * older flow */
+    list_for_each (pList, &pFlowTable->flowEntryList)
+    {
+        pFlowEntryParser = (tOfcFlowEntry *) pList;
+
+        if (pFlowEntry->priority < pFlowEntryParser->priority)
+        {
+            continue;
+        }
+
+        printk (KERN_INFO "Inserting entry in flow table\r\n");
+        /* Insert new flow before this flow entry */
+        INIT_LIST_HEAD (&pFlowEntry->list);
+        list_add_tail (&pFlowEntry->list, &pFlowEntryParser->list);
+        pFlowTable->activeCount++;
+        OfcDpUpdateMatchFieldMask (pFlowEntry, OFC_TRUE);
+        break;
+    }
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpDeleteFlowEntry
+*
+* Description: This function deletes flow entry from flow table
+*
+* Input: pFlowEntry - Pointer to flow entry
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpDeleteFlowEntry (tOfcFlowEntry *pFlowEntry)
+{
+    tOfcFlowTable     *pFlowTable = NULL;
+    tOfcFlowEntry     *pFlowEntryParser = NULL;
+    struct list_head  *pList = NULL;
+    __u8              tableId = 0;
+
+    tableId = pFlowEntry->tableId;
+    pFlowTable = OfcDpGetFlowTableEntry (tableId);
+    if (pFlowTable == NULL)
+    {
+        printk (KERN_CRIT "Invalid flow table Id in flow entry\r\n");
+        OfcDpFreeFlowEntry (pFlowEntry);
+        pFlowEntry = NULL;
+        return OFC_FAILURE;
+    }
+
+#if 0
+    printk (KERN_INFO "Dumping pFlowEntry:\r\n");
+    OfcDumpFlowFields (pFlowEntry);
+    printk (KERN_INFO "\r\n");
+#endif
+    list_for_each (pList, &pFlowTable->flowEntryList)
+    {
+        pFlowEntryParser = (tOfcFlowEntry *) pList;
+
+#if 0
+        printk (KERN_INFO "Dumping pFlowEntryParser:\r\n");
+        OfcDumpFlowFields (pFlowEntryParser);
+        printk (KERN_INFO "\r\n");
+#endif
+
+        if (pFlowEntryParser->hardTimeout != 
+            pFlowEntry->hardTimeout)
+        {
+            continue;
+        }
+        if (pFlowEntryParser->idleTimeout !=
+            pFlowEntry->idleTimeout)
+        {
+            continue;
+        }
+
+        if (memcmp (&pFlowEntryParser->cookie, &pFlowEntry->cookie,
+                    sizeof (pFlowEntry->cookie)))
+        {
+            continue;
+        }
+        if (memcmp (&pFlowEntryParser->cookieMask,
+                    &pFlowEntry->cookieMask,
+                    sizeof (pFlowEntry->cookieMask)))
+        {
+            continue;
+        }
+
+        if (pFlowEntryParser->flags != pFlowEntry->flags)
+        {
+            continue;
+        }
+
+        if (pFlowEntryParser->priority != pFlowEntry->priority)
+        {
+            continue;
+        }
+
+        if (pFlowEntryParser->bufId != pFlowEntry->bufId)
+        {
+            continue;
+        }
+        if (pFlowEntryParser->outPort != pFlowEntry->outPort)
+        {
+            continue;
+        }
+        if (pFlowEntryParser->outGrp != pFlowEntry->outGrp)
+        {
+            continue;
+        }
+
+        if (pFlowEntryParser->tableId != pFlowEntry->tableId)
+        {
+            continue;
+        }
+
+        if (memcmp (&pFlowEntryParser->matchFields,
+                    &pFlowEntry->matchFields,
+                    sizeof (pFlowEntry->matchFields)))
+        {
+            continue;
+        }
+        if (memcmp (&pFlowEntryParser->matchMask,
+                    &pFlowEntry->matchMask,
+                    sizeof (pFlowEntry->matchMask)))
+        {
+            continue;
+        }
+
+        /* TODO: Match instruction list for deletion as well */
+
+        printk (KERN_INFO "Deleting entry from flow table\r\n");
+
+        /* Flow entry found, delete it */
+        list_del_init (pList);
+        pFlowTable->activeCount--;
+        OfcDpUpdateMatchFieldMask (pFlowEntryParser, OFC_FALSE);
+        OfcDpFreeFlowEntry (pFlowEntryParser);
+        pFlowEntryParser = NULL;
+        break;
+    }
+
+    OfcDpFreeFlowEntry (pFlowEntry);
+    pFlowEntry = NULL;
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpIsExtFieldsMatch
+*
+* Description: This function matches packet fields that are
+*              matched only if present in extMatchFlags of flow,
+*              since zero is a valid value of these fields. ICMP
+*              and TCP flag fields also require the L4 protocol of
+*              flow.
+*
+* Input: pFlowFields - Match fields of flow
+*        pFlowMask - Mask of maskable fields of flow
+*        pPktFields - Match fields of packet
+*
+* Output: None
+*
+* Returns: OFC_TRUE if packet matches, OFC_FALSE otherwise
+*
+*******************************************************************/
+int OfcDpIsExtFieldsMatch (tOfcMatchFields *pFlowFields,
+                           tOfcMatchFields *pFlowMask,
+                           tOfcMatchFields *pPktFields)
+{
+    __u32 matchFlags = pFlowFields->extMatchFlags;
+
+    if ((matchFlags & (OFC_FLD_ICMP_TYPE | OFC_FLD_ICMP_CODE | 
+                       OFC_FLD_TCP_FLAGS)) &&
+        (pFlowFields->l4HeaderType != pPktFields->protocolType))
+    {
+        return OFC_FALSE;
+    }
+
+    if ((matchFlags & OFC_FLD_IPV6_SRC) &&
+        (OfcDpIsMaskedMatch (pFlowFields->aSrcIpv6Addr, 
+                             pFlowMask->aSrcIpv6Addr,
+                             pPktFields->aSrcIpv6Addr,
+                             OFC_IPV6_ADDR_LEN) != OFC_TRUE))
+    {
+        return OFC_FALSE;
+    }
+    if ((matchFlags & OFC_FLD_IPV6_DST) &&
+        (OfcDpIsMaskedMatch (pFlowFields->aDstIpv6Addr, 
+                             pFlowMask->aDstIpv6Addr,
+                             pPktFields->aDstIpv6Addr,
+                             OFC_IPV6_ADDR_LEN) != OFC_TRUE))
+    {
+        return OFC_FALSE;
+    }
+    if ((matchFlags & OFC_FLD_IPV6_FLABEL) &&
+        (pFlowFields->ipv6FlowLabel != 
+         (pPktFields->ipv6FlowLabel & pFlowMask->ipv6FlowLabel)))
+    {
+        return OFC_FALSE;
+    }
+    if ((matchFlags & OFC_FLD_ICMP_TYPE) &&
+        (pFlowFields->icmpType != pPktFields->icmpType))
+    {
+        return OFC_FALSE;
+    }
+    if ((matchFlags & OFC_FLD_ICMP_CODE) &&
+        (pFlowFields->icmpCode != pPktFields->icmpCode))
+    {
+        return OFC_FALSE;
+    }
+    if ((matchFlags & OFC_FLD_ARP_OP) &&
+        (pFlowFields->arpFlds.opCode != pPktFields->arpFlds.opCode))
+    {
+        return OFC_FALSE;
+    }
+    if ((matchFlags & OFC_FLD_ARP_SPA) &&
+        (pFlowFields->arpFlds.senderIpAddr != 
+         (pPktFields->arpFlds.senderIpAddr & 
+          pFlowMask->arpFlds.senderIpAddr)))
+    {
+        return OFC_FALSE;
+    }
+    if ((matchFlags & OFC_FLD_ARP_SHA) &&
+        (OfcDpIsMaskedMatch (pFlowFields->arpFlds.aSenderMacAddr,
+                             pFlowMask->arpFlds.aSenderMacAddr,
+                             pPktFields->arpFlds.aSenderMacAddr,
+                             OFC_MAC_ADDR_LEN) != OFC_TRUE))
+    {
+        return OFC_FALSE;
+    }
+    if ((matchFlags & OFC_FLD_ARP_THA) &&
+        (OfcDpIsMaskedMatch (pFlowFields->arpFlds.aTargetMacAddr,
+                             pFlowMask->arpFlds.aTargetMacAddr,
+                             pPktFields->arpFlds.aTargetMacAddr,
+                             OFC_MAC_ADDR_LEN) != OFC_TRUE))
+    {
+        return OFC_FALSE;
+    }
+    if ((matchFlags & OFC_FLD_TCP_FLAGS) &&
+        (pFlowFields->tcpFlags != 
+         (pPktFields->tcpFlags & pFlowMask->tcpFlags)))
+    {
+        return OFC_FALSE;
+    }
+    if ((matchFlags & OFC_FLD_IP_FRAG) &&
+        (pFlowFields->ipFragFlags != 
+         (pPktFields->ipFragFlags & pFlowMask->ipFragFlags)))
+    {
+        return OFC_FALSE;
+    }
+
+    return OFC_TRUE;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpIsMaskedMatch
+*
+* Description: This function matches a multi-byte packet field
+*              with masked value of flow
+*
+* Input: pFlowValue - Value of flow, already masked
+*        pFlowMask - Mask of flow
+*        pPktValue - Value of packet
+*        length - Length of field
+*
+* Output: None
+*
+* Returns: OFC_TRUE if packet matches, OFC_FALSE otherwise
+*
+*******************************************************************/
+int OfcDpIsMaskedMatch (__u8 *pFlowValue, __u8 *pFlowMask,
+                        __u8 *pPktValue, __u8 length)
+{
+    __u8 index = 0;
+
+    for (index = 0; index < length; index++)
+    {
+        if (pFlowValue[index] != (pPktValue[index] & pFlowMask[index]))
+        {
+            return OFC_FALSE;
+        }
+    }
+
+    return OFC_TRUE;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpGetFlowFieldMask
+*
+* Description: This function gets packet fields referenced by match
+*              fields of flow. Maskable fields are referenced if
+*              their mask is non-zero, as their value may be zero.
+*
+* Input: pFlowEntry - Pointer to flow entry
+*
+* Output: None
+*
+* Returns: OFC_FLD_xxx mask
+*
+*******************************************************************/
+__u32 OfcDpGetFlowFieldMask (tOfcFlowEntry *pFlowEntry)
+{
+    tOfcMatchFields *pMatchFields = &pFlowEntry->matchFields;
+    tOfcMatchFields *pMatchMask = &pFlowEntry->matchMask;
+    __u8            aNullMacAddr[OFC_MAC_ADDR_LEN];
+    __u32           fieldMask = 0;
+
+    memset (aNullMacAddr, 0, sizeof(aNullMacAddr));
+
+    if (memcmp (pMatchMask->aDstMacAddr, aNullMacAddr, 
+                OFC_MAC_ADDR_LEN))
+    {
+        fieldMask |= OFC_FLD_ETH_DST;
+    }
+    if (memcmp (pMatchMask->aSrcMacAddr, aNullMacAddr, 
+                OFC_MAC_ADDR_LEN))
+    {
+        fieldMask |= OFC_FLD_ETH_SRC;
+    }
+    if (pMatchMask->vlanId != 0)
+    {
+        fieldMask |= OFC_FLD_VLAN_VID;
+    }
+    if (pMatchFields->etherType != 0)
+    {
+        fieldMask |= OFC_FLD_ETH_TYPE;
+    }
+    if (pMatchFields->mplsMatchFlags != 0)
+    {
+        fieldMask |= OFC_FLD_MPLS;
+    }
+    if (pMatchMask->arpFlds.targetIpAddr != 0)
+    {
+        fieldMask |= OFC_FLD_ARP_TPA;
+    }
+    if (pMatchMask->srcIpAddr != 0)
+    {
+        fieldMask |= OFC_FLD_IPV4_SRC;
+    }
+    if (pMatchMask->dstIpAddr != 0)
+    {
+        fieldMask |= OFC_FLD_IPV4_DST;
+    }
+    if (pMatchFields->protocolType != 0)
+    {
+        fieldMask |= OFC_FLD_IP_PROTO;
+    }
+    /* L4 ports are matched along with IP protocol */
+    if (pMatchMask->srcPortNum != 0)
+    {
+        fieldMask |= OFC_FLD_L4_SRC | OFC_FLD_IP_PROTO;
+    }
+    if (pMatchMask->dstPortNum != 0)
+    {
+        fieldMask |= OFC_FLD_L4_DST | OFC_FLD_IP_PROTO;
+    }
+
+    fieldMask |= pMatchFields->extMatchFlags;
+    if (pMatchFields->extMatchFlags & OFC_FLD_L4_MASK)
+    {
+        fieldMask |= OFC_FLD_IP_PROTO;
+    }
+
+    return fieldMask;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpUpdateMatchFieldMask
+*
+* Description: This function counts flows referencing each packet
+*              field as flows are inserted and deleted, and updates
+*              fields extracted from packets to those referenced by
+*              any installed flow
+*
+* Input: pFlowEntry - Pointer to flow entry
+*        isAdd - OFC_TRUE if flow is inserted, OFC_FALSE if deleted
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpUpdateMatchFieldMask (tOfcFlowEntry *pFlowEntry, int isAdd)
+{
+    __u32 fieldMask = 0;
+    __u8  field = 0;
+
+    fieldMask = OfcDpGetFlowFieldMask (pFlowEntry);
+    for (field = 0; field < OFC_NUM_FLD; field++)
+    {
+        if (!(fieldMask & (1 << field)))
+        {
+            continue;
+        }
+
+        if (isAdd == OFC_TRUE)
+        {
+            if (gOfcDpGlobals.aMatchFieldRefCount[field]++ == 0)
+            {
+                gOfcDpGlobals.matchFieldMask |= (1 << field);
+            }
+        }
+        else if ((gOfcDpGlobals.aMatchFieldRefCount[field] != 0) &&
+                 (--gOfcDpGlobals.aMatchFieldRefCount[field] == 0))
+        {
+            gOfcDpGlobals.matchFieldMask &= ~(1 << field);
+        }
+    }
+
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpFreeFlowEntry
+*
+* Description: This function frees flow entry along with its
+*              match and instruction lists
+*
+* Input: pFlowEntry - Pointer to flow entry
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpFreeFlowEntry (tOfcFlowEntry *pFlowEntry)
+{
+    tOfcInstrList     *pInstrList = NULL;
+    struct list_head  *pList = NULL;
+
+    list_for_each (pList, &pFlowEntry->instrList)
+    {
+        pInstrList = (tOfcInstrList *) pList;
+        OfcDeleteList (&pInstrList->u.actionList);
+    }
+    OfcDeleteList (&pFlowEntry->instrList);
+    OfcDeleteList (&pFlowEntry->matchList);
+    if (pFlowEntry->pMatchInstr != NULL)
+    {
+        kfree (pFlowEntry->pMatchInstr);
+        pFlowEntry->pMatchInstr = NULL;
+    }
+    kfree (pFlowEntry);
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpCollectFlowStats
+*
+* Description: This function collects flow or aggregate stats for
+*              request in progress. At most OFC_STATS_BATCH flows
+*              are visited per call, so that data packets are not
+*              held up behind large flow tables. Flow stats are
+*              sent to control path one reply segment at a time.
+*              Flow whose entry is larger than segment size is sent
+*              in a segment of its own
+*
+* Input: None
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpCollectFlowStats (void)
+{
+    tOfcStatsReq     *pReq = gOfcDpGlobals.pStatsReq;
+    tOfcFlowTable    *pTable = NULL;
+    tOfcFlowEntry    *pFlowEntry = NULL;
+    tOfcFlowEntry    *pFilter = NULL;
+    tOfcAggrStats    *pAggrStats = NULL;
+    tDpCpMsgQ        msgQ;
+    __u8             *pSeg = NULL;
+    __u8             *pLargeSeg = NULL;
+    __u32            seqNum = 0;
+    __u32            numVisited = 0;
+    __u16            segLen = 0;
+    __u16            entryLen = 0;
+    __u8             isDone = OFC_FALSE;
+
+    if (pReq->pTable == NULL)
+    {
+        /* First batch, start with first flow table */
+        pReq->pTable =
+            (tOfcFlowTable *) gOfcDpGlobals.flowTableListHead.next;
+        pReq->pNextFlow = pReq->pTable->flowEntryList.next;
+    }
+
+    if (pReq->type == OFPMP_FLOW)
+    {
+        /* Room for OpenFlow and multipart headers is reserved, these
+         * are filled by control path */
+        pSeg = (__u8 *) kmalloc (OFC_MULTIPART_HDR_ROOM + pReq->segSize,
+                                 GFP_KERNEL);
+        if (pSeg == NULL)
+        {
+            printk (KERN_CRIT "Failed to allocate memory to flow "
+                              "stats reply\r\n");
+            return;
+        }
+    }
+
+    while (numVisited < OFC_STATS_BATCH)
+    {
+        pTable = pReq->pTable;
+        if ((pReq->pNextFlow == &pTable->flowEntryList) ||
+            ((pReq->pFilter->tableId != OFPTT_ALL) &&
+             (pReq->pFilter->tableId != pTable->tableId)))
+        {
+            /* End of table or table not requested */
+            if (pTable->list.next == &gOfcDpGlobals.flowTableListHead)
+            {
+                isDone = OFC_TRUE;
+                break;
+            }
+            pReq->pTable = (tOfcFlowTable *) pTable->list.next;
+            pReq->pNextFlow = pReq->pTable->flowEntryList.next;
+            continue;
+        }
+
+        pFlowEntry = (tOfcFlowEntry *) pReq->pNextFlow;
+        if (OfcDpIsFlowStatsMatch (pFlowEntry, pReq->pFilter) == OFC_TRUE)
+        {
+            if (pReq->type == OFPMP_AGGREGATE)
+            {
+                pReq->pktCount += pFlowEntry->pktMatchCount;
+                pReq->byteCount += pFlowEntry->byteMatchCount;
+                pReq->flowCount++;
+            }
+            else
+            {
+                entryLen = sizeof (tOfcFlowStats) +
+                           pFlowEntry->matchInstrLen;
+                if (((segLen + entryLen) > pReq->segSize) &&
+                    (segLen != 0))
+                {
+                    /* Segment full, flow goes in next segment */
+                    break;
+                }
+                if (entryLen > pReq->segSize)
+                {
+                    /* Segment is grown to fit the flow, which fills
+                     * it on its own */
+                    pLargeSeg = (__u8 *) krealloc (pSeg, 
+                                                   OFC_MULTIPART_HDR_ROOM +
+                                                   entryLen, GFP_KERNEL);
+                    if (pLargeSeg == NULL)
+                    {
+                        printk (KERN_CRIT "Failed to allocate memory to "
+                                          "flow stats reply\r\n");
+                        kfree (pSeg);
+                        pSeg = NULL;
+                        return;
+                    }
+                    pSeg = pLargeSeg;
+                }
+                segLen += OfcDpEncodeFlowStats (pFlowEntry,
+                                                pSeg +
+                                                OFC_MULTIPART_HDR_ROOM +
+                                                segLen);
+            }
+        }
+
+        pReq->pNextFlow = pReq->pNextFlow->next;
+        numVisited++;
+    }
+
+    if (pReq->type == OFPMP_AGGREGATE)
+    {
+        if (isDone == OFC_FALSE)
+        {
+            return;
+        }
+
+        segLen = sizeof (tOfcAggrStats);
+        pSeg = (__u8 *) kmalloc (OFC_MULTIPART_HDR_ROOM + segLen,
+                                 GFP_KERNEL);
+        if (pSeg == NULL)
+        {
+            printk (KERN_CRIT "Failed to allocate memory to aggregate "
+                              "stats reply\r\n");
+            return;
+        }
+
+        pAggrStats = (tOfcAggrStats *) (void *)
+                     (pSeg + OFC_MULTIPART_HDR_ROOM);
+        memset (pAggrStats, 0, sizeof (tOfcAggrStats));
+        OfcSetEightByte (&pAggrStats->pktCount, pReq->pktCount);
+        OfcSetEightByte (&pAggrStats->byteCount, pReq->byteCount);
+        pAggrStats->flowCount = htonl (pReq->flowCount);
+    }
+    else if ((segLen == 0) && (isDone == OFC_FALSE))
+    {
+        /* No flow matched in this batch */
+        kfree (pSeg);
+        pSeg = NULL;
+        return;
+    }
+
+    /* Control path frees request after last segment, so release
+     * data path references before queuing it */
+    seqNum = pReq->seqNum;
+    pFilter = pReq->pFilter;
+    if (isDone == OFC_TRUE)
+    {
+        pReq->pFilter = NULL;
+        gOfcDpGlobals.pStatsReq = NULL;
+    }
+
+    memset (&msgQ, 0, sizeof (msgQ));
+    msgQ.pStatsReq = pReq;
+    msgQ.pPkt = pSeg;
+    msgQ.pktLen = OFC_MULTIPART_HDR_ROOM + segLen;
+    msgQ.isLastSeg = isDone;
+    if (OfcDpSendToCpQ (&msgQ) != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "Failed to send stats reply to control "
+                          "path\r\n");
+        kfree (pSeg);
+        pSeg = NULL;
+        if (isDone == OFC_TRUE)
+        {
+            kfree (pReq);
+        }
+    }
+    OfcCpSendEvent (OFC_DP_TO_CP_EVENT);
+
+    if (isDone == OFC_TRUE)
+    {
+        OfcDpFreeFlowEntry (pFilter);
+        pFilter = NULL;
+
+        /* Barriers after the request are answered once control path
+         * has sent the last segment */
+        smp_store_release (&gOfcDpGlobals.commitSeqNum, seqNum);
+        OfcCpSendEvent (OFC_DP_COMMIT_EVENT);
+    }
+
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpIsFlowStatsMatch
+*
+* Description: This function checks if flow entry is selected by
+*              flow stats request. Match is non-strict, i.e. flow
+*              must have every match field of request, at least
+*              as specific as in request, and may have more match
+*              fields
+*
+* Input: pFlowEntry - Pointer to flow entry
+*        pFilter - Table, cookie, out port, out group and match of
+*                  request
+*
+* Output: None
+*
+* Returns: OFC_TRUE/OFC_FALSE
+*
+*******************************************************************/
+int OfcDpIsFlowStatsMatch (tOfcFlowEntry *pFlowEntry,
+                           tOfcFlowEntry *pFilter)
+{
+    tMatchListEntry  *pFilterMatch = NULL;
+    tMatchListEntry  *pFlowMatch = NULL;
+    struct list_head *pFilterList = NULL;
+    struct list_head *pList = NULL;
+    __u8             isFound = OFC_FALSE;
+
+    if (((pFlowEntry->cookie.hi ^ pFilter->cookie.hi) &
+         pFilter->cookieMask.hi) ||
+        ((pFlowEntry->cookie.lo ^ pFilter->cookie.lo) &
+         pFilter->cookieMask.lo))
+    {
+        return OFC_FALSE;
+    }
+
+    if (((pFilter->outPort != OFPP_ANY) ||
+         (pFilter->outGrp != OFPG_ANY)) &&
+        (OfcDpIsFlowOutputTo (pFlowEntry, pFilter->outPort,
+                              pFilter->outGrp) != OFC_TRUE))
+    {
+        return OFC_FALSE;
+    }
+
+    list_for_each (pFilterList, &pFilter->matchList)
+    {
+        pFilterMatch = (tMatchListEntry *) pFilterList;
+        isFound = OFC_FALSE;
+        list_for_each (pList, &pFlowEntry->matchList)
+        {
+            pFlowMatch = (tMatchListEntry *) pList;
+            if (OfcDpIsMatchCovered (pFlowMatch, pFilterMatch) 
+                == OFC_TRUE)
+            {
+                isFound = OFC_TRUE;
+                break;
+            }
+        }
+
+        if (isFound == OFC_FALSE)
+        {
+            return OFC_FALSE;
+        }
+    }
+
+    return OFC_TRUE;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpIsMatchCovered
+*
+* Description: This function checks if a match field of flow is
+*              covered by the same field of request, i.e. flow
+*              matches the field at least as specifically as
+*              request does
+*
+* Input: pFlowMatch - Match field of flow
+*        pFilterMatch - Match field of request
+*
+* Output: None
+*
+* Returns: OFC_TRUE/OFC_FALSE
+*
+*******************************************************************/
+int OfcDpIsMatchCovered (tMatchListEntry *pFlowMatch,
+                         tMatchListEntry *pFilterMatch)
+{
+    __u8 index = 0;
+
+    if ((pFlowMatch->field != pFilterMatch->field) ||
+        (pFlowMatch->length != pFilterMatch->length))
+    {
+        return OFC_FALSE;
+    }
+
+    for (index = 0; index < pFilterMatch->length; index++)
+    {
+        /* Bits matched by request must be matched by flow with
+         * same value */
+        if ((pFlowMatch->aMask[index] & pFilterMatch->aMask[index]) !=
+            pFilterMatch->aMask[index])
+        {
+            return OFC_FALSE;
+        }
+        if ((pFlowMatch->aValue[index] ^ pFilterMatch->aValue[index]) &
+            pFilterMatch->aMask[index])
+        {
+            return OFC_FALSE;
+        }
+    }
+
+    return OFC_TRUE;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpIsFlowOutputTo
+*
+* Description: This function checks if apply or write actions of
+*              flow entry output to given port and group
+*
+* Input: pFlowEntry - Pointer to flow entry
+*        outPort - Output port, OFPP_ANY for any port
+*        outGrp - Output group, OFPG_ANY for any group
+*
+* Output: None
+*
+* Returns: OFC_TRUE/OFC_FALSE
+*
+*******************************************************************/
+int OfcDpIsFlowOutputTo (tOfcFlowEntry *pFlowEntry, __u32 outPort,
+                         __u32 outGrp)
+{
+    tOfcInstrList    *pInstr = NULL;
+    tOfcActionList   *pAction = NULL;
+    struct list_head *pInstrList = NULL;
+    struct list_head *pList = NULL;
+    __u8             isPortFound = (outPort == OFPP_ANY);
+    __u8             isGrpFound = (outGrp == OFPG_ANY);
+
+    list_for_each (pInstrList, &pFlowEntry->instrList)
+    {
+        pInstr = (tOfcInstrList *) pInstrList;
+        if ((pInstr->instrType != OFCIT_APPLY_ACTIONS) &&
+            (pInstr->instrType != OFCIT_WRITE_ACTIONS))
+        {
+            continue;
+        }
+
+        list_for_each (pList, &pInstr->u.actionList)
+        {
+            pAction = (tOfcActionList *) pList;
+            if ((pAction->actionType == OFCAT_OUTPUT) &&
+                (pAction->u.outPort == outPort))
+            {
+                isPortFound = OFC_TRUE;
+            }
+            else if ((pAction->actionType == OFCAT_GROUP) &&
+                     (pAction->u.groupId == outGrp))
+            {
+                isGrpFound = OFC_TRUE;
+            }
+        }
+    }
+
+    return ((isPortFound && isGrpFound) ? OFC_TRUE : OFC_FALSE);
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpEncodeFlowStats
+*
+* Description: This function encodes flow stats entry of a flow,
+*              followed by match and instructions received in its
+*              flow mod
+*
+* Input: pFlowEntry - Pointer to flow entry
+*        pBuf - Buffer with room for entry
+*
+* Output: None
+*
+* Returns: Length of flow stats entry
+*
+*******************************************************************/
+__u16 OfcDpEncodeFlowStats (tOfcFlowEntry *pFlowEntry, __u8 *pBuf)
+{
+    tOfcFlowStats *pFlowStats = (tOfcFlowStats *) (void *) pBuf;
+    __u64         durationNs = 0;
+    __u32         durationNsec = 0;
+    __u16         entryLen = 0;
+
+    entryLen = sizeof (tOfcFlowStats) + pFlowEntry->matchInstrLen;
+    durationNs = ktime_get_ns() - pFlowEntry->installNs;
+    durationNsec = do_div (durationNs, NSEC_PER_SEC);
+
+    memset (pFlowStats, 0, sizeof (tOfcFlowStats));
+    pFlowStats->length = htons (entryLen);
+    pFlowStats->tableId = (__u8) pFlowEntry->tableId;
+    pFlowStats->durationSec = htonl ((__u32) durationNs);
+    pFlowStats->durationNsec = htonl (durationNsec);
+    pFlowStats->priority = htons (pFlowEntry->priority);
+    pFlowStats->idleTimeout = htons ((__u16) pFlowEntry->idleTimeout);
+    pFlowStats->hardTimeout = htons ((__u16) pFlowEntry->hardTimeout);
+    pFlowStats->flags = htons (pFlowEntry->flags);
+    pFlowStats->cookie = pFlowEntry->cookie;
+    OfcSetEightByte (&pFlowStats->pktCount, pFlowEntry->pktMatchCount);
+    OfcSetEightByte (&pFlowStats->byteCount, pFlowEntry->byteMatchCount);
+
+    if (pFlowEntry->matchInstrLen > 0)
+    {
+        memcpy (pBuf + sizeof (tOfcFlowStats), pFlowEntry->pMatchInstr,
+                pFlowEntry->matchInstrLen);
+    }
+
+    return entryLen;
+}
+/******************************************************************                                                                          
+* Function: OfcDpExecPktOutActions
+*
+* Description: This function executes actions specified in the
+*              packet-out message
+*
+* Input: pPkt - Pointer to data packet buffer, packet follows
+*               OFC_DP_PKT_HEADROOM
+*        pktLen - Length of packet
+*        inPort - Input port (dataIfNum) of packet, or
+*                 OFC_INVALID_DATA_IF
+*        pActionsListHead - Actions list head
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpExecPktOutActions (__u8 *pPkt, __u16 pktLen, __u8 inPort,
+                            struct list_head *pActionsListHead)
+{
+    tOfcDpPkt dpPkt;
+    __u32   aOutPortList[OFC_MAX_OUT_PORTS];
+    __u8    numOutPorts = 0;
+
+    printk (KERN_INFO "Packet-Out Rx from control path " 
+                      "task\r\n");
+
+    if ((pPkt == NULL) || (pActionsListHead == NULL))
+    {
+        printk (KERN_CRIT "[%s]: Invalid inputs\r\n", __func__);
+        return OFC_FAILURE;
+    }
+
+    /* Packet-out data was copied after the reserved headroom */
+    memset (&dpPkt, 0, sizeof (dpPkt));
+    dpPkt.pBuf = pPkt;
+    dpPkt.pPkt = pPkt + OFC_DP_PKT_HEADROOM;
+    dpPkt.pktLen = pktLen;
+    dpPkt.inPort = inPort;
+
+    memset (aOutPortList, 0, sizeof (aOutPortList));
+    if (OfcDpApplyInstrActions (&dpPkt, pActionsListHead, aOutPortList,
+                                &numOutPorts)
+        != OFC_SUCCESS)
+    {
+        OfcDeleteList (pActionsListHead);
+        kfree (pActionsListHead);
+        pActionsListHead = NULL;
+        kfree (pPkt);
+        pPkt = NULL;
+        return OFC_FAILURE;
+    }
+
+    /* Packet was sent by output actions. No packet-in is
+     * generated for packet-out, since it has no matching flow */
+    OfcDeleteList (pActionsListHead);
+    kfree (pActionsListHead);
+    pActionsListHead = NULL;
+    kfree (pPkt);
+    pPkt = NULL;
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpNormalForward
+*
+* Description: This function forwards packet like a traditional L2
+*              switch. Source MAC address is learnt on input port.
+*              Packets to learnt unicast addresses are sent on the
+*              learnt port, other packets are flooded.
+*
+* Input: pDpPkt - Pointer to data packet
+*
+* Output: None
+*
+* Returns: Mask of ports on which packet is to be sent
+*
+*******************************************************************/
+__u32 OfcDpNormalForward (tOfcDpPkt *pDpPkt)
+{
+    __u8    *pPkt = pDpPkt->pPkt;
+    __u16   vlanTpid = 0;
+    __u16   vlanId = 0;
+    __u8    outDataIfNum = 0;
+
+    __u32   inPortMask = 0;
+
+    if (pDpPkt->pktLen < (OFC_ETH_ADDRS_LEN + OFC_VLAN_TAG_LEN))
+    {
+        return 0;
+    }
+
+    /* Learning is per VLAN */
+    memcpy (&vlanTpid, pPkt + OFC_ETH_ADDRS_LEN, sizeof (vlanTpid));
+    vlanTpid = ntohs (vlanTpid);
+    if ((vlanTpid == OFC_VLAN_TPID) || (vlanTpid == OFC_QINQ_TPID))
+    {
+        memcpy (&vlanId, pPkt + OFC_ETH_ADDRS_LEN + OFC_ETHTYPE_LEN,
+                sizeof (vlanId));
+        vlanId = ntohs (vlanId) & OFC_VLAN_VID_MASK;
+    }
+
+    if (pDpPkt->inPort < gNumOpenFlowIf)
+    {
+        OfcDpMacLearn (pPkt + OFC_MAC_ADDR_LEN, vlanId, pDpPkt->inPort);
+        inPortMask = (1 << pDpPkt->inPort);
+    }
+
+    /* Multicast and broadcast have group bit set in first octet */
+    if ((!(pPkt[0] & 0x01)) &&
+        (OfcDpMacLookup (pPkt, vlanId, &outDataIfNum) == OFC_SUCCESS))
+    {
+        return (1 << outDataIfNum) & ~inPortMask;
+    }
+
+    return gOfcDpGlobals.floodPortMask & ~inPortMask;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpMacLearn
+*
+* Description: This function learns MAC address on a port. Table
+*              is set-associative, an address is stored in one of
+*              the entries of its hash bucket. When bucket is full,
+*              the least recently seen entry is replaced.
+*
+* Input: pMacAddr - Pointer to MAC address
+*        vlanId - VLAN Id
+*        dataIfNum - OpenFlow interface number
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpMacLearn (__u8 *pMacAddr, __u16 vlanId, __u8 dataIfNum)
+{
+    tOfcMacEntry  *pBucket = NULL;
+    tOfcMacEntry  *pMacEntry = NULL;
+    tOfcMacEntry  *pFreeEntry = NULL;
+    __u32         hash = 0;
+    __u8          way = 0;
+
+    if (pMacAddr[0] & 0x01)
+    {
+        /* Multicast source address is invalid */
+        return OFC_FAILURE;
+    }
+
+    hash = jhash (pMacAddr, OFC_MAC_ADDR_LEN, vlanId);
+    pBucket = &gOfcDpGlobals.aMacTable[(hash & 
+                                        (OFC_MAC_TABLE_BUCKETS - 1)) *
+                                       OFC_MAC_TABLE_WAYS];
+
+    for (way = 0; way < OFC_MAC_TABLE_WAYS; way++)
+    {
+        pMacEntry = &pBucket[way];
+        if ((pMacEntry->isValid == OFC_TRUE) &&
+            (pMacEntry->vlanId == vlanId) &&
+            (!memcmp (pMacEntry->aMacAddr, pMacAddr, OFC_MAC_ADDR_LEN)))
+        {
+            /* Refresh entry, address may have moved */
+            pMacEntry->dataIfNum = dataIfNum;
+            pMacEntry->lastSeen = jiffies;
+            return OFC_SUCCESS;
+        }
+
+        if ((pFreeEntry == NULL) || (pMacEntry->isValid != OFC_TRUE) ||
+            ((pFreeEntry->isValid == OFC_TRUE) &&
+             time_before (pMacEntry->lastSeen, pFreeEntry->lastSeen)))
+        {
+            pFreeEntry = pMacEntry;
+        }
+    }
+
+    memcpy (pFreeEntry->aMacAddr, pMacAddr, OFC_MAC_ADDR_LEN);
+    pFreeEntry->vlanId = vlanId;
+    pFreeEntry->dataIfNum = dataIfNum;
+    pFreeEntry->lastSeen = jiffies;
+    pFreeEntry->isValid = OFC_TRUE;
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpMacLookup
+*
+* Description: This function looks up port on which MAC address
+*              is learnt. Entries older than aging time are
+*              invalidated during lookup.
+*
+* Input: pMacAddr - Pointer to MAC address
+*        vlanId - VLAN Id
+*
+* Output: pDataIfNum - OpenFlow interface number
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpMacLookup (__u8 *pMacAddr, __u16 vlanId, __u8 *pDataIfNum)
+{
+    tOfcMacEntry  *pBucket = NULL;
+    tOfcMacEntry  *pMacEntry = NULL;
+    __u32         hash = 0;
+    __u8          way = 0;
+
+    hash = jhash (pMacAddr, OFC_MAC_ADDR_LEN, vlanId);
+    pBucket = &gOfcDpGlobals.aMacTable[(hash & 
+                                        (OFC_MAC_TABLE_BUCKETS - 1)) *
+                                       OFC_MAC_TABLE_WAYS];
+
+    for (way = 0; way < OFC_MAC_TABLE_WAYS; way++)
+    {
+        pMacEntry = &pBucket[way];
+        if ((pMacEntry->isValid != OFC_TRUE) ||
+            (pMacEntry->vlanId != vlanId) ||
+            (memcmp (pMacEntry->aMacAddr, pMacAddr, OFC_MAC_ADDR_LEN)))
+        {
+            continue;
+        }
+
+        if (time_after (jiffies, 
+                        pMacEntry->lastSeen + OFC_MAC_AGING_TIME))
+        {
+            /* Entry aged out */
+            pMacEntry->isValid = OFC_FALSE;
+            return OFC_FAILURE;
+        }
+
+        *pDataIfNum = pMacEntry->dataIfNum;
+        return OFC_SUCCESS;
+    }
+
+    return OFC_FAILURE;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpIsPendingMiss
+*
+* Description: This function checks if table-miss packet-in of a
+*              flow was sent recently. Table is set-associative like
+*              MAC table, and is owned by data path task.
+*
+* Input: pMatchFields - Match fields of packet
+*        tableId - Table in which packet missed
+*        hash - Hash of match fields
+*
+* Output: None
+*
+* Returns: OFC_TRUE if packet-in is pending, OFC_FALSE otherwise
+*
+*******************************************************************/
+int OfcDpIsPendingMiss (tOfcMatchFields *pMatchFields, __u8 tableId,
+                        __u32 hash)
+{
+    tOfcPendingMiss *pBucket = NULL;
+    tOfcPendingMiss *pEntry = NULL;
+    __u8            way = 0;
+
+    pBucket = &gOfcDpGlobals.aPendingMiss[(hash & 
+                                           (OFC_PENDING_MISS_BUCKETS - 1)) *
+                                          OFC_PENDING_MISS_WAYS];
+
+    for (way = 0; way < OFC_PENDING_MISS_WAYS; way++)
+    {
+        pEntry = &pBucket[way];
+        if ((pEntry->generation == gOfcDpGlobals.pendingMissGen) &&
+            (pEntry->hash == hash) && (pEntry->tableId == tableId) &&
+            (!memcmp (&pEntry->matchFields, pMatchFields, 
+                      sizeof (tOfcMatchFields))))
+        {
+            /* Packet-in is sent again once entry expires, if
+             * controller did not install flow */
+            return (time_before (jiffies, pEntry->expiry) ? 
+                    OFC_TRUE : OFC_FALSE);
+        }
+    }
+
+    return OFC_FALSE;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpAddPendingMiss
+*
+* Description: This function adds flow to pending miss table once
+*              its table-miss packet-in is queued to control path,
+*              or restarts expiry of its entry. Invalid entry of
+*              bucket is replaced, or else entry expiring first.
+*
+* Input: pMatchFields - Match fields of packet
+*        tableId - Table in which packet missed
+*        hash - Hash of match fields
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpAddPendingMiss (tOfcMatchFields *pMatchFields, __u8 tableId,
+                          __u32 hash)
+{
+    tOfcPendingMiss *pBucket = NULL;
+    tOfcPendingMiss *pEntry = NULL;
+    tOfcPendingMiss *pFreeEntry = NULL;
+    __u8            way = 0;
+
+    pBucket = &gOfcDpGlobals.aPendingMiss[(hash & 
+                                           (OFC_PENDING_MISS_BUCKETS - 1)) *
+                                          OFC_PENDING_MISS_WAYS];
+
+    for (way = 0; way < OFC_PENDING_MISS_WAYS; way++)
+    {
+        pEntry = &pBucket[way];
+        if ((pEntry->generation == gOfcDpGlobals.pendingMissGen) &&
+            (pEntry->hash == hash) && (pEntry->tableId == tableId) &&
+            (!memcmp (&pEntry->matchFields, pMatchFields, 
+                      sizeof (tOfcMatchFields))))
+        {
+            pEntry->expiry = jiffies + OFC_PENDING_MISS_TTL;
+            return;
+        }
+
+        /* Replace invalid entry, or else entry expiring first */
+        if ((pFreeEntry == NULL) ||
+            (pEntry->generation != gOfcDpGlobals.pendingMissGen) ||
+            ((pFreeEntry->generation == gOfcDpGlobals.pendingMissGen) &&
+             time_before (pEntry->expiry, pFreeEntry->expiry)))
+        {
+            pFreeEntry = pEntry;
+        }
+    }
+
+    memcpy (&pFreeEntry->matchFields, pMatchFields, 
+            sizeof (tOfcMatchFields));
+    pFreeEntry->hash = hash;
+    pFreeEntry->tableId = tableId;
+    pFreeEntry->expiry = jiffies + OFC_PENDING_MISS_TTL;
+    pFreeEntry->generation = gOfcDpGlobals.pendingMissGen;
+
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpInitTokenBucket
+*
+* Description: This function initializes token bucket of packet-in
+*              rate limit. Bucket starts full.
+*
+* Input: pBucket - Token bucket
+*        rate - Packets per second, 0 is unlimited
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpInitTokenBucket (tOfcTokenBucket *pBucket, __u32 rate)
+{
+    __u64 burstPkts = 0;
+
+    memset (pBucket, 0, sizeof (tOfcTokenBucket));
+    pBucket->rate = rate;
+
+    burstPkts = ((__u64) rate * OFC_PKT_IN_BURST_MSECS) / MSEC_PER_SEC;
+    if (burstPkts == 0)
+    {
+        burstPkts = 1;
+    }
+    pBucket->burst = burstPkts * NSEC_PER_SEC;
+    pBucket->tokens = pBucket->burst;
+    pBucket->lastNs = ktime_get_ns();
+
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpTokenBucketConforms
+*
+* Description: This function refills token bucket for time elapsed
+*              since last refill, and takes token of one packet
+*
+* Input: pBucket - Token bucket
+*        nowNs - Current time
+*
+* Output: None
+*
+* Returns: OFC_TRUE if packet is within rate, OFC_FALSE otherwise
+*
+*******************************************************************/
+int OfcDpTokenBucketConforms (tOfcTokenBucket *pBucket, __u64 nowNs)
+{
+    __u64 elapsedNs = 0;
+
+    if (pBucket->rate == 0)
+    {
+        return OFC_TRUE;
+    }
+
+    if (nowNs > pBucket->lastNs)
+    {
+        elapsedNs = nowNs - pBucket->lastNs;
+        pBucket->lastNs = nowNs;
+
+        /* Bucket is full after this interval, also avoids
+         * overflow after long idle period */
+        if (elapsedNs > (pBucket->burst / pBucket->rate))
+        {
+            pBucket->tokens = pBucket->burst;
+        }
+        else
+        {
+            pBucket->tokens += elapsedNs * pBucket->rate;
+            if (pBucket->tokens > pBucket->burst)
+            {
+                pBucket->tokens = pBucket->burst;
+            }
+        }
+    }
+
+    if (pBucket->tokens < NSEC_PER_SEC)
+    {
+        pBucket->dropCount++;
+        return OFC_FALSE;
+    }
+
+    pBucket->tokens -= NSEC_PER_SEC;
+    return OFC_TRUE;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpTokenBucketReturn
+*
+* Description: This function returns token of a packet that
+*              conformed to rate but was not sent
+*
+* Input: pBucket - Token bucket
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpTokenBucketReturn (tOfcTokenBucket *pBucket)
+{
+    if (pBucket->rate == 0)
+    {
+        return;
+    }
+
+    pBucket->tokens += NSEC_PER_SEC;
+    if (pBucket->tokens > pBucket->burst)
+    {
+        pBucket->tokens = pBucket->burst;
+    }
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpIsPktInAllowed
+*
+* Description: This function applies packet-in rate limits of
+*              ingress port and of all ports to a packet-in
+*
+* Input: inPort - Ingress port of packet
+*        pktInClass - OFC_PKT_IN_MISS/OFC_PKT_IN_ACTION
+*
+* Output: None
+*
+* Returns: OFC_TRUE if packet-in can be sent, OFC_FALSE otherwise
+*
+*******************************************************************/
+int OfcDpIsPktInAllowed (__u8 inPort, int pktInClass)
+{
+    tOfcTokenBucket *pPortBucket = NULL;
+    __u64           nowNs = 0;
+
+    nowNs = ktime_get_ns();
+
+    /* Packets sent by controller have no ingress OpenFlow port */
+    if (inPort < OFC_MAX_OF_IF_NUM)
+    {
+        pPortBucket = 
+            &gOfcDpGlobals.aaPortPktInBucket[inPort][pktInClass];
+        if (OfcDpTokenBucketConforms (pPortBucket, nowNs) != OFC_TRUE)
+        {
+            return OFC_FALSE;
+        }
+    }
+
+    if (OfcDpTokenBucketConforms (&gOfcDpGlobals.aPktInBucket[pktInClass],
+                                  nowNs) != OFC_TRUE)
+    {
+        /* Return token of port, packet-in is not sent */
+        if (pPortBucket != NULL)
+        {
+            OfcDpTokenBucketReturn (pPortBucket);
+        }
+        return OFC_FALSE;
+    }
+
+    return OFC_TRUE;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpReturnPktInTokens
+*
+* Description: This function returns tokens taken by
+*              OfcDpIsPktInAllowed for a packet-in that could not
+*              be queued to control path
+*
+* Input: inPort - Ingress port of packet
+*        pktInClass - OFC_PKT_IN_MISS/OFC_PKT_IN_ACTION
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpReturnPktInTokens (__u8 inPort, int pktInClass)
+{
+    if (inPort < OFC_MAX_OF_IF_NUM)
+    {
+        OfcDpTokenBucketReturn 
+            (&gOfcDpGlobals.aaPortPktInBucket[inPort][pktInClass]);
+    }
+    OfcDpTokenBucketReturn (&gOfcDpGlobals.aPktInBucket[pktInClass]);
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpUpdatePortConfig
+*
+* Description: This function updates configuration of OpenFlow port
+*              as requested by port mod message
+*
+* Input: dataIfNum - OpenFlow interface number
+*        config - New configuration flags (OFPPC_xxx)
+*        mask - Configuration flags to be changed
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpUpdatePortConfig (__u8 dataIfNum, __u32 config, __u32 mask)
+{
+    __u32  index = 0;
+
+    if (dataIfNum >= gNumOpenFlowIf)
+    {
+        return OFC_FAILURE;
+    }
+
+    gOfcDpGlobals.aPortConfig[dataIfNum] = 
+        (gOfcDpGlobals.aPortConfig[dataIfNum] & ~mask) | (config & mask);
+    OfcDpUpdateFwdPortMask();
+
+    if (gOfcDpGlobals.aPortConfig[dataIfNum] & OFPPC_PORT_DOWN)
+    {
+        /* Forget addresses learnt on port */
+        for (index = 0; index < OFC_MAC_TABLE_SIZE; index++)
+        {
+            if (gOfcDpGlobals.aMacTable[index].dataIfNum == dataIfNum)
+            {
+                gOfcDpGlobals.aMacTable[index].isValid = OFC_FALSE;
+            }
+        }
+    }
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpUpdateFwdPortMask
+*
+* Description: This function recomputes masks of ports that
+*              forward packets and flooded packets from port
+*              configuration, so that output does not check
+*              configuration of each port
+*
+* Input: None
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpUpdateFwdPortMask (void)
+{
+    __u32 fwdPortMask = 0;
+    __u32 floodPortMask = 0;
+    __u8  dataIfNum = 0;
+
+    for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; dataIfNum++)
+    {
+        if (gOfcDpGlobals.aPortConfig[dataIfNum] & 
+            (OFPPC_PORT_DOWN | OFPPC_NO_FWD))
+        {
+            continue;
+        }
+        fwdPortMask |= (1 << dataIfNum);
+
+        if (!(gOfcDpGlobals.aPortConfig[dataIfNum] & OFPPC_NO_FLOOD))
+        {
+            floodPortMask |= (1 << dataIfNum);
+        }
+    }
+
+    gOfcDpGlobals.fwdPortMask = fwdPortMask;
+    gOfcDpGlobals.floodPortMask = floodPortMask;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpCreatePortStats
+*
+* Description: This function allocates per-CPU statistics of
+*              OpenFlow interfaces. Rx threads, ring handlers and
+*              data path task update the copy of the CPU they run
+*              on, so counting needs no lock
+*
+* Input: None
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpCreatePortStats (void)
+{
+    int dataIfNum = 0;
+
+    for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; dataIfNum++)
+    {
+        gOfcDpGlobals.apPortStats[dataIfNum] = 
+            alloc_percpu (tOfcPortStats);
+        if (gOfcDpGlobals.apPortStats[dataIfNum] == NULL)
+        {
+            printk (KERN_CRIT "Failed to allocate memory to port "
+                              "statistics\r\n");
+            return OFC_FAILURE;
+        }
+    }
+
+    gOfcDpGlobals.portStartNs = ktime_get_ns();
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpDeletePortStats
+*
+* Description: This function releases per-CPU statistics of
+*              OpenFlow interfaces
+*
+* Input: None
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpDeletePortStats (void)
+{
+    int dataIfNum = 0;
+
+    for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; dataIfNum++)
+    {
+        free_percpu (gOfcDpGlobals.apPortStats[dataIfNum]);
+        gOfcDpGlobals.apPortStats[dataIfNum] = NULL;
+    }
+
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpGetPortStats
+*
+* Description: This function sums per-CPU counters of OpenFlow
+*              interface. Counters are read while they are being
+*              updated, sum may lag behind by packets in flight
+*
+* Input: dataIfNum - OpenFlow interface number
+*
+* Output: pPortStats - Pointer to port statistics
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpGetPortStats (__u8 dataIfNum, tOfcPortStats *pPortStats)
+{
+    tOfcPortStats *pCpuStats = NULL;
+    int           cpu = 0;
+
+    if ((dataIfNum >= gNumOpenFlowIf) || (pPortStats == NULL) ||
+        (gOfcDpGlobals.apPortStats[dataIfNum] == NULL))
+    {
+        return OFC_FAILURE;
+    }
+
+    memset (pPortStats, 0, sizeof (tOfcPortStats));
+    for_each_possible_cpu (cpu)
+    {
+        pCpuStats = per_cpu_ptr (gOfcDpGlobals.apPortStats[dataIfNum], 
+                                 cpu);
+        pPortStats->rxPktCount += pCpuStats->rxPktCount;
+        pPortStats->txPktCount += pCpuStats->txPktCount;
+        pPortStats->rxByteCount += pCpuStats->rxByteCount;
+        pPortStats->txByteCount += pCpuStats->txByteCount;
+        pPortStats->rxDropCount += pCpuStats->rxDropCount;
+        pPortStats->txDropCount += pCpuStats->txDropCount;
+        pPortStats->rxErrorCount += pCpuStats->rxErrorCount;
+        pPortStats->txErrorCount += pCpuStats->txErrorCount;
+    }
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpCreateGroupPktBufs
+*
+* Description: This function allocates buffers in which buckets
+*              of group modify their copy of the packet, one for
+*              each level of nested group. Data path task executes
+*              one bucket at a time, so buffers are reused for
+*              every packet
+*
+* Input: None
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpCreateGroupPktBufs (void)
+{
+    int depth = 0;
+
+    for (depth = 0; depth < OFC_MAX_GROUP_DEPTH; depth++)
+    {
+        gOfcDpGlobals.apGroupPktBuf[depth] = 
+            (__u8 *) kmalloc (OFC_GROUP_PKT_BUF_SIZE, GFP_KERNEL);
+        if (gOfcDpGlobals.apGroupPktBuf[depth] == NULL)
+        {
+            printk (KERN_CRIT "Failed to allocate memory to group "
+                              "packet buffer\r\n");
+            OfcDpDeleteGroupPktBufs();
+            return OFC_FAILURE;
+        }
+    }
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpDeleteGroupPktBufs
+*
+* Description: This function releases packet buffers of group
+*              buckets
+*
+* Input: None
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpDeleteGroupPktBufs (void)
+{
+    int depth = 0;
+
+    for (depth = 0; depth < OFC_MAX_GROUP_DEPTH; depth++)
+    {
+        kfree (gOfcDpGlobals.apGroupPktBuf[depth]);
+        gOfcDpGlobals.apGroupPktBuf[depth] = NULL;
+    }
+
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpGetGroupEntry
+*
+* Description: This function fetches group entry from group table
+*
+* Input: groupId - Group identifier
+*
+* Output: None
+*
+* Returns: Pointer to group entry
+*
+*******************************************************************/
+tOfcGroupEntry *OfcDpGetGroupEntry (__u32 groupId)
+{
+    tOfcGroupEntry    *pGroupEntry = NULL;
+    struct list_head  *pList = NULL;
+
+    list_for_each (pList, 
+                   &gOfcDpGlobals.aGroupHashList[OFC_GROUP_HASH(groupId)])
+    {
+        pGroupEntry = (tOfcGroupEntry *) pList;
+        if (pGroupEntry->groupId == groupId)
+        {
+            return pGroupEntry;
+        }
+    }
+
+    return NULL;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpInsertGroupEntry
+*
+* Description: This function inserts group entry in group table
+*
+* Input: pGroupEntry - Pointer to group entry
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpInsertGroupEntry (tOfcGroupEntry *pGroupEntry)
+{
+    __u32 groupId = pGroupEntry->groupId;
+
+    if (OfcDpGetGroupEntry (groupId) != NULL)
+    {
+        /* TODO: Send OFPGMFC_GROUP_EXISTS error message */
+        printk (KERN_CRIT "Group %u already exists\r\n", groupId);
+        OfcDpFreeGroupEntry (pGroupEntry);
+        pGroupEntry = NULL;
+        return OFC_FAILURE;
+    }
+
+    INIT_LIST_HEAD (&pGroupEntry->list);
+    list_add_tail (&pGroupEntry->list,
+                   &gOfcDpGlobals.aGroupHashList[OFC_GROUP_HASH(groupId)]);
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpModifyGroupEntry
+*
+* Description: This function replaces buckets of an existing
+*              group. Group counters are retained across modify.
+*
+* Input: pGroupEntry - Pointer to new group entry
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpModifyGroupEntry (tOfcGroupEntry *pGroupEntry)
+{
+    tOfcGroupEntry *pOldGroupEntry = NULL;
+    tOfcGroupStats __percpu *pStats = NULL;
+
+    pOldGroupEntry = OfcDpGetGroupEntry (pGroupEntry->groupId);
+    if (pOldGroupEntry == NULL)
+    {
+        /* TODO: Send OFPGMFC_UNKNOWN_GROUP error message */
+        printk (KERN_CRIT "Group %u does not exist\r\n",
+                pGroupEntry->groupId);
+        OfcDpFreeGroupEntry (pGroupEntry);
+        pGroupEntry = NULL;
+        return OFC_FAILURE;
+    }
+
+    /* Group table is only accessed by data path task, therefore 
+     * the entry can be swapped without locking */
+    pStats = pOldGroupEntry->pStats;
+    pOldGroupEntry->pStats = pGroupEntry->pStats;
+    pGroupEntry->pStats = pStats;
+
+    INIT_LIST_HEAD (&pGroupEntry->list);
+    list_replace (&pOldGroupEntry->list, &pGroupEntry->list);
+    OfcDpFreeGroupEntry (pOldGroupEntry);
+    pOldGroupEntry = NULL;
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpDeleteGroupEntry
+*
+* Description: This function deletes group entry from group table
+*              along with flow entries that forward to it
+*
+* Input: groupId - Group identifier, OFPG_ALL deletes all groups
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpDeleteGroupEntry (__u32 groupId)
+{
+    tOfcGroupEntry    *pGroupEntry = NULL;
+    struct list_head  *pList = NULL;
+    struct list_head  *pTmpList = NULL;
+    __u32             hashIndex = 0;
+
+    if (groupId == OFPG_ALL)
+    {
+        for (hashIndex = 0; hashIndex < OFC_GROUP_HASH_SIZE; hashIndex++)
+        {
+            list_for_each_safe (pList, pTmpList,
+                                &gOfcDpGlobals.aGroupHashList[hashIndex])
+            {
+                pGroupEntry = (tOfcGroupEntry *) pList;
+                OfcDpDeleteGroupFlows (pGroupEntry->groupId);
+                list_del_init (&pGroupEntry->list);
+                OfcDpFreeGroupEntry (pGroupEntry);
+            }
+        }
+        return OFC_SUCCESS;
+    }
+
+    /* Deleting a non-existent group is not an error */
+    pGroupEntry = OfcDpGetGroupEntry (groupId);
+    if (pGroupEntry != NULL)
+    {
+        /* Flows forwarding to group are removed along with it */
+        OfcDpDeleteGroupFlows (groupId);
+        list_del_init (&pGroupEntry->list);
+        OfcDpFreeGroupEntry (pGroupEntry);
+        pGroupEntry = NULL;
+    }
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpDeleteGroupFlows
+*
+* Description: This function deletes flow entries of all flow
+*              tables whose apply or write actions forward to the
+*              group, as group is being deleted
+*
+* Input: groupId - Group identifier
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpDeleteGroupFlows (__u32 groupId)
+{
+    tOfcFlowTable     *pFlowTable = NULL;
+    tOfcFlowEntry     *pFlowEntry = NULL;
+    struct list_head  *pTableList = NULL;
+    struct list_head  *pList = NULL;
+    struct list_head  *pTmpList = NULL;
+
+    list_for_each (pTableList, &gOfcDpGlobals.flowTableListHead)
+    {
+        pFlowTable = (tOfcFlowTable *) pTableList;
+        list_for_each_safe (pList, pTmpList, &pFlowTable->flowEntryList)
+        {
+            pFlowEntry = (tOfcFlowEntry *) pList;
+            if (OfcDpIsFlowOutputTo (pFlowEntry, OFPP_ANY, groupId)
+                != OFC_TRUE)
+            {
+                continue;
+            }
+
+            list_del_init (pList);
+            pFlowTable->activeCount--;
+            OfcDpUpdateMatchFieldMask (pFlowEntry, OFC_FALSE);
+            OfcDpFreeFlowEntry (pFlowEntry);
+            pFlowEntry = NULL;
+        }
+    }
+
+    /* Deleted flows miss again */
+    gOfcDpGlobals.pendingMissGen++;
+
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpFreeGroupEntry
+*
+* Description: This function releases group entry along with
+*              bucket action lists and per-CPU statistics
+*
+* Input: pGroupEntry - Pointer to group entry
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpFreeGroupEntry (tOfcGroupEntry *pGroupEntry)
+{
+    __u8 bucketIndex = 0;
+
+    if (pGroupEntry == NULL)
+    {
+        return;
+    }
+
+    for (bucketIndex = 0; bucketIndex < pGroupEntry->numBuckets;
+         bucketIndex++)
+    {
+        OfcDeleteList (&pGroupEntry->aBuckets[bucketIndex].actionList);
+    }
+
+    if (pGroupEntry->pStats != NULL)
+    {
+        free_percpu (pGroupEntry->pStats);
+        pGroupEntry->pStats = NULL;
+    }
+
+    kfree (pGroupEntry);
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpIsPortLive
+*
+* Description: This function checks liveness of port watched by
+*              group bucket
+*
+* Input: port - Controller port number
+*
+* Output: None
+*
+* Returns: OFC_TRUE/OFC_FALSE
+*
+*******************************************************************/
+int OfcDpIsPortLive (__u32 port)
+{
+    struct net_device *pDev = NULL;
+
+    if (port == OFPP_ANY)
+    {
+        /* Bucket does not watch any port */
+        return OFC_TRUE;
+    }
+
+    if ((port < 1) || (port > gNumOpenFlowIf))
+    {
+        return OFC_FALSE;
+    }
+
+    /* Port n corresponds to dataIfNum n-1 */
+    pDev = gOfcDpGlobals.aDataIfDev[port - 1];
+    if ((pDev == NULL) || (!netif_running (pDev)) ||
+        (!netif_carrier_ok (pDev)))
+    {
+        return OFC_FALSE;
+    }
+
+    return OFC_TRUE;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpIsBucketLive
+*
+* Description: This function checks liveness of group bucket
+*              using its watch port and watch group. A watched
+*              group is live if any of its buckets watch a live
+*              port.
+*
+* Input: pBucket - Pointer to group bucket
+*
+* Output: None
+*
+* Returns: OFC_TRUE/OFC_FALSE
+*
+*******************************************************************/
+int OfcDpIsBucketLive (tOfcGroupBucket *pBucket)
+{
+    tOfcGroupEntry *pWatchGroup = NULL;
+    __u8           bucketIndex = 0;
+
+    if (OfcDpIsPortLive (pBucket->watchPort) != OFC_TRUE)
+    {
+        return OFC_FALSE;
+    }
+
+    if (pBucket->watchGroup == OFPG_ANY)
+    {
+        return OFC_TRUE;
+    }
+
+    pWatchGroup = OfcDpGetGroupEntry (pBucket->watchGroup);
+    if (pWatchGroup == NULL)
+    {
+        return OFC_FALSE;
+    }
+
+    for (bucketIndex = 0; bucketIndex < pWatchGroup->numBuckets;
+         bucketIndex++)
+    {
+        if (OfcDpIsPortLive (pWatchGroup->aBuckets[bucketIndex].watchPort)
+            == OFC_TRUE)
+        {
+            return OFC_TRUE;
+        }
+    }
+
+    return OFC_FALSE;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpSelectGroupBucket
+*
+* Description: This function selects bucket of select group
+*              using hash of packet 5-tuple, so that all packets
+*              of a flow take the same bucket. Buckets are spread
+*              over slots in proportion to their weight when the
+*              group is created. If the selected bucket is not
+*              live, the next live slot is used.
+*
+* Input: pDpPkt - Pointer to data packet
+*        pGroupEntry - Pointer to group entry
+*
+* Output: None
+*
+* Returns: Bucket index, or -1 if no bucket is live
+*
+*******************************************************************/
+int OfcDpSelectGroupBucket (tOfcDpPkt *pDpPkt,
+                            tOfcGroupEntry *pGroupEntry)
+{
+    tOfcMatchFields *pMatch = pDpPkt->pMatchFields;
+    __u32           hash = 0;
+    __u32           slot = 0;
+    __u32           slotCount = 0;
+    __u8            bucketIndex = 0;
+
+    if (OfcDpExtractAllPktHdrs (pDpPkt) == OFC_SUCCESS)
+    {
+        if (pMatch->etherType == OFC_IP_ETHTYPE)
+        {
+            hash = jhash_3words (pMatch->srcIpAddr, pMatch->dstIpAddr,
+                                 ((__u32) pMatch->srcPortNum << 16) |
+                                 pMatch->dstPortNum,
+                                 pMatch->protocolType);
+        }
+        else
+        {
+            /* No L3 header, spread using MAC addresses */
+            hash = jhash (pMatch->aSrcMacAddr, OFC_MAC_ADDR_LEN,
+                          jhash (pMatch->aDstMacAddr, 
+                                 OFC_MAC_ADDR_LEN, 0));
+        }
+    }
+
+    slot = hash & (OFC_GROUP_SELECT_SLOTS - 1);
+    for (slotCount = 0; slotCount < OFC_GROUP_SELECT_SLOTS; slotCount++)
+    {
+        bucketIndex = pGroupEntry->aSelectMap[slot];
+        if (OfcDpIsBucketLive (&pGroupEntry->aBuckets[bucketIndex])
+            == OFC_TRUE)
+        {
+            return bucketIndex;
+        }
+        slot = (slot + 1) & (OFC_GROUP_SELECT_SLOTS - 1);
+    }
+
+    return -1;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpExecuteGroupBucket
+*
+* Description: This function executes actions of group bucket.
+*              Buckets that only output the packet add their port
+*              to output port list of group, which is sent when
+*              group completes. Other buckets modify a copy of the
+*              packet in buffer of their group depth, the copy is
+*              sent by bucket's output actions before the next
+*              bucket runs, so that the packet seen by remaining
+*              buckets and actions is not altered.
+*
+* Input: pDpPkt - Pointer to data packet
+*        pGroupEntry - Pointer to group entry
+*        bucketIndex - Index of bucket to execute
+*
+* Output: pOutPortList - Pointer to output port list
+*         pNumOutPorts - Number of output ports
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpExecuteGroupBucket (tOfcDpPkt *pDpPkt,
+                             tOfcGroupEntry *pGroupEntry,
+                             __u8 bucketIndex, __u32 *pOutPortList,
+                             __u8 *pNumOutPorts)
+{
+    tOfcGroupBucket *pBucket = &pGroupEntry->aBuckets[bucketIndex];
+    tOfcDpPkt       cloneDpPkt;
+    __u32           aCloneOutPortList[OFC_MAX_OUT_PORTS];
+    __u8            numCloneOutPorts = 0;
+    __u8            *pCloneBuf = NULL;
+
+    this_cpu_inc (pGroupEntry->pStats->aBucketPktCount[bucketIndex]);
+    this_cpu_add (pGroupEntry->pStats->aBucketByteCount[bucketIndex],
+                  pDpPkt->pktLen);
+
+    if (pBucket->isOutputOnly == OFC_TRUE)
+    {
+        if (*pNumOutPorts >= OFC_MAX_OUT_PORTS)
+        {
+            OfcDpFlushOutput (pDpPkt, pOutPortList, pNumOutPorts);
+        }
+        pOutPortList[(*pNumOutPorts)++] = pBucket->outPort;
+        return OFC_SUCCESS;
+    }
+
+    if ((OFC_DP_PKT_HEADROOM + pDpPkt->pktLen) > OFC_GROUP_PKT_BUF_SIZE)
+    {
+        printk (KERN_CRIT "[%s]: Packet too large for group "
+                          "bucket\r\n", __func__);
+        return OFC_FAILURE;
+    }
+    pCloneBuf = gOfcDpGlobals.apGroupPktBuf[pDpPkt->groupDepth];
+
+    memcpy (&cloneDpPkt, pDpPkt, sizeof (cloneDpPkt));
+    cloneDpPkt.pBuf = pCloneBuf;
+    cloneDpPkt.pPkt = pCloneBuf + OFC_DP_PKT_HEADROOM;
+    cloneDpPkt.groupDepth++;
+    memcpy (cloneDpPkt.pPkt, pDpPkt->pPkt, pDpPkt->pktLen);
+
+    /* Output actions of bucket send the copy as they run */
+    memset (aCloneOutPortList, 0, sizeof (aCloneOutPortList));
+    return OfcDpApplyInstrActions (&cloneDpPkt, &pBucket->actionList,
+                                   aCloneOutPortList, 
+                                   &numCloneOutPorts);
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpExecuteGroup
+*
+* Description: This function executes group action on packet.
+*              Packet is sent out of buckets before the group
+*              action returns. Ports of output-only buckets are
+*              collected and sent together, each port getting a
+*              clone of one socket buffer
+*
+* Input: pDpPkt - Pointer to data packet
+*        groupId - Group identifier
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpExecuteGroup (tOfcDpPkt *pDpPkt, __u32 groupId)
+{
+    tOfcGroupEntry *pGroupEntry = NULL;
+    __u32          aOutPortList[OFC_MAX_OUT_PORTS];
+    __u8           numOutPorts = 0;
+    int            bucketIndex = 0;
+    int            retVal = OFC_SUCCESS;
+
+    if (pDpPkt->groupDepth >= OFC_MAX_GROUP_DEPTH)
+    {
+        printk (KERN_CRIT "[%s]: Group chain too deep\r\n", __func__);
+        return OFC_FAILURE;
+    }
+
+    pGroupEntry = OfcDpGetGroupEntry (groupId);
+    if (pGroupEntry == NULL)
+    {
+        printk (KERN_CRIT "[%s]: Group %u not found\r\n", __func__,
+                groupId);
+        return OFC_FAILURE;
+    }
+
+    /* Counters are per-CPU so that they are updated without
+     * locking or atomic operations */
+    this_cpu_inc (pGroupEntry->pStats->pktCount);
+    this_cpu_add (pGroupEntry->pStats->byteCount, pDpPkt->pktLen);
+
+    switch (pGroupEntry->groupType)
+    {
+        case OFPGT_ALL:
+            for (bucketIndex = 0; bucketIndex < pGroupEntry->numBuckets;
+                 bucketIndex++)
+            {
+                if (OfcDpExecuteGroupBucket (pDpPkt, pGroupEntry,
+                                             bucketIndex, aOutPortList,
+                                             &numOutPorts)
+                    != OFC_SUCCESS)
+                {
+                    retVal = OFC_FAILURE;
+                }
+            }
+            break;
+
+        case OFPGT_SELECT:
+            bucketIndex = OfcDpSelectGroupBucket (pDpPkt, pGroupEntry);
+            if (bucketIndex < 0)
+            {
+                /* No live bucket, drop packet */
+                break;
+            }
+            retVal = OfcDpExecuteGroupBucket (pDpPkt, pGroupEntry,
+                                              bucketIndex, aOutPortList,
+                                              &numOutPorts);
+            break;
+
+        case OFPGT_INDIRECT:
+            retVal = OfcDpExecuteGroupBucket (pDpPkt, pGroupEntry, 0,
+                                              aOutPortList,
+                                              &numOutPorts);
+            break;
+
+        case OFPGT_FF:
+            /* Use first live bucket */
+            for (bucketIndex = 0; bucketIndex < pGroupEntry->numBuckets;
+                 bucketIndex++)
+            {
+                if (OfcDpIsBucketLive (&pGroupEntry->aBuckets[bucketIndex])
+                    == OFC_TRUE)
+                {
+                    retVal = OfcDpExecuteGroupBucket (pDpPkt, pGroupEntry,
+                                                      bucketIndex,
+                                                      aOutPortList,
+                                                      &numOutPorts);
+                    break;
+                }
+            }
+            break;
+
+        default:
+            retVal = OFC_FAILURE;
+            break;
+    }
+
+    /* Send before actions following group modify the packet */
+    OfcDpFlushOutput (pDpPkt, aOutPortList, &numOutPorts);
+
+    return retVal;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpGetGroupStats
+*
+* Description: This function sums per-CPU counters of group
+*
+* Input: pGroupEntry - Pointer to group entry
+*
+* Output: pGroupStats - Pointer to group statistics
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpGetGroupStats (tOfcGroupEntry *pGroupEntry,
+                        tOfcGroupStats *pGroupStats)
+{
+    tOfcGroupStats *pCpuStats = NULL;
+    __u8           bucketIndex = 0;
+    int            cpu = 0;
+
+    if ((pGroupEntry == NULL) || (pGroupStats == NULL))
+    {
+        return OFC_FAILURE;
+    }
+
+    memset (pGroupStats, 0, sizeof (tOfcGroupStats));
+    for_each_possible_cpu (cpu)
+    {
+        pCpuStats = per_cpu_ptr (pGroupEntry->pStats, cpu);
+        pGroupStats->pktCount += pCpuStats->pktCount;
+        pGroupStats->byteCount += pCpuStats->byteCount;
+        for (bucketIndex = 0; bucketIndex < OFC_MAX_GROUP_BUCKETS;
+             bucketIndex++)
+        {
+            pGroupStats->aBucketPktCount[bucketIndex] +=
+                pCpuStats->aBucketPktCount[bucketIndex];
+            pGroupStats->aBucketByteCount[bucketIndex] +=
+                pCpuStats->aBucketByteCount[bucketIndex];
+        }
+    }
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpGetMeterEntry
+*
+* Description: This function fetches meter entry from meter table
+*
+* Input: meterId - Meter identifier
+*
+* Output: None
+*
+* Returns: Pointer to meter entry
+*
+*******************************************************************/
+tOfcMeterEntry *OfcDpGetMeterEntry (__u32 meterId)
+{
+    tOfcMeterEntry    *pMeterEntry = NULL;
+    struct list_head  *pList = NULL;
+
+    list_for_each (pList, 
+                   &gOfcDpGlobals.aMeterHashList[OFC_METER_HASH(meterId)])
+    {
+        pMeterEntry = (tOfcMeterEntry *) pList;
+        if (pMeterEntry->meterId == meterId)
+        {
+            return pMeterEntry;
+        }
+    }
+
+    return NULL;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpInsertMeterEntry
+*
+* Description: This function inserts meter entry in meter table
+*
+* Input: pMeterEntry - Pointer to meter entry
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpInsertMeterEntry (tOfcMeterEntry *pMeterEntry)
+{
+    __u32 meterId = pMeterEntry->meterId;
+
+    if (OfcDpGetMeterEntry (meterId) != NULL)
+    {
+        /* TODO: Send OFPMMFC_METER_EXISTS error message */
+        printk (KERN_CRIT "Meter %u already exists\r\n", meterId);
+        OfcDpFreeMeterEntry (pMeterEntry);
+        pMeterEntry = NULL;
+        return OFC_FAILURE;
+    }
+
+    INIT_LIST_HEAD (&pMeterEntry->list);
+    list_add_tail (&pMeterEntry->list,
+                   &gOfcDpGlobals.aMeterHashList[OFC_METER_HASH(meterId)]);
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpModifyMeterEntry
+*
+* Description: This function replaces configuration of an existing
+*              meter. Token buckets start full with new rates.
+*
+* Input: pMeterEntry - Pointer to new meter entry
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpModifyMeterEntry (tOfcMeterEntry *pMeterEntry)
+{
+    tOfcMeterEntry *pOldMeterEntry = NULL;
+
+    pOldMeterEntry = OfcDpGetMeterEntry (pMeterEntry->meterId);
+    if (pOldMeterEntry == NULL)
+    {
+        /* TODO: Send OFPMMFC_UNKNOWN_METER error message */
+        printk (KERN_CRIT "Meter %u does not exist\r\n",
+                pMeterEntry->meterId);
+        OfcDpFreeMeterEntry (pMeterEntry);
+        pMeterEntry = NULL;
+        return OFC_FAILURE;
+    }
+
+    /* Meter table is only accessed by data path task, therefore
+     * the entry can be swapped without locking */
+    INIT_LIST_HEAD (&pMeterEntry->list);
+    list_replace (&pOldMeterEntry->list, &pMeterEntry->list);
+    OfcDpFreeMeterEntry (pOldMeterEntry);
+    pOldMeterEntry = NULL;
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpDeleteMeterEntry
+*
+* Description: This function deletes meter entry from meter table
+*
+* Input: meterId - Meter identifier, OFPM_ALL deletes all meters
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpDeleteMeterEntry (__u32 meterId)
+{
+    tOfcMeterEntry    *pMeterEntry = NULL;
+    struct list_head  *pList = NULL;
+    struct list_head  *pTmpList = NULL;
+    __u32             hashIndex = 0;
+
+    if (meterId == OFPM_ALL)
+    {
+        for (hashIndex = 0; hashIndex < OFC_METER_HASH_SIZE; hashIndex++)
+        {
+            list_for_each_safe (pList, pTmpList,
+                                &gOfcDpGlobals.aMeterHashList[hashIndex])
+            {
+                pMeterEntry = (tOfcMeterEntry *) pList;
+                list_del_init (&pMeterEntry->list);
+                OfcDpFreeMeterEntry (pMeterEntry);
+            }
+        }
+        return OFC_SUCCESS;
+    }
+
+    /* Deleting a non-existent meter is not an error */
+    pMeterEntry = OfcDpGetMeterEntry (meterId);
+    if (pMeterEntry != NULL)
+    {
+        list_del_init (&pMeterEntry->list);
+        OfcDpFreeMeterEntry (pMeterEntry);
+        pMeterEntry = NULL;
+    }
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpFreeMeterEntry
+*
+* Description: This function releases meter entry along with its
+*              per-CPU state
+*
+* Input: pMeterEntry - Pointer to meter entry
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpFreeMeterEntry (tOfcMeterEntry *pMeterEntry)
+{
+    if (pMeterEntry == NULL)
+    {
+        return;
+    }
+
+    if (pMeterEntry->pCpuState != NULL)
+    {
+        free_percpu (pMeterEntry->pCpuState);
+        pMeterEntry->pCpuState = NULL;
+    }
+
+    kfree (pMeterEntry);
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpMeterBandConforms
+*
+* Description: This function takes tokens for a packet from meter
+*              band. Tokens are first taken from the tokens cached
+*              by this CPU. When they run out, the shared pool is
+*              refilled for the elapsed time and a batch of tokens
+*              is moved to this CPU with a compare-and-swap, so no
+*              lock is taken.
+*
+* Input: pBand - Pointer to meter band
+*        pLocalTokens - Pointer to tokens cached by this CPU
+*        cost - Tokens needed for the packet
+*        nowNs - Current time in nanoseconds
+*
+* Output: None
+*
+* Returns: OFC_TRUE if packet is within band rate, else OFC_FALSE
+*
+*******************************************************************/
+int OfcDpMeterBandConforms (tOfcMeterBand *pBand, __s64 *pLocalTokens,
+                            __s64 cost, __u64 nowNs)
+{
+    __s64   lastNs = 0;
+    __s64   elapsedNs = 0;
+    __s64   maxElapsedNs = 0;
+    __s64   oldTokens = 0;
+    __s64   newTokens = 0;
+    __s64   needTokens = 0;
+    __s64   takeTokens = 0;
+
+    if (*pLocalTokens >= cost)
+    {
+        *pLocalTokens -= cost;
+        return OFC_TRUE;
+    }
+
+    /* Refill shared pool. Only the CPU that advances the refill
+     * timestamp adds tokens for the elapsed interval. */
+    lastNs = atomic64_read (&pBand->lastRefillNs);
+    if (((__s64) nowNs > lastNs) &&
+        (atomic64_cmpxchg (&pBand->lastRefillNs, lastNs, nowNs) 
+         == lastNs))
+    {
+        elapsedNs = (__s64) nowNs - lastNs;
+        /* Bucket is full after this interval, also avoids
+         * overflow after long idle period */
+        maxElapsedNs = (pBand->burstUnits / pBand->rate) + 1;
+        if (elapsedNs > maxElapsedNs)
+        {
+            elapsedNs = maxElapsedNs;
+        }
+
+        do
+        {
+            oldTokens = atomic64_read (&pBand->tokens);
+            newTokens = oldTokens + (elapsedNs * pBand->rate);
+            if (newTokens > pBand->burstUnits)
+            {
+                newTokens = pBand->burstUnits;
+            }
+        } while (atomic64_cmpxchg (&pBand->tokens, oldTokens, newTokens)
+                 != oldTokens);
+    }
+
+    /* Take tokens for this packet plus a batch for next packets */
+    needTokens = cost - *pLocalTokens + pBand->batchUnits;
+    do
+    {
+        oldTokens = atomic64_read (&pBand->tokens);
+        if (oldTokens >= needTokens)
+        {
+            takeTokens = needTokens;
+        }
+        else if ((oldTokens + *pLocalTokens) >= cost)
+        {
+            takeTokens = oldTokens;
+        }
+        else
+        {
+            /* Rate exceeded, leave tokens in pool */
+            return OFC_FALSE;
+        }
+    } while (atomic64_cmpxchg (&pBand->tokens, oldTokens,
+                               oldTokens - takeTokens) != oldTokens);
+
+    *pLocalTokens += takeTokens - cost;
+    return OFC_TRUE;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpApplyMeter
+*
+* Description: This function meters packet. Of the bands whose
+*              rate is exceeded, the band with highest rate is
+*              applied to the packet. Drop band marks the packet as
+*              dropped, DSCP remark band increases drop precedence.
+*
+* Input: pDpPkt - Pointer to data packet
+*        meterId - Meter identifier
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE (meter not found)
+*
+*******************************************************************/
+int OfcDpApplyMeter (tOfcDpPkt *pDpPkt, __u32 meterId)
+{
+    tOfcMeterEntry    *pMeterEntry = NULL;
+    tOfcMeterCpuState *pCpuState = NULL;
+    tOfcMeterBand     *pBand = NULL;
+    __u64             nowNs = 0;
+    __s64             cost = 0;
+    int               exceedBand = -1;
+    __u8              bandIndex = 0;
+
+    pMeterEntry = OfcDpGetMeterEntry (meterId);
+    if (pMeterEntry == NULL)
+    {
+        return OFC_FAILURE;
+    }
+
+    if (pMeterEntry->flags & OFPMF_PKTPS)
+    {
+        cost = OFC_METER_UNITS_PER_PKT;
+    }
+    else
+    {
+        cost = (__s64) pDpPkt->pktLen * 8 * OFC_METER_UNITS_PER_BIT;
+    }
+    nowNs = ktime_get_ns();
+
+    /* Preemption is disabled while per-CPU state is in use */
+    pCpuState = get_cpu_ptr (pMeterEntry->pCpuState);
+    pCpuState->pktInCount++;
+    pCpuState->byteInCount += pDpPkt->pktLen;
+
+    for (bandIndex = 0; bandIndex < pMeterEntry->numBands; bandIndex++)
+    {
+        pBand = &pMeterEntry->aBands[bandIndex];
+        if (OfcDpMeterBandConforms (pBand,
+                                    &pCpuState->aLocalTokens[bandIndex],
+                                    cost, nowNs) == OFC_TRUE)
+        {
+            continue;
+        }
+
+        if ((exceedBand < 0) ||
+            (pBand->rate > pMeterEntry->aBands[exceedBand].rate))
+        {
+            exceedBand = bandIndex;
+        }
+    }
+
+    if (exceedBand >= 0)
+    {
+        pCpuState->aBandPktCount[exceedBand]++;
+        pCpuState->aBandByteCount[exceedBand] += pDpPkt->pktLen;
+    }
+    put_cpu_ptr (pMeterEntry->pCpuState);
+
+    if (exceedBand < 0)
+    {
+        return OFC_SUCCESS;
+    }
+
+    pBand = &pMeterEntry->aBands[exceedBand];
+    if (pBand->type == OFPMBT_DROP)
+    {
+        pDpPkt->isDropped = OFC_TRUE;
+    }
+    else if (pBand->type == OFPMBT_DSCP_REMARK)
+    {
+        OfcDpRemarkDscp (pDpPkt, pBand->precLevel);
+    }
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpRemarkDscp
+*
+* Description: This function increases drop precedence of IPv4 or
+*              IPv6 DSCP by given level, saturating at highest
+*              drop precedence
+*
+* Input: pDpPkt - Pointer to data packet
+*        precLevel - Number of drop precedence levels to add
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpRemarkDscp (tOfcDpPkt *pDpPkt, __u8 precLevel)
+{
+    __u8    *pIpHdr = NULL;
+    __u16   l2HdrLen = 0;
+    __u16   etherType = 0;
+    __u16   oldWord = 0;
+    __u16   newWord = 0;
+    __u8    dscp = 0;
+    __u8    dropPrec = 0;
+
+    if (OfcDpGetL2HdrLen (pDpPkt, &l2HdrLen) != OFC_SUCCESS)
+    {
+        return OFC_FAILURE;
+    }
+
+    memcpy (&etherType, pDpPkt->pPkt + l2HdrLen, sizeof (etherType));
+    etherType = ntohs (etherType);
+    pIpHdr = pDpPkt->pPkt + l2HdrLen + OFC_ETHTYPE_LEN;
+    if ((pIpHdr + 2) > (pDpPkt->pPkt + pDpPkt->pktLen))
+    {
+        return OFC_FAILURE;
+    }
+
+    if (etherType == OFC_IP_ETHTYPE)
+    {
+        dscp = pIpHdr[OFC_IP_TOS_OFFSET] >> OFC_DSCP_SHIFT;
+    }
+    else if (etherType == OFC_IPV6_ETHTYPE)
+    {
+        /* Traffic class spans first two bytes of IPv6 header */
+        dscp = (((pIpHdr[0] << OFC_IPV6_TC_SHIFT) | 
+                 (pIpHdr[1] >> OFC_IPV6_TC_SHIFT)) >> OFC_DSCP_SHIFT) &
+               OFC_DSCP_MASK;
+    }
+    else
+    {
+        return OFC_FAILURE;
+    }
+
+    dropPrec = (dscp >> OFC_DSCP_DROP_PREC_SHIFT) & 
+               OFC_DSCP_DROP_PREC_MASK;
+    dropPrec = ((dropPrec + precLevel) > OFC_DSCP_DROP_PREC_MASK) ?
+               OFC_DSCP_DROP_PREC_MASK : (dropPrec + precLevel);
+    dscp = (dscp & ~(OFC_DSCP_DROP_PREC_MASK << 
+                     OFC_DSCP_DROP_PREC_SHIFT)) |
+           (dropPrec << OFC_DSCP_DROP_PREC_SHIFT);
+
+    memcpy (&oldWord, pIpHdr, sizeof (oldWord));
+    if (etherType == OFC_IP_ETHTYPE)
+    {
+        pIpHdr[OFC_IP_TOS_OFFSET] = 
+            (dscp << OFC_DSCP_SHIFT) | 
+            (pIpHdr[OFC_IP_TOS_OFFSET] & ((1 << OFC_DSCP_SHIFT) - 1));
+        memcpy (&newWord, pIpHdr, sizeof (newWord));
+        OfcDpUpdateIpv4Chksum (pIpHdr, oldWord, newWord);
+    }
+    else
+    {
+        /* Version(4) | DSCP(6) | ECN(2) | Flow label... */
+        pIpHdr[0] = (pIpHdr[0] & 0xF0) | (dscp >> 2);
+        pIpHdr[1] = (pIpHdr[1] & 0x3F) | ((dscp & 0x3) << 6);
+    }
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpGetMeterStats
+*
+* Description: This function sums per-CPU counters of meter
+*
+* Input: pMeterEntry - Pointer to meter entry
+*
+* Output: pMeterStats - Pointer to meter statistics
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpGetMeterStats (tOfcMeterEntry *pMeterEntry,
+                        tOfcMeterCpuState *pMeterStats)
+{
+    tOfcMeterCpuState *pCpuState = NULL;
+    __u8              bandIndex = 0;
+    int               cpu = 0;
+
+    if ((pMeterEntry == NULL) || (pMeterStats == NULL))
+    {
+        return OFC_FAILURE;
+    }
+
+    memset (pMeterStats, 0, sizeof (tOfcMeterCpuState));
+    for_each_possible_cpu (cpu)
+    {
+        pCpuState = per_cpu_ptr (pMeterEntry->pCpuState, cpu);
+        pMeterStats->pktInCount += pCpuState->pktInCount;
+        pMeterStats->byteInCount += pCpuState->byteInCount;
+        for (bandIndex = 0; bandIndex < OFC_MAX_METER_BANDS; bandIndex++)
+        {
+            pMeterStats->aBandPktCount[bandIndex] +=
+                pCpuState->aBandPktCount[bandIndex];
+            pMeterStats->aBandByteCount[bandIndex] +=
+                pCpuState->aBandByteCount[bandIndex];
+        }
+    }
+
     return OFC_SUCCESS;
 }
@@ -25,37 +25,300 @@
 #define OFC_MAX_THREAD_NAME_LEN 35
 #define OFC_RX_DATA_PKT_TH_NAME "OpenFlowRxDataPktThread"
 #define OFC_MAX_DATA_SOCK       10
+#define OFC_MAX_RX_QUEUES       8  /* Rx threads per OpenFlow interface */
+
+/* Rx thread polling */
+#define OFC_RX_BACKOFF_MIN_MS   1     /* First sleep after rx error */
+#define OFC_RX_BACKOFF_MAX_MS   1000  /* Sleep doubles up to this */
+#define OFC_RX_STATS_INTERVAL_NS (60 * NSEC_PER_SEC)
+#define OFC_RX_THROTTLE_USECS   100   /* Rx thread wait while data path
+                                       * queue is above high watermark */
+#define OFC_DATA_SOCK_TMO       (HZ / 10) /* Blocking receive on data
+                                           * socket */
+
+/* Queue limits. Producers are throttled above 3/4 of queue length
+ * until consumer drains queue below 1/4 */
+#define OFC_PKT_RX_Q_LEN        4096  /* Rx threads to data path */
+#define OFC_CP_MSG_Q_LEN        1024  /* Control path to data path */
+#define OFC_PKT_IN_Q_LEN        1024  /* Data path to control path */
+#define OFC_MIN_Q_LEN           16
+#define OFC_PKT_IN_SAMPLE_RATE  16    /* 1 in n packet-ins is sent
+                                       * while packet-in queue is
+                                       * above high watermark */
+
+/* Packet-in rate limits in packets per second, of each class. Bursts
+ * of OFC_PKT_IN_BURST_MSECS at the rate are allowed. */
+#define OFC_PKT_IN_RATE         1000  /* All ports */
+#define OFC_PORT_PKT_IN_RATE    200   /* Each ingress port */
+#define OFC_PKT_IN_BURST_MSECS  100
+#define OFC_PKT_IN_MISS         0     /* Class of table-miss packet-in */
+#define OFC_PKT_IN_ACTION       1     /* Class of output to controller */
+#define OFC_MAX_PKT_IN_CLASS    2
+#define OFC_PKT_IN_TX_BUDGET    64    /* Packet-ins sent before control
+                                       * path task serves controllers */
+#define OFC_CNTRL_TX_RESERVE    4096  /* Socket send buffer kept free
+                                       * of packet-ins for replies and
+                                       * echo messages */
 #define OFC_MTU_SIZE            1500
 #define OFC_L2_HDR_LEN          18
 #define OFC_MAX_PKT_SIZE        (OFC_MTU_SIZE + OFC_L2_HDR_LEN) /* Check if CRC is required */
+#define OFC_DP_PKT_HEADROOM     32 /* Reserved ahead of received frame
+                                    * for in-place tag push */
 #define OFC_DEF_CNTRL_PORT_NUM  6633
-#define OFC_TASK_SPAWN_GAP      1000 /* 1 second */
+
+/* Controller connections */
+#define OFC_MAX_CNTRL           4 /* Controllers connected at a time */
+#define OFC_MAX_AUX_CONN        3 /* Auxiliary connections per
+                                   * controller, carry packet-ins */
+#define OFC_CNTRL_RX_BUF_SIZE   0x10000 /* Holds largest OpenFlow
+                                         * message while its bytes
+                                         * arrive over several reads */
+
+/* Pending work of controller connection, bits of flags */
+#define OFC_CONN_RX_PENDING     0 /* Control packets queued */
+#define OFC_CONN_STATE_PENDING  1 /* TCP state changed */
+
+/* Controller connection states */
+#define OFC_CNTRL_DISCONNECTED  0 /* Waiting for reconnect timer */
+#define OFC_CNTRL_CONNECTING    1 /* TCP handshake in progress */
+#define OFC_CNTRL_CONNECTED     2
+
+/* Controller connection timers */
+#define OFC_CNTRL_BACKOFF_MIN_MS 100   /* First reconnect delay */
+#define OFC_CNTRL_BACKOFF_MAX_MS 8000  /* Delay doubles up to this */
+#define OFC_CNTRL_CONNECT_TMO_MS 3000  /* TCP handshake timeout */
+#define OFC_CNTRL_SOCK_TMO_MS    1000  /* Socket send/receive timeout */
+#define OFC_ECHO_INTERVAL_MS     5000  /* Echo request when idle */
+#define OFC_ECHO_MAX_MISS        3     /* Unanswered echo requests
+                                        * before disconnect */
+
+/* Asynchronous message masks set on new connection. Index 0 of
+ * masks applies in master and equal role, index 1 in slave role. */
+#define OFC_ASYNC_MASTER                0
+#define OFC_ASYNC_SLAVE                 1
+#define OFC_DEF_PKT_IN_MASK             0x7 /* All reasons */
+#define OFC_DEF_PORT_STATUS_MASK        0x7 /* All reasons */
+#define OFC_DEF_FLOW_REMOVED_MASK       0xF /* All reasons */
+
+/* Behaviour when controller connection is lost */
+#define OFC_FAIL_SECURE         0 /* Packets for controller dropped */
+#define OFC_FAIL_STANDALONE     1 /* Packets for controller forwarded
+                                   * as learning switch */
+
+/* Data packet I/O modes */
+#define OFC_DATA_IO_SOCKET      0 /* One socket receive per frame */
+#define OFC_DATA_IO_RING        1 /* Frames received in ring blocks */
+#define OFC_DATA_IO_RX_HANDLER  2 /* Ring filled from device rx
+                                   * handler, bypassing the stack */
+
+/* Receive ring, frames are laid out in blocks as in TPACKET_V3 */
+#define OFC_RING_NUM_BLOCKS     8
+#define OFC_RING_BLOCK_SIZE     (1 << 16)
+#define OFC_RING_BLOCK_TMO      (HZ / 100) /* Retire partly filled
+                                            * block after timeout */
+#define OFC_RING_ALIGN(len)     (((len) + 15) & ~15)
+#define OFC_RING_FIRST_PKT_OFFSET \
+        OFC_RING_ALIGN (sizeof (struct tpacket_block_desc))
+#define OFC_RING_MAC_OFFSET \
+        (OFC_RING_ALIGN (sizeof (struct tpacket3_hdr)) + \
+         OFC_DP_PKT_HEADROOM)
+
+/* Thread classes, each class can be pinned to a set of CPUs */
+#define OFC_DP_THREAD           0 /* Data path task */
+#define OFC_CP_THREAD           1 /* Control path task */
+#define OFC_RX_THREAD           2 /* Rx data packet threads */
+#define OFC_MAX_THREAD_CLASS    3
 
 /* NOTE: If events are added or removed, update OFC_MAX_EVENTS */
 #define OFC_PKT_RX_EVENT   0x00001
 #define OFC_CTRL_PKT_EVENT 0x00002
 #define OFC_DP_TO_CP_EVENT 0X00004
 #define OFC_CP_TO_DP_EVENT 0x00008
-#define OFC_MAX_EVENTS     4
+#define OFC_CNTRL_STATE_EVENT 0x00010
+#define OFC_DP_COMMIT_EVENT 0x00020
+#define OFC_MAX_EVENTS     6
 
 #define OFC_MAX_FLOW_TABLES   2
 #define OFC_MAX_FLOW_ENTRIES  20
 #define OFC_MIN_FLOW_PRIORITY 0
 #define OFC_FIRST_TABLE_INDEX 0
 
+#define OFC_MAX_OUT_PORTS     64
+#define OFC_ACTION_SET_SIZE   28 /* OFCAT_POP_PBB + 1, indexed by type */
+
+/* Group table */
+#define OFC_GROUP_HASH_SIZE      16 /* Must be power of 2 */
+#define OFC_MAX_GROUP_BUCKETS    8
+#define OFC_GROUP_SELECT_SLOTS   64 /* Weighted bucket slots of
+                                     * select group */
+#define OFC_MAX_GROUP_DEPTH      4  /* Nested group actions */
+#define OFC_GROUP_PKT_BUF_SIZE   (OFC_DP_PKT_HEADROOM + OFC_MAX_PKT_SIZE + \
+                                  OFC_DP_PKT_HEADROOM) /* Bucket copy,
+                                  * with tags pushed before group */
+#define OFC_GROUP_HASH(groupId)  ((groupId) & (OFC_GROUP_HASH_SIZE - 1))
+
+/* MAC learning table for OFPP_NORMAL */
+#define OFC_MAC_TABLE_BUCKETS     256 /* Must be power of 2 */
+#define OFC_MAC_TABLE_WAYS        4   /* Entries per bucket */
+#define OFC_MAC_TABLE_SIZE        (OFC_MAC_TABLE_BUCKETS * \
+                                   OFC_MAC_TABLE_WAYS)
+#define OFC_MAC_AGING_TIME        (300 * HZ) /* 5 minutes */
+#define OFC_INVALID_DATA_IF       0xFF
+
+/* Pending miss table. Table-miss packet-in of a flow is sent once,
+ * later packets of the flow are not sent to controller until TTL
+ * expires or flow table changes */
+#define OFC_PENDING_MISS_BUCKETS  256 /* Must be power of 2 */
+#define OFC_PENDING_MISS_WAYS     4   /* Entries per bucket */
+#define OFC_PENDING_MISS_SIZE     (OFC_PENDING_MISS_BUCKETS * \
+                                   OFC_PENDING_MISS_WAYS)
+#define OFC_PENDING_MISS_TTL      (HZ / 10) /* 100 ms */
+#define OFC_ALL_PORT_MASK         0xFFFFFFFF
+
+/* Meter table */
+#define OFC_METER_HASH_SIZE       16 /* Must be power of 2 */
+#define OFC_MAX_METER_BANDS       4
+#define OFC_METER_HASH(meterId)   ((meterId) & (OFC_METER_HASH_SIZE - 1))
+/* Token bucket units, a band earns 'rate' units per nanosecond */
+#define OFC_METER_UNITS_PER_BIT   1000000LL    /* kbps meters */
+#define OFC_METER_UNITS_PER_PKT   1000000000LL /* pktps meters */
+#define OFC_METER_UNITS_PER_BURST 1000000000LL /* kbit or packet */
+#define OFC_METER_BATCH_DIV       8  /* Each CPU caches 1/(8*nCPU) of
+                                      * burst to avoid shared atomics */
+
 #define OFC_MAC_ADDR_LEN             6
 #define OFC_IP_PROT_TYPE_OFFSET      9
 #define OFC_IP_SRC_IP_OFFSET         12
 #define OFC_IP_DST_IP_OFFSET         16
 #define OFC_MATCH_TLV_OFFSET         40
+#define OFC_OXM_HAS_MASK             0x01 /* Mask follows OXM value */
+#define OFC_WRITE_METADATA_LEN       24
 #define OFC_HEADER_OFFSET_FROM_IP    52
 #define OFC_ARP_TRGT_IP_ADDR_OFFSET  24
+#define OFC_IP_TOS_OFFSET            1
+#define OFC_IP_TTL_OFFSET            8
+#define OFC_IP_CHKSUM_OFFSET         10
+#define OFC_IPV6_HOP_LIMIT_OFFSET    7
+#define OFC_IP_FRAG_OFFSET           6
+#define OFC_IP_MIN_HDR_LEN           20
+#define OFC_IPV6_HDR_LEN             40
+#define OFC_IPV6_NEXT_HDR_OFFSET     6
+#define OFC_IPV6_SRC_IP_OFFSET       8
+#define OFC_IPV6_DST_IP_OFFSET       24
+#define OFC_IPV6_ADDR_LEN            16
+#define OFC_IPV6_FLABEL_MASK         0xFFFFF
+#define OFC_IPV6_FRAG_HDR_LEN        8
+#define OFC_IPV6_MAX_EXT_HDRS        8  /* Extension headers skipped
+                                         * before giving up on L4 */
+#define OFC_ARP_HDR_LEN              28
+#define OFC_ARP_OP_OFFSET            6
+#define OFC_ARP_SNDR_MAC_OFFSET      8
+#define OFC_ARP_SNDR_IP_ADDR_OFFSET  14
+#define OFC_ARP_TRGT_MAC_OFFSET      18
+#define OFC_L4_PORTS_LEN             4
+#define OFC_ICMP_HDR_LEN             2  /* Type and code */
+#define OFC_TCP_FLAGS_OFFSET         12
+#define OFC_TCP_MIN_HDR_LEN          20
+#define OFC_TCP_FLAGS_MASK           0x0FFF
+#define OFC_ETH_ADDRS_LEN            (2 * OFC_MAC_ADDR_LEN)
+#define OFC_ETHTYPE_LEN              2
+#define OFC_VLAN_TAG_LEN             4
+#define OFC_MPLS_SHIM_LEN            4
 
 #define OFC_ARP_ETHTYPE    0x0806
 #define OFC_IP_ETHTYPE     0x0800
 #define OFC_VLAN_TPID      0x8100
+#define OFC_QINQ_TPID      0x88A8
+#define OFC_IPV6_ETHTYPE   0x86DD
+#define OFC_MPLS_ETHTYPE   0x8847
+#define OFC_MPLSM_ETHTYPE  0x8848
 #define OFC_TCP_PROT_TYPE  0x06
 #define OFC_UDP_PROT_TYPE  0x11
+#define OFC_ICMP_PROT_TYPE 0x01
+#define OFC_ICMPV6_PROT_TYPE 0x3A
+
+/* IPv4 fragment field and IPv6 extension headers */
+#define OFC_IP_MF_FLAG           0x2000
+#define OFC_IP_FRAG_OFF_MASK     0x1FFF
+#define OFC_IPV6_MF_FLAG         0x0001
+#define OFC_IPV6_FRAG_OFF_MASK   0xFFF8
+#define OFC_IPV6_HOP_OPTS        0
+#define OFC_IPV6_ROUTING         43
+#define OFC_IPV6_FRAGMENT        44
+#define OFC_IPV6_AUTH            51
+#define OFC_IPV6_DEST_OPTS       60
+
+/* Fragment flags of packet, as Nicira NXM_NX_IP_FRAG */
+#define OFC_FRAG_ANY             0x01 /* Packet is a fragment */
+#define OFC_FRAG_LATER           0x02 /* Fragment other than first */
+#define OFC_FRAG_MASK            (OFC_FRAG_ANY | OFC_FRAG_LATER)
+
+/* VLAN TCI and MPLS label stack entry layout */
+#define OFC_VLAN_VID_MASK     0x0FFF
+#define OFC_VLAN_PRESENT      0x1000 /* OFPVID_PRESENT, set in VLAN
+                                      * Id of tagged packets */
+#define OFC_VLAN_MATCH_MASK   (OFC_VLAN_PRESENT | OFC_VLAN_VID_MASK)
+#define OFC_MPLS_LABEL_SHIFT  12
+#define OFC_MPLS_LABEL_MASK   0xFFFFF
+#define OFC_MPLS_TC_SHIFT     9
+#define OFC_MPLS_TC_MASK      0x7
+#define OFC_MPLS_BOS_SHIFT    8
+#define OFC_MPLS_BOS_MASK     0x1
+#define OFC_MPLS_TTL_MASK     0xFF
+
+/* DSCP drop precedence (AF classes) */
+#define OFC_DSCP_SHIFT            2
+#define OFC_DSCP_MASK             0x3F
+#define OFC_DSCP_DROP_PREC_SHIFT  1
+#define OFC_DSCP_DROP_PREC_MASK   0x3
+#define OFC_IPV6_TC_SHIFT         4
+
+/* MPLS match fields present in flow (label/BoS may be zero) */
+#define OFC_MPLS_LABEL_MATCH 0x01
+#define OFC_MPLS_TC_MATCH    0x02
+#define OFC_MPLS_BOS_MATCH   0x04
+
+/* Packet fields referenced by installed flows. Headers are parsed
+ * only up to the deepest layer with a referenced field. */
+#define OFC_FLD_ETH_DST      0x0001
+#define OFC_FLD_ETH_SRC      0x0002
+#define OFC_FLD_VLAN_VID     0x0004
+#define OFC_FLD_ETH_TYPE     0x0008
+#define OFC_FLD_MPLS         0x0010
+#define OFC_FLD_ARP_TPA      0x0020
+#define OFC_FLD_IPV4_SRC     0x0040
+#define OFC_FLD_IPV4_DST     0x0080
+#define OFC_FLD_IP_PROTO     0x0100
+#define OFC_FLD_L4_SRC       0x0200
+#define OFC_FLD_L4_DST       0x0400
+#define OFC_FLD_IPV6_SRC     0x0800
+#define OFC_FLD_IPV6_DST     0x1000
+#define OFC_FLD_IPV6_FLABEL  0x2000
+#define OFC_FLD_ICMP_TYPE    0x4000
+#define OFC_FLD_ICMP_CODE    0x8000
+#define OFC_FLD_ARP_OP       0x10000
+#define OFC_FLD_ARP_SPA      0x20000
+#define OFC_FLD_ARP_SHA      0x40000
+#define OFC_FLD_ARP_THA      0x80000
+#define OFC_FLD_TCP_FLAGS    0x100000
+#define OFC_FLD_IP_FRAG      0x200000
+#define OFC_NUM_FLD          22
+#define OFC_FLD_ALL          ((1 << OFC_NUM_FLD) - 1)
+#define OFC_FLD_ETH_TYPE_MASK (OFC_FLD_ALL & ~(OFC_FLD_ETH_DST | \
+                                               OFC_FLD_ETH_SRC))
+#define OFC_FLD_L3_MASK      (OFC_FLD_ETH_TYPE_MASK & \
+                              ~(OFC_FLD_VLAN_VID | OFC_FLD_ETH_TYPE))
+#define OFC_FLD_L4_MASK      (OFC_FLD_L4_SRC | OFC_FLD_L4_DST | \
+                              OFC_FLD_ICMP_TYPE | OFC_FLD_ICMP_CODE | \
+                              OFC_FLD_TCP_FLAGS)
+/* Fields whose zero value is matched, flow records them in
+ * extMatchFlags */
+#define OFC_FLD_EXT_MASK     (OFC_FLD_IPV6_SRC | OFC_FLD_IPV6_DST | \
+                              OFC_FLD_IPV6_FLABEL | OFC_FLD_ICMP_TYPE | \
+                              OFC_FLD_ICMP_CODE | OFC_FLD_ARP_OP | \
+                              OFC_FLD_ARP_SPA | OFC_FLD_ARP_SHA | \
+                              OFC_FLD_ARP_THA | OFC_FLD_TCP_FLAGS | \
+                              OFC_FLD_IP_FRAG)
 
 #define OFC_OPENFLOW_HDR_LEN     8
 #define OFC_VERSION              0x04
@@ -63,6 +326,17 @@
 #define OFC_NO_BUFFER            0xffffffff
 #define OFC_MAX_PKT_BUFFER       0x111
 #define OFC_CTRL_MAIN_CONNECTION 0x0
+#define OFC_ERROR_DATA_LEN       64 /* Bytes of failed request
+                                     * echoed in error message */
+
+/* Flow stats are collected by data path a few flows at a time and
+ * returned in segments of at most socket send buffer size */
+#define OFC_STATS_BATCH          64
+#define OFC_STATS_SEG_MIN        2048 /* Larger flows are sent in a
+                                       * segment of their own */
+#define OFC_STATS_SEG_MAX        0xF000 /* Also limits flow stats
+                                         * entry of a flow */
+#define OFC_MULTIPART_HDR_ROOM   (OFC_OPENFLOW_HDR_LEN + 8)
 
 #define OFC_DESCR_STRING_LEN     256
 #define OFC_SERIAL_NUM_LEN       32
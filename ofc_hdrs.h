@@ -26,6 +26,14 @@
 #include <linux/if_ether.h>
 #include <linux/if_packet.h>
 #include <linux/inetdevice.h>
+#include <linux/percpu.h>
+#include <linux/jhash.h>
+#include <linux/atomic.h>
+#include <linux/ktime.h>
+#include <linux/llist.h>
+#include <linux/mutex.h>
+#include <net/sock.h>
+#include <asm/unaligned.h>
 
 #include "ofc_defn.h"
 #include "ofc_pkt.h"
@@ -19,19 +19,89 @@ char *gpOpenFlowIf[OFC_MAX_OF_IF_NUM];
 int  gNumOpenFlowIf = 0;
 module_param_array (gpOpenFlowIf, charp, &gNumOpenFlowIf, 0);
 
-/* SDN Controller IP address */
-char *gpServerIpAddr = NULL;
-module_param (gpServerIpAddr, charp, 0);
+/* SDN Controller IP addresses, one per controller */
+char *gpServerIpAddr[OFC_MAX_CNTRL];
+int  gNumCntrl = 0;
+module_param_array (gpServerIpAddr, charp, &gNumCntrl, 0);
 
-/* SDN Controller port number (optional) */
-unsigned short gCntrlPortNo = 0;
-module_param (gCntrlPortNo, short, 0);
+/* SDN Controller port numbers (optional), in order of controller
+ * IP addresses */
+unsigned short gCntrlPortNo[OFC_MAX_CNTRL];
+int  gNumCntrlPortNo = 0;
+module_param_array (gCntrlPortNo, ushort, &gNumCntrlPortNo, 0);
 
-/* SDN Controller IP address in integer format */
-unsigned int gCntrlIpAddr = 0;
+/* Auxiliary connections per controller (optional). Packet-ins are
+ * spread over main and auxiliary connections by flow. */
+unsigned int gNumAuxConn = 0;
+module_param (gNumAuxConn, uint, 0);
+
+/* Data packet I/O mode (optional): 0 - socket, 1 - ring, 
+ * 2 - ring filled from rx handler */
+unsigned int gDataIoMode = OFC_DATA_IO_SOCKET;
+module_param (gDataIoMode, uint, 0);
+
+/* Rx threads per OpenFlow interface (optional), defaults to
+ * number of rx queues of interface */
+unsigned int gNumRxQueues = 0;
+module_param (gNumRxQueues, uint, 0);
+
+/* Rx thread busy poll budget in microseconds (optional). Rx
+ * threads poll for this long after last packet before blocking,
+ * 0 disables busy polling */
+unsigned int gRxPollUsecs = 0;
+module_param (gRxPollUsecs, uint, 0);
+
+/* CPU lists of data path task, control path task and rx threads
+ * (optional), e.g. "2-3". Can be changed at runtime in sysfs. */
+static const struct kernel_param_ops gOfcCpuListParamOps = 
+{
+    .set = OfcSetCpuListParam,
+    .get = OfcGetCpuListParam,
+};
+module_param_cb (gDpCpuList, &gOfcCpuListParamOps, 
+                 &gOfcGlobals.aThreadCpuMask[OFC_DP_THREAD], 0644);
+module_param_cb (gCpCpuList, &gOfcCpuListParamOps, 
+                 &gOfcGlobals.aThreadCpuMask[OFC_CP_THREAD], 0644);
+module_param_cb (gRxCpuList, &gOfcCpuListParamOps, 
+                 &gOfcGlobals.aThreadCpuMask[OFC_RX_THREAD], 0644);
+
+/* SCHED_FIFO priority of data path task and rx threads (optional),
+ * 0 keeps normal policy. Busy polling rx threads with SCHED_FIFO
+ * should be pinned to CPUs isolated from other tasks. */
+unsigned int gDpSchedPrio = 0;
+module_param (gDpSchedPrio, uint, 0444);
+
+/* Behaviour while controller is unreachable (optional): 0 - fail
+ * secure, packets for controller are dropped, 1 - fail standalone,
+ * packets for controller are forwarded as learning switch. Installed
+ * flows keep forwarding in both modes. */
+unsigned int gFailMode = OFC_FAIL_SECURE;
+module_param (gFailMode, uint, 0644);
+
+/* Queue lengths (optional): rx threads to data path, control path
+ * to data path, and packet-ins from data path to control path.
+ * Packets are dropped or sampled instead of using more memory. */
+unsigned int gPktRxQLen = OFC_PKT_RX_Q_LEN;
+module_param (gPktRxQLen, uint, 0);
+unsigned int gCpMsgQLen = OFC_CP_MSG_Q_LEN;
+module_param (gCpMsgQLen, uint, 0);
+unsigned int gPktInQLen = OFC_PKT_IN_Q_LEN;
+module_param (gPktInQLen, uint, 0);
+
+/* Packet-in rate limits in packets per second (optional), of all
+ * ports and of each ingress port. Table-miss and output to
+ * controller packet-ins are limited separately. 0 is unlimited. */
+unsigned int gPktInRate = OFC_PKT_IN_RATE;
+module_param (gPktInRate, uint, 0);
+unsigned int gPortPktInRate = OFC_PORT_PKT_IN_RATE;
+module_param (gPortPktInRate, uint, 0);
+
+/* SDN Controller IP addresses in integer format */
+unsigned int gaCntrlIpAddr[OFC_MAX_CNTRL];
 
 extern tOfcDpGlobals gOfcDpGlobals;
 extern tOfcCpGlobals gOfcCpGlobals;
+extern struct mutex gOfcThreadLock;
 
 
 unsigned int OfcNetFilterPreRouteHook (const struct nf_hook_ops *ops,
@@ -40,7 +110,6 @@ unsigned int OfcNetFilterPreRouteHook (const struct nf_hook_ops *ops,
                                        const struct net_device *out,
                                        int (*okfn)(struct sk_buff*))
 {
-    struct iphdr  *iph = NULL;
     int           dataIfNum = 0;
 
     /* Check whether data packet has been received */
@@ -54,27 +123,8 @@ unsigned int OfcNetFilterPreRouteHook (const struct nf_hook_ops *ops,
         }
     }
 
-    /* Check whether control packet has been recevied  */
-    if (gOfcCpGlobals.isModInit == OFC_TRUE)
-    {
-        iph = ip_hdr (skb);
-        if ((iph != NULL) && 
-            (gCntrlIpAddr == (ntohl (iph->saddr))))
-        {
-            /* Packet received from controller. Send event
-             * to control path task only if it is an
-             * OpenFlow packet i.e. TCP packet consisting
-             * of some payload. The control path task
-             * will validate whether payload is OpenFlow
-             * packet or not */
-            if (ntohs (iph->tot_len) != 
-                OFC_HEADER_OFFSET_FROM_IP)
-            {
-                OfcCpSendEvent (OFC_CTRL_PKT_EVENT);
-            }
-        }
-    }
-    
+    /* Control packets are notified to control path task by data
+     * ready callback of controller sockets */
     return NF_ACCEPT;
 }
 
@@ -92,8 +142,10 @@ static int OfcMainInit (void)
 
 static int __init OpenFlowClientStart (void)
 {
+    int cntrlIndex = 0;
+
     /* Command line arguments missing */
-    if ((gpServerIpAddr == NULL) || (gNumOpenFlowIf == 0))
+    if ((gNumCntrl == 0) || (gNumOpenFlowIf == 0))
     {
         printk (KERN_CRIT "Missing command line arguments!!\r\n");
         return OFC_FAILURE;
@@ -103,12 +155,42 @@ static int __init OpenFlowClientStart (void)
         printk (KERN_CRIT "Too many OpenFlow interfaces!!\r\n");
         return OFC_FAILURE;
     }
-    if (OfcConvertStringToIp (gpServerIpAddr, &gCntrlIpAddr) 
-        != OFC_SUCCESS)
+    if (gDataIoMode > OFC_DATA_IO_RX_HANDLER)
+    {
+        printk (KERN_CRIT "Invalid data I/O mode!!\r\n");
+        return OFC_FAILURE;
+    }
+    if (gFailMode > OFC_FAIL_STANDALONE)
+    {
+        printk (KERN_CRIT "Invalid fail mode!!\r\n");
+        return OFC_FAILURE;
+    }
+    if (gDpSchedPrio >= MAX_RT_PRIO)
+    {
+        printk (KERN_CRIT "Invalid SCHED_FIFO priority!!\r\n");
+        return OFC_FAILURE;
+    }
+    if (gNumAuxConn > OFC_MAX_AUX_CONN)
+    {
+        printk (KERN_CRIT "Too many auxiliary connections!!\r\n");
+        return OFC_FAILURE;
+    }
+    if ((gPktRxQLen < OFC_MIN_Q_LEN) || (gCpMsgQLen < OFC_MIN_Q_LEN) ||
+        (gPktInQLen < OFC_MIN_Q_LEN))
     {
-        printk (KERN_CRIT "Invalid controller IP address!!\r\n");
+        printk (KERN_CRIT "Queue length too small!!\r\n");
         return OFC_FAILURE;
     }
+    for (cntrlIndex = 0; cntrlIndex < gNumCntrl; cntrlIndex++)
+    {
+        if (OfcConvertStringToIp (gpServerIpAddr[cntrlIndex], 
+                                  &gaCntrlIpAddr[cntrlIndex]) 
+            != OFC_SUCCESS)
+        {
+            printk (KERN_CRIT "Invalid controller IP address!!\r\n");
+            return OFC_FAILURE;
+        }
+    }
 
     /* Initialize kernel module */
     if (OfcMainInit() != OFC_SUCCESS)
@@ -118,39 +200,95 @@ static int __init OpenFlowClientStart (void)
     }
 
     /* Spawn OpenFlow data path task */
-    gOfcGlobals.pOfcDpThread = kthread_run (OfcDpMainTask, NULL, 
-                                            OFC_DP_TASK_NAME);
-    if (!gOfcGlobals.pOfcDpThread)
+    init_completion (&gOfcGlobals.dpInitDone);
+    mutex_lock (&gOfcThreadLock);
+    gOfcGlobals.pOfcDpThread = 
+        kthread_create_on_node (OfcDpMainTask, NULL, 
+                                OfcGetThreadClassNode (OFC_DP_THREAD),
+                                OFC_DP_TASK_NAME);
+    if (IS_ERR_OR_NULL (gOfcGlobals.pOfcDpThread))
     {
         printk (KERN_CRIT "Error creating OpenFlow data " 
                           "path task!!\r\n");
-        kthread_stop (gOfcGlobals.pOfcCpThread);
+        gOfcGlobals.pOfcDpThread = NULL;
+        mutex_unlock (&gOfcThreadLock);
+        nf_unregister_hook (&gOfcGlobals.netFilterOps);
 	    return OFC_FAILURE;
     }
+    OfcSetThreadAffinity (gOfcGlobals.pOfcDpThread, OFC_DP_THREAD, 0,
+                          NUMA_NO_NODE);
+    OfcSetThreadPriority (gOfcGlobals.pOfcDpThread, OFC_DP_THREAD);
+    wake_up_process (gOfcGlobals.pOfcDpThread);
+    mutex_unlock (&gOfcThreadLock);
 
-    /* Wait for data path task to be spawned */
-    msleep ((gNumOpenFlowIf - 1) * OFC_TASK_SPAWN_GAP);
+    /* Wait for data path task to create data sockets and rx
+     * threads, control path connects to controller only after
+     * data path is ready */
+    wait_for_completion (&gOfcGlobals.dpInitDone);
+    if (gOfcGlobals.dpInitStatus != OFC_SUCCESS)
+    {
+        printk (KERN_CRIT "OpenFlow data path task initialization " 
+                          "failed!!\r\n");
+        /* Data path task has exited and cleared its thread */
+        nf_unregister_hook (&gOfcGlobals.netFilterOps);
+        return OFC_FAILURE;
+    }
 
     /* Spawn OpenFlow control path task */
-    gOfcGlobals.pOfcCpThread = kthread_run (OfcCpMainTask, NULL,
-                                            OFC_CP_TASK_NAME);
-    if (!gOfcGlobals.pOfcCpThread)
+    mutex_lock (&gOfcThreadLock);
+    gOfcGlobals.pOfcCpThread = 
+        kthread_create_on_node (OfcCpMainTask, NULL, 
+                                OfcGetThreadClassNode (OFC_CP_THREAD),
+                                OFC_CP_TASK_NAME);
+    if (IS_ERR_OR_NULL (gOfcGlobals.pOfcCpThread))
     {
         printk (KERN_CRIT "Error creating OpenFlow control" 
                           " path task!!\r\n");
+        gOfcGlobals.pOfcCpThread = NULL;
+        /* Data path task runs module code, stop it before module
+         * is freed */
+        kthread_stop (gOfcGlobals.pOfcDpThread);
+        gOfcGlobals.pOfcDpThread = NULL;
+        mutex_unlock (&gOfcThreadLock);
+        OfcDpMainDeInit();
+        nf_unregister_hook (&gOfcGlobals.netFilterOps);
         return OFC_FAILURE;
     }
+    OfcSetThreadAffinity (gOfcGlobals.pOfcCpThread, OFC_CP_THREAD, 0,
+                          NUMA_NO_NODE);
+    wake_up_process (gOfcGlobals.pOfcCpThread);
+    mutex_unlock (&gOfcThreadLock);
 
     return OFC_SUCCESS;
 }
 
 static void __exit OpenFlowClientStop (void)
 {
-    /* TODO: Release all data sockets */
-    /* TODO: Stop all data pkt rx threads */
+    int cntrlIndex = 0;
+    int auxId = 0;
+
+    /* Threads are cleared once stopped, so that module
+     * parameters no longer rebind them */
+    mutex_lock (&gOfcThreadLock);
     kthread_stop (gOfcGlobals.pOfcDpThread);
-    sock_release (gOfcCpGlobals.pCntrlSocket);
+    gOfcGlobals.pOfcDpThread = NULL;
     kthread_stop (gOfcGlobals.pOfcCpThread);
+    gOfcGlobals.pOfcCpThread = NULL;
+    mutex_unlock (&gOfcThreadLock);
+    for (cntrlIndex = 0; cntrlIndex < gNumCntrl; cntrlIndex++)
+    {
+        for (auxId = 0; auxId <= gNumAuxConn; auxId++)
+        {
+            OfcCpDeleteCntrlSocket 
+                (&gOfcCpGlobals.aCntrl[cntrlIndex].aConn[auxId]);
+            kfree (gOfcCpGlobals.aCntrl[cntrlIndex].aConn[auxId].pRxBuf);
+        }
+    }
+
+    /* Rx threads, sockets and rings are released once data path
+     * task no longer processes packets, and control path task no
+     * longer reads statistics */
+    OfcDpMainDeInit();
     nf_unregister_hook (&gOfcGlobals.netFilterOps);
     printk (KERN_INFO "Openflow Client Stopped!!\r\n");
 }
@@ -158,6 +296,6 @@ static void __exit OpenFlowClientStop (void)
 module_init (OpenFlowClientStart);
 module_exit (OpenFlowClientStop);
 
-MODULE_LICENSE ("Proprietary");
+MODULE_LICENSE ("GPL");
 MODULE_AUTHOR (MOD_AUTHOR);
 MODULE_DESCRIPTION (MOD_DESC);
@@ -81,6 +81,52 @@ typedef struct
     tOfcInstrTlv  OfpInstr[0];
 } tOfcFlowModHdr;
 
+typedef struct
+{
+    __u16         command;
+    __u8          type;
+    __u8          pad;
+    __u32         groupId;
+} tOfcGroupModHdr;
+
+typedef struct
+{
+    __u16         length;
+    __u16         weight;
+    __u32         watchPort;
+    __u32         watchGroup;
+    __u8          aPad[4];
+} tOfcBucketTlv;
+
+typedef struct
+{
+    __u16         command;
+    __u16         flags;
+    __u32         meterId;
+} tOfcMeterModHdr;
+
+typedef struct
+{
+    __u32         portNo;
+    __u8          aPad[4];
+    __u8          aHwAddr[OFC_MAC_ADDR_LEN];
+    __u8          aPad2[2];
+    __u32         config;
+    __u32         mask;
+    __u32         advertise;
+    __u8          aPad3[4];
+} tOfcPortModHdr;
+
+typedef struct
+{
+    __u16         type;
+    __u16         length;
+    __u32         rate;
+    __u32         burstSize;
+    __u8          precLevel; /* DSCP remark band only */
+    __u8          aPad[3];
+} tOfcMeterBandTlv;
+
 typedef struct
 {
     __u32         bufId;
@@ -132,4 +178,100 @@ typedef struct
     __u32    maxSpeed;
 } tOfcMultipartPortDesc;
 
+typedef struct
+{
+    __u8          tableId;
+    __u8          aPad[3];
+    __u32         outPort;
+    __u32         outGrp;
+    __u8          aPad2[4];
+    tOfcEightByte cookie;
+    tOfcEightByte cookieMask;
+    tOfcMatchTlv  match;
+} tOfcFlowStatsReq;
+
+/* Followed by match and instructions of flow */
+typedef struct
+{
+    __u16         length;
+    __u8          tableId;
+    __u8          pad;
+    __u32         durationSec;
+    __u32         durationNsec;
+    __u16         priority;
+    __u16         idleTimeout;
+    __u16         hardTimeout;
+    __u16         flags;
+    __u8          aPad[4];
+    tOfcEightByte cookie;
+    tOfcEightByte pktCount;
+    tOfcEightByte byteCount;
+} tOfcFlowStats;
+
+typedef struct
+{
+    tOfcEightByte pktCount;
+    tOfcEightByte byteCount;
+    __u32         flowCount;
+    __u8          aPad[4];
+} tOfcAggrStats;
+
+typedef struct
+{
+    __u32         portNo;
+    __u8          aPad[4];
+} tOfcPortStatsReq;
+
+typedef struct
+{
+    __u32         portNo;
+    __u8          aPad[4];
+    tOfcEightByte rxPktCount;
+    tOfcEightByte txPktCount;
+    tOfcEightByte rxByteCount;
+    tOfcEightByte txByteCount;
+    tOfcEightByte rxDropCount;
+    tOfcEightByte txDropCount;
+    tOfcEightByte rxErrorCount;
+    tOfcEightByte txErrorCount;
+    tOfcEightByte rxFrameErrCount;
+    tOfcEightByte rxOverErrCount;
+    tOfcEightByte rxCrcErrCount;
+    tOfcEightByte collisionCount;
+    __u32         durationSec;
+    __u32         durationNsec;
+} tOfcPortStatsReply;
+
+typedef struct
+{
+    __u8          tableId;
+    __u8          aPad[3];
+    __u32         activeCount;
+    tOfcEightByte lookupCount;
+    tOfcEightByte matchCount;
+} tOfcTableStats;
+
+typedef struct
+{
+    __u32         role;
+    __u8          pad[4];
+    tOfcEightByte generationId;
+} tOfcRoleMsg;
+
+/* Body of Set Async and Get Async Reply. Bit n of mask enables
+ * reason n, index 0 applies in master and equal role and index 1
+ * in slave role. */
+typedef struct
+{
+    __u32         aPktInMask[2];
+    __u32         aPortStatusMask[2];
+    __u32         aFlowRemovedMask[2];
+} tOfcAsyncConfig;
+
+typedef struct
+{
+    __u16  type;
+    __u16  code;
+} tOfcErrorMsg;
+
 #endif /* __OFC_PKT_H__ */
@@ -65,7 +65,8 @@ enum
     OFCXMT_OFB_PBB_ISID        = 37,  /* PBB I-SID */
     OFCXMT_OFB_TUNNEL_ID       = 38,  /* Logical Port Metadata */
     OFCXMT_OFB_IPV6_EXTHDR     = 39,  /* IPv6 Extension Header pseudo-field */
-    OFCXMT_OFB_MAX             = 40
+    OFCXMT_OFB_MAX             = 40,
+    OFCXMT_OFB_TCP_FLAGS       = 42   /* TCP flags, OpenFlow 1.5 */
 };
 
 enum 
@@ -122,6 +123,12 @@ enum
     OFPXMC_EXPERIMENTER = 0xFFFF
 };
 
+/* Nicira extension match fields of class OFPXMC_NXM_1 */
+enum
+{
+    OFCNXM_NX_IP_FRAG = 26  /* IP fragment flags */
+};
+
 enum 
 {
     OFPT_HELLO, 
@@ -197,10 +204,136 @@ enum
     OFPMP_EXPERIMENTER    = 0xffff
 };
 
+enum
+{
+    OFPMPF_REPLY_MORE = 1 << 0 /* More replies to follow */
+};
+
+enum
+{
+    OFPTT_MAX = 0xfe,
+    OFPTT_ALL = 0xff  /* Wildcard table used for table config,
+                       * flow stats and flow deletes */
+};
+
+enum
+{
+    OFPCML_NO_BUFFER = 0xffff
+};
+
+/* Group commands */
+enum
+{
+    OFPGC_ADD    = 0, /* New group */
+    OFPGC_MODIFY = 1, /* Modify all matching groups */
+    OFPGC_DELETE = 2  /* Delete all matching groups */
+};
+
+/* Group types */
+enum
+{
+    OFPGT_ALL      = 0, /* All (multicast/broadcast) group */
+    OFPGT_SELECT   = 1, /* Select group */
+    OFPGT_INDIRECT = 2, /* Indirect group */
+    OFPGT_FF       = 3  /* Fast failover group */
+};
+
+/* Group numbering */
+enum
+{
+    OFPG_MAX = 0xffffff00, /* Last usable group number */
+    OFPG_ALL = 0xfffffffc, /* Represents all groups for group delete */
+    OFPG_ANY = 0xffffffff  /* Wildcard group */
+};
+
+/* Meter commands */
+enum
+{
+    OFPMC_ADD    = 0, /* New meter */
+    OFPMC_MODIFY = 1, /* Modify specified meter */
+    OFPMC_DELETE = 2  /* Delete specified meter */
+};
+
+/* Meter configuration flags */
+enum
+{
+    OFPMF_KBPS  = 1 << 0, /* Rate value in kb/s (kilo-bit per second) */
+    OFPMF_PKTPS = 1 << 1, /* Rate value in packet/sec */
+    OFPMF_BURST = 1 << 2, /* Do burst size */
+    OFPMF_STATS = 1 << 3  /* Collect statistics */
+};
+
+/* Meter band types */
+enum
+{
+    OFPMBT_DROP         = 1,      /* Drop packet */
+    OFPMBT_DSCP_REMARK  = 2,      /* Remark DSCP in the IP header */
+    OFPMBT_EXPERIMENTER = 0xFFFF  /* Experimenter meter band */
+};
+
+/* Meter numbering */
+enum
+{
+    OFPM_MAX        = 0xffff0000, /* Last usable meter */
+    OFPM_SLOWPATH   = 0xfffffffd, /* Meter for slow datapath */
+    OFPM_CONTROLLER = 0xfffffffe, /* Meter for controller connection */
+    OFPM_ALL        = 0xffffffff  /* Represents all meters */
+};
+
+/* Port configuration flags */
+enum
+{
+    OFPPC_PORT_DOWN    = 1 << 0, /* Port is administratively down */
+    OFPPC_NO_RECV      = 1 << 2, /* Drop all packets received by port */
+    OFPPC_NO_FLOOD     = 1 << 4, /* Do not include port when flooding,
+                                  * OpenFlow 1.0 flag, reserved in 1.3 */
+    OFPPC_NO_FWD       = 1 << 5, /* Drop packets forwarded to port */
+    OFPPC_NO_PACKET_IN = 1 << 6  /* Do not send packet-in msgs for port */
+};
+
 enum {
     OFPPS_LINK_DOWN = 1 << 0,
     OFPPS_BLOCKED   = 1 << 1,
     OFPPS_LIVE      = 1 << 2
 };
 
+/* Controller roles */
+enum
+{
+    OFPCR_ROLE_NOCHANGE = 0, /* Don't change current role */
+    OFPCR_ROLE_EQUAL    = 1, /* Default role, full access */
+    OFPCR_ROLE_MASTER   = 2, /* Full access, at most one master */
+    OFPCR_ROLE_SLAVE    = 3  /* Read-only access */
+};
+
+/* Error types */
+enum
+{
+    OFPET_BAD_REQUEST         = 1,  /* Request was not understood */
+    OFPET_BAD_MATCH           = 4,  /* Error in match */
+    OFPET_ROLE_REQUEST_FAILED = 11  /* Controller role request failed */
+};
+
+/* OFPET_BAD_REQUEST codes */
+enum
+{
+    OFPBRC_BAD_LEN  = 6, /* Wrong request length for type */
+    OFPBRC_IS_SLAVE = 10, /* Denied because controller is slave */
+    OFPBRC_BAD_PORT = 11  /* Invalid port */
+};
+
+/* OFPET_BAD_MATCH codes */
+enum
+{
+    OFPBMC_BAD_MASK = 8  /* Unsupported mask specified in match */
+};
+
+/* OFPET_ROLE_REQUEST_FAILED codes */
+enum
+{
+    OFPRRFC_STALE    = 0, /* Stale message: old generation_id */
+    OFPRRFC_UNSUP    = 1, /* Controller role change unsupported */
+    OFPRRFC_BAD_ROLE = 2  /* Invalid role */
+};
+
 #endif /* __OFC_STD_H__ */
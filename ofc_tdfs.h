@@ -22,56 +22,103 @@ typedef struct
     char               aDataIfName[OFC_MAX_IFNAME_LEN];
     char               aCntrlIfName[OFC_MAX_IFNAME_LEN];
     int                events;
+    /* CPUs of each thread class, empty if class is not pinned */
+    cpumask_t          aThreadCpuMask[OFC_MAX_THREAD_CLASS];
+    struct completion  dpInitDone;   /* Data path task initialized */
+    int                dpInitStatus; /* OFC_SUCCESS/OFC_FAILURE */
 } tOfcGlobals;
 
 /* Data path structures */
+/* Lockless message queue with many producers and one consumer */
 typedef struct
 {
-    struct list_head list;
-    __u8             *pDataPkt;
-    __u16            dataPktLen;
-    int              dataIfNum;
+    struct llist_head head;
+    struct llist_node *pPending; /* Messages taken by consumer */
+    atomic_t          count;     /* Queued and pending messages */
+    __u32             maxLen;    /* Bounded push fails at this length */
+    __u32             highWater; /* Queue is throttled at this length */
+    __u32             lowWater;  /* until it drains to this length */
+    int               isThrottled;
+    int               isResumed; /* Drained after being throttled,
+                                  * cleared by consumer */
+    atomic_long_t     dropCount;
+} tOfcQueue;
+
+typedef struct
+{
+    struct llist_node node;
+    __u8              *pDataPkt;
+    __u16             dataPktLen;
+    int               dataIfNum;
+    __u8              isRingBlock; /* pDataPkt is a retired ring block */
 } tDataPktRxIfQ;
 
+/* Receive ring of an OpenFlow interface. A block is owned by the
+ * packet handler while its status is TP_STATUS_KERNEL and by the
+ * data path while it is TP_STATUS_USER. */
 typedef struct
 {
-    struct socket      *aDataSocket[OFC_MAX_OF_IF_NUM];
-    struct task_struct *aDataPktRxThread[OFC_MAX_OF_IF_NUM];
-    struct semaphore   semId;
-    struct semaphore   dataPktQSemId;
-    struct semaphore   cpMsgQSemId;
-    struct list_head   pktRxIfListHead; /* Queue for interfaces on which
-                                       * data packet is received */
-    struct list_head   cpMsgListHead;   /* Queue for messages from
-                                       * control path sub module */
-    struct list_head   flowTableListHead;
-    int                events;
-} tOfcDpGlobals;
+    spinlock_t         lock;
+    wait_queue_head_t  waitQueue;
+    __u8               *apBlock[OFC_RING_NUM_BLOCKS];
+    __u32              fillBlock;  /* Block being filled */
+    __u32              fillOffset; /* Offset of next frame in block */
+    __u32              rxBlock;    /* Next block posted to data path */
+    __u32              dropCount;  /* Frames dropped as ring was full */
+} tOfcDataRing;
 
-/* Control path structures */
+/* Time spent by rx thread in each state, used to tune busy poll
+ * budget against CPU usage */
 typedef struct
 {
-    struct socket    *pCntrlSocket;
-    struct semaphore semId;
-    struct semaphore dpMsgQSemId;
-    struct list_head dpMsgListHead; /* Queue for messages rx from
-                                     * data path sub module */
-    int              events;
-    int              isModInit;
-    __u32            numCntrlPktInQ;
-} tOfcCpGlobals;
+    __u64              pollNs;      /* Busy polling */
+    __u64              sleepNs;     /* Blocked waiting for packets */
+    __u64              backoffNs;   /* Sleeping after errors */
+    __u64              rxCount;     /* Packets or ring blocks */
+    __u64              emptyPollCount;
+    __u64              errCount;
+    __u64              throttleCount; /* Waits for data path queue */
+    __u64              lastReportNs;
+} tOfcRxThreadStats;
 
-#if 0
-typedef struct _tOfcEightByte
-{    
-    __u32   hi;     
-    __u32   lo;                    
-} tOfcEightByte;
-#endif
+/* Arguments of rx thread, one thread per rx queue of interface */
+typedef struct
+{
+    int                dataIfNum;
+    int                rxQueue;
+    tOfcRxThreadStats  stats;
+} tOfcRxThreadArgs;
+
+/* Learnt MAC address entry */
+typedef struct
+{
+    unsigned long    lastSeen;  /* jiffies */
+    __u8             aMacAddr[OFC_MAC_ADDR_LEN];
+    __u16            vlanId;
+    __u8             dataIfNum;
+    __u8             isValid;
+} tOfcMacEntry;
+
+/* Port statistics, one copy per CPU */
+typedef struct
+{
+    __u64  rxPktCount;
+    __u64  txPktCount;
+    __u64  rxByteCount;
+    __u64  txByteCount;
+    __u64  rxDropCount;
+    __u64  txDropCount;
+    __u64  rxErrorCount;
+    __u64  txErrorCount;
+} tOfcPortStats;
 
 typedef struct
 {
     __u32  targetIpAddr;
+    __u32  senderIpAddr;
+    __u16  opCode;
+    __u8   aSenderMacAddr[OFC_MAC_ADDR_LEN];
+    __u8   aTargetMacAddr[OFC_MAC_ADDR_LEN];
 } tArpMtchFlds;
 
 typedef struct
@@ -88,8 +135,175 @@ typedef struct
     __u16         dstPortNum;
     __u8          l4HeaderType;
     tArpMtchFlds  arpFlds;
+    __u32         mplsLabel;
+    __u8          mplsTc;
+    __u8          mplsBos;
+    __u8          mplsMatchFlags; /* OFC_MPLS_xxx_MATCH */
+    __u8          aSrcIpv6Addr[OFC_IPV6_ADDR_LEN];
+    __u8          aDstIpv6Addr[OFC_IPV6_ADDR_LEN];
+    __u32         ipv6FlowLabel;
+    __u16         tcpFlags;
+    __u8          icmpType;       /* ICMPv4 or ICMPv6 */
+    __u8          icmpCode;
+    __u8          ipFragFlags;    /* OFC_FRAG_xxx */
+    __u64         metadata;       /* Written by flow instructions,
+                                   * not a packet header */
+    __u32         extMatchFlags;  /* OFC_FLD_EXT_MASK fields matched
+                                   * by flow, zero for packet */
 } tOfcMatchFields;
 
+/* Token bucket of packet-in rate limit, owned by data path task */
+typedef struct
+{
+    __u64  tokens;     /* Packets scaled by NSEC_PER_SEC */
+    __u64  burst;      /* Bucket size, scaled as tokens */
+    __u64  lastNs;     /* Time of last refill */
+    __u32  rate;       /* Packets per second, 0 is unlimited */
+    __u32  dropCount;
+} tOfcTokenBucket;
+
+/* Flow whose table-miss packet-in is waiting for controller to
+ * install it */
+typedef struct
+{
+    tOfcMatchFields  matchFields;
+    unsigned long    expiry;     /* jiffies */
+    __u32            hash;
+    __u32            generation; /* Entry is valid if equal to
+                                  * pendingMissGen */
+    __u8             tableId;
+} tOfcPendingMiss;
+
+typedef struct
+{
+    /* Each interface is received on aNumRxQueues[n] sockets or
+     * rings, one per NIC rx queue, each read by its own thread */
+    struct socket      *aaDataSocket[OFC_MAX_OF_IF_NUM][OFC_MAX_RX_QUEUES];
+    struct task_struct *aaDataPktRxThread[OFC_MAX_OF_IF_NUM][OFC_MAX_RX_QUEUES];
+    tOfcRxThreadArgs   aaRxThreadArgs[OFC_MAX_OF_IF_NUM][OFC_MAX_RX_QUEUES];
+    struct completion  rxThreadStarted; /* Completed by each rx thread */
+    tOfcDataRing       aaDataRing[OFC_MAX_OF_IF_NUM][OFC_MAX_RX_QUEUES];
+    struct packet_type aRingPktType[OFC_MAX_OF_IF_NUM];
+    int                aNumRxQueues[OFC_MAX_OF_IF_NUM];
+    tOfcQueue          pktRxQ;   /* Queue for interfaces on which
+                                  * data packet is received */
+    tOfcQueue          cpMsgQ;   /* Queue for messages from
+                                  * control path sub module */
+    struct list_head   flowTableListHead;
+    struct list_head   aGroupHashList[OFC_GROUP_HASH_SIZE];
+    struct list_head   aMeterHashList[OFC_METER_HASH_SIZE];
+    struct net_device  *aDataIfDev[OFC_MAX_OF_IF_NUM];
+    __u32              aPortConfig[OFC_MAX_OF_IF_NUM]; /* OFPPC_xxx */
+    __u32              fwdPortMask; /* Bit n set if dataIfNum n
+                                       * forwards packets */
+    __u32              floodPortMask; /* Bit n set if dataIfNum n
+                                       * forwards flooded packets */
+    tOfcPortStats      __percpu *apPortStats[OFC_MAX_OF_IF_NUM];
+    __u64              portStartNs; /* Start of port statistics */
+    tOfcMacEntry       aMacTable[OFC_MAC_TABLE_SIZE];
+    tOfcPendingMiss    aPendingMiss[OFC_PENDING_MISS_SIZE];
+    __u32              pendingMissGen; /* Incremented when flow table
+                                        * changes */
+    __u32              pendingMissCount; /* Packet-ins suppressed */
+    unsigned long      events; /* Bit n set for event (1 << n) */
+    __u32              commitSeqNum; /* Sequence number of last
+                                      * control path message applied */
+    __u32              pktInSampleCount; /* Packet-ins while packet-in
+                                          * queue is throttled */
+    tOfcTokenBucket    aaPortPktInBucket[OFC_MAX_OF_IF_NUM]
+                                        [OFC_MAX_PKT_IN_CLASS];
+    tOfcTokenBucket    aPktInBucket[OFC_MAX_PKT_IN_CLASS];
+    __u32              matchFieldMask; /* OFC_FLD_xxx referenced by
+                                        * installed flows */
+    __u32              aMatchFieldRefCount[OFC_NUM_FLD]; /* Flows
+                                        * referencing each field */
+    struct _tOfcStatsReq *pStatsReq; /* Stats being collected, later
+                                      * control path messages wait */
+    __u8               *apGroupPktBuf[OFC_MAX_GROUP_DEPTH]; /* Packet
+                                        * copy of bucket, per depth */
+} tOfcDpGlobals;
+
+/* Control path structures */
+typedef struct
+{
+    struct socket    *pSocket;
+    unsigned long    flags;            /* OFC_CONN_xxx_PENDING bits */
+    int              state;            /* OFC_CNTRL_xxx */
+    unsigned long    connectTime;      /* jiffies of connect attempt
+                                        * or reconnect timer expiry */
+    unsigned long    lastRxTime;       /* jiffies of last control
+                                        * packet from controller */
+    unsigned long    lastEchoTime;     /* jiffies of last echo request */
+    __u32            backoffMs;        /* Next reconnect delay */
+    __u32            echoMissCount;
+    __u32            reconnectCount;
+    __u32            pktInDropCount;   /* Packet-ins not sent to keep
+                                        * send buffer for replies */
+    tOfcAsyncConfig  asyncConfig;      /* Asynchronous messages sent
+                                        * on connection, host order */
+    __u8             *pRxBuf;          /* Control messages received,
+                                        * last may be incomplete */
+    __u32            rxLen;            /* Bytes in pRxBuf */
+    __u8             cntrlIndex;
+    __u8             auxId;            /* 0 for main connection */
+    void             (*pfnSockStateChange) (struct sock *sk);
+    void             (*pfnSockDataReady) (struct sock *sk);
+} tOfcCntrlConn;
+
+typedef struct
+{
+    tOfcCntrlConn    aConn[OFC_MAX_AUX_CONN + 1]; /* Main connection
+                                                   * followed by
+                                                   * auxiliary */
+    __u32            role;             /* OFPCR_ROLE_xxx */
+} tOfcCntrl;
+
+/* Barrier request waiting for earlier messages to be applied
+ * by data path */
+typedef struct
+{
+    struct list_head node;
+    tOfcCntrlConn    *pConn;
+    __u32            xid;
+    __u32            seqNum;           /* Last message sent to data
+                                        * path before barrier */
+} tOfcBarrierEntry;
+
+typedef struct
+{
+    tOfcCntrl        aCntrl[OFC_MAX_CNTRL];
+    tOfcCntrlConn    *pRxConn;         /* Connection of control packet
+                                        * being processed, replies
+                                        * are sent on it */
+    tOfcQueue        dpMsgQ;        /* Queue for messages rx from
+                                     * data path sub module */
+    unsigned long    events; /* Bit n set for event (1 << n) */
+    int              isModInit;
+    __u32            numCntrlPktInQ;
+    int              numCntrlUp;       /* Controllers with main
+                                        * connection up */
+    __u32            pktInReasonMask;  /* Bit n set if packet-in of
+                                        * reason n is sent on any
+                                        * connection, data path does
+                                        * not copy other packets */
+    __u64            generationId;     /* Of last master/slave role
+                                        * request */
+    int              isGenerationIdSet;
+    __u32            echoXid;
+    __u32            cmdSeqNum;        /* Sequence number of last
+                                        * message sent to data path */
+    struct list_head barrierList;      /* tOfcBarrierEntry in order
+                                        * of sequence number */
+} tOfcCpGlobals;
+
+#if 0
+typedef struct _tOfcEightByte
+{    
+    __u32   hi;     
+    __u32   lo;                    
+} tOfcEightByte;
+#endif
+
 typedef struct
 {
     struct list_head  list;
@@ -121,29 +335,169 @@ typedef struct
     __u32              matchCount;
     struct list_head   matchList;
     struct list_head   instrList;
-    tOfcMatchFields    matchFields;
+    tOfcMatchFields    matchFields;   /* Values of maskable fields
+                                       * are stored masked */
+    tOfcMatchFields    matchMask;     /* Maskable fields are matched
+                                       * if their mask is non-zero */
+    __u64              installNs;     /* Time of insertion in table */
+    __u8               *pMatchInstr;  /* Match and instructions as
+                                       * received in flow mod, sent
+                                       * back in flow stats */
+    __u16              matchInstrLen;
 } tOfcFlowEntry;
 
+/* Flow or aggregate stats request, collected by data path in
+ * batches. Data path owns the request until last reply segment
+ * is sent to control path */
+typedef struct _tOfcStatsReq
+{
+    tOfcCntrlConn    *pConn;
+    __u32            xid;
+    __u32            seqNum;          /* Control path message order */
+    __u16            type;            /* OFPMP_FLOW/OFPMP_AGGREGATE */
+    __u16            segSize;         /* Max reply body length */
+    tOfcFlowEntry    *pFilter;        /* Table, cookie, out port,
+                                       * out group and match */
+    tOfcFlowTable    *pTable;         /* Position of next flow */
+    struct list_head *pNextFlow;
+    __u64            pktCount;        /* Aggregate stats */
+    __u64            byteCount;
+    __u32            flowCount;
+} tOfcStatsReq;
+
+/* Group statistics, one copy per CPU */
 typedef struct
 {
-    struct list_head list;
-    tOfcFlowEntry    *pFlowEntry;
-    struct list_head *pActionListHead;
-    __u8             *pPkt;
-    __u32            pktLen;
-    __u8             inPort;
-    __u8             msgType;
-    __u8             tableId;
-    tOfcEightByte    cookie;
+    __u64  pktCount;
+    __u64  byteCount;
+    __u64  aBucketPktCount[OFC_MAX_GROUP_BUCKETS];
+    __u64  aBucketByteCount[OFC_MAX_GROUP_BUCKETS];
+} tOfcGroupStats;
+
+typedef struct
+{
+    struct list_head actionList;
+    __u32            watchPort;
+    __u32            watchGroup;
+    __u32            outPort;    /* Valid if bucket only outputs
+                                  * packet to a port */
+    __u16            weight;
+    __u8             isOutputOnly;
+} tOfcGroupBucket;
+
+typedef struct
+{
+    struct list_head  list;
+    __u32             groupId;
+    __u8              groupType;
+    __u8              numBuckets;
+    tOfcGroupBucket   aBuckets[OFC_MAX_GROUP_BUCKETS];
+    __u8              aSelectMap[OFC_GROUP_SELECT_SLOTS];
+    tOfcGroupStats    __percpu *pStats;
+} tOfcGroupEntry;
+
+/* Meter band with shared token pool. Each CPU takes tokens from
+ * the pool in batches, see tOfcMeterCpuState */
+typedef struct
+{
+    atomic64_t  tokens;
+    atomic64_t  lastRefillNs;
+    __s64       burstUnits;
+    __s64       batchUnits;
+    __u32       rate;
+    __u32       burstSize;
+    __u16       type;
+    __u8        precLevel;
+} tOfcMeterBand;
+
+/* Meter state and statistics, one copy per CPU */
+typedef struct
+{
+    __s64  aLocalTokens[OFC_MAX_METER_BANDS];
+    __u64  pktInCount;
+    __u64  byteInCount;
+    __u64  aBandPktCount[OFC_MAX_METER_BANDS];
+    __u64  aBandByteCount[OFC_MAX_METER_BANDS];
+} tOfcMeterCpuState;
+
+typedef struct
+{
+    struct list_head   list;
+    __u32              meterId;
+    __u16              flags;
+    __u8               numBands;
+    tOfcMeterBand      aBands[OFC_MAX_METER_BANDS];
+    tOfcMeterCpuState  __percpu *pCpuState;
+} tOfcMeterEntry;
+
+/* Header offsets found by parser, so that actions need not parse
+ * packet again. Zero offset means header is not present or not
+ * parsed yet. */
+typedef struct
+{
+    __u16  l2HdrLen;       /* Offset of innermost EtherType */
+    __u16  vlanOffset;     /* Offset of outermost VLAN TCI */
+    __u16  l3Offset;
+    __u16  l4Offset;       /* Not set for later fragments */
+} tOfcPktMeta;
+
+/* Data packet being processed by OpenFlow pipeline. Frame starts
+ * at pPkt, and the bytes between pBuf and pPkt are headroom
+ * available for pushing tags without reallocating the packet */
+typedef struct
+{
+    __u8   *pBuf;
+    __u8   *pPkt;
+    __u32  pktLen;
+    __u8   inPort;
+    __u8   isHdrModified;
+    __u8   isTableMiss;
+    __u8   groupDepth;     /* Nesting of group actions */
+    __u8   isDropped;      /* Dropped by meter */
+    __u32  parsedFieldMask; /* OFC_FLD_xxx extracted in pMatchFields */
+    __u64  metadata;        /* Passed between tables */
+    tOfcPktMeta     meta;   /* Valid until headers are pushed or
+                             * popped */
+    tOfcMatchFields *pMatchFields;
+    tOfcFlowEntry   *pMatchFlow;
+    /* Action set, one action per type. Bit n of actionSetMask is
+     * set if apActionSet[n] is valid */
+    __u32           actionSetMask;
+    struct _tOfcActionList *apActionSet[OFC_ACTION_SET_SIZE];
+} tOfcDpPkt;
+
+typedef struct
+{
+    struct llist_node node;
+    tOfcFlowEntry     *pFlowEntry;
+    tOfcGroupEntry    *pGroupEntry;
+    tOfcMeterEntry    *pMeterEntry;
+    struct list_head  *pActionListHead;
+    __u8              *pPkt;
+    __u32             pktLen;
+    __u8              inPort;
+    __u8              msgType;
+    __u8              tableId;
+    tOfcEightByte     cookie;
+    tOfcMatchFields   matchFields;    /* Packet-in, copied as flow may
+                                       * be deleted before it is sent */
+    __u32             seqNum;         /* Control path message order */
+    __u32             flowHash;       /* Packet-in connection */
+    __u32             portConfig;     /* Port mod */
+    __u32             portConfigMask;
+    struct _tOfcStatsReq *pStatsReq;  /* Flow stats request or reply
+                                       * segment in pPkt */
+    __u8              isLastSeg;
 } tDpCpMsgQ;
 
 typedef struct
 {
     struct list_head list;
     __u8             field;
-    __u8             length;
-    /* TODO: Masks not supported */
+    __u8             length;  /* Length of value */
+    __u8             hasMask;
     __u8             aValue[16];
+    __u8             aMask[16]; /* All ones if OXM has no mask */
 } tMatchListEntry;
 
 typedef struct
@@ -153,12 +507,18 @@ typedef struct
     union
     {
        __u8             tableId;
+       __u32            meterId;
        struct list_head actionList;
+       struct
+       {
+           __u64        metadata;
+           __u64        metadataMask;
+       } writeMetadata;
     } u;
 
 } tOfcInstrList;
 
-typedef struct
+typedef struct _tOfcActionList
 {
     struct list_head list;
     __u16            actionType;
@@ -166,6 +526,9 @@ typedef struct
     {
         __u32            outPort;
         struct list_head setFieldList;
+        __u16            etherType; /* Push VLAN/MPLS, Pop MPLS */
+        __u8             ttl;       /* Set MPLS/NW TTL */
+        __u32            groupId;   /* Group */
     } u;
 
 } tOfcActionList;
@@ -188,7 +551,15 @@ enum
 {
     OFC_FLOW_MOD_ADD = 0,
     OFC_FLOW_MOD_DEL,
-    OFC_PACKET_OUT
+    OFC_PACKET_OUT,
+    OFC_GROUP_MOD_ADD,
+    OFC_GROUP_MOD_MODIFY,
+    OFC_GROUP_MOD_DEL,
+    OFC_METER_MOD_ADD,
+    OFC_METER_MOD_MODIFY,
+    OFC_METER_MOD_DEL,
+    OFC_PORT_MOD,
+    OFC_FLOW_STATS
 };
 
 /* Function Declarations */
@@ -197,65 +568,213 @@ int OfcDpSendEvent (int events);
 void OfcDumpPacket (char *au1Packet, int len);
 void OfcDumpFlows (__u8 tableId);
 int OfcDumpFlowFields (tOfcFlowEntry *pFlowEntry);
+void OfcDumpGroups (void);
+void OfcDumpMeters (void);
 struct net_device *OfcGetNetDevByName (char *pIfName);
 struct net_device *OfcGetNetDevByIp (unsigned int ipAddr);
 int OfcConvertStringToIp (char *pString, unsigned int *pIpAddr);
 int OfcDeleteList (struct list_head *pListHead);
+void OfcSetEightByte (tOfcEightByte *pEightByte, __u64 value);
 int OfcCalcHdrOffset (__u8 *pPkt, __u16 pktLen, __u8 hdrField,
                       __u16 *pPktOffset);
 
+void OfcDpMainDeInit (void);
 int OfcDpMainTask (void *args);
+int OfcDpGetNumRxQueues (struct net_device *dev);
 int OfcDpCreateSocketsForDataPkts (void);
+void OfcDpDeleteSocketsForDataPkts (void);
+int OfcDpCreateDataRings (void);
+void OfcDpDeleteDataRings (void);
+int OfcDpRingRcv (struct sk_buff *pSkb, struct net_device *pDev,
+                  struct packet_type *pPktType,
+                  struct net_device *pOrigDev);
+rx_handler_result_t OfcDpRxHandler (struct sk_buff **ppSkb);
+int OfcDpRingEnqueue (int dataIfNum, struct sk_buff *pSkb);
+void OfcDpRingRetireBlock (tOfcDataRing *pRing);
+int OfcDpRcvRingBlock (__u8 dataIfNum, int rxQueue, int isPoll,
+                       __u8 **ppBlock);
+void OfcDpReleaseRingBlock (__u8 *pBlock);
+int OfcDpRxRingBlock (__u8 dataIfNum, __u8 *pBlock);
 int OfcDpCreateThreadsForRxDataPkts (void);
+void OfcDpDeleteThreadsForRxDataPkts (void);
 int OfcDpRxDataPacket (void);
 int OfcDpSendToDataPktQ (int dataIfNum, __u8 *pDataPkt, 
-                         __u16 dataPktLen);
+                         __u16 dataPktLen, __u8 isRingBlock);
+void OfcQueueInit (tOfcQueue *pQueue, __u32 maxLen);
+int OfcQueuePush (tOfcQueue *pQueue, struct llist_node *pNode,
+                  int isBounded);
+struct llist_node *OfcQueuePop (tOfcQueue *pQueue);
+int OfcQueueIsThrottled (tOfcQueue *pQueue);
+int OfcQueueIsResumed (tOfcQueue *pQueue);
 tDataPktRxIfQ *OfcDpRecvFromDataPktQ (void);
 tDpCpMsgQ *OfcDpRecvFromCpMsgQ (void);
 int OfcDpSendToCpQ (tDpCpMsgQ *pMsgParam);
 int OfcDpCreateFlowTables (void);
-__u32 OfcDpRcvDataPktFromSock (__u8 dataIfNum, __u8 **ppPkt,
-                               __u32 *pPktLen);
-int OfcDpSendDataPktOnSock (__u8 dataIfNum, __u8 *pPkt,
-                            __u32 pktLen);
+void OfcDpDeleteFlowTables (void);
+__u32 OfcDpRcvDataPktFromSock (__u8 dataIfNum, int rxQueue, int flags,
+                               __u8 **ppPkt, __u32 *pPktLen, 
+                               int *pError);
+void OfcDumpRxThreadStats (tOfcRxThreadArgs *pArgs);
+void OfcDumpQueueStats (void);
+int OfcSetThreadAffinity (struct task_struct *pThread, int threadClass,
+                          int index, int node);
+int OfcGetThreadClassNode (int threadClass);
+int OfcSetThreadPriority (struct task_struct *pThread, int threadClass);
+void OfcSetThreadClassAffinity (int threadClass);
+int OfcSetCpuListParam (const char *pVal, const struct kernel_param *pKp);
+int OfcGetCpuListParam (char *pBuf, const struct kernel_param *pKp);
+int OfcDpXmitPktOnPorts (__u8 *pPkt, __u32 pktLen, __u32 portMask);
 tOfcFlowTable *OfcDpGetFlowTableEntry (__u8 tableId);
 int OfcDpRxDataPktThread (void *args);
-int OfcDpProcessPktOpenFlowPipeline (__u8 *pPkt, __u32 pktLen,
-                                     __u8 inPort);
-int OfcDpExecuteFlowInstr (__u8 *pPkt, __u32 pktLen, __u8 inPort,
+int OfcDpProcessPktOpenFlowPipeline (tOfcDpPkt *pDpPkt);
+int OfcDpExecuteFlowInstr (tOfcDpPkt *pDpPkt,
                            struct list_head *pInstrList, __u8 *pTableId,
                            __u32 *pOutPortList, __u8 *pNumOutPorts);
-int OfcDpApplyInstrActions (__u8 *pPkt, __u32 pktLen, __u8 inPort,
+int OfcDpApplyInstrActions (tOfcDpPkt *pDpPkt,
                             struct list_head *pActionsList,
                             __u32 *pOutPortList, __u8 *pNumOutPorts);
+void OfcDpFlushOutput (tOfcDpPkt *pDpPkt, __u32 *pOutPortList,
+                       __u8 *pNumOutPorts);
+int OfcDpApplyAction (tOfcDpPkt *pDpPkt, tOfcActionList *pActions,
+                      __u32 *pOutPortList, __u8 *pNumOutPorts);
+int OfcDpWriteActionSet (tOfcDpPkt *pDpPkt,
+                         struct list_head *pActionsList);
+int OfcDpExecuteActionSet (tOfcDpPkt *pDpPkt, __u32 *pOutPortList,
+                           __u8 *pNumOutPorts);
+int OfcDpGetL2HdrLen (tOfcDpPkt *pDpPkt, __u16 *pL2HdrLen);
+int OfcDpPushVlanTag (tOfcDpPkt *pDpPkt, __u16 tpid);
+int OfcDpPopVlanTag (tOfcDpPkt *pDpPkt);
+int OfcDpPushMplsShim (tOfcDpPkt *pDpPkt, __u16 etherType);
+int OfcDpPopMplsShim (tOfcDpPkt *pDpPkt, __u16 etherType);
+int OfcDpSetTtl (tOfcDpPkt *pDpPkt, __u16 actionType, __u8 ttl);
+int OfcDpCopyTtl (tOfcDpPkt *pDpPkt, __u16 actionType);
+int OfcDpUpdateIpv4Ttl (__u8 *pIpHdr, __u8 ttl);
 tOfcFlowEntry *OfcDpGetBestMatchFlow (tOfcMatchFields pktMatchFields,
                                       struct list_head *pFlowEntryList,
                                       __u8 *pIsTableMiss);
+int OfcDpExtractAllPktHdrs (tOfcDpPkt *pDpPkt);
+__u32 OfcDpGetFlowFieldMask (tOfcFlowEntry *pFlowEntry);
+void OfcDpUpdateMatchFieldMask (tOfcFlowEntry *pFlowEntry, int isAdd);
 int OfcDpExtractPktHdrs (__u8 *pPkt, __u32 pktLen, __u8 inPort,
-                         tOfcMatchFields *pPktMatchFields);
+                         __u32 fieldMask, 
+                         tOfcMatchFields *pPktMatchFields,
+                         tOfcPktMeta *pMeta);
+int OfcDpExtractL3Hdrs (__u8 *pPkt, __u32 pktLen, __u32 fieldMask,
+                        tOfcMatchFields *pPktMatchFields,
+                        tOfcPktMeta *pMeta);
+int OfcDpExtractIpv6Hdrs (__u8 *pPkt, __u32 pktLen, __u32 fieldMask,
+                          tOfcMatchFields *pPktMatchFields,
+                          tOfcPktMeta *pMeta);
+int OfcDpExtractL4Hdrs (__u8 *pPkt, __u32 pktLen, 
+                        tOfcMatchFields *pPktMatchFields,
+                        tOfcPktMeta *pMeta);
+int OfcDpIsExtFieldsMatch (tOfcMatchFields *pFlowFields,
+                           tOfcMatchFields *pFlowMask,
+                           tOfcMatchFields *pPktFields);
+int OfcDpIsMaskedMatch (__u8 *pFlowValue, __u8 *pFlowMask,
+                        __u8 *pPktValue, __u8 length);
 int OfcDpRxControlPathMsg (void);
 int OfcDpInsertFlowEntry (tOfcFlowEntry *pFlowEntry);
 int OfcDpDeleteFlowEntry (tOfcFlowEntry *pFlowEntry);
-int OfcDpExecPktOutActions (__u8 *pPkt, __u16 pktLen,
+void OfcDpFreeFlowEntry (tOfcFlowEntry *pFlowEntry);
+void OfcDpCollectFlowStats (void);
+int OfcDpIsFlowStatsMatch (tOfcFlowEntry *pFlowEntry,
+                           tOfcFlowEntry *pFilter);
+int OfcDpIsMatchCovered (tMatchListEntry *pFlowMatch,
+                         tMatchListEntry *pFilterMatch);
+int OfcDpIsFlowOutputTo (tOfcFlowEntry *pFlowEntry, __u32 outPort,
+                         __u32 outGrp);
+__u16 OfcDpEncodeFlowStats (tOfcFlowEntry *pFlowEntry, __u8 *pBuf);
+int OfcDpExecPktOutActions (__u8 *pPkt, __u16 pktLen, __u8 inPort,
                             struct list_head *pActionsListHead);
+__u32 OfcDpNormalForward (tOfcDpPkt *pDpPkt);
+int OfcDpMacLearn (__u8 *pMacAddr, __u16 vlanId, __u8 dataIfNum);
+int OfcDpMacLookup (__u8 *pMacAddr, __u16 vlanId, __u8 *pDataIfNum);
+int OfcDpIsPendingMiss (tOfcMatchFields *pMatchFields, __u8 tableId,
+                        __u32 hash);
+void OfcDpAddPendingMiss (tOfcMatchFields *pMatchFields, __u8 tableId,
+                          __u32 hash);
+void OfcDpInitTokenBucket (tOfcTokenBucket *pBucket, __u32 rate);
+int OfcDpTokenBucketConforms (tOfcTokenBucket *pBucket, __u64 nowNs);
+void OfcDpTokenBucketReturn (tOfcTokenBucket *pBucket);
+int OfcDpIsPktInAllowed (__u8 inPort, int pktInClass);
+void OfcDpReturnPktInTokens (__u8 inPort, int pktInClass);
+int OfcDpUpdatePortConfig (__u8 dataIfNum, __u32 config, __u32 mask);
+int OfcDpCreatePortStats (void);
+void OfcDpDeletePortStats (void);
+int OfcDpGetPortStats (__u8 dataIfNum, tOfcPortStats *pPortStats);
+void OfcDpUpdateFwdPortMask (void);
+int OfcDpOutputPkt (tOfcDpPkt *pDpPkt, __u32 *pOutPortList,
+                    __u8 numOutPorts);
+int OfcDpCreateGroupPktBufs (void);
+void OfcDpDeleteGroupPktBufs (void);
+tOfcGroupEntry *OfcDpGetGroupEntry (__u32 groupId);
+int OfcDpInsertGroupEntry (tOfcGroupEntry *pGroupEntry);
+int OfcDpModifyGroupEntry (tOfcGroupEntry *pGroupEntry);
+int OfcDpDeleteGroupEntry (__u32 groupId);
+void OfcDpDeleteGroupFlows (__u32 groupId);
+void OfcDpFreeGroupEntry (tOfcGroupEntry *pGroupEntry);
+int OfcDpExecuteGroup (tOfcDpPkt *pDpPkt, __u32 groupId);
+int OfcDpSelectGroupBucket (tOfcDpPkt *pDpPkt,
+                            tOfcGroupEntry *pGroupEntry);
+int OfcDpIsPortLive (__u32 port);
+int OfcDpIsBucketLive (tOfcGroupBucket *pBucket);
+int OfcDpExecuteGroupBucket (tOfcDpPkt *pDpPkt,
+                             tOfcGroupEntry *pGroupEntry,
+                             __u8 bucketIndex, __u32 *pOutPortList,
+                             __u8 *pNumOutPorts);
+int OfcDpGetGroupStats (tOfcGroupEntry *pGroupEntry,
+                        tOfcGroupStats *pGroupStats);
+tOfcMeterEntry *OfcDpGetMeterEntry (__u32 meterId);
+int OfcDpInsertMeterEntry (tOfcMeterEntry *pMeterEntry);
+int OfcDpModifyMeterEntry (tOfcMeterEntry *pMeterEntry);
+int OfcDpDeleteMeterEntry (__u32 meterId);
+void OfcDpFreeMeterEntry (tOfcMeterEntry *pMeterEntry);
+int OfcDpApplyMeter (tOfcDpPkt *pDpPkt, __u32 meterId);
+int OfcDpMeterBandConforms (tOfcMeterBand *pBand, __s64 *pLocalTokens,
+                            __s64 cost, __u64 nowNs);
+int OfcDpRemarkDscp (tOfcDpPkt *pDpPkt, __u8 precLevel);
+int OfcDpUpdateIpv4Chksum (__u8 *pIpHdr, __u16 oldWord, __u16 newWord);
+int OfcDpGetMeterStats (tOfcMeterEntry *pMeterEntry,
+                        tOfcMeterCpuState *pMeterStats);
 
 int OfcCpMainTask (void *args);
-int OfcCpReceiveEvent (int events, int *pRxEvents);
+int OfcCpReceiveEvent (int events, long timeout, int *pRxEvents);
 int OfcCpSendEvent (int events);
-int OfcCpCreateCntrlSocket (void);
-int OfcCpRxControlPacket (void);
+int OfcCpCreateCntrlSocket (tOfcCntrlConn *pConn);
+void OfcCpDeleteCntrlSocket (tOfcCntrlConn *pConn);
+void OfcCpCntrlSockStateChange (struct sock *sk);
+void OfcCpCntrlSockDataReady (struct sock *sk);
+void OfcCpCntrlStateChange (tOfcCntrlConn *pConn);
+void OfcCpCntrlDisconnect (tOfcCntrlConn *pConn);
+long OfcCpCntrlConnTimer (void);
+unsigned long OfcCpConnTimer (tOfcCntrlConn *pConn);
+void OfcCpRxCntrlConns (void);
+tOfcCntrlConn *OfcCpGetPktInConn (int cntrlIndex, __u32 flowHash);
+int OfcCpRxControlPacket (tOfcCntrlConn *pConn);
 int OfcCpSendToDpQ (tDpCpMsgQ *pMsgParam);
 tDpCpMsgQ *OfcCpRecvFromDpMsgQ (void);
 int OfcCpSendToCntrlPktQ (void);
 __u32 OfcCpRecvFromCntrlPktQ (void);
-int OfcCpRecvCntrlPktOnSock (__u8 **ppPkt, __u16 *pPktLen);
+int OfcCpRecvCntrlPktOnSock (tOfcCntrlConn *pConn);
+int OfcCpSendCntrlPktOnConn (tOfcCntrlConn *pConn, __u8 *pPkt, 
+                             __u32 pktLen);
 int OfcCpSendCntrlPktFromSock (__u8 *pPkt, __u32 pktLen);
-void OfcCpRxDataPathMsg (void);
+void OfcCpRxDataPathMsg (int isDrain);
+void OfcCpSetDefaultAsync (tOfcCntrlConn *pConn);
+int OfcCpIsAsyncEnabled (tOfcCntrlConn *pConn, __u8 msgType, 
+                         __u8 reason);
+void OfcCpUpdatePktInReasons (void);
 int OfcCpAddOpenFlowHdr (__u8 *pPktHdr, __u16 pktHdrLen,
                          __u8 msgType, __u32 xid,
                          __u8 **ppOfPkt);
 int OfcCpSendHelloPacket (__u32 xid);
 int OfcCpSendEchoReply (__u8 *pCntrlPkt, __u16 cntrlPktLen);
+int OfcCpSendEchoRequest (tOfcCntrlConn *pConn);
+int OfcCpSendErrorMsg (__u8 *pCntrlPkt, __u16 errType, __u16 errCode);
+int OfcCpProcessRoleRequest (__u8 *pCntrlPkt, __u16 cntrlPktLen);
+int OfcCpProcessSetAsync (__u8 *pCntrlPkt, __u16 cntrlPktLen);
+int OfcCpProcessGetAsyncReq (__u8 *pCntrlPkt, __u16 cntrlPktLen);
 int OfcCpSendFeatureReply (__u8 *pCntrlPkt);
 int OfcCpConstructPacketIn (__u8 *pPkt, __u32 pktLen, __u8 inPort,
                             __u8 msgType, __u8 tableId,
@@ -268,16 +787,39 @@ tOfcFlowEntry *OfcCpExtractFlow (tOfcFlowModHdr *pFlowMod,
                                  __u16 flowModLen);
 int OfcCpAddMatchFieldsInFlow (tOfcFlowModHdr *pFlowMod, __u16 flowModLen,
                                tOfcFlowEntry *pFlowEntry);
+__u8 OfcCpGetOxmFieldLen (__u8 field);
+int OfcCpIsOxmFieldMaskable (__u8 field);
+void OfcCpSetMaskedField (__u8 *pValue, __u8 *pMask,
+                          tMatchListEntry *pMatchList, __u8 length);
 int OfcCpAddInstrListInFlow (tOfcFlowModHdr *pFlowMod,
                              __u16 flowModLen,
                              tOfcFlowEntry *pFlowEntry);
+int OfcCpAddInstrInOrder (tOfcInstrList *pInstrList,
+                          struct list_head *pInstrListHead);
 int OfcCpAddActionListToInstr (tOfcActionTlv *pActionTlv,
                                __u16 actionTlvLen,
                                tOfcInstrList *pInstrList);
+int OfcCpAddActionList (tOfcActionTlv *pActionTlv, __u16 actionTlvLen,
+                        struct list_head *pActionListHead);
+int OfcCpProcessGroupMod (__u8 *pPkt, __u16 pktLen);
+tOfcGroupEntry *OfcCpExtractGroup (tOfcGroupModHdr *pGroupMod,
+                                   __u16 groupModLen);
+int OfcCpProcessMeterMod (__u8 *pPkt, __u16 pktLen);
+int OfcCpProcessPortMod (__u8 *pPkt, __u16 pktLen);
+tOfcMeterEntry *OfcCpExtractMeter (tOfcMeterModHdr *pMeterMod,
+                                   __u16 meterModLen);
 int OfcCpProcessMultipartReq (__u8 *pCntrlPkt, __u16 cntrlPktLen);
 int OfcCpHandleMultipartSwitchDesc (__u8 *pCntrlPkt,
                                     __u16 cntrlPktLen);
 int OfcCpHandleMultipartPortDesc (__u8 *pCntrlPkt, __u16 cntrlPktLen);
-int OfcCpSendBarrierReply (__u32 xid);
+int OfcCpHandleMultipartFlowStats (__u8 *pCntrlPkt, __u16 cntrlPktLen);
+int OfcCpHandleMultipartPortStats (__u8 *pCntrlPkt, __u16 cntrlPktLen);
+int OfcCpHandleMultipartTableStats (__u8 *pCntrlPkt,
+                                    __u16 cntrlPktLen);
+int OfcCpSendStatsReply (tDpCpMsgQ *pMsgQ);
+int OfcCpSendBarrierReply (tOfcCntrlConn *pConn, __u32 xid);
+int OfcCpProcessBarrierReq (__u32 xid);
+void OfcCpRxDataPathCommit (void);
+void OfcCpDeleteBarriers (tOfcCntrlConn *pConn);
 
 #endif /* __OFC_TDFS_H__ */
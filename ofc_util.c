@@ -14,13 +14,20 @@ extern tOfcDpGlobals gOfcDpGlobals;
 extern tOfcCpGlobals gOfcCpGlobals;
 extern char *gpOpenFlowIf[OFC_MAX_OF_IF_NUM];
 extern int gNumOpenFlowIf;
-extern unsigned int gCntrlIpAddr;
-extern unsigned short gCntrlPortNo;
+extern unsigned int gaCntrlIpAddr[OFC_MAX_CNTRL];
+extern unsigned short gCntrlPortNo[OFC_MAX_CNTRL];
+extern unsigned int gDataIoMode;
+extern unsigned int gNumRxQueues;
+extern unsigned int gDpSchedPrio;
+extern tOfcGlobals gOfcGlobals;
 
 /* Event wait queue for data path task */
 DECLARE_WAIT_QUEUE_HEAD (gOfcDpWaitQueue);
 /* Event wait queue for control path task */
 DECLARE_WAIT_QUEUE_HEAD (gOfcCpWaitQueue);
+/* Serializes creation and stopping of module threads with CPU
+ * rebinding from module parameters */
+DEFINE_MUTEX (gOfcThreadLock);
 
 /******************************************************************                                                                          
 * Function: OfcDpReceiveEvent
@@ -33,30 +40,39 @@ DECLARE_WAIT_QUEUE_HEAD (gOfcCpWaitQueue);
 *
 * Output: pRxEvents - Event that has occurred
 *
-* Returns: OFC_SUCCESS/OFC_FAILURE
+* Returns: OFC_SUCCESS/OFC_FAILURE (task stopped)
 *
 *******************************************************************/
 int OfcDpReceiveEvent (int events, int *pRxEvents)
 {
-    printk (KERN_INFO "Waiting for event...\r\n");
-    wait_event_interruptible (gOfcDpWaitQueue, gOfcDpGlobals.events);
-    printk (KERN_INFO "Event Rx: %u\r\n", gOfcDpGlobals.events);
-    if (gOfcDpGlobals.events & events)
-    {
-        down_interruptible (&gOfcDpGlobals.semId);
-        *pRxEvents = gOfcDpGlobals.events & events;
-        gOfcDpGlobals.events &= ~(*pRxEvents);
-        up (&gOfcDpGlobals.semId);
-        return OFC_SUCCESS;
+    int eventBit = 0;
+
+    wait_event_interruptible (gOfcDpWaitQueue, 
+                              ((ACCESS_ONCE (gOfcDpGlobals.events) & events) ||
+                               (kthread_should_stop ())));
+
+    /* Each event bit is cleared atomically, so an event posted
+     * while events are being received is not lost */
+    *pRxEvents = 0;
+    for (eventBit = 0; eventBit < OFC_MAX_EVENTS; eventBit++)
+    {
+        if ((events & (1 << eventBit)) &&
+            (test_and_clear_bit (eventBit, &gOfcDpGlobals.events)))
+        {
+            *pRxEvents |= (1 << eventBit);
+        }
     }
 
-    return OFC_FAILURE;
+    return (*pRxEvents != 0) ? OFC_SUCCESS : OFC_FAILURE;
 }
 
 /******************************************************************                                                                          
 * Function: OfcDpSendEvent
 *
-* Description: This function posts events to data path task
+* Description: This function posts events to data path task. Task
+*              is woken up only if it is waiting for events. This
+*              function does not sleep and may be called from
+*              softirq context.
 *
 * Input: events - Event that has occurred
 *
@@ -67,48 +83,73 @@ int OfcDpReceiveEvent (int events, int *pRxEvents)
 *******************************************************************/
 int OfcDpSendEvent (int events)
 {
-    printk (KERN_INFO "Sending event:%u\r\n", events);
-    down_interruptible (&gOfcDpGlobals.semId);
-    gOfcDpGlobals.events |= events;
-    up (&gOfcDpGlobals.semId);
-    wake_up_interruptible (&gOfcDpWaitQueue);
+    int eventBit = 0;
+
+    for (eventBit = 0; eventBit < OFC_MAX_EVENTS; eventBit++)
+    {
+        if (events & (1 << eventBit))
+        {
+            set_bit (eventBit, &gOfcDpGlobals.events);
+        }
+    }
+
+    /* Event bits must be visible before wait queue is checked,
+     * pairs with barrier in wait_event */
+    smp_mb__after_atomic();
+    if (waitqueue_active (&gOfcDpWaitQueue))
+    {
+        wake_up_interruptible (&gOfcDpWaitQueue);
+    }
+
     return OFC_SUCCESS;
 }
 
 /******************************************************************                                                                          
 * Function: OfcCpReceiveEvent
 *
-* Description: This function waits and receives events from
-*              from kernel and data path task
+* Description: This function causes control path task to wait for
+*              events, and receives events from kernel or data
+*              path task
 *
 * Input: events - BitList of possible events
+*        timeout - Maximum wait in jiffies, MAX_SCHEDULE_TIMEOUT
+*                  to wait until an event occurs
 *
 * Output: pRxEvents - Event that has occurred
 *
-* Returns: OFC_SUCCESS/OFC_FAILURE
+* Returns: OFC_SUCCESS/OFC_FAILURE (timeout or task stopped)
 *
 *******************************************************************/
-int OfcCpReceiveEvent (int events, int *pRxEvents)
+int OfcCpReceiveEvent (int events, long timeout, int *pRxEvents)
 {
-    printk (KERN_INFO "Control path Waiting for event...\r\n");
-    wait_event_interruptible (gOfcCpWaitQueue, gOfcCpGlobals.events);
-    printk (KERN_INFO "Control path Event Rx: %u\r\n", gOfcCpGlobals.events);
-    if (gOfcCpGlobals.events & events)
-    {
-        down_interruptible (&gOfcCpGlobals.semId);
-        *pRxEvents = gOfcCpGlobals.events & events;
-        gOfcCpGlobals.events &= ~(*pRxEvents);
-        up (&gOfcCpGlobals.semId);
-        return OFC_SUCCESS;
+    int eventBit = 0;
+
+    wait_event_interruptible_timeout (gOfcCpWaitQueue, 
+                              ((ACCESS_ONCE (gOfcCpGlobals.events) & events) ||
+                               (kthread_should_stop ())), timeout);
+
+    /* Each event bit is cleared atomically, so an event posted
+     * while events are being received is not lost */
+    *pRxEvents = 0;
+    for (eventBit = 0; eventBit < OFC_MAX_EVENTS; eventBit++)
+    {
+        if ((events & (1 << eventBit)) &&
+            (test_and_clear_bit (eventBit, &gOfcCpGlobals.events)))
+        {
+            *pRxEvents |= (1 << eventBit);
+        }
     }
 
-    return OFC_FAILURE;
+    return (*pRxEvents != 0) ? OFC_SUCCESS : OFC_FAILURE;
 }
 
 /******************************************************************                                                                          
 * Function: OfcCpSendEvent
 *
-* Description: This function posts events to control path task
+* Description: This function posts events to control path task. Task
+*              is woken up only if it is waiting for events. This
+*              function does not sleep and may be called from
+*              softirq context.
 *
 * Input: events - Event that has occurred
 *
@@ -119,14 +160,180 @@ int OfcCpReceiveEvent (int events, int *pRxEvents)
 *******************************************************************/
 int OfcCpSendEvent (int events)
 {
-    printk (KERN_INFO "Control path sending event:%u\r\n", events);
-    down_interruptible (&gOfcCpGlobals.semId);
-    gOfcCpGlobals.events |= events;
-    up (&gOfcCpGlobals.semId);
-    wake_up_interruptible (&gOfcCpWaitQueue);
+    int eventBit = 0;
+
+    for (eventBit = 0; eventBit < OFC_MAX_EVENTS; eventBit++)
+    {
+        if (events & (1 << eventBit))
+        {
+            set_bit (eventBit, &gOfcCpGlobals.events);
+        }
+    }
+
+    /* Event bits must be visible before wait queue is checked,
+     * pairs with barrier in wait_event */
+    smp_mb__after_atomic();
+    if (waitqueue_active (&gOfcCpWaitQueue))
+    {
+        wake_up_interruptible (&gOfcCpWaitQueue);
+    }
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcQueuePush
+*
+* Description: This function adds a message to a lockless queue.
+*              Queue may have many producers, and does not need a
+*              lock or semaphore. Bounded push fails once queue is
+*              full, so that producers drop messages instead of
+*              using more memory. Length may be exceeded by a few
+*              messages of concurrent producers.
+*
+* Input: pQueue - Queue
+*        pNode - Queue node of message
+*        isBounded - OFC_TRUE to fail if queue is full
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcQueuePush (tOfcQueue *pQueue, struct llist_node *pNode,
+                  int isBounded)
+{
+    if ((isBounded == OFC_TRUE) &&
+        (atomic_read (&pQueue->count) >= pQueue->maxLen))
+    {
+        atomic_long_inc (&pQueue->dropCount);
+        return OFC_FAILURE;
+    }
+
+    if (atomic_inc_return (&pQueue->count) >= pQueue->highWater)
+    {
+        ACCESS_ONCE (pQueue->isThrottled) = OFC_TRUE;
+    }
+
+    llist_add (pNode, &pQueue->head);
     return OFC_SUCCESS;
 }
 
+/******************************************************************                                                                          
+* Function: OfcQueuePop
+*
+* Description: This function removes oldest message from a
+*              lockless queue. Queue must have a single consumer.
+*              All queued messages are taken at once and kept in
+*              consumer's pending list, so producers are touched
+*              once per batch of messages.
+*
+* Input: pQueue - Queue
+*
+* Output: None
+*
+* Returns: Queue node of message, NULL if queue is empty
+*
+*******************************************************************/
+struct llist_node *OfcQueuePop (tOfcQueue *pQueue)
+{
+    struct llist_node *pNode = NULL;
+
+    if (pQueue->pPending == NULL)
+    {
+        /* Queue is a stack of messages, reverse it to get
+         * messages in order of arrival */
+        pQueue->pPending = llist_reverse_order 
+                               (llist_del_all (&pQueue->head));
+    }
+
+    pNode = pQueue->pPending;
+    if (pNode != NULL)
+    {
+        pQueue->pPending = pNode->next;
+
+        if ((atomic_dec_return (&pQueue->count) <= pQueue->lowWater) &&
+            (ACCESS_ONCE (pQueue->isThrottled) == OFC_TRUE))
+        {
+            ACCESS_ONCE (pQueue->isThrottled) = OFC_FALSE;
+            pQueue->isResumed = OFC_TRUE;
+        }
+    }
+
+    return pNode;
+}
+
+/******************************************************************                                                                          
+* Function: OfcQueueInit
+*
+* Description: This function initializes a lockless queue and its
+*              watermarks
+*
+* Input: pQueue - Queue
+*        maxLen - Maximum length of queue for bounded push
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcQueueInit (tOfcQueue *pQueue, __u32 maxLen)
+{
+    memset (pQueue, 0, sizeof (tOfcQueue));
+    init_llist_head (&pQueue->head);
+    atomic_set (&pQueue->count, 0);
+    atomic_long_set (&pQueue->dropCount, 0);
+    pQueue->maxLen = maxLen;
+    pQueue->highWater = (maxLen / 4) * 3;
+    pQueue->lowWater = maxLen / 4;
+    pQueue->isThrottled = OFC_FALSE;
+}
+
+/******************************************************************                                                                          
+* Function: OfcQueueIsThrottled
+*
+* Description: This function checks if queue is above its high
+*              watermark and has not yet drained to low watermark.
+*              Producers should back off while queue is throttled.
+*
+* Input: pQueue - Queue
+*
+* Output: None
+*
+* Returns: OFC_TRUE/OFC_FALSE
+*
+*******************************************************************/
+int OfcQueueIsThrottled (tOfcQueue *pQueue)
+{
+    return ACCESS_ONCE (pQueue->isThrottled);
+}
+
+/******************************************************************                                                                          
+* Function: OfcQueueIsResumed
+*
+* Description: This function checks if queue has drained to low
+*              watermark since it was throttled, so that consumer
+*              can notify producers waiting for it. Must be called
+*              by consumer.
+*
+* Input: pQueue - Queue
+*
+* Output: None
+*
+* Returns: OFC_TRUE/OFC_FALSE
+*
+*******************************************************************/
+int OfcQueueIsResumed (tOfcQueue *pQueue)
+{
+    if (pQueue->isResumed == OFC_TRUE)
+    {
+        pQueue->isResumed = OFC_FALSE;
+        return OFC_TRUE;
+    }
+
+    return OFC_FALSE;
+}
+
 /******************************************************************                                                                          
 * Function: OfcDpRecvFromDataPktQ
 *
@@ -142,18 +349,7 @@ int OfcCpSendEvent (int events)
 *******************************************************************/
 tDataPktRxIfQ *OfcDpRecvFromDataPktQ (void)
 {
-    struct list_head *pMsgQ = NULL;
-    struct list_head *pListHead = NULL;
-
-    pListHead = &gOfcDpGlobals.pktRxIfListHead;
-    list_for_each (pMsgQ, pListHead)
-    {
-        /* Queue is not empty, remove first element */
-        list_del_init (pMsgQ);
-        return (tDataPktRxIfQ *) pMsgQ;
-    }
-
-    return NULL;
+    return (tDataPktRxIfQ *) OfcQueuePop (&gOfcDpGlobals.pktRxQ);
 }
 
 /******************************************************************                                                                          
@@ -163,6 +359,9 @@ tDataPktRxIfQ *OfcDpRecvFromDataPktQ (void)
 *              data path task
 *
 * Input: dataIfNum - OpenFlow interface
+*        pDataPkt - Data packet, or ring block in ring mode
+*        dataPktLen - Length of data packet
+*        isRingBlock - OFC_TRUE if pDataPkt is a ring block
 *
 * Output: None
 *
@@ -170,7 +369,7 @@ tDataPktRxIfQ *OfcDpRecvFromDataPktQ (void)
 *
 *******************************************************************/
 int OfcDpSendToDataPktQ (int dataIfNum, __u8 *pDataPkt, 
-                         __u16 dataPktLen)
+                         __u16 dataPktLen, __u8 isRingBlock)
 {
     tDataPktRxIfQ *pMsgQ = NULL;
 
@@ -183,11 +382,18 @@ int OfcDpSendToDataPktQ (int dataIfNum, __u8 *pDataPkt,
     }
 
     memset (pMsgQ, 0, sizeof (tDataPktRxIfQ));
-    INIT_LIST_HEAD (&pMsgQ->list);
     pMsgQ->pDataPkt = pDataPkt;
     pMsgQ->dataPktLen = dataPktLen;
     pMsgQ->dataIfNum = dataIfNum;
-    list_add_tail (&pMsgQ->list, &gOfcDpGlobals.pktRxIfListHead);
+    pMsgQ->isRingBlock = isRingBlock;
+    if (OfcQueuePush (&gOfcDpGlobals.pktRxQ, &pMsgQ->node, OFC_TRUE)
+        != OFC_SUCCESS)
+    {
+        /* Data path is behind, caller drops packet */
+        kfree (pMsgQ);
+        pMsgQ = NULL;
+        return OFC_FAILURE;
+    }
 
     return OFC_SUCCESS;
 }
@@ -207,18 +413,7 @@ int OfcDpSendToDataPktQ (int dataIfNum, __u8 *pDataPkt,
 *******************************************************************/
 tDpCpMsgQ *OfcDpRecvFromCpMsgQ (void)
 {
-    struct list_head *pMsgQ = NULL;
-    struct list_head *pListHead = NULL;
-
-    pListHead = &gOfcDpGlobals.cpMsgListHead;
-    list_for_each (pMsgQ, pListHead)
-    {
-        /* Queue is not empty, remove first element */
-        list_del_init (pMsgQ);
-        return (tDpCpMsgQ *) pMsgQ;
-    }
-
-    return NULL;
+    return (tDpCpMsgQ *) OfcQueuePop (&gOfcDpGlobals.cpMsgQ);
 }
 
 /******************************************************************                                                                          
@@ -246,14 +441,19 @@ int OfcDpSendToCpQ (tDpCpMsgQ *pMsgParam)
         return OFC_FAILURE;
     }
 
-    down_interruptible (&gOfcCpGlobals.dpMsgQSemId);
-
     memset (pMsgQ, 0, sizeof(tDpCpMsgQ));
     memcpy (pMsgQ, pMsgParam, sizeof(tDpCpMsgQ));
-    INIT_LIST_HEAD (&pMsgQ->list);
-    list_add_tail (&pMsgQ->list, &gOfcCpGlobals.dpMsgListHead);
 
-    up (&gOfcCpGlobals.dpMsgQSemId);
+    /* Packet-ins are dropped when queue is full. Stats replies are
+     * always queued, data path paces them by flow table size */
+    if (OfcQueuePush (&gOfcCpGlobals.dpMsgQ, &pMsgQ->node,
+                      (pMsgQ->pStatsReq == NULL) ? OFC_TRUE : OFC_FALSE)
+        != OFC_SUCCESS)
+    {
+        kfree (pMsgQ);
+        pMsgQ = NULL;
+        return OFC_FAILURE;
+    }
 
     return OFC_SUCCESS;
 }
@@ -284,14 +484,17 @@ int OfcCpSendToDpQ (tDpCpMsgQ *pMsgParam)
         return OFC_FAILURE;
     }
 
-    down_interruptible (&gOfcDpGlobals.cpMsgQSemId);
-
     memset (pMsgQ, 0, sizeof(tDpCpMsgQ));
     memcpy (pMsgQ, pMsgParam, sizeof (tDpCpMsgQ));
-    INIT_LIST_HEAD (&pMsgQ->list);
-    list_add_tail (&pMsgQ->list, &gOfcDpGlobals.cpMsgListHead);
 
-    up (&gOfcDpGlobals.cpMsgQSemId);
+    /* Data path acknowledges messages by sequence number, barrier
+     * replies wait for acknowledgment of earlier messages */
+    pMsgQ->seqNum = ++gOfcCpGlobals.cmdSeqNum;
+
+    /* Controller messages are never dropped. Control path stops
+     * reading controller sockets while queue is throttled, see
+     * OfcCpRxCntrlConns */
+    OfcQueuePush (&gOfcDpGlobals.cpMsgQ, &pMsgQ->node, OFC_FALSE);
 
     return OFC_SUCCESS;
 }
@@ -311,18 +514,7 @@ int OfcCpSendToDpQ (tDpCpMsgQ *pMsgParam)
 *******************************************************************/
 tDpCpMsgQ *OfcCpRecvFromDpMsgQ (void)
 {
-    struct list_head *pMsgQ = NULL;
-    struct list_head *pListHead = NULL;
-
-    pListHead = &gOfcCpGlobals.dpMsgListHead;
-    list_for_each (pMsgQ, pListHead)
-    {
-        /* Queue is not empty, remove first element */
-        list_del_init (pMsgQ);
-        return (tDpCpMsgQ *) pMsgQ;
-    }
-
-    return NULL;
+    return (tDpCpMsgQ *) OfcQueuePop (&gOfcCpGlobals.dpMsgQ);
 }
 
 /******************************************************************                                                                          
@@ -473,13 +665,15 @@ void OfcDumpFlows (__u8 tableId)
         list_for_each (pList2, &pFlowEntry->matchList)
         {
             pMatchList = (tMatchListEntry *) pList2;
-            printk (KERN_INFO "field:%d, length:%d\r\n",
-                    pMatchList->field, pMatchList->length);
+            printk (KERN_INFO "field:%d, length:%d, hasMask:%d\r\n",
+                    pMatchList->field, pMatchList->length,
+                    pMatchList->hasMask);
             for (index = 0; index < pMatchList->length;
                  index++)
             {
-                printk (KERN_INFO "value[%d]:0x%x\r\n",  
-                        index, pMatchList->aValue[index]);
+                printk (KERN_INFO "value[%d]:0x%x, mask[%d]:0x%x\r\n",  
+                        index, pMatchList->aValue[index], index,
+                        pMatchList->aMask[index]);
             }
         }
 
@@ -548,6 +742,15 @@ void OfcDumpFlows (__u8 tableId)
             printk (KERN_INFO "arpFlds.targetIpAddr:%u\r\n",
                     pFlowEntry->matchFields.arpFlds.targetIpAddr);
         }
+        if (pFlowEntry->matchFields.mplsMatchFlags != 0)
+        {
+            printk (KERN_INFO "mplsLabel:%u, mplsTc:%d, mplsBos:%d "
+                    "(flags:0x%x)\r\n", 
+                    pFlowEntry->matchFields.mplsLabel,
+                    pFlowEntry->matchFields.mplsTc,
+                    pFlowEntry->matchFields.mplsBos,
+                    pFlowEntry->matchFields.mplsMatchFlags);
+        }
 
         printk (KERN_INFO "Instruction List:\r\n");
         list_for_each (pList2, &pFlowEntry->instrList)
@@ -559,6 +762,11 @@ void OfcDumpFlows (__u8 tableId)
                 printk (KERN_INFO "GotoTableId:%d\r\n", 
                         pInstrList->u.tableId);
             }
+            if (pInstrList->instrType == OFCIT_METER)
+            {
+                printk (KERN_INFO "MeterId:%u\r\n", 
+                        pInstrList->u.meterId);
+            }
             if ((pInstrList->instrType == OFCIT_WRITE_ACTIONS) ||
                 (pInstrList->instrType == OFCIT_APPLY_ACTIONS))
             {
@@ -573,7 +781,105 @@ void OfcDumpFlows (__u8 tableId)
                         printk (KERN_INFO "outputPort:0x%x\r\n",
                                 pActionList->u.outPort);
                     }
+                    if ((pActionList->actionType == OFCAT_PUSH_VLAN) ||
+                        (pActionList->actionType == OFCAT_PUSH_MPLS) ||
+                        (pActionList->actionType == OFCAT_POP_MPLS))
+                    {
+                        printk (KERN_INFO "etherType:0x%x\r\n",
+                                pActionList->u.etherType);
+                    }
+                    if (pActionList->actionType == OFCAT_GROUP)
+                    {
+                        printk (KERN_INFO "groupId:%u\r\n",
+                                pActionList->u.groupId);
+                    }
+                }
+            }
+        }
+    }
+
+    return;
+}
+
+/* Debug function to dump meters in meter table */
+void OfcDumpMeters (void)
+{
+    tOfcMeterEntry    *pMeterEntry = NULL;
+    tOfcMeterBand     *pBand = NULL;
+    tOfcMeterCpuState meterStats;
+    struct list_head  *pList = NULL;
+    __u32             hashIndex = 0;
+    __u8              bandIndex = 0;
+
+    for (hashIndex = 0; hashIndex < OFC_METER_HASH_SIZE; hashIndex++)
+    {
+        list_for_each (pList, &gOfcDpGlobals.aMeterHashList[hashIndex])
+        {
+            pMeterEntry = (tOfcMeterEntry *) pList;
+            OfcDpGetMeterStats (pMeterEntry, &meterStats);
+            printk (KERN_INFO "\nMeter Entry (0x%x)\r\n",
+                    pMeterEntry->meterId);
+            printk (KERN_INFO "flags:0x%x, numBands:%d\r\n",
+                    pMeterEntry->flags, pMeterEntry->numBands);
+            printk (KERN_INFO "pktInCount:%llu, byteInCount:%llu\r\n",
+                    meterStats.pktInCount, meterStats.byteInCount);
+
+            for (bandIndex = 0; bandIndex < pMeterEntry->numBands;
+                 bandIndex++)
+            {
+                pBand = &pMeterEntry->aBands[bandIndex];
+                printk (KERN_INFO "band:%d, type:%d, rate:%u, burst:%u, "
+                        "precLevel:%d\r\n", bandIndex, pBand->type,
+                        pBand->rate, pBand->burstSize, pBand->precLevel);
+                printk (KERN_INFO "pktCount:%llu, byteCount:%llu\r\n",
+                        meterStats.aBandPktCount[bandIndex],
+                        meterStats.aBandByteCount[bandIndex]);
+            }
+        }
+    }
+
+    return;
+}
+
+/* Debug function to dump groups in group table */
+void OfcDumpGroups (void)
+{
+    tOfcGroupEntry   *pGroupEntry = NULL;
+    tOfcGroupBucket  *pBucket = NULL;
+    tOfcGroupStats   groupStats;
+    struct list_head *pList = NULL;
+    __u32            hashIndex = 0;
+    __u8             bucketIndex = 0;
+
+    for (hashIndex = 0; hashIndex < OFC_GROUP_HASH_SIZE; hashIndex++)
+    {
+        list_for_each (pList, &gOfcDpGlobals.aGroupHashList[hashIndex])
+        {
+            pGroupEntry = (tOfcGroupEntry *) pList;
+            OfcDpGetGroupStats (pGroupEntry, &groupStats);
+            printk (KERN_INFO "\nGroup Entry (%u)\r\n",
+                    pGroupEntry->groupId);
+            printk (KERN_INFO "type:%d, numBuckets:%d\r\n",
+                    pGroupEntry->groupType, pGroupEntry->numBuckets);
+            printk (KERN_INFO "pktCount:%llu, byteCount:%llu\r\n",
+                    groupStats.pktCount, groupStats.byteCount);
+
+            for (bucketIndex = 0; bucketIndex < pGroupEntry->numBuckets;
+                 bucketIndex++)
+            {
+                pBucket = &pGroupEntry->aBuckets[bucketIndex];
+                printk (KERN_INFO "bucket:%d, weight:%d, watchPort:0x%x, "
+                        "watchGroup:0x%x\r\n", bucketIndex, 
+                        pBucket->weight, pBucket->watchPort,
+                        pBucket->watchGroup);
+                if (pBucket->isOutputOnly == OFC_TRUE)
+                {
+                    printk (KERN_INFO "outputPort:0x%x\r\n",
+                            pBucket->outPort);
                 }
+                printk (KERN_INFO "pktCount:%llu, byteCount:%llu\r\n",
+                        groupStats.aBucketPktCount[bucketIndex],
+                        groupStats.aBucketByteCount[bucketIndex]);
             }
         }
     }
@@ -581,6 +887,85 @@ void OfcDumpFlows (__u8 tableId)
     return;
 }
 
+/******************************************************************                                                                          
+* Function: OfcDumpRxThreadStats
+*
+* Description: This function dumps time spent by rx thread polling,
+*              blocked and backing off, to tune busy poll budget
+*
+* Input: pArgs - Pointer to rx thread arguments
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDumpRxThreadStats (tOfcRxThreadArgs *pArgs)
+{
+    tOfcRxThreadStats *pStats = &pArgs->stats;
+
+    printk (KERN_INFO "dataIfNum:%d, rxQueue:%d, rx:%llu, "
+            "pollUs:%llu, emptyPolls:%llu, sleepUs:%llu, "
+            "backoffUs:%llu, errors:%llu\r\n", 
+            pArgs->dataIfNum, pArgs->rxQueue, pStats->rxCount,
+            div_u64 (pStats->pollNs, NSEC_PER_USEC), 
+            pStats->emptyPollCount,
+            div_u64 (pStats->sleepNs, NSEC_PER_USEC),
+            div_u64 (pStats->backoffNs, NSEC_PER_USEC),
+            pStats->errCount);
+    printk (KERN_INFO "dataIfNum:%d, rxQueue:%d, throttled:%llu\r\n",
+            pArgs->dataIfNum, pArgs->rxQueue, pStats->throttleCount);
+}
+
+/******************************************************************                                                                          
+* Function: OfcDumpQueueStats
+*
+* Description: This function dumps length and drops of queues
+*              between rx threads, data path and control path, and
+*              packet-ins dropped by rate limits
+*
+* Input: None
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDumpQueueStats (void)
+{
+    __u32 aPortDrops[OFC_MAX_PKT_IN_CLASS];
+    int   pktInClass = 0;
+    int   dataIfNum = 0;
+
+    memset (aPortDrops, 0, sizeof (aPortDrops));
+    for (pktInClass = 0; pktInClass < OFC_MAX_PKT_IN_CLASS; pktInClass++)
+    {
+        for (dataIfNum = 0; dataIfNum < OFC_MAX_OF_IF_NUM; dataIfNum++)
+        {
+            aPortDrops[pktInClass] += 
+                ACCESS_ONCE (gOfcDpGlobals.aaPortPktInBucket[dataIfNum]
+                             [pktInClass].dropCount);
+        }
+    }
+
+    printk (KERN_INFO "pktRxQ len:%d, drops:%ld; cpMsgQ len:%d; "
+            "dpMsgQ len:%d, drops:%ld, pending miss:%u\r\n",
+            atomic_read (&gOfcDpGlobals.pktRxQ.count),
+            atomic_long_read (&gOfcDpGlobals.pktRxQ.dropCount),
+            atomic_read (&gOfcDpGlobals.cpMsgQ.count),
+            atomic_read (&gOfcCpGlobals.dpMsgQ.count),
+            atomic_long_read (&gOfcCpGlobals.dpMsgQ.dropCount),
+            ACCESS_ONCE (gOfcDpGlobals.pendingMissCount));
+    printk (KERN_INFO "Packet-in rate drops miss port:%u, all:%u; "
+            "action port:%u, all:%u\r\n",
+            aPortDrops[OFC_PKT_IN_MISS],
+            ACCESS_ONCE (gOfcDpGlobals.aPktInBucket[OFC_PKT_IN_MISS]
+                         .dropCount),
+            aPortDrops[OFC_PKT_IN_ACTION],
+            ACCESS_ONCE (gOfcDpGlobals.aPktInBucket[OFC_PKT_IN_ACTION]
+                         .dropCount));
+}
+
 int OfcDumpFlowFields (tOfcFlowEntry *pFlowEntry)
 {
     struct list_head *pList2 = NULL;
@@ -612,13 +997,15 @@ int OfcDumpFlowFields (tOfcFlowEntry *pFlowEntry)
     list_for_each (pList2, &pFlowEntry->matchList)
     {
         pMatchList = (tMatchListEntry *) pList2;
-        printk (KERN_INFO "field:%d, length:%d\r\n",
-                pMatchList->field, pMatchList->length);
+        printk (KERN_INFO "field:%d, length:%d, hasMask:%d\r\n",
+                pMatchList->field, pMatchList->length,
+                pMatchList->hasMask);
         for (index = 0; index < pMatchList->length;
              index++)
         {
-            printk (KERN_INFO "value[%d]:0x%x\r\n",  
-                    index, pMatchList->aValue[index]);
+            printk (KERN_INFO "value[%d]:0x%x, mask[%d]:0x%x\r\n",  
+                    index, pMatchList->aValue[index], index,
+                    pMatchList->aMask[index]);
         }
     }
 
@@ -687,6 +1074,15 @@ int OfcDumpFlowFields (tOfcFlowEntry *pFlowEntry)
         printk (KERN_INFO "arpFlds.targetIpAddr:%u\r\n",
                 pFlowEntry->matchFields.arpFlds.targetIpAddr);
     }
+    if (pFlowEntry->matchFields.mplsMatchFlags != 0)
+    {
+        printk (KERN_INFO "mplsLabel:%u, mplsTc:%d, mplsBos:%d "
+                "(flags:0x%x)\r\n", 
+                pFlowEntry->matchFields.mplsLabel,
+                pFlowEntry->matchFields.mplsTc,
+                pFlowEntry->matchFields.mplsBos,
+                pFlowEntry->matchFields.mplsMatchFlags);
+    }
 
     printk (KERN_INFO "Instruction List:\r\n");
     list_for_each (pList2, &pFlowEntry->instrList)
@@ -712,6 +1108,13 @@ int OfcDumpFlowFields (tOfcFlowEntry *pFlowEntry)
                     printk (KERN_INFO "outputPort:0x%x\r\n",
                             pActionList->u.outPort);
                 }
+                if ((pActionList->actionType == OFCAT_PUSH_VLAN) ||
+                    (pActionList->actionType == OFCAT_PUSH_MPLS) ||
+                    (pActionList->actionType == OFCAT_POP_MPLS))
+                {
+                    printk (KERN_INFO "etherType:0x%x\r\n",
+                            pActionList->u.etherType);
+                }
             }
         }
     }
@@ -719,11 +1122,49 @@ int OfcDumpFlowFields (tOfcFlowEntry *pFlowEntry)
     return OFC_SUCCESS;
 }
 
+/******************************************************************
+* Function: OfcDpGetNumRxQueues
+*
+* Description: This function returns number of rx queues on which
+*              an OpenFlow interface is received. One queue is used
+*              per NIC rx queue, limited by gNumRxQueues if set.
+*
+* Input: dev - OpenFlow interface
+*
+* Output: None
+*
+* Returns: Number of rx queues
+*
+*******************************************************************/
+int OfcDpGetNumRxQueues (struct net_device *dev)
+{
+    int numRxQueues = dev->real_num_rx_queues;
+
+    if ((gNumRxQueues != 0) && (gNumRxQueues < numRxQueues))
+    {
+        numRxQueues = gNumRxQueues;
+    }
+    if (numRxQueues > OFC_MAX_RX_QUEUES)
+    {
+        numRxQueues = OFC_MAX_RX_QUEUES;
+    }
+    if (numRxQueues < 1)
+    {
+        numRxQueues = 1;
+    }
+
+    return numRxQueues;
+}
+
 /******************************************************************
 * Function: OfcDpCreateSocketsForDataPkts
 *
 * Description: This function creates raw sockets on OpenFlow
-*              interfaces to transmit and receive data packets
+*              interfaces to transmit and receive data packets.
+*              When an interface has multiple rx queues, one
+*              socket is created per queue and sockets are joined
+*              in a fanout group that distributes packets by the
+*              NIC rx queue they were received on.
 *
 * Input: None 
 *
@@ -738,16 +1179,12 @@ int OfcDpCreateSocketsForDataPkts (void)
     struct sockaddr_ll   socketBindAddr;
     struct socket        *socket = NULL;
     int                  dataIfNum = 0;
+    int                  rxQueue = 0;
+    int                  numRxQueues = 0;
+    int                  fanoutArg = 0;
 
     for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; dataIfNum++)
     {
-        if ((sock_create (AF_PACKET, SOCK_RAW, htons(ETH_P_ALL), 
-             &socket)) < 0)
-        {
-            printk (KERN_CRIT "Failed to open data socket!!\r\n");
-            return OFC_FAILURE;
-        }
-
         dev = OfcGetNetDevByName (gpOpenFlowIf[dataIfNum]);
         if (dev == NULL)
         {
@@ -756,67 +1193,940 @@ int OfcDpCreateSocketsForDataPkts (void)
         }
         printk (KERN_INFO "dev->ifindex:%d\r\n", dev->ifindex);
 
-        memset (&socketBindAddr, 0, sizeof(socketBindAddr));
-        socketBindAddr.sll_family = AF_PACKET;
-        socketBindAddr.sll_protocol = htons(ETH_P_ALL);
-        socketBindAddr.sll_ifindex = dev->ifindex;
+        numRxQueues = OfcDpGetNumRxQueues (dev);
+        /* Fanout group id is unique per interface */
+        fanoutArg = (dev->ifindex & 0xFFFF) | (PACKET_FANOUT_QM << 16);
 
-        if (socket->ops->bind (socket, (struct sockaddr *) &socketBindAddr, 
-                               sizeof(socketBindAddr)) < 0)
+        for (rxQueue = 0; rxQueue < numRxQueues; rxQueue++)
         {
-            printk (KERN_CRIT "Failed to bind data socket!!\r\n");
-            return OFC_FAILURE;
+            if ((sock_create (AF_PACKET, SOCK_RAW, htons(ETH_P_ALL), 
+                 &socket)) < 0)
+            {
+                printk (KERN_CRIT "Failed to open data socket!!\r\n");
+                return OFC_FAILURE;
+            }
+            /* Socket is released with the others if its setup
+             * fails */
+            gOfcDpGlobals.aaDataSocket[dataIfNum][rxQueue] = socket;
+
+            /* Blocking receive returns periodically, so that rx
+             * thread can be stopped */
+            socket->sk->sk_rcvtimeo = OFC_DATA_SOCK_TMO;
+
+            memset (&socketBindAddr, 0, sizeof(socketBindAddr));
+            socketBindAddr.sll_family = AF_PACKET;
+            socketBindAddr.sll_protocol = htons(ETH_P_ALL);
+            socketBindAddr.sll_ifindex = dev->ifindex;
+
+            if (socket->ops->bind (socket, 
+                                   (struct sockaddr *) &socketBindAddr, 
+                                   sizeof(socketBindAddr)) < 0)
+            {
+                printk (KERN_CRIT "Failed to bind data socket!!\r\n");
+                return OFC_FAILURE;
+            }
+
+            if ((numRxQueues > 1) &&
+                (kernel_setsockopt (socket, SOL_PACKET, PACKET_FANOUT,
+                                    (char *) &fanoutArg, 
+                                    sizeof(fanoutArg)) < 0))
+            {
+                printk (KERN_CRIT "Failed to join fanout group!!\r\n");
+                return OFC_FAILURE;
+            }
+
+            socket = NULL;
         }
 
-        gOfcDpGlobals.aDataSocket[dataIfNum] = socket;
+        gOfcDpGlobals.aNumRxQueues[dataIfNum] = numRxQueues;
+        /* Device is cached for port liveness checks */
+        gOfcDpGlobals.aDataIfDev[dataIfNum] = dev;
         dev = NULL;
-        socket = NULL;
     }
 
     return OFC_SUCCESS;
 }
 
 /******************************************************************
-* Function: OfcDpCreateThreadsForRxDataPkts
+* Function: OfcDpDeleteSocketsForDataPkts
 *
-* Description: This function creates threads for receiving data
-*              packets on raw sockets 
+* Description: This function stops rx threads reading raw sockets
+*              of OpenFlow interfaces and releases the sockets
 *
 * Input: None 
 *
 * Output: None
 *
-* Returns: OFC_SUCCESS/OFC_FAILURE
+* Returns: None
 *
 *******************************************************************/
-int OfcDpCreateThreadsForRxDataPkts (void)
+void OfcDpDeleteSocketsForDataPkts (void)
 {
-    struct task_struct *pThread = NULL;
-    char               threadName[OFC_MAX_THREAD_NAME_LEN];
-    int                dataIfNum = 0;
-    
+    int dataIfNum = 0;
+    int rxQueue = 0;
+
+    OfcDpDeleteThreadsForRxDataPkts();
+
     for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; dataIfNum++)
     {
-        memset (threadName, 0, sizeof (threadName));
-        sprintf (threadName, "%s%d", OFC_RX_DATA_PKT_TH_NAME, 
-                                     dataIfNum + 1);
-        pThread = kthread_run (OfcDpRxDataPktThread, 
-                               (void *) &dataIfNum, threadName);
-        if (!pThread)
+        for (rxQueue = 0; rxQueue < OFC_MAX_RX_QUEUES; rxQueue++)
         {
-            printk (KERN_CRIT "Failed to create Rx Data Packet "
-                    "thread for dataIfNum:%d\r\n", dataIfNum);
-            return OFC_FAILURE;
+            if (gOfcDpGlobals.aaDataSocket[dataIfNum][rxQueue] != NULL)
+            {
+                sock_release (gOfcDpGlobals.aaDataSocket[dataIfNum]
+                                                        [rxQueue]);
+                gOfcDpGlobals.aaDataSocket[dataIfNum][rxQueue] = NULL;
+            }
         }
-
-        gOfcDpGlobals.aDataPktRxThread[dataIfNum] = pThread;
-        pThread = NULL;
-        msleep (OFC_TASK_SPAWN_GAP);
+    }
+}
+
+/******************************************************************
+* Function: OfcDpCreateDataRings
+*
+* Description: This function creates receive rings on OpenFlow
+*              interfaces. A packet handler is attached to each
+*              interface in the same way as a bound raw socket,
+*              and frames are copied into blocks of the ring
+*              instead of the socket receive queue. In rx handler
+*              mode, the interface rx handler is used instead of
+*              packet handler. One ring is created per rx queue of
+*              interface.
+*
+* Input: None 
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpCreateDataRings (void)
+{
+    struct tpacket_block_desc *pBlockDesc = NULL;
+    struct net_device         *dev = NULL;
+    struct packet_type        *pPktType = NULL;
+    tOfcDataRing              *pRing = NULL;
+    int                       dataIfNum = 0;
+    int                       rxQueue = 0;
+    int                       numRxQueues = 0;
+    int                       blockIndex = 0;
+
+    for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; dataIfNum++)
+    {
+        dev = OfcGetNetDevByName (gpOpenFlowIf[dataIfNum]);
+        if (dev == NULL)
+        {
+            printk (KERN_CRIT "Device not found!!\r\n");
+            return OFC_FAILURE;
+        }
+
+        numRxQueues = OfcDpGetNumRxQueues (dev);
+        for (rxQueue = 0; rxQueue < numRxQueues; rxQueue++)
+        {
+            pRing = &gOfcDpGlobals.aaDataRing[dataIfNum][rxQueue];
+            for (blockIndex = 0; blockIndex < OFC_RING_NUM_BLOCKS; 
+                 blockIndex++)
+            {
+                /* Ring is filled on CPUs serving NIC, place it on
+                 * node of interface */
+                pRing->apBlock[blockIndex] = 
+                    (__u8 *) kmalloc_node (OFC_RING_BLOCK_SIZE, 
+                                           GFP_KERNEL,
+                                           dev_to_node (&dev->dev));
+                if (pRing->apBlock[blockIndex] == NULL)
+                {
+                    printk (KERN_CRIT "Failed to allocate ring "
+                                      "block!!\r\n");
+                    return OFC_FAILURE;
+                }
+
+                memset (pRing->apBlock[blockIndex], 0, 
+                        OFC_RING_BLOCK_SIZE);
+                pBlockDesc = (struct tpacket_block_desc *) 
+                             pRing->apBlock[blockIndex];
+                pBlockDesc->version = TPACKET_V3;
+                pBlockDesc->hdr.bh1.offset_to_first_pkt = 
+                    OFC_RING_FIRST_PKT_OFFSET;
+                pBlockDesc->hdr.bh1.block_status = TP_STATUS_KERNEL;
+            }
+
+            spin_lock_init (&pRing->lock);
+            init_waitqueue_head (&pRing->waitQueue);
+            pRing->fillBlock = 0;
+            pRing->fillOffset = OFC_RING_FIRST_PKT_OFFSET;
+            pRing->rxBlock = 0;
+            pRing = NULL;
+        }
+
+        gOfcDpGlobals.aNumRxQueues[dataIfNum] = numRxQueues;
+
+        pPktType = &gOfcDpGlobals.aRingPktType[dataIfNum];
+        pPktType->type = htons(ETH_P_ALL);
+        pPktType->dev = dev;
+        if (gDataIoMode == OFC_DATA_IO_RX_HANDLER)
+        {
+            /* Frames are claimed by rx handler before they reach
+             * network stack, packet type only identifies ring */
+            rtnl_lock();
+            if (netdev_rx_handler_register (dev, OfcDpRxHandler, 
+                                            pPktType) < 0)
+            {
+                rtnl_unlock();
+                printk (KERN_CRIT "Failed to register rx handler, "
+                                  "device may be enslaved!!\r\n");
+                /* Handler of another module must not be
+                 * unregistered */
+                pPktType->dev = NULL;
+                return OFC_FAILURE;
+            }
+            rtnl_unlock();
+        }
+        else
+        {
+            pPktType->func = OfcDpRingRcv;
+            dev_add_pack (pPktType);
+        }
+
+        /* Device is cached for port liveness checks */
+        gOfcDpGlobals.aDataIfDev[dataIfNum] = dev;
+        dev = NULL;
+        pPktType = NULL;
+    }
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************
+* Function: OfcDpDeleteDataRings
+*
+* Description: This function detaches packet handlers or rx
+*              handlers of receive rings from OpenFlow interfaces,
+*              stops rx threads reading the rings and releases ring
+*              blocks. Data path task must be stopped before, so
+*              that no block is being processed
+*
+* Input: None 
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpDeleteDataRings (void)
+{
+    tOfcDataRing  *pRing = NULL;
+    int           dataIfNum = 0;
+    int           rxQueue = 0;
+    int           blockIndex = 0;
+
+    for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; dataIfNum++)
+    {
+        if (gOfcDpGlobals.aRingPktType[dataIfNum].func != NULL)
+        {
+            dev_remove_pack (&gOfcDpGlobals.aRingPktType[dataIfNum]);
+        }
+        else if (gOfcDpGlobals.aRingPktType[dataIfNum].dev != NULL)
+        {
+            rtnl_lock();
+            netdev_rx_handler_unregister 
+                (gOfcDpGlobals.aRingPktType[dataIfNum].dev);
+            rtnl_unlock();
+        }
+    }
+
+    /* Handlers no longer fill rings, stop threads that post
+     * blocks to data path task */
+    OfcDpDeleteThreadsForRxDataPkts();
+
+    /* Rings of interface that failed part way are also released */
+    for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; dataIfNum++)
+    {
+        for (rxQueue = 0; rxQueue < OFC_MAX_RX_QUEUES; rxQueue++)
+        {
+            pRing = &gOfcDpGlobals.aaDataRing[dataIfNum][rxQueue];
+            for (blockIndex = 0; blockIndex < OFC_RING_NUM_BLOCKS; 
+                 blockIndex++)
+            {
+                kfree (pRing->apBlock[blockIndex]);
+                pRing->apBlock[blockIndex] = NULL;
+            }
+        }
+    }
+}
+
+/******************************************************************
+* Function: OfcDpRingRcv
+*
+* Description: This function is the packet handler of receive
+*              ring. Received frame is copied into ring.
+*
+* Input: pSkb - Received packet
+*        pDev - Interface on which packet is received
+*        pPktType - Packet handler of ring
+*        pOrigDev - Original interface of packet
+*
+* Output: None
+*
+* Returns: NET_RX_SUCCESS/NET_RX_DROP
+*
+*******************************************************************/
+int OfcDpRingRcv (struct sk_buff *pSkb, struct net_device *pDev,
+                  struct packet_type *pPktType,
+                  struct net_device *pOrigDev)
+{
+    int dataIfNum = 0;
+
+    dataIfNum = pPktType - gOfcDpGlobals.aRingPktType;
+
+    /* Packets transmitted on interface, including those sent by
+     * data path, are also delivered to packet handler */
+    if ((pSkb->pkt_type == PACKET_OUTGOING) || 
+        (pSkb->pkt_type == PACKET_LOOPBACK))
+    {
+        kfree_skb (pSkb);
+        return NET_RX_DROP;
+    }
+
+    if (OfcDpRingEnqueue (dataIfNum, pSkb) != OFC_SUCCESS)
+    {
+        kfree_skb (pSkb);
+        return NET_RX_DROP;
+    }
+
+    consume_skb (pSkb);
+    return NET_RX_SUCCESS;
+}
+
+/******************************************************************
+* Function: OfcDpRxHandler
+*
+* Description: This function is the rx handler of OpenFlow
+*              interface in rx handler mode. Received frame is
+*              copied into ring and is not passed to network
+*              stack, or to packet taps attached after it.
+*
+* Input: ppSkb - Pointer to received packet
+*
+* Output: None
+*
+* Returns: RX_HANDLER_CONSUMED
+*
+*******************************************************************/
+rx_handler_result_t OfcDpRxHandler (struct sk_buff **ppSkb)
+{
+    struct sk_buff     *pSkb = *ppSkb;
+    struct packet_type *pPktType = NULL;
+    int                dataIfNum = 0;
+
+    pPktType = (struct packet_type *) 
+               rcu_dereference (pSkb->dev->rx_handler_data);
+    dataIfNum = pPktType - gOfcDpGlobals.aRingPktType;
+
+    if (OfcDpRingEnqueue (dataIfNum, pSkb) != OFC_SUCCESS)
+    {
+        kfree_skb (pSkb);
+        return RX_HANDLER_CONSUMED;
+    }
+
+    consume_skb (pSkb);
+    return RX_HANDLER_CONSUMED;
+}
+
+/******************************************************************
+* Function: OfcDpRingEnqueue
+*
+* Description: This function copies received frame into block of
+*              receive ring being filled, and retires block to
+*              data path when it is full. Frame is dropped if ring
+*              has no free block. Ring is selected by NIC rx queue
+*              on which frame is received.
+*
+* Input: dataIfNum - OpenFlow interface number
+*        pSkb - Received packet, MAC header must be set
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpRingEnqueue (int dataIfNum, struct sk_buff *pSkb)
+{
+    struct tpacket_block_desc *pBlockDesc = NULL;
+    struct tpacket3_hdr       *pFrameHdr = NULL;
+    tOfcDataRing              *pRing = NULL;
+    int                       rxQueue = 0;
+    int                       macOffset = 0;
+    __u32                     frameLen = 0;
+    __u32                     slotLen = 0;
+    int                       isRetired = OFC_FALSE;
+
+    if (skb_rx_queue_recorded (pSkb))
+    {
+        rxQueue = skb_get_rx_queue (pSkb) % 
+                  gOfcDpGlobals.aNumRxQueues[dataIfNum];
+    }
+    pRing = &gOfcDpGlobals.aaDataRing[dataIfNum][rxQueue];
+
+    /* Frame starts at MAC header, before skb data */
+    macOffset = skb_mac_header (pSkb) - pSkb->data;
+    frameLen = pSkb->len - macOffset;
+    slotLen = OFC_RING_ALIGN (OFC_RING_MAC_OFFSET + frameLen);
+    if (frameLen > OFC_MAX_PKT_SIZE)
+    {
+        this_cpu_inc (gOfcDpGlobals.apPortStats[dataIfNum]->rxErrorCount);
+        return OFC_FAILURE;
+    }
+
+    spin_lock (&pRing->lock);
+
+    if ((pRing->fillOffset + slotLen) > OFC_RING_BLOCK_SIZE)
+    {
+        OfcDpRingRetireBlock (pRing);
+        isRetired = OFC_TRUE;
+    }
+
+    pBlockDesc = (struct tpacket_block_desc *) 
+                 pRing->apBlock[pRing->fillBlock];
+    if (pBlockDesc->hdr.bh1.block_status != TP_STATUS_KERNEL)
+    {
+        /* Data path has not released the block yet */
+        pRing->dropCount++;
+        spin_unlock (&pRing->lock);
+        this_cpu_inc (gOfcDpGlobals.apPortStats[dataIfNum]->rxDropCount);
+        if (isRetired == OFC_TRUE)
+        {
+            wake_up_interruptible (&pRing->waitQueue);
+        }
+        return OFC_FAILURE;
+    }
+
+    pFrameHdr = (struct tpacket3_hdr *) 
+                ((__u8 *) pBlockDesc + pRing->fillOffset);
+    memset (pFrameHdr, 0, sizeof (struct tpacket3_hdr));
+    pFrameHdr->tp_len = frameLen;
+    pFrameHdr->tp_snaplen = frameLen;
+    pFrameHdr->tp_mac = OFC_RING_MAC_OFFSET;
+    pFrameHdr->tp_next_offset = slotLen;
+    skb_copy_bits (pSkb, macOffset, (__u8 *) pFrameHdr + 
+                   OFC_RING_MAC_OFFSET, frameLen);
+
+    pBlockDesc->hdr.bh1.num_pkts++;
+    pRing->fillOffset += slotLen;
+
+    spin_unlock (&pRing->lock);
+
+    this_cpu_inc (gOfcDpGlobals.apPortStats[dataIfNum]->rxPktCount);
+    this_cpu_add (gOfcDpGlobals.apPortStats[dataIfNum]->rxByteCount,
+                  frameLen);
+
+    if (isRetired == OFC_TRUE)
+    {
+        wake_up_interruptible (&pRing->waitQueue);
+    }
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************
+* Function: OfcDpRingRetireBlock
+*
+* Description: This function hands over block being filled to
+*              data path and moves to next block of ring. Ring
+*              lock must be held.
+*
+* Input: pRing - Pointer to receive ring
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpRingRetireBlock (tOfcDataRing *pRing)
+{
+    struct tpacket_block_desc *pBlockDesc = NULL;
+
+    pBlockDesc = (struct tpacket_block_desc *) 
+                 pRing->apBlock[pRing->fillBlock];
+    pBlockDesc->hdr.bh1.blk_len = pRing->fillOffset;
+
+    /* Frames must be visible before block is handed over */
+    smp_wmb();
+    pBlockDesc->hdr.bh1.block_status = TP_STATUS_USER;
+
+    pRing->fillBlock = (pRing->fillBlock + 1) % OFC_RING_NUM_BLOCKS;
+    pRing->fillOffset = OFC_RING_FIRST_PKT_OFFSET;
+}
+
+/******************************************************************
+* Function: OfcDpRcvRingBlock
+*
+* Description: This function waits for next block of receive
+*              ring to be retired. A partly filled block is
+*              retired if no block is retired before timeout, so
+*              that frames are not held back at low rates. When
+*              polling, function does not wait and a partly filled
+*              block is retired at once.
+*
+* Input: dataIfNum - OpenFlow interface number
+*        rxQueue - Rx queue of interface
+*        isPoll - OFC_TRUE to poll without waiting
+*
+* Output: ppBlock - Pointer to retired block
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpRcvRingBlock (__u8 dataIfNum, int rxQueue, int isPoll,
+                       __u8 **ppBlock)
+{
+    struct tpacket_block_desc *pBlockDesc = NULL;
+    tOfcDataRing              *pRing = NULL;
+
+    pRing = &gOfcDpGlobals.aaDataRing[dataIfNum][rxQueue];
+    pBlockDesc = (struct tpacket_block_desc *) 
+                 pRing->apBlock[pRing->rxBlock];
+
+    if (isPoll != OFC_TRUE)
+    {
+        wait_event_interruptible_timeout (pRing->waitQueue, 
+            (pBlockDesc->hdr.bh1.block_status == TP_STATUS_USER),
+            OFC_RING_BLOCK_TMO);
+    }
+
+    if (pBlockDesc->hdr.bh1.block_status != TP_STATUS_USER)
+    {
+        spin_lock_bh (&pRing->lock);
+        if ((pRing->fillBlock == pRing->rxBlock) &&
+            (pBlockDesc->hdr.bh1.num_pkts != 0))
+        {
+            OfcDpRingRetireBlock (pRing);
+        }
+        spin_unlock_bh (&pRing->lock);
+
+        if (pBlockDesc->hdr.bh1.block_status != TP_STATUS_USER)
+        {
+            return OFC_FAILURE;
+        }
+    }
+
+    /* Frames are read only after block status */
+    smp_rmb();
+    pRing->rxBlock = (pRing->rxBlock + 1) % OFC_RING_NUM_BLOCKS;
+    *ppBlock = (__u8 *) pBlockDesc;
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************
+* Function: OfcDpReleaseRingBlock
+*
+* Description: This function returns block processed by data path
+*              to packet handler of receive ring
+*
+* Input: pBlock - Pointer to ring block
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpReleaseRingBlock (__u8 *pBlock)
+{
+    struct tpacket_block_desc *pBlockDesc = NULL;
+
+    pBlockDesc = (struct tpacket_block_desc *) pBlock;
+    pBlockDesc->hdr.bh1.num_pkts = 0;
+    pBlockDesc->hdr.bh1.blk_len = 0;
+
+    /* Frames must be read before block is reused */
+    smp_mb();
+    pBlockDesc->hdr.bh1.block_status = TP_STATUS_KERNEL;
+}
+
+/******************************************************************
+* Function: OfcDpCreateThreadsForRxDataPkts
+*
+* Description: This function creates threads for receiving data
+*              packets on raw sockets. One thread is created per
+*              rx queue of interface, and thread of rx queue n is
+*              bound to n-th CPU of rx thread class, so that a
+*              busy interface is received on several CPUs.
+*
+* Input: None 
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpCreateThreadsForRxDataPkts (void)
+{
+    struct task_struct *pThread = NULL;
+    struct net_device  *pDev = NULL;
+    tOfcRxThreadArgs   *pArgs = NULL;
+    char               threadName[OFC_MAX_THREAD_NAME_LEN];
+    int                dataIfNum = 0;
+    int                rxQueue = 0;
+    int                numThreads = 0;
+    
+    init_completion (&gOfcDpGlobals.rxThreadStarted);
+
+    for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; dataIfNum++)
+    {
+        for (rxQueue = 0; rxQueue < gOfcDpGlobals.aNumRxQueues[dataIfNum];
+             rxQueue++)
+        {
+            /* Each thread has its own arguments, as thread may
+             * start after this loop moves on */
+            pArgs = &gOfcDpGlobals.aaRxThreadArgs[dataIfNum][rxQueue];
+            pArgs->dataIfNum = dataIfNum;
+            pArgs->rxQueue = rxQueue;
+
+            memset (threadName, 0, sizeof (threadName));
+            sprintf (threadName, "%s%d/%d", OFC_RX_DATA_PKT_TH_NAME, 
+                                            dataIfNum + 1, rxQueue);
+            /* Thread stack is placed on node of interface */
+            pDev = gOfcDpGlobals.aDataIfDev[dataIfNum];
+            pThread = kthread_create_on_node (OfcDpRxDataPktThread, 
+                                              (void *) pArgs,
+                                              dev_to_node (&pDev->dev),
+                                              threadName);
+            if (IS_ERR_OR_NULL (pThread))
+            {
+                printk (KERN_CRIT "Failed to create Rx Data Packet "
+                        "thread for dataIfNum:%d, rxQueue:%d\r\n", 
+                        dataIfNum, rxQueue);
+                return OFC_FAILURE;
+            }
+
+            mutex_lock (&gOfcThreadLock);
+            OfcSetThreadAffinity (pThread, OFC_RX_THREAD, rxQueue,
+                                  dev_to_node (&pDev->dev));
+            OfcSetThreadPriority (pThread, OFC_RX_THREAD);
+            wake_up_process (pThread);
+            gOfcDpGlobals.aaDataPktRxThread[dataIfNum][rxQueue] = pThread;
+            mutex_unlock (&gOfcThreadLock);
+            pThread = NULL;
+            pArgs = NULL;
+            numThreads++;
+        }
+    }
+
+    /* Threads start in parallel, wait until all of them run */
+    while (numThreads-- > 0)
+    {
+        wait_for_completion (&gOfcDpGlobals.rxThreadStarted);
+    }
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpDeleteThreadsForRxDataPkts
+*
+* Description: This function stops rx threads of OpenFlow
+*              interfaces, and discards packets and ring blocks
+*              they queued to data path task that were not
+*              processed
+*
+* Input: None 
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcDpDeleteThreadsForRxDataPkts (void)
+{
+    tDataPktRxIfQ *pMsgQ = NULL;
+    int           dataIfNum = 0;
+    int           rxQueue = 0;
+
+    mutex_lock (&gOfcThreadLock);
+    for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; dataIfNum++)
+    {
+        for (rxQueue = 0; rxQueue < OFC_MAX_RX_QUEUES; rxQueue++)
+        {
+            if (gOfcDpGlobals.aaDataPktRxThread[dataIfNum][rxQueue] != 
+                NULL)
+            {
+                kthread_stop 
+                    (gOfcDpGlobals.aaDataPktRxThread[dataIfNum][rxQueue]);
+                gOfcDpGlobals.aaDataPktRxThread[dataIfNum][rxQueue] = 
+                    NULL;
+            }
+        }
+    }
+    mutex_unlock (&gOfcThreadLock);
+
+    while ((pMsgQ = OfcDpRecvFromDataPktQ()) != NULL)
+    {
+        if (pMsgQ->isRingBlock != OFC_TRUE)
+        {
+            kfree (pMsgQ->pDataPkt);
+        }
+        kfree (pMsgQ);
+        pMsgQ = NULL;
+    }
+}
+
+/******************************************************************                                                                          
+* Function: OfcSetThreadAffinity
+*
+* Description: This function binds thread to CPUs of its thread
+*              class. Rx thread n is bound to the n-th CPU of class,
+*              or to n-th online CPU of NUMA node of its interface
+*              if class is not pinned. Other threads may run on any
+*              CPU of class.
+*
+* Input: pThread - Thread to be bound
+*        threadClass - OFC_xx_THREAD
+*        index - Index of thread within class
+*        node - NUMA node of thread, NUMA_NO_NODE if none
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcSetThreadAffinity (struct task_struct *pThread, int threadClass,
+                          int index, int node)
+{
+    cpumask_t *pCpuMask = &gOfcGlobals.aThreadCpuMask[threadClass];
+    cpumask_t nodeCpuMask;
+    int       cpu = 0;
+    int       cpuIndex = 0;
+
+    if (pThread == NULL)
+    {
+        return OFC_FAILURE;
+    }
+
+    if (threadClass != OFC_RX_THREAD)
+    {
+        if (cpumask_empty (pCpuMask))
+        {
+            return set_cpus_allowed_ptr (pThread, cpu_possible_mask);
+        }
+        return set_cpus_allowed_ptr (pThread, pCpuMask);
+    }
+
+    if (cpumask_empty (pCpuMask))
+    {
+        /* Spread over CPUs of interface node, any online CPU if
+         * node is unknown or has no CPU online */
+        cpumask_clear (&nodeCpuMask);
+        if (node != NUMA_NO_NODE)
+        {
+            cpumask_and (&nodeCpuMask, cpumask_of_node (node), 
+                         cpu_online_mask);
+        }
+        if (cpumask_empty (&nodeCpuMask))
+        {
+            cpumask_copy (&nodeCpuMask, cpu_online_mask);
+        }
+        pCpuMask = &nodeCpuMask;
+    }
+
+    index %= cpumask_weight (pCpuMask);
+    for_each_cpu (cpu, pCpuMask)
+    {
+        if (cpuIndex++ == index)
+        {
+            break;
+        }
+    }
+
+    return set_cpus_allowed_ptr (pThread, cpumask_of (cpu));
+}
+
+/******************************************************************                                                                          
+* Function: OfcGetThreadClassNode
+*
+* Description: This function returns NUMA node of CPUs of thread
+*              class, so that thread is created on that node
+*
+* Input: threadClass - OFC_xx_THREAD
+*
+* Output: None
+*
+* Returns: NUMA node, NUMA_NO_NODE if class is not pinned
+*
+*******************************************************************/
+int OfcGetThreadClassNode (int threadClass)
+{
+    cpumask_t *pCpuMask = &gOfcGlobals.aThreadCpuMask[threadClass];
+
+    if (cpumask_empty (pCpuMask))
+    {
+        return NUMA_NO_NODE;
+    }
+
+    return cpu_to_node (cpumask_first (pCpuMask));
+}
+
+/******************************************************************                                                                          
+* Function: OfcSetThreadPriority
+*
+* Description: This function sets scheduling policy of thread.
+*              Data path and rx threads run as SCHED_FIFO when
+*              gDpSchedPrio is set, control path always runs with
+*              normal policy.
+*
+* Input: pThread - Thread
+*        threadClass - OFC_xx_THREAD
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcSetThreadPriority (struct task_struct *pThread, int threadClass)
+{
+    struct sched_param schedParam;
+
+    if ((pThread == NULL) || (gDpSchedPrio == 0) || 
+        (threadClass == OFC_CP_THREAD))
+    {
+        return OFC_SUCCESS;
+    }
+
+    memset (&schedParam, 0, sizeof (schedParam));
+    schedParam.sched_priority = gDpSchedPrio;
+    if (sched_setscheduler_nocheck (pThread, SCHED_FIFO, &schedParam) 
+        < 0)
+    {
+        printk (KERN_CRIT "Failed to set SCHED_FIFO priority:%u\r\n",
+                gDpSchedPrio);
+        return OFC_FAILURE;
     }
 
     return OFC_SUCCESS;
 }
 
+/******************************************************************                                                                          
+* Function: OfcSetThreadClassAffinity
+*
+* Description: This function rebinds running threads of a class
+*              after CPUs of class are changed. Threads not
+*              created yet or already stopped are skipped, they
+*              are bound to CPUs of class when created. Called
+*              with gOfcThreadLock held.
+*
+* Input: threadClass - OFC_xx_THREAD
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcSetThreadClassAffinity (int threadClass)
+{
+    struct net_device *pDev = NULL;
+    int               dataIfNum = 0;
+    int               rxQueue = 0;
+
+    if (threadClass == OFC_DP_THREAD)
+    {
+        OfcSetThreadAffinity (gOfcGlobals.pOfcDpThread, threadClass,
+                              0, NUMA_NO_NODE);
+        return;
+    }
+    if (threadClass == OFC_CP_THREAD)
+    {
+        OfcSetThreadAffinity (gOfcGlobals.pOfcCpThread, threadClass,
+                              0, NUMA_NO_NODE);
+        return;
+    }
+
+    for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; dataIfNum++)
+    {
+        for (rxQueue = 0; rxQueue < gOfcDpGlobals.aNumRxQueues[dataIfNum];
+             rxQueue++)
+        {
+            if (gOfcDpGlobals.aaDataPktRxThread[dataIfNum][rxQueue] == 
+                NULL)
+            {
+                continue;
+            }
+            pDev = gOfcDpGlobals.aDataIfDev[dataIfNum];
+            OfcSetThreadAffinity 
+                (gOfcDpGlobals.aaDataPktRxThread[dataIfNum][rxQueue],
+                 threadClass, rxQueue, dev_to_node (&pDev->dev));
+        }
+    }
+}
+
+/******************************************************************                                                                          
+* Function: OfcSetCpuListParam
+*
+* Description: This function sets CPUs of a thread class from
+*              module parameter in cpu list format, e.g. "0-3,6".
+*              Parameter can be changed at runtime through sysfs,
+*              running threads of class are then rebound. Empty
+*              list unpins the class.
+*
+* Input: pVal - CPU list
+*        pKp - Module parameter, arg is CPU mask of class
+*
+* Output: None
+*
+* Returns: 0 on success, negative error otherwise
+*
+*******************************************************************/
+int OfcSetCpuListParam (const char *pVal, const struct kernel_param *pKp)
+{
+    cpumask_t *pCpuMask = (cpumask_t *) pKp->arg;
+    cpumask_t cpuMask;
+    int       retVal = 0;
+
+    retVal = cpulist_parse (pVal, &cpuMask);
+    if (retVal < 0)
+    {
+        return retVal;
+    }
+    if (!cpumask_empty (&cpuMask) && 
+        !cpumask_intersects (&cpuMask, cpu_online_mask))
+    {
+        return -EINVAL;
+    }
+
+    /* Threads may be created or stopped meanwhile, e.g. while
+     * module is unloaded */
+    mutex_lock (&gOfcThreadLock);
+    cpumask_copy (pCpuMask, &cpuMask);
+    OfcSetThreadClassAffinity (pCpuMask - gOfcGlobals.aThreadCpuMask);
+    mutex_unlock (&gOfcThreadLock);
+
+    return 0;
+}
+
+/******************************************************************                                                                          
+* Function: OfcGetCpuListParam
+*
+* Description: This function shows CPUs of a thread class as
+*              module parameter in cpu list format
+*
+* Input: pKp - Module parameter, arg is CPU mask of class
+*
+* Output: pBuf - CPU list
+*
+* Returns: Length of CPU list
+*
+*******************************************************************/
+int OfcGetCpuListParam (char *pBuf, const struct kernel_param *pKp)
+{
+    int len = 0;
+
+    /* Leave room for trailing newline */
+    len = cpulist_scnprintf (pBuf, PAGE_SIZE - 1, 
+                             (cpumask_t *) pKp->arg);
+    pBuf[len++] = '\n';
+    pBuf[len] = '\0';
+
+    return len;
+}
+
 /******************************************************************                                                                          
 * Function: OfcConvertStringToIp
 *
@@ -882,17 +2192,33 @@ int OfcConvertStringToIp (char *pString, unsigned int *pIpAddr)
 * Description: This function creates TCP socket to communicate
 *              with SDN controller
 *
-* Input: None
+* Input: pConn - Controller connection
 *
 * Output: None
 *
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcCpCreateCntrlSocket (void)
+int OfcCpCreateCntrlSocket (tOfcCntrlConn *pConn)
 {
     struct sockaddr_in   serverAddr;
     struct socket        *socket = NULL;
+    int                  retVal = 0;
+
+    /* Messages split across reads are reassembled in receive
+     * buffer, allocated once per connection */
+    if (pConn->pRxBuf == NULL)
+    {
+        pConn->pRxBuf = (__u8 *) kmalloc (OFC_CNTRL_RX_BUF_SIZE,
+                                          GFP_KERNEL);
+        if (pConn->pRxBuf == NULL)
+        {
+            printk (KERN_CRIT "Failed to allocate memory to control "
+                              "packet buffer\r\n");
+            return OFC_FAILURE;
+        }
+    }
+    pConn->rxLen = 0;
 
     if ((sock_create (AF_INET, SOCK_STREAM, 0, &socket)) < 0)
     {
@@ -900,25 +2226,44 @@ int OfcCpCreateCntrlSocket (void)
         return OFC_FAILURE;
     }
 
+    /* Socket calls must not block control path task for long,
+     * echo requests and reconnects are driven by the same task */
+    socket->sk->sk_rcvtimeo = msecs_to_jiffies (OFC_CNTRL_SOCK_TMO_MS);
+    socket->sk->sk_sndtimeo = msecs_to_jiffies (OFC_CNTRL_SOCK_TMO_MS);
+
+    /* Connection establishment, loss and received control packets
+     * are notified to control path task through socket callbacks */
+    write_lock_bh (&socket->sk->sk_callback_lock);
+    socket->sk->sk_user_data = pConn;
+    pConn->pfnSockStateChange = socket->sk->sk_state_change;
+    pConn->pfnSockDataReady = socket->sk->sk_data_ready;
+    socket->sk->sk_state_change = OfcCpCntrlSockStateChange;
+    socket->sk->sk_data_ready = OfcCpCntrlSockDataReady;
+    write_unlock_bh (&socket->sk->sk_callback_lock);
+
     memset (&serverAddr, 0, sizeof(serverAddr));
     serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = htonl (gCntrlIpAddr);
-    if (gCntrlPortNo == 0)
+    serverAddr.sin_addr.s_addr = 
+        htonl (gaCntrlIpAddr[pConn->cntrlIndex]);
+    serverAddr.sin_port = htons (OFC_DEF_CNTRL_PORT_NUM);
+    if (gCntrlPortNo[pConn->cntrlIndex] != 0)
     {
-        /* set default OpenFlow port number */
-        gCntrlPortNo = OFC_DEF_CNTRL_PORT_NUM;
+        serverAddr.sin_port = htons (gCntrlPortNo[pConn->cntrlIndex]);
     }
-    serverAddr.sin_port = htons (gCntrlPortNo);
 
-    if (socket->ops->connect (socket, (struct sockaddr *) &serverAddr, 
-                              sizeof(serverAddr), 0) < 0)
+    /* Connect does not wait for TCP handshake, so an unreachable
+     * controller does not stall control path task */
+    pConn->pSocket = socket;
+    retVal = socket->ops->connect (socket, 
+                                   (struct sockaddr *) &serverAddr, 
+                                   sizeof(serverAddr), O_NONBLOCK);
+    if ((retVal < 0) && (retVal != -EINPROGRESS))
     {
         printk (KERN_CRIT "Failed to connect to controller!!\r\n");
+        OfcCpDeleteCntrlSocket (pConn);
         return OFC_FAILURE;
     }
 
-    gOfcCpGlobals.pCntrlSocket = socket;
-
 #if 0
     /* Send Hello packet to controller */
     OfcCpSendHelloPacket (htonl (OFC_INIT_TRANSACTION_ID));
@@ -927,6 +2272,108 @@ int OfcCpCreateCntrlSocket (void)
     return OFC_SUCCESS;
 }
 
+/******************************************************************                                                                          
+* Function: OfcCpDeleteCntrlSocket
+*
+* Description: This function closes TCP socket connected to
+*              SDN controller
+*
+* Input: pConn - Controller connection
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcCpDeleteCntrlSocket (tOfcCntrlConn *pConn)
+{
+    struct socket *socket = pConn->pSocket;
+
+    if (socket == NULL)
+    {
+        return;
+    }
+
+    pConn->pSocket = NULL;
+
+    write_lock_bh (&socket->sk->sk_callback_lock);
+    socket->sk->sk_state_change = pConn->pfnSockStateChange;
+    socket->sk->sk_data_ready = pConn->pfnSockDataReady;
+    socket->sk->sk_user_data = NULL;
+    write_unlock_bh (&socket->sk->sk_callback_lock);
+
+    kernel_sock_shutdown (socket, SHUT_RDWR);
+    sock_release (socket);
+
+    /* Discard work posted by closed socket */
+    pConn->flags = 0;
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpCntrlSockStateChange
+*
+* Description: This function is the state change callback of
+*              controller socket. It is invoked in softirq context
+*              when TCP connection is established or lost, and
+*              notifies control path task.
+*
+* Input: sk - Controller socket
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcCpCntrlSockStateChange (struct sock *sk)
+{
+    tOfcCntrlConn *pConn = NULL;
+
+    read_lock_bh (&sk->sk_callback_lock);
+    pConn = (tOfcCntrlConn *) sk->sk_user_data;
+    if (pConn != NULL)
+    {
+        pConn->pfnSockStateChange (sk);
+        set_bit (OFC_CONN_STATE_PENDING, &pConn->flags);
+    }
+    read_unlock_bh (&sk->sk_callback_lock);
+
+    OfcCpSendEvent (OFC_CNTRL_STATE_EVENT);
+    return;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpCntrlSockDataReady
+*
+* Description: This function is the data ready callback of
+*              controller socket. It is invoked in softirq context
+*              once control packet is queued to socket, and
+*              notifies control path task.
+*
+* Input: sk - Controller socket
+*
+* Output: None
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcCpCntrlSockDataReady (struct sock *sk)
+{
+    tOfcCntrlConn *pConn = NULL;
+
+    read_lock_bh (&sk->sk_callback_lock);
+    pConn = (tOfcCntrlConn *) sk->sk_user_data;
+    if (pConn != NULL)
+    {
+        pConn->pfnSockDataReady (sk);
+        set_bit (OFC_CONN_RX_PENDING, &pConn->flags);
+    }
+    read_unlock_bh (&sk->sk_callback_lock);
+
+    OfcCpSendEvent (OFC_CTRL_PKT_EVENT);
+    return;
+}
+
 /******************************************************************                                                                          
 * Function: OfcDpRcvDataPktFromSock
 *
@@ -934,51 +2381,94 @@ int OfcCpCreateCntrlSocket (void)
 *              interfaces raw socket in data path task
 *
 * Input: dataIfNum - OpenFlow interface number
+*        rxQueue - Rx queue of interface
+*        flags - MSG_DONTWAIT to poll without blocking
 *
-* Output: ppPkt - Pointer to data packet
+* Output: ppPkt - Pointer to data packet buffer, frame starts at
+*                 OFC_DP_PKT_HEADROOM
 *         pPktLen - Length of data packet
+*         pError - Socket error on failure, -EAGAIN if no packet
+*                  was available, 0 if packet was discarded
 *
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-__u32 OfcDpRcvDataPktFromSock (__u8 dataIfNum, __u8 **ppPkt, 
-                               __u32 *pPktLen)
+__u32 OfcDpRcvDataPktFromSock (__u8 dataIfNum, int rxQueue, int flags,
+                               __u8 **ppPkt, __u32 *pPktLen, 
+                               int *pError)
 {
-    struct msghdr msg;
-    struct iovec  iov;
-    mm_segment_t  old_fs;
-    __u32         msgLen = 0;
-    __u8          *pDataPkt = NULL;
+    struct socket      *pSocket = NULL;
+    struct msghdr      msg;
+    struct iovec       iov;
+    struct sockaddr_ll fromAddr;
+    mm_segment_t       old_fs;
+    int                msgLen = 0;
+    __u8               *pDataPkt = NULL;
+
+    pSocket = gOfcDpGlobals.aaDataSocket[dataIfNum][rxQueue];
+    *pError = 0;
+
+    /* Polling socket with no packet must be cheap, check receive
+     * queue before allocating packet buffer */
+    if ((flags & MSG_DONTWAIT) && 
+        (skb_queue_empty (&pSocket->sk->sk_receive_queue)))
+    {
+        *pError = -EAGAIN;
+        return OFC_FAILURE;
+    }
 
-    pDataPkt = (__u8 *) kmalloc (OFC_MAX_PKT_SIZE, GFP_KERNEL);
+    /* Headroom is reserved ahead of the frame so that VLAN/MPLS
+     * push actions can be performed in place */
+    pDataPkt = (__u8 *) kmalloc (OFC_DP_PKT_HEADROOM + OFC_MAX_PKT_SIZE,
+                                 GFP_KERNEL);
     if (pDataPkt == NULL)
     {
         printk (KERN_CRIT "Failed to allocate memory to data " 
                           "packet!!\r\n");
+        this_cpu_inc (gOfcDpGlobals.apPortStats[dataIfNum]->rxDropCount);
         return OFC_FAILURE;
     }
 
     memset (&msg, 0, sizeof(msg));
     memset (&iov, 0, sizeof(iov));
-    memset (pDataPkt, 0, OFC_MAX_PKT_SIZE);
-    iov.iov_base = pDataPkt;
+    memset (&fromAddr, 0, sizeof(fromAddr));
+    memset (pDataPkt, 0, OFC_DP_PKT_HEADROOM + OFC_MAX_PKT_SIZE);
+    iov.iov_base = pDataPkt + OFC_DP_PKT_HEADROOM;
     iov.iov_len = OFC_MAX_PKT_SIZE;
+    msg.msg_name = &fromAddr;
+    msg.msg_namelen = sizeof(fromAddr);
     msg.msg_iov = &iov;
     msg.msg_iovlen = 1;
     old_fs = get_fs();
     set_fs(KERNEL_DS);
-    msgLen = sock_recvmsg (gOfcDpGlobals.aDataSocket[dataIfNum], 
-                           &msg, OFC_MAX_PKT_SIZE, 0);
+    msgLen = sock_recvmsg (pSocket, &msg, OFC_MAX_PKT_SIZE, flags);
     set_fs(old_fs);
-    if (msgLen == 0)
+    if (msgLen <= 0)
     {
-        printk (KERN_CRIT "Failed to receive message from data " 
-                          "socket!!\r\n");
+        *pError = (msgLen < 0) ? msgLen : -EIO;
+        if (*pError != -EAGAIN)
+        {
+            this_cpu_inc 
+                (gOfcDpGlobals.apPortStats[dataIfNum]->rxErrorCount);
+        }
+        kfree (pDataPkt);
+        pDataPkt = NULL;
+        return OFC_FAILURE;
+    }
+
+    if (fromAddr.sll_pkttype == PACKET_OUTGOING)
+    {
+        /* Packets transmitted on interface, including those sent
+         * by data path, are looped back to packet socket */
         kfree (pDataPkt);
         pDataPkt = NULL;
         return OFC_FAILURE;
     }
 
+    this_cpu_inc (gOfcDpGlobals.apPortStats[dataIfNum]->rxPktCount);
+    this_cpu_add (gOfcDpGlobals.apPortStats[dataIfNum]->rxByteCount,
+                  msgLen);
+
     *ppPkt = pDataPkt;
     *pPktLen = msgLen;
 
@@ -986,115 +2476,202 @@ __u32 OfcDpRcvDataPktFromSock (__u8 dataIfNum, __u8 **ppPkt,
 }
 
 /******************************************************************                                                                          
-* Function: OfcDpSendDataPktOnSock
+* Function: OfcDpXmitPktOnPorts
+*
+* Description: This function transmits data packet on a set of
+*              OpenFlow interfaces. Packet is copied once into an
+*              skb, and the skb is cloned for each additional
+*              interface, so all interfaces share the packet data.
+*              Packets are handed to the device queue directly.
+*
+* Input: pPkt - Pointer to data packet
+*        pktLen - Length of data packet
+*        portMask - Bit n is set to transmit on dataIfNum n
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpXmitPktOnPorts (__u8 *pPkt, __u32 pktLen, __u32 portMask)
+{
+    struct sk_buff    *pSkb = NULL;
+    struct sk_buff    *pTxSkb = NULL;
+    struct net_device *pDev = NULL;
+    int               lastDataIfNum = 0;
+    int               dataIfNum = 0;
+
+    portMask &= (1 << gNumOpenFlowIf) - 1;
+    if ((portMask == 0) || (pktLen < ETH_HLEN))
+    {
+        return OFC_SUCCESS;
+    }
+
+    pSkb = alloc_skb (LL_MAX_HEADER + pktLen, GFP_KERNEL);
+    if (pSkb == NULL)
+    {
+        printk (KERN_CRIT "[%s]: Failed to allocate skb\r\n", __func__);
+        for (dataIfNum = 0; dataIfNum < gNumOpenFlowIf; dataIfNum++)
+        {
+            if (portMask & (1 << dataIfNum))
+            {
+                this_cpu_inc 
+                    (gOfcDpGlobals.apPortStats[dataIfNum]->txDropCount);
+            }
+        }
+        return OFC_FAILURE;
+    }
+
+    skb_reserve (pSkb, LL_MAX_HEADER);
+    memcpy (skb_put (pSkb, pktLen), pPkt, pktLen);
+    skb_reset_mac_header (pSkb);
+    skb_set_network_header (pSkb, ETH_HLEN);
+    pSkb->protocol = eth_hdr (pSkb)->h_proto;
+
+    /* Original skb is sent on last interface, clones on others */
+    lastDataIfNum = fls (portMask) - 1;
+    for (dataIfNum = 0; dataIfNum <= lastDataIfNum; dataIfNum++)
+    {
+        if (!(portMask & (1 << dataIfNum)))
+        {
+            continue;
+        }
+
+        pDev = gOfcDpGlobals.aDataIfDev[dataIfNum];
+        if ((pDev == NULL) || 
+            (pktLen > (pDev->mtu + pDev->hard_header_len + VLAN_HLEN)))
+        {
+            this_cpu_inc 
+                (gOfcDpGlobals.apPortStats[dataIfNum]->txErrorCount);
+            continue;
+        }
+
+        if (dataIfNum == lastDataIfNum)
+        {
+            pTxSkb = pSkb;
+            pSkb = NULL;
+        }
+        else
+        {
+            pTxSkb = skb_clone (pSkb, GFP_KERNEL);
+            if (pTxSkb == NULL)
+            {
+                this_cpu_inc 
+                    (gOfcDpGlobals.apPortStats[dataIfNum]->txDropCount);
+                continue;
+            }
+        }
+
+        pTxSkb->dev = pDev;
+        /* Device queue consumes skb even on failure */
+        if (dev_queue_xmit (pTxSkb) == NET_XMIT_SUCCESS)
+        {
+            this_cpu_inc (gOfcDpGlobals.apPortStats[dataIfNum]->txPktCount);
+            this_cpu_add (gOfcDpGlobals.apPortStats[dataIfNum]->txByteCount,
+                          pktLen);
+        }
+        else
+        {
+            this_cpu_inc 
+                (gOfcDpGlobals.apPortStats[dataIfNum]->txDropCount);
+        }
+        pTxSkb = NULL;
+    }
+
+    if (pSkb != NULL)
+    {
+        /* Last interface could not transmit */
+        kfree_skb (pSkb);
+        pSkb = NULL;
+    }
+
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcCpRecvCntrlPktOnSock
 *
-* Description: This function sends data packets on OpenFlow
-*              interfaces raw socket in data path task
+* Description: This function receives OpenFlow control packets
+*              on tcp socket from controller in control path task.
+*              Received bytes are appended to receive buffer of
+*              connection, after incomplete message of last read
 *
-* Input: dataIfNum - OpenFlow interface number
-*        pPkt - Pointer to data packet
-*        pktLen - Length of data packet
+* Input: pConn - Controller connection
 *
 * Output: None
 *
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcDpSendDataPktOnSock (__u8 dataIfNum, __u8 *pPkt, 
-                            __u32 pktLen)
+int OfcCpRecvCntrlPktOnSock (tOfcCntrlConn *pConn)
 {
     struct msghdr msg;
     struct iovec  iov;
     mm_segment_t  old_fs;
-    __u32         msgLen = 0;
+    __u32         bufLen = 0;
+    int           msgLen = 0;
+
+    /* Incomplete message is shorter than largest message, buffer
+     * always has room */
+    bufLen = OFC_CNTRL_RX_BUF_SIZE - pConn->rxLen;
 
     memset (&msg, 0, sizeof(msg));
     memset (&iov, 0, sizeof(iov));
-    iov.iov_base = pPkt;
-    iov.iov_len = pktLen;
+    iov.iov_base = pConn->pRxBuf + pConn->rxLen;
+    iov.iov_len = bufLen;
     msg.msg_iov = &iov;
     msg.msg_iovlen = 1;
     old_fs = get_fs();
     set_fs(KERNEL_DS);
-    msgLen = sock_sendmsg (gOfcDpGlobals.aDataSocket[dataIfNum],
-                           &msg, pktLen);
+    msgLen = sock_recvmsg (pConn->pSocket, &msg, bufLen, MSG_DONTWAIT);
     set_fs(old_fs);
-    if (msgLen == 0)
+
+    if (msgLen <= 0)
     {
-        printk (KERN_CRIT "Failed to send message from data "
-                          "socket!!\r\n");
+        if (msgLen != -EAGAIN)
+        {
+            printk (KERN_CRIT "Failed to receive control packet\r\n");
+        }
         return OFC_FAILURE;
     }
 
-    printk (KERN_INFO "Packet Tx from data socket " 
-            "(dataIfNum:%d)\r\n", dataIfNum);
-
+    pConn->rxLen += msgLen;
     return OFC_SUCCESS;
 }
 
 /******************************************************************                                                                          
-* Function: OfcCpRecvCntrlPktOnSock
+* Function: OfcCpSendCntrlPktFromSock
 *
-* Description: This function receives OpenFlow control packets
-*              on tcp socket from controller in control path task
+* Description: This function sends OpenFlow control packets to
+*              controller on connection the request being processed
+*              was received on
 *
-* Input: None
+* Input: pPkt - Pointer to control packet
+*        pktLen - Length of control packet
 *
-* Output: ppPkt - Pointer to control packet
-*         pPktLen - Pointer to length of control packet
+* Output: None
 *
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcCpRecvCntrlPktOnSock (__u8 **ppPkt, __u16 *pPktLen)
+int OfcCpSendCntrlPktFromSock (__u8 *pPkt, __u32 pktLen)
 {
-    struct msghdr msg;
-    struct iovec  iov;
-    mm_segment_t  old_fs;
-    __u8          *pCntrlPkt = NULL;
-    int           msgLen = 0;
-
-    pCntrlPkt = (__u8 *) kmalloc (OFC_MTU_SIZE, GFP_KERNEL);
-    if (pCntrlPkt == NULL)
-    {
-        printk (KERN_CRIT "Failed to allocate memory to " 
-                          "control packet\r\n");
-        return OFC_FAILURE;
-    }
-    memset (&msg, 0, sizeof(msg));
-    memset (&iov, 0, sizeof(iov));
-    memset (pCntrlPkt, 0, OFC_MTU_SIZE);
-
-    iov.iov_base = pCntrlPkt;
-    iov.iov_len = OFC_MTU_SIZE;
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
-    old_fs = get_fs();
-    set_fs(KERNEL_DS);
-    msgLen = sock_recvmsg (gOfcCpGlobals.pCntrlSocket, &msg,
-                           OFC_MTU_SIZE, 0);
-    set_fs(old_fs);
-
-    if (msgLen < OFC_OPENFLOW_HDR_LEN)
+    if (gOfcCpGlobals.pRxConn == NULL)
     {
-        printk (KERN_CRIT "Failed to receive control packet\r\n");
-        kfree (pCntrlPkt);
-        pCntrlPkt = NULL;
         return OFC_FAILURE;
     }
 
-    *ppPkt = pCntrlPkt;
-    *pPktLen = msgLen;
-    return OFC_SUCCESS;
+    return OfcCpSendCntrlPktOnConn (gOfcCpGlobals.pRxConn, pPkt, pktLen);
 }
 
 /******************************************************************                                                                          
-* Function: OfcCpSendCntrlPktFromSock
+* Function: OfcCpSendCntrlPktOnConn
 *
 * Description: This function sends OpenFlow control packets
 *              on tcp socket to controller in control path task
 *
-* Input: pPkt - Pointer to control packet
+* Input: pConn - Controller connection
+*        pPkt - Pointer to control packet
 *        pktLen - Length of control packet
 *
 * Output: None
@@ -1102,13 +2679,20 @@ int OfcCpRecvCntrlPktOnSock (__u8 **ppPkt, __u16 *pPktLen)
 * Returns: OFC_SUCCESS/OFC_FAILURE
 *
 *******************************************************************/
-int OfcCpSendCntrlPktFromSock (__u8 *pPkt, __u32 pktLen)
+int OfcCpSendCntrlPktOnConn (tOfcCntrlConn *pConn, __u8 *pPkt, 
+                             __u32 pktLen)
 {
     struct msghdr msg;
     struct iovec  iov;
     mm_segment_t  old_fs;
     int           msgLen = 0;
 
+    if (pConn->pSocket == NULL)
+    {
+        /* Controller not connected */
+        return OFC_FAILURE;
+    }
+
     memset (&msg, 0, sizeof(msg));
     memset (&iov, 0, sizeof(iov));
     iov.iov_base = pPkt;
@@ -1117,11 +2701,10 @@ int OfcCpSendCntrlPktFromSock (__u8 *pPkt, __u32 pktLen)
     msg.msg_iovlen = 1;
     old_fs = get_fs();
     set_fs(KERNEL_DS);
-    msgLen = sock_sendmsg (gOfcCpGlobals.pCntrlSocket, &msg,
-                           pktLen);
+    msgLen = sock_sendmsg (pConn->pSocket, &msg, pktLen);
     set_fs(old_fs);
 
-    if (msgLen == 0)
+    if (msgLen <= 0)
     {
         printk (KERN_CRIT "Failed to send message from control "
                           "socket!!\r\n");
@@ -1167,255 +2750,529 @@ tOfcFlowTable *OfcDpGetFlowTableEntry (__u8 tableId)
 * Function: OfcDpExtractPktHdrs
 *
 * Description: This function extracts packet headers for matching
-*              flow table entries
+*              flow table entries in a single pass, and records
+*              header offsets for actions. Only layers up to the
+*              deepest field in fieldMask are parsed, so parse cost
+*              follows fields referenced by installed flows. Every
+*              read is checked against packet length, fields of
+*              headers not parsed or truncated are left as zero.
 *
 * Input: pPkt - Pointer to packet
 *        pktLen - Length of packet
 *        inPort - Ingress port
+*        fieldMask - OFC_FLD_xxx fields needed
 *
-* Output: pktMatchFields - Extracted packet headers
+* Output: pPktMatchFields - Extracted packet headers
+*         pMeta - Header offsets
 *
-* Returns: OFC_SUCCESS/OFC_FAILURE
+* Returns: OFC_SUCCESS/OFC_FAILURE (packet truncated)
 *
 *******************************************************************/
 int OfcDpExtractPktHdrs (__u8 *pPkt, __u32 pktLen, __u8 inPort, 
-                         tOfcMatchFields *pPktMatchFields)
+                         __u32 fieldMask, 
+                         tOfcMatchFields *pPktMatchFields,
+                         tOfcPktMeta *pMeta)
 {
     __u32   pktOffset = 0;
-    __u16   vlanTpid = 0;
-    __u16   vlanId = 0;
-    __u8    ipHdrLen = 0;
+    __u16   etherType = 0;
 
     /* Port n in switch corresponds to port n+1 for controller */
     pPktMatchFields->inPort = inPort + 1;
 
-    /* Extract destination MAC address */
-    memcpy (pPktMatchFields->aDstMacAddr, pPkt, OFC_MAC_ADDR_LEN);
-    pktOffset += OFC_MAC_ADDR_LEN;
+    if (pktLen < (OFC_ETH_ADDRS_LEN + OFC_ETHTYPE_LEN))
+    {
+        return OFC_FAILURE;
+    }
+
+    if (fieldMask & OFC_FLD_ETH_DST)
+    {
+        memcpy (pPktMatchFields->aDstMacAddr, pPkt, OFC_MAC_ADDR_LEN);
+    }
+    if (fieldMask & OFC_FLD_ETH_SRC)
+    {
+        memcpy (pPktMatchFields->aSrcMacAddr, pPkt + OFC_MAC_ADDR_LEN,
+                OFC_MAC_ADDR_LEN);
+    }
+    if (!(fieldMask & OFC_FLD_ETH_TYPE_MASK))
+    {
+        return OFC_SUCCESS;
+    }
 
-    /* Extract source MAC address */
-    memcpy (pPktMatchFields->aSrcMacAddr, pPkt + pktOffset,
-            OFC_MAC_ADDR_LEN);
-    pktOffset += OFC_MAC_ADDR_LEN;
+    /* Skip VLAN tags, VLAN Id is taken from outermost tag */
+    pktOffset = OFC_ETH_ADDRS_LEN;
+    etherType = get_unaligned_be16 (pPkt + pktOffset);
+    while ((etherType == OFC_VLAN_TPID) || (etherType == OFC_QINQ_TPID))
+    {
+        if ((pktOffset + OFC_VLAN_TAG_LEN + OFC_ETHTYPE_LEN) > pktLen)
+        {
+            return OFC_FAILURE;
+        }
+        if (pMeta->vlanOffset == 0)
+        {
+            pMeta->vlanOffset = pktOffset + OFC_ETHTYPE_LEN;
+            pPktMatchFields->vlanId = 
+                (get_unaligned_be16 (pPkt + pMeta->vlanOffset) &
+                 OFC_VLAN_VID_MASK) | OFC_VLAN_PRESENT;
+        }
+        pktOffset += OFC_VLAN_TAG_LEN;
+        etherType = get_unaligned_be16 (pPkt + pktOffset);
+    }
+    pPktMatchFields->etherType = etherType;
+    pMeta->l2HdrLen = pktOffset;
+    pMeta->l3Offset = pktOffset + OFC_ETHTYPE_LEN;
 
-    /* Extract Vlan Id (if present) */
-    vlanTpid = htons (OFC_VLAN_TPID);
-    if (!memcmp ((pPkt + pktOffset), &vlanTpid, sizeof(vlanTpid)))
+    if (!(fieldMask & OFC_FLD_L3_MASK))
     {
-        pktOffset += sizeof(vlanTpid);
-        memcpy (&vlanId, pPkt + pktOffset, sizeof(vlanId));
-        pPktMatchFields->vlanId = ntohs (vlanId) & 0xFFF;
-        pktOffset += sizeof(vlanId);
+        return OFC_SUCCESS;
     }
 
-    /* Extract EthType */
-    memcpy (&pPktMatchFields->etherType, pPkt + pktOffset, 
-            sizeof (pPktMatchFields->etherType));
-    pPktMatchFields->etherType = ntohs (pPktMatchFields->etherType);
-    pktOffset += sizeof (pPktMatchFields->etherType);
+    return OfcDpExtractL3Hdrs (pPkt, pktLen, fieldMask, pPktMatchFields,
+                               pMeta);
+}
 
-    if (pPktMatchFields->etherType == OFC_ARP_ETHTYPE)
+/******************************************************************                                                                          
+* Function: OfcDpExtractL3Hdrs
+*
+* Description: This function extracts MPLS, ARP, IPv4 or IPv6
+*              header fields. L4 header of IPv4 fragments other
+*              than the first is not present.
+*
+* Input: pPkt - Pointer to packet
+*        pktLen - Length of packet
+*        fieldMask - OFC_FLD_xxx fields needed
+*        pMeta - Header offsets, L3 offset is set
+*
+* Output: pPktMatchFields - Extracted packet headers
+*         pMeta - Header offsets
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE (packet truncated)
+*
+*******************************************************************/
+int OfcDpExtractL3Hdrs (__u8 *pPkt, __u32 pktLen, __u32 fieldMask,
+                        tOfcMatchFields *pPktMatchFields,
+                        tOfcPktMeta *pMeta)
+{
+    __u32   l3Offset = pMeta->l3Offset;
+    __u32   mplsShim = 0;
+    __u16   fragField = 0;
+    __u8    ipHdrLen = 0;
+
+    if ((pPktMatchFields->etherType == OFC_MPLS_ETHTYPE) ||
+        (pPktMatchFields->etherType == OFC_MPLSM_ETHTYPE))
     {
-        /* Extract ARP specific fields */
-        /* Extract target IP address */
-        memcpy (&pPktMatchFields->arpFlds.targetIpAddr,
-                pPkt + pktOffset + OFC_ARP_TRGT_IP_ADDR_OFFSET, 
-                sizeof (__u32));
-        pPktMatchFields->arpFlds.targetIpAddr =
-            ntohl (pPktMatchFields->arpFlds.targetIpAddr);
+        /* Extract outermost MPLS label stack entry */
+        if ((l3Offset + OFC_MPLS_SHIM_LEN) > pktLen)
+        {
+            return OFC_FAILURE;
+        }
+        mplsShim = get_unaligned_be32 (pPkt + l3Offset);
+        pPktMatchFields->mplsLabel = (mplsShim >> OFC_MPLS_LABEL_SHIFT) &
+                                     OFC_MPLS_LABEL_MASK;
+        pPktMatchFields->mplsTc = (mplsShim >> OFC_MPLS_TC_SHIFT) &
+                                  OFC_MPLS_TC_MASK;
+        pPktMatchFields->mplsBos = (mplsShim >> OFC_MPLS_BOS_SHIFT) &
+                                   OFC_MPLS_BOS_MASK;
+        pPktMatchFields->mplsMatchFlags = OFC_MPLS_LABEL_MATCH |
+                                          OFC_MPLS_TC_MATCH |
+                                          OFC_MPLS_BOS_MATCH;
+        return OFC_SUCCESS;
+    }
 
+    if (pPktMatchFields->etherType == OFC_ARP_ETHTYPE)
+    {
+        if ((l3Offset + OFC_ARP_HDR_LEN) > pktLen)
+        {
+            return OFC_FAILURE;
+        }
+        pPktMatchFields->arpFlds.opCode = 
+            get_unaligned_be16 (pPkt + l3Offset + OFC_ARP_OP_OFFSET);
+        memcpy (pPktMatchFields->arpFlds.aSenderMacAddr,
+                pPkt + l3Offset + OFC_ARP_SNDR_MAC_OFFSET, 
+                OFC_MAC_ADDR_LEN);
+        pPktMatchFields->arpFlds.senderIpAddr = 
+            get_unaligned_be32 (pPkt + l3Offset + 
+                                OFC_ARP_SNDR_IP_ADDR_OFFSET);
+        memcpy (pPktMatchFields->arpFlds.aTargetMacAddr,
+                pPkt + l3Offset + OFC_ARP_TRGT_MAC_OFFSET, 
+                OFC_MAC_ADDR_LEN);
+        pPktMatchFields->arpFlds.targetIpAddr = 
+            get_unaligned_be32 (pPkt + l3Offset + 
+                                OFC_ARP_TRGT_IP_ADDR_OFFSET);
         return OFC_SUCCESS;
     }
 
+    if (pPktMatchFields->etherType == OFC_IPV6_ETHTYPE)
+    {
+        return OfcDpExtractIpv6Hdrs (pPkt, pktLen, fieldMask,
+                                     pPktMatchFields, pMeta);
+    }
+
     if (pPktMatchFields->etherType != OFC_IP_ETHTYPE)
     {
         return OFC_SUCCESS;
     }
 
-    /* Fetch IP header length */
-    memcpy (&ipHdrLen, pPkt + pktOffset, sizeof (ipHdrLen));
-    ipHdrLen = (ipHdrLen & 0xF) * 4;
+    if ((l3Offset + OFC_IP_MIN_HDR_LEN) > pktLen)
+    {
+        return OFC_FAILURE;
+    }
+    ipHdrLen = (pPkt[l3Offset] & 0xF) * 4;
+    if ((ipHdrLen < OFC_IP_MIN_HDR_LEN) || 
+        ((l3Offset + ipHdrLen) > pktLen))
+    {
+        return OFC_FAILURE;
+    }
+
+    pPktMatchFields->protocolType = 
+        pPkt[l3Offset + OFC_IP_PROT_TYPE_OFFSET];
+    pPktMatchFields->srcIpAddr = 
+        get_unaligned_be32 (pPkt + l3Offset + OFC_IP_SRC_IP_OFFSET);
+    pPktMatchFields->dstIpAddr = 
+        get_unaligned_be32 (pPkt + l3Offset + OFC_IP_DST_IP_OFFSET);
 
-    /* Extract protocol type */
-    memcpy (&pPktMatchFields->protocolType, 
-            pPkt + pktOffset + OFC_IP_PROT_TYPE_OFFSET,
-            sizeof (pPktMatchFields->protocolType));
-#if 0
-    pPktMatchFields->protocolType = ntohs (pPktMatchFields->protocolType);
-#endif
-    
-    /* Extract source IP address */
-    memcpy (&pPktMatchFields->srcIpAddr,
-            pPkt + pktOffset + OFC_IP_SRC_IP_OFFSET,
-            sizeof (pPktMatchFields->srcIpAddr));
-    pPktMatchFields->srcIpAddr = ntohl (pPktMatchFields->srcIpAddr);
-
-    /* Extract destination IP address */
-    memcpy (&pPktMatchFields->dstIpAddr, 
-            pPkt + pktOffset + OFC_IP_DST_IP_OFFSET,
-            sizeof (pPktMatchFields->dstIpAddr));
-    pPktMatchFields->dstIpAddr = ntohl (pPktMatchFields->dstIpAddr);
-    pktOffset += ipHdrLen;
-
-    if ((pPktMatchFields->protocolType != OFC_TCP_PROT_TYPE) &&
-        (pPktMatchFields->protocolType != OFC_UDP_PROT_TYPE))
+    fragField = get_unaligned_be16 (pPkt + l3Offset + OFC_IP_FRAG_OFFSET);
+    if (fragField & (OFC_IP_MF_FLAG | OFC_IP_FRAG_OFF_MASK))
     {
+        pPktMatchFields->ipFragFlags |= OFC_FRAG_ANY;
+    }
+    if (fragField & OFC_IP_FRAG_OFF_MASK)
+    {
+        /* Only first fragment carries L4 header */
+        pPktMatchFields->ipFragFlags |= OFC_FRAG_LATER;
         return OFC_SUCCESS;
     }
 
-    /* Extract L4 source port number */
-    memcpy (&pPktMatchFields->srcPortNum, pPkt + pktOffset,
-            sizeof(pPktMatchFields->srcPortNum));
-    pPktMatchFields->srcPortNum = ntohs (pPktMatchFields->srcPortNum);
-    pktOffset += sizeof(pPktMatchFields->srcPortNum);
-  
-    /* Extract L4 destination port number */
-    memcpy (&pPktMatchFields->dstPortNum, pPkt + pktOffset,
-            sizeof(pPktMatchFields->dstPortNum));
-    pPktMatchFields->dstPortNum = ntohs (pPktMatchFields->dstPortNum);
-    pktOffset += sizeof(pPktMatchFields->dstPortNum);
+    pMeta->l4Offset = l3Offset + ipHdrLen;
+    if (!(fieldMask & OFC_FLD_L4_MASK))
+    {
+        return OFC_SUCCESS;
+    }
 
-    return OFC_SUCCESS;
+    return OfcDpExtractL4Hdrs (pPkt, pktLen, pPktMatchFields, pMeta);
 }
 
 /******************************************************************                                                                          
-* Function: OfcDeleteList
+* Function: OfcDpExtractIpv6Hdrs
 *
-* Description: This function deletes the linked list and frees
-*              memory of each member in the list
+* Description: This function extracts IPv6 header fields and skips
+*              extension headers to find the L4 header. Protocol
+*              type is set to the last next header. L4 header of
+*              fragments other than the first is not present.
 *
-* Input: pListHead - Head of linked list
+* Input: pPkt - Pointer to packet
+*        pktLen - Length of packet
+*        fieldMask - OFC_FLD_xxx fields needed
+*        pMeta - Header offsets, L3 offset is set
 *
-* Output: None
+* Output: pPktMatchFields - Extracted packet headers
+*         pMeta - Header offsets
 *
-* Returns: OFC_SUCCESS/OFC_FAILURE
+* Returns: OFC_SUCCESS/OFC_FAILURE (packet truncated)
 *
 *******************************************************************/
-int OfcDeleteList (struct list_head *pListHead)
+int OfcDpExtractIpv6Hdrs (__u8 *pPkt, __u32 pktLen, __u32 fieldMask,
+                          tOfcMatchFields *pPktMatchFields,
+                          tOfcPktMeta *pMeta)
 {
-    struct list_head  *pList = NULL;
- 
-    if (pListHead == NULL)
+    __u32   pktOffset = pMeta->l3Offset;
+    __u32   extHdrLen = 0;
+    __u16   fragField = 0;
+    __u8    nextHdr = 0;
+    __u8    extHdrCount = 0;
+
+    if ((pktOffset + OFC_IPV6_HDR_LEN) > pktLen)
     {
         return OFC_FAILURE;
     }
 
-    list_for_each (pList, pListHead)
+    pPktMatchFields->ipv6FlowLabel = get_unaligned_be32 (pPkt + pktOffset) &
+                                     OFC_IPV6_FLABEL_MASK;
+    memcpy (pPktMatchFields->aSrcIpv6Addr, 
+            pPkt + pktOffset + OFC_IPV6_SRC_IP_OFFSET, OFC_IPV6_ADDR_LEN);
+    memcpy (pPktMatchFields->aDstIpv6Addr, 
+            pPkt + pktOffset + OFC_IPV6_DST_IP_OFFSET, OFC_IPV6_ADDR_LEN);
+    nextHdr = pPkt[pktOffset + OFC_IPV6_NEXT_HDR_OFFSET];
+    pktOffset += OFC_IPV6_HDR_LEN;
+
+    for (extHdrCount = 0; extHdrCount < OFC_IPV6_MAX_EXT_HDRS; 
+         extHdrCount++)
     {
-        list_del_init (pList);
-        kfree (pList);
-        pList = pListHead;
+        if ((nextHdr != OFC_IPV6_HOP_OPTS) && 
+            (nextHdr != OFC_IPV6_ROUTING) &&
+            (nextHdr != OFC_IPV6_DEST_OPTS) &&
+            (nextHdr != OFC_IPV6_AUTH) &&
+            (nextHdr != OFC_IPV6_FRAGMENT))
+        {
+            break;
+        }
+
+        /* Next header and length of all extension headers */
+        if ((pktOffset + OFC_IPV6_FRAG_HDR_LEN) > pktLen)
+        {
+            return OFC_FAILURE;
+        }
+
+        if (nextHdr == OFC_IPV6_FRAGMENT)
+        {
+            extHdrLen = OFC_IPV6_FRAG_HDR_LEN;
+            fragField = get_unaligned_be16 (pPkt + pktOffset + 2);
+            pPktMatchFields->ipFragFlags |= OFC_FRAG_ANY;
+            if (fragField & OFC_IPV6_FRAG_OFF_MASK)
+            {
+                /* Only first fragment carries L4 header */
+                pPktMatchFields->ipFragFlags |= OFC_FRAG_LATER;
+                pPktMatchFields->protocolType = pPkt[pktOffset];
+                return OFC_SUCCESS;
+            }
+        }
+        else if (nextHdr == OFC_IPV6_AUTH)
+        {
+            extHdrLen = (pPkt[pktOffset + 1] + 2) * 4;
+        }
+        else
+        {
+            extHdrLen = (pPkt[pktOffset + 1] + 1) * 8;
+        }
+
+        nextHdr = pPkt[pktOffset];
+        pktOffset += extHdrLen;
     }
 
-    return OFC_SUCCESS;
+    pPktMatchFields->protocolType = nextHdr;
+    if (extHdrCount == OFC_IPV6_MAX_EXT_HDRS)
+    {
+        /* Too many extension headers, L4 header is not parsed */
+        return OFC_SUCCESS;
+    }
+
+    pMeta->l4Offset = pktOffset;
+    if (!(fieldMask & OFC_FLD_L4_MASK))
+    {
+        return OFC_SUCCESS;
+    }
+
+    return OfcDpExtractL4Hdrs (pPkt, pktLen, pPktMatchFields, pMeta);
 }
 
 /******************************************************************                                                                          
-* Function: OfcCalcHdrOffset
+* Function: OfcDpExtractL4Hdrs
 *
-* Description: This function calculates header field offset
-*              from the packet.
+* Description: This function extracts TCP/UDP ports, TCP flags and
+*              ICMPv4/ICMPv6 type and code
 *
 * Input: pPkt - Pointer to packet
 *        pktLen - Length of packet
-*        hdrField - Header field for packet offset
+*        pMeta - Header offsets, L4 offset is set
 *
-* Output: pPktOffset - Pointer to packet header offset
+* Output: pPktMatchFields - Extracted packet headers
 *
-* Returns: OFC_SUCCESS/OFC_FAILURE
+* Returns: OFC_SUCCESS/OFC_FAILURE (packet truncated)
 *
 *******************************************************************/
-int OfcCalcHdrOffset (__u8 *pPkt, __u16 pktLen, __u8 hdrField, 
-                      __u16 *pPktOffset)
+int OfcDpExtractL4Hdrs (__u8 *pPkt, __u32 pktLen, 
+                        tOfcMatchFields *pPktMatchFields,
+                        tOfcPktMeta *pMeta)
 {
-    __u16   parsedLen = 0;
-    __u16   etherType = 0;
-    __u8    ipHdrLen = 0;
-    __u8    ipProtType = 0;
-    
-    /* Destination MAC address offset */
-    if (hdrField == OFCXMT_OFB_ETH_DST)
-    {
-        *pPktOffset = 0;
-        return OFC_SUCCESS;
-    }
-    parsedLen += OFC_MAC_ADDR_LEN;
+    __u32   l4Offset = pMeta->l4Offset;
+    __u8    protocolType = pPktMatchFields->protocolType;
 
-    /* Source MAC address offset */
-    if (hdrField == OFCXMT_OFB_ETH_SRC)
+    if ((protocolType == OFC_TCP_PROT_TYPE) ||
+        (protocolType == OFC_UDP_PROT_TYPE))
     {
-        *pPktOffset = parsedLen;
+        if ((l4Offset + OFC_L4_PORTS_LEN) > pktLen)
+        {
+            return OFC_FAILURE;
+        }
+        pPktMatchFields->srcPortNum = get_unaligned_be16 (pPkt + l4Offset);
+        pPktMatchFields->dstPortNum = 
+            get_unaligned_be16 (pPkt + l4Offset + 
+                                sizeof (pPktMatchFields->srcPortNum));
+
+        if (protocolType == OFC_TCP_PROT_TYPE)
+        {
+            if ((l4Offset + OFC_TCP_MIN_HDR_LEN) > pktLen)
+            {
+                return OFC_FAILURE;
+            }
+            pPktMatchFields->tcpFlags = 
+                get_unaligned_be16 (pPkt + l4Offset + 
+                                    OFC_TCP_FLAGS_OFFSET) &
+                OFC_TCP_FLAGS_MASK;
+        }
         return OFC_SUCCESS;
     }
-    parsedLen += OFC_MAC_ADDR_LEN;
 
-    memcpy (&etherType, pPkt + parsedLen, sizeof (etherType));
-    etherType = ntohs (etherType);
-    parsedLen += sizeof (etherType);
-
-    if (hdrField == OFCXMT_OFB_VLAN_VID)
+    if ((protocolType == OFC_ICMP_PROT_TYPE) ||
+        (protocolType == OFC_ICMPV6_PROT_TYPE))
     {
-        /* VLAN tag not present in packet */
-        if (etherType != OFC_VLAN_TPID)
+        if ((l4Offset + OFC_ICMP_HDR_LEN) > pktLen)
         {
             return OFC_FAILURE;
         }
+        pPktMatchFields->icmpType = pPkt[l4Offset];
+        pPktMatchFields->icmpCode = pPkt[l4Offset + 1];
+    }
 
-        *pPktOffset = parsedLen;
-        return OFC_SUCCESS;
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcDpExtractAllPktHdrs
+*
+* Description: This function extracts all packet headers when
+*              fields not needed for matching are used, e.g. for
+*              hashing flows of packet-ins and select groups
+*
+* Input: pDpPkt - Pointer to data packet
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDpExtractAllPktHdrs (tOfcDpPkt *pDpPkt)
+{
+    if (pDpPkt->pMatchFields == NULL)
+    {
+        return OFC_FAILURE;
     }
 
-    if (etherType == OFC_VLAN_TPID)
+    if (pDpPkt->parsedFieldMask == OFC_FLD_ALL)
     {
-        parsedLen += sizeof (etherType);
-        memcpy (&etherType, pPkt + parsedLen, sizeof (etherType));
-        etherType = ntohs (etherType);
-        parsedLen += sizeof (etherType);
+        return OFC_SUCCESS;
     }
 
-    /* Check for various EtherTypes */
+    memset (pDpPkt->pMatchFields, 0, sizeof (tOfcMatchFields));
+    pDpPkt->pMatchFields->metadata = pDpPkt->metadata;
+    memset (&pDpPkt->meta, 0, sizeof (pDpPkt->meta));
+    pDpPkt->parsedFieldMask = OFC_FLD_ALL;
+    return OfcDpExtractPktHdrs (pDpPkt->pPkt, pDpPkt->pktLen, 
+                                pDpPkt->inPort, OFC_FLD_ALL,
+                                pDpPkt->pMatchFields, &pDpPkt->meta);
+}
 
-    /* All non-IP fields must have been checked before this
-     * Now check only IP and higher layer related fields */
-    if (etherType != OFC_IP_ETHTYPE)
+/******************************************************************                                                                          
+* Function: OfcDeleteList
+*
+* Description: This function deletes the linked list and frees
+*              memory of each member in the list
+*
+* Input: pListHead - Head of linked list
+*
+* Output: None
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcDeleteList (struct list_head *pListHead)
+{
+    struct list_head  *pList = NULL;
+ 
+    if (pListHead == NULL)
     {
         return OFC_FAILURE;
     }
 
-    if ((hdrField == OFCXMT_OFB_IPV4_SRC) ||
-        (hdrField == OFCXMT_OFB_IPV4_DST))
+    list_for_each (pList, pListHead)
     {
-        *pPktOffset = parsedLen;
-        return OFC_SUCCESS;
+        list_del_init (pList);
+        kfree (pList);
+        pList = pListHead;
     }
 
-    /* Fetch IP header length */
-    memcpy (&ipHdrLen, pPkt + parsedLen, sizeof (ipHdrLen));
-    ipHdrLen = (ipHdrLen & 0xF) * 4;
+    return OFC_SUCCESS;
+}
+
+/******************************************************************                                                                          
+* Function: OfcSetEightByte
+*
+* Description: This function stores 64 bit counter in network byte
+*              order
+*
+* Input: value - Counter value
+*
+* Output: pEightByte - Pointer to eight byte field of packet
+*
+* Returns: None
+*
+*******************************************************************/
+void OfcSetEightByte (tOfcEightByte *pEightByte, __u64 value)
+{
+    pEightByte->hi = htonl ((__u32) (value >> 32));
+    pEightByte->lo = htonl ((__u32) value);
+}
 
-    /* Fetch protocol type */
-    memcpy (&ipProtType,
-            pPkt + parsedLen + OFC_IP_PROT_TYPE_OFFSET,
-            sizeof (ipProtType));
+/******************************************************************                                                                          
+* Function: OfcCalcHdrOffset
+*
+* Description: This function calculates header field offset
+*              from the packet. Offset of L3 fields is start of L3
+*              header, and of L4 fields is start of L4 header.
+*
+* Input: pPkt - Pointer to packet
+*        pktLen - Length of packet
+*        hdrField - Header field for packet offset
+*
+* Output: pPktOffset - Pointer to packet header offset
+*
+* Returns: OFC_SUCCESS/OFC_FAILURE
+*
+*******************************************************************/
+int OfcCalcHdrOffset (__u8 *pPkt, __u16 pktLen, __u8 hdrField, 
+                      __u16 *pPktOffset)
+{
+    tOfcMatchFields matchFields;
+    tOfcPktMeta     meta;
 
-    parsedLen += ipHdrLen;
-    /* Check for various L3 protocols */
+    memset (&matchFields, 0, sizeof (matchFields));
+    memset (&meta, 0, sizeof (meta));
+    OfcDpExtractPktHdrs (pPkt, pktLen, 0, OFC_FLD_ALL, &matchFields, 
+                         &meta);
 
-    /* All non-layer 4 protocols must have been checked
-     * before this */
-    if ((hdrField == OFCXMT_OFB_TCP_SRC) ||
-        (hdrField == OFCXMT_OFB_TCP_DST) ||
-        (hdrField == OFCXMT_OFB_UDP_SRC) ||
-        (hdrField == OFCXMT_OFB_UDP_DST))
+    switch (hdrField)
     {
-        if ((ipProtType != OFC_TCP_PROT_TYPE) &&
-            (ipProtType != OFC_UDP_PROT_TYPE))
-        {
-            return OFC_FAILURE;
-        }
-
-        *pPktOffset = parsedLen;
-        return OFC_SUCCESS;
+        case OFCXMT_OFB_ETH_DST:
+            *pPktOffset = 0;
+            return (pktLen >= OFC_MAC_ADDR_LEN) ? 
+                   OFC_SUCCESS : OFC_FAILURE;
+
+        case OFCXMT_OFB_ETH_SRC:
+            *pPktOffset = OFC_MAC_ADDR_LEN;
+            return (pktLen >= OFC_ETH_ADDRS_LEN) ? 
+                   OFC_SUCCESS : OFC_FAILURE;
+
+        case OFCXMT_OFB_VLAN_VID:
+            *pPktOffset = meta.vlanOffset;
+            return (meta.vlanOffset != 0) ? OFC_SUCCESS : OFC_FAILURE;
+
+        case OFCXMT_OFB_IPV4_SRC:
+        case OFCXMT_OFB_IPV4_DST:
+            *pPktOffset = meta.l3Offset;
+            return ((matchFields.etherType == OFC_IP_ETHTYPE) &&
+                    ((meta.l3Offset + OFC_IP_MIN_HDR_LEN) <= pktLen)) ?
+                   OFC_SUCCESS : OFC_FAILURE;
+
+        case OFCXMT_OFB_IPV6_SRC:
+        case OFCXMT_OFB_IPV6_DST:
+        case OFCXMT_OFB_IPV6_FLABEL:
+            *pPktOffset = meta.l3Offset;
+            return ((matchFields.etherType == OFC_IPV6_ETHTYPE) &&
+                    ((meta.l3Offset + OFC_IPV6_HDR_LEN) <= pktLen)) ?
+                   OFC_SUCCESS : OFC_FAILURE;
+
+        case OFCXMT_OFB_TCP_SRC:
+        case OFCXMT_OFB_TCP_DST:
+        case OFCXMT_OFB_UDP_SRC:
+        case OFCXMT_OFB_UDP_DST:
+            *pPktOffset = meta.l4Offset;
+            return ((meta.l4Offset != 0) &&
+                    ((matchFields.protocolType == OFC_TCP_PROT_TYPE) ||
+                     (matchFields.protocolType == OFC_UDP_PROT_TYPE)) &&
+                    ((meta.l4Offset + OFC_L4_PORTS_LEN) <= pktLen)) ?
+                   OFC_SUCCESS : OFC_FAILURE;
+
+        default:
+            break;
     }
 
     return OFC_FAILURE;